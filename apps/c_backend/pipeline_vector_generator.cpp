@@ -0,0 +1,34 @@
+#include "Halide.h"
+
+namespace {
+
+// Compile a vectorized pipeline to an object and to C code.
+class VectorPipeline : public Halide::Generator<VectorPipeline> {
+public:
+    ImageParam input{UInt(16), 2, "input"};
+    Func build() {
+        Var x, y;
+
+        Expr in = input(x, y);
+
+        // Comparisons of 16-bit and 32-bit values make masks with
+        // lanes of different widths. Select between them.
+        Expr narrow = in > 1000;
+        Expr wide = cast<int32_t>(in) * 3 < x * y;
+        Expr mask = select(x % 3 == 0, narrow, wide);
+
+        Expr value = select(mask, in / 2, in + 7);
+
+        // require() makes an if_then_else with a vector condition.
+        Func g;
+        g(x, y) = require(value != 12345, value * 3);
+
+        g.vectorize(x, 8);
+
+        return g;
+    }
+};
+
+Halide::RegisterGenerator<VectorPipeline> register_me{"pipeline_vector"};
+
+}  // namespace
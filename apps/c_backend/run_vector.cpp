@@ -0,0 +1,40 @@
+#include <cstdio>
+#include <cstdlib>
+
+#include "HalideBuffer.h"
+#include "pipeline_vector_c.h"
+#include "pipeline_vector_native.h"
+
+using namespace Halide::Runtime;
+
+int main(int argc, char **argv) {
+    Buffer<uint16_t> in(1432, 324);
+
+    for (int y = 0; y < in.height(); y++) {
+        for (int x = 0; x < in.width(); x++) {
+            // Stay clear of the value require() rejects.
+            in(x, y) = (uint16_t)(rand() % 12000);
+        }
+    }
+
+    Buffer<uint16_t> out_native(423, 300);
+    Buffer<uint16_t> out_c(423, 300);
+
+    pipeline_vector_native(in, out_native);
+
+    pipeline_vector_c(in, out_c);
+
+    for (int y = 0; y < out_native.height(); y++) {
+        for (int x = 0; x < out_native.width(); x++) {
+            if (out_native(x, y) != out_c(x, y)) {
+                printf("out_native(%d, %d) = %d, but out_c(%d, %d) = %d\n",
+                       x, y, out_native(x, y),
+                       x, y, out_c(x, y));
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,380 @@
+#include <set>
+
+#include "AsyncProducers.h"
+#include "Debug.h"
+#include "Function.h"
+#include "IRMutator.h"
+#include "IROperator.h"
+#include "IRPrinter.h"
+#include "ExprUsesVar.h"
+#include "InjectHostDevBufferCopies.h"
+#include "runtime/HalideRuntime.h"
+
+namespace Halide {
+namespace Internal {
+
+using std::map;
+using std::set;
+using std::string;
+using std::vector;
+
+Stmt acquire_semaphore(const string &sema, Expr count) {
+    Expr sema_var = Variable::make(type_of<halide_semaphore_t *>(), sema);
+    return call_extern_and_assert("halide_semaphore_acquire", {sema_var, count});
+}
+
+Stmt release_semaphore(const string &sema, Expr count) {
+    Expr sema_var = Variable::make(type_of<halide_semaphore_t *>(), sema);
+    return Evaluate::make(Call::make(Int(32), "halide_semaphore_release",
+                                     {sema_var, count}, Call::Extern));
+}
+
+Stmt make_semaphore(const string &sema, Expr initial_count, Stmt body) {
+    Expr sema_var = Variable::make(type_of<halide_semaphore_t *>(), sema);
+    Expr storage = Call::make(type_of<halide_semaphore_t *>(), Call::alloca,
+                              {(int)sizeof(halide_semaphore_t)}, Call::Intrinsic);
+    Expr init = Call::make(Int(32), "halide_semaphore_init",
+                           {sema_var, initial_count}, Call::Extern);
+    return LetStmt::make(sema, storage, Block::make(Evaluate::make(init), body));
+}
+
+Stmt close_semaphore_on_exit(const string &sema) {
+    Expr sema_var = Variable::make(type_of<halide_semaphore_t *>(), sema);
+    return Evaluate::make(Call::make(Int(32), Call::register_destructor,
+                                     {Expr("halide_semaphore_close"), sema_var}, Call::Intrinsic));
+}
+
+namespace {
+
+// Is this a call to the given runtime semaphore function on the given
+// semaphore? Acquires check their result, so they are the value of a
+// LetStmt.
+bool is_semaphore_call(Stmt s, const string &fn, const string &sema) {
+    const Call *call = nullptr;
+    if (const Evaluate *eval = s.as<Evaluate>()) {
+        call = eval->value.as<Call>();
+    } else if (const LetStmt *let = s.as<LetStmt>()) {
+        call = let->value.as<Call>();
+    }
+    if (!call || call->name != fn || call->args.empty()) {
+        return false;
+    }
+    const Variable *var = call->args[0].as<Variable>();
+    return var && var->name == sema;
+}
+
+// Does a statement contain anything that belongs on the producer side
+// of the fork: the production of the func, or an acquire of its
+// folding semaphore?
+class HasProducerParts : public IRVisitor {
+    const string &func;
+
+    using IRVisitor::visit;
+
+    void visit(const ProducerConsumer *op) {
+        if (op->is_producer && op->name == func) {
+            result = true;
+        } else {
+            IRVisitor::visit(op);
+        }
+    }
+
+    void visit(const LetStmt *op) {
+        if (is_semaphore_call(op, "halide_semaphore_acquire", func + ".folding_semaphore")) {
+            result = true;
+        } else {
+            IRVisitor::visit(op);
+        }
+    }
+
+public:
+    bool result = false;
+    HasProducerParts(const string &f) : func(f) {}
+};
+
+bool has_producer_parts(Stmt s, const string &func) {
+    HasProducerParts has(func);
+    s.accept(&has);
+    return has.result;
+}
+
+// Does a statement or expression refer to a func or its buffer?
+class UsesFunc : public IRVisitor {
+    const string &func;
+
+    using IRVisitor::visit;
+
+    void visit(const Call *op) {
+        if (op->name == func) {
+            result = true;
+        } else {
+            IRVisitor::visit(op);
+        }
+    }
+
+    void visit(const Variable *op) {
+        if (starts_with(op->name, func + ".")) {
+            result = true;
+        }
+    }
+
+public:
+    bool result = false;
+    UsesFunc(const string &f) : func(f) {}
+};
+
+template<typename T>
+bool uses_func(T ir, const string &func) {
+    if (!ir.defined()) {
+        return false;
+    }
+    UsesFunc uses(func);
+    ir.accept(&uses);
+    return uses.result;
+}
+
+// Strip a statement down to the producer side of the fork: the loops,
+// lets and conditions that enclose the production of the func, the
+// production itself, and the acquires of the folding semaphore. Each
+// production is followed by a release of the func's semaphore.
+Stmt make_producer_body(Stmt s, const string &func) {
+    if (!has_producer_parts(s, func)) {
+        return Evaluate::make(0);
+    }
+
+    if (is_semaphore_call(s, "halide_semaphore_acquire", func + ".folding_semaphore")) {
+        return s;
+    } else if (const ProducerConsumer *op = s.as<ProducerConsumer>()) {
+        if (op->is_producer && op->name == func) {
+            return Block::make(s, release_semaphore(func + ".semaphore", 1));
+        } else {
+            return make_producer_body(op->body, func);
+        }
+    } else if (const Realize *op = s.as<Realize>()) {
+        // The producer side doesn't touch this realization (checked
+        // below), so it doesn't need the storage.
+        return make_producer_body(op->body, func);
+    } else if (const Block *op = s.as<Block>()) {
+        Stmt first = make_producer_body(op->first, func);
+        Stmt rest = make_producer_body(op->rest, func);
+        if (is_no_op(first)) {
+            return rest;
+        } else if (is_no_op(rest)) {
+            return first;
+        } else {
+            return Block::make(first, rest);
+        }
+    } else if (const LetStmt *op = s.as<LetStmt>()) {
+        return LetStmt::make(op->name, op->value, make_producer_body(op->body, func));
+    } else if (const IfThenElse *op = s.as<IfThenElse>()) {
+        Stmt then_case = make_producer_body(op->then_case, func);
+        Stmt else_case = op->else_case.defined() ? make_producer_body(op->else_case, func) : Stmt();
+        if (else_case.defined() && is_no_op(else_case)) {
+            else_case = Stmt();
+        }
+        return IfThenElse::make(op->condition, then_case, else_case);
+    } else if (const For *op = s.as<For>()) {
+        // The producer and consumer count iterations of these loops
+        // off against each other, so they have to run in order.
+        user_assert(op->for_type == ForType::Serial || op->for_type == ForType::Unrolled)
+            << "Func " << func << " is async, so the loop over " << op->name
+            << " between its store_at and compute_at levels must be serial.\n";
+        return For::make(op->name, op->min, op->extent, op->for_type, op->device_api,
+                         make_producer_body(op->body, func));
+    } else {
+        user_error << "Func " << func << " is async, but its production is inside "
+                   << "an unsupported construct:\n" << s << "\n";
+        return s;
+    }
+}
+
+// Place an acquire of a func's semaphore as late as possible at the
+// start of a statement, so that work that doesn't depend on the func
+// (e.g. the production of another async func) can overlap with its
+// production. Doesn't move the acquire into any loop, which would
+// change how many times it runs.
+Stmt sink_acquire(Stmt acquire, Stmt s, const string &func) {
+    if (const Block *op = s.as<Block>()) {
+        if (!uses_func(op->first, func)) {
+            return Block::make(op->first, sink_acquire(acquire, op->rest, func));
+        }
+    } else if (const Realize *op = s.as<Realize>()) {
+        bool bounds_use_func = uses_func(op->condition, func);
+        for (const Range &r : op->bounds) {
+            bounds_use_func = bounds_use_func || uses_func(r.min, func) || uses_func(r.extent, func);
+        }
+        if (!bounds_use_func) {
+            return Realize::make(op->name, op->types, op->bounds, op->condition,
+                                 sink_acquire(acquire, op->body, func));
+        }
+    } else if (const ProducerConsumer *op = s.as<ProducerConsumer>()) {
+        return ProducerConsumer::make(op->name, op->is_producer, sink_acquire(acquire, op->body, func));
+    } else if (const LetStmt *op = s.as<LetStmt>()) {
+        if (!uses_func(op->value, func)) {
+            return LetStmt::make(op->name, op->value, sink_acquire(acquire, op->body, func));
+        }
+    }
+    return Block::make(acquire, s);
+}
+
+// The consumer side of the fork. Replaces each production of the func
+// with an acquire of its semaphore, and drops the acquires of the
+// folding semaphore, which belong to the producer.
+class MakeConsumerBody : public IRMutator {
+    const string &func;
+    Stmt acquire;
+
+    using IRMutator::visit;
+
+    void visit(const ProducerConsumer *op) {
+        if (op->is_producer && op->name == func) {
+            stmt = acquire;
+        } else {
+            IRMutator::visit(op);
+        }
+    }
+
+    void visit(const LetStmt *op) {
+        if (is_semaphore_call(op, "halide_semaphore_acquire", func + ".folding_semaphore")) {
+            stmt = Evaluate::make(0);
+        } else {
+            IRMutator::visit(op);
+        }
+    }
+
+    void visit(const Block *op) {
+        Stmt first = mutate(op->first);
+        Stmt rest = mutate(op->rest);
+        if (first.same_as(acquire)) {
+            stmt = sink_acquire(acquire, rest, func);
+        } else if (is_no_op(first)) {
+            stmt = rest;
+        } else if (first.same_as(op->first) && rest.same_as(op->rest)) {
+            stmt = op;
+        } else {
+            stmt = Block::make(first, rest);
+        }
+    }
+
+public:
+    MakeConsumerBody(const string &f) : func(f) {
+        acquire = acquire_semaphore(func + ".semaphore", 1);
+    }
+};
+
+// Find the realizations in a statement, outside of the production
+// of the given func.
+class FindRealizations : public IRVisitor {
+    const string &func;
+
+    using IRVisitor::visit;
+
+    void visit(const Realize *op) {
+        names.insert(op->name);
+        IRVisitor::visit(op);
+    }
+
+    void visit(const ProducerConsumer *op) {
+        if (!(op->is_producer && op->name == func)) {
+            IRVisitor::visit(op);
+        }
+    }
+
+public:
+    set<string> names;
+    FindRealizations(const string &f) : func(f) {}
+};
+
+class ForkAsyncProducers : public IRMutator {
+    const map<string, Function> &env;
+
+    // Are we inside a loop that runs on a device?
+    bool in_device_loop = false;
+
+    using IRMutator::visit;
+
+    void visit(const For *op) {
+        bool old_in_device_loop = in_device_loop;
+        if (op->device_api != DeviceAPI::None &&
+            op->device_api != DeviceAPI::Host) {
+            in_device_loop = true;
+        }
+        IRMutator::visit(op);
+        in_device_loop = old_in_device_loop;
+    }
+
+    void visit(const Realize *op) {
+        auto it = env.find(op->name);
+        if (it == env.end() ||
+            !it->second.schedule().async() ||
+            !has_producer_parts(op->body, op->name)) {
+            IRMutator::visit(op);
+            return;
+        }
+        const string &func = op->name;
+
+        user_assert(!in_device_loop)
+            << "Func " << func << " is async, so it can't be computed inside a loop that runs on a device.\n";
+
+        debug(3) << "Forking the producer of async func " << func << "\n";
+
+        Stmt producer = make_producer_body(op->body, func);
+        Stmt consumer = MakeConsumerBody(func).mutate(op->body);
+
+        // The producer side drops the realizations inside this one, so
+        // it must not use them.
+        FindRealizations inner(func);
+        op->body.accept(&inner);
+        for (const string &name : inner.names) {
+            user_assert(!uses_func(producer, name))
+                << "Func " << func << " is async, but its production uses " << name
+                << ", which is computed inside the storage of " << func
+                << ". Compute " << name << " at the same level as " << func
+                << " or outside it.\n";
+        }
+
+        // Other async funcs may be computed on either side.
+        producer = mutate(producer);
+        consumer = mutate(consumer);
+
+        // If either side fails, the other mustn't wait for it
+        // forever. The producer releases the func's semaphore, and
+        // the consumer releases the folding semaphore, if there is
+        // one.
+        producer = Block::make(close_semaphore_on_exit(func + ".semaphore"), producer);
+        string folding_sema = func + ".folding_semaphore";
+        if (stmt_uses_var(op->body, folding_sema)) {
+            consumer = Block::make(close_semaphore_on_exit(folding_sema), consumer);
+        }
+
+        // Run the two sides as the two tasks of a parallel loop. The
+        // thread pool makes sure both tasks make progress even if one
+        // of them blocks on a semaphore before the other has started.
+        string fork_var = func + ".fork";
+        Expr is_producer = Variable::make(Int(32), fork_var) == 0;
+        Stmt body = For::make(fork_var, 0, 2, ForType::Parallel, DeviceAPI::None,
+                              IfThenElse::make(is_producer, producer, consumer));
+        body = make_semaphore(func + ".semaphore", 0, body);
+
+        stmt = Realize::make(op->name, op->types, op->bounds, op->condition, body);
+    }
+
+public:
+    ForkAsyncProducers(const map<string, Function> &e) : env(e) {}
+};
+
+}  // namespace
+
+Stmt fork_async_producers(Stmt s, const map<string, Function> &env) {
+    bool any_async = false;
+    for (const auto &p : env) {
+        any_async = any_async || p.second.schedule().async();
+    }
+    if (!any_async) {
+        return s;
+    }
+    return ForkAsyncProducers(env).mutate(s);
+}
+
+}
+}
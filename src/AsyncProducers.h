@@ -0,0 +1,47 @@
+#ifndef HALIDE_ASYNC_PRODUCERS_H
+#define HALIDE_ASYNC_PRODUCERS_H
+
+/** \file
+ * Defines the lowering pass that runs async producers on their own
+ * task, concurrently with their consumers.
+ */
+
+#include <map>
+
+#include "IR.h"
+
+namespace Halide {
+namespace Internal {
+
+/** Split the code inside the realization of each async Func into a
+ * producer half, which contains the loops enclosing the production of
+ * the Func and the production itself, and a consumer half, which is
+ * everything else. The two halves run as the two tasks of a parallel
+ * loop, and synchronize through a semaphore: the producer releases it
+ * each time it completes a production, and the consumer acquires it
+ * in place of each production. Storage folding adds a second
+ * semaphore for async Funcs, which stops the producer from
+ * overwriting parts of the circular buffer the consumer still needs
+ * (see storage_folding). */
+Stmt fork_async_producers(Stmt s, const std::map<std::string, Function> &env);
+
+/** Make calls to the runtime's semaphore functions. The semaphore is
+ * referred to by the name of a variable holding a pointer to it. */
+// @{
+Stmt acquire_semaphore(const std::string &sema, Expr count);
+Stmt release_semaphore(const std::string &sema, Expr count);
+// @}
+
+/** Wrap a statement in the definition of a variable pointing to a
+ * new semaphore with the given initial count. */
+Stmt make_semaphore(const std::string &sema, Expr initial_count, Stmt body);
+
+/** Close a semaphore when the enclosing task exits, whether it
+ * succeeds or fails, so that acquires that can no longer be
+ * satisfied return an error instead of blocking. */
+Stmt close_semaphore_on_exit(const std::string &sema);
+
+}
+}
+
+#endif
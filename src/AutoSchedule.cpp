@@ -0,0 +1,868 @@
+#include <algorithm>
+#include <map>
+#include <set>
+#include <sstream>
+
+#include "AutoSchedule.h"
+#include "Bounds.h"
+#include "FindCalls.h"
+#include "Func.h"
+#include "IROperator.h"
+#include "IRVisitor.h"
+#include "RealizationOrder.h"
+#include "Simplify.h"
+
+namespace Halide {
+
+MachineParams MachineParams::generic() {
+    return MachineParams(16, 16 * 1024 * 1024, 40);
+}
+
+std::string MachineParams::to_string() const {
+    std::ostringstream o;
+    o << parallelism << "," << last_level_cache_size << "," << balance;
+    return o.str();
+}
+
+namespace Internal {
+
+using std::map;
+using std::set;
+using std::string;
+using std::vector;
+
+namespace {
+
+// Counts the arithmetic operations done, and the values loaded from
+// each function and input image, to compute one point of a
+// definition.
+class CountOps : public IRVisitor {
+public:
+    double ops;
+    map<string, double> calls;
+    map<string, int> image_bytes;
+
+    CountOps() : ops(0) {}
+
+private:
+    using IRVisitor::visit;
+
+    // Most operations cost about the same. Division, modulus and
+    // calls to math library functions cost more.
+    void visit(const Cast *op) {IRVisitor::visit(op); ops += 1;}
+    void visit(const Add *op) {IRVisitor::visit(op); ops += 1;}
+    void visit(const Sub *op) {IRVisitor::visit(op); ops += 1;}
+    void visit(const Mul *op) {IRVisitor::visit(op); ops += 1;}
+    void visit(const Div *op) {IRVisitor::visit(op); ops += 4;}
+    void visit(const Mod *op) {IRVisitor::visit(op); ops += 4;}
+    void visit(const Min *op) {IRVisitor::visit(op); ops += 1;}
+    void visit(const Max *op) {IRVisitor::visit(op); ops += 1;}
+    void visit(const EQ *op) {IRVisitor::visit(op); ops += 1;}
+    void visit(const NE *op) {IRVisitor::visit(op); ops += 1;}
+    void visit(const LT *op) {IRVisitor::visit(op); ops += 1;}
+    void visit(const LE *op) {IRVisitor::visit(op); ops += 1;}
+    void visit(const GT *op) {IRVisitor::visit(op); ops += 1;}
+    void visit(const GE *op) {IRVisitor::visit(op); ops += 1;}
+    void visit(const And *op) {IRVisitor::visit(op); ops += 1;}
+    void visit(const Or *op) {IRVisitor::visit(op); ops += 1;}
+    void visit(const Not *op) {IRVisitor::visit(op); ops += 1;}
+    void visit(const Select *op) {IRVisitor::visit(op); ops += 1;}
+
+    void visit(const Call *op) {
+        IRVisitor::visit(op);
+        if (op->call_type == Call::Halide || op->call_type == Call::Image) {
+            calls[op->name] += 1;
+            if (op->call_type == Call::Image) {
+                image_bytes[op->name] = op->type.bytes();
+            }
+        } else {
+            ops += 4;
+        }
+    }
+};
+
+// What we know and have decided about one function.
+struct FuncInfo {
+    Function func;
+    bool is_output, fixed, inlined;
+    // Must be computed at root, because an extern stage uses it.
+    bool must_root;
+
+    // The estimated region computed.
+    vector<int64_t> mins, extents;
+    double points;
+
+    // The arithmetic done over the whole region, and the number of
+    // values loaded from each producer and input image. Inlining a
+    // function moves its costs into its consumers.
+    double ops;
+    map<string, double> calls;
+
+    int bytes_per_point, values_per_point;
+
+    // Set if this function is computed at tiles of another one.
+    string group_root;
+
+    // For functions computed at root, the tile size in each
+    // dimension, and the functions computed at each tile.
+    vector<int64_t> tile;
+    vector<string> members;
+
+    FuncInfo() : is_output(false), fixed(false), inlined(false), must_root(false),
+                 points(1), ops(0), bytes_per_point(0), values_per_point(0) {}
+
+    bool is_split(size_t d) const {
+        return d < tile.size() && tile[d] < extents[d];
+    }
+
+    int64_t trips(size_t d) const {
+        int64_t t = d < tile.size() ? tile[d] : 1;
+        return (extents[d] + t - 1) / t;
+    }
+};
+
+bool const_interval(const Interval &i, int64_t *min, int64_t *extent) {
+    if (!i.min.defined() || !i.max.defined()) {
+        return false;
+    }
+    const int64_t *lo = as_const_int(simplify(i.min));
+    const int64_t *hi = as_const_int(simplify(i.max));
+    if (!lo || !hi) {
+        return false;
+    }
+    *min = *lo;
+    *extent = std::max(*hi - *lo + 1, (int64_t)0);
+    return true;
+}
+
+string sanitize(const string &name) {
+    string result = name;
+    for (char &c : result) {
+        if (!isalnum(c) && c != '_') {
+            c = '_';
+        }
+    }
+    return result;
+}
+
+class AutoScheduler {
+    const Target &target;
+    const MachineParams &params;
+    vector<Function> outputs;
+    map<string, Function> env;
+    vector<string> order;
+    map<string, FuncInfo> funcs;
+    map<string, int> image_bytes;
+
+    // Functions whose region can't be bounded are assumed to be as
+    // large as the largest output dimension.
+    int64_t fallback_extent;
+
+    // The working set of one tile should fit in each core's share of
+    // the last level cache.
+    int64_t cache_budget() const {
+        return std::max((int64_t)params.last_level_cache_size / std::max(params.parallelism, 1),
+                        (int64_t)32 * 1024);
+    }
+
+    // Starting from the given regions, work out the regions required
+    // of the functions they call. Only the functions for which expand
+    // returns true are looked through.
+    template<typename Pred>
+    map<string, Box> propagate(map<string, Box> regions, Pred expand) const {
+        for (auto it = order.rbegin(); it != order.rend(); ++it) {
+            auto r = regions.find(*it);
+            if (r == regions.end() || !expand(*it)) {
+                continue;
+            }
+            const Function &f = env.at(*it);
+            if (f.has_extern_definition()) {
+                continue;
+            }
+
+            Scope<Interval> scope;
+            const vector<string> args = f.args();
+            for (size_t i = 0; i < args.size(); i++) {
+                scope.push(args[i], r->second[i]);
+            }
+
+            vector<map<string, Box>> required;
+            for (Expr v : f.values()) {
+                required.push_back(boxes_required(v, scope));
+            }
+            for (const Definition &u : f.updates()) {
+                const vector<ReductionVariable> &rvars = u.schedule().rvars();
+                for (const ReductionVariable &rv : rvars) {
+                    scope.push(rv.var, Interval(rv.min, simplify(rv.min + rv.extent - 1)));
+                }
+                for (Expr e : u.args()) {
+                    required.push_back(boxes_required(e, scope));
+                }
+                for (Expr e : u.values()) {
+                    required.push_back(boxes_required(e, scope));
+                }
+                for (const ReductionVariable &rv : rvars) {
+                    scope.pop(rv.var);
+                }
+            }
+
+            for (const map<string, Box> &boxes : required) {
+                for (const auto &b : boxes) {
+                    if (b.first == f.name()) {
+                        continue;
+                    }
+                    auto existing = regions.find(b.first);
+                    if (existing == regions.end()) {
+                        regions[b.first] = b.second;
+                    } else {
+                        merge_boxes(existing->second, b.second);
+                    }
+                }
+            }
+        }
+        return regions;
+    }
+
+    // The number of points in a box, taking the full estimated region
+    // for any dimension that can't be bounded.
+    double box_points(const string &name, const Box &b) const {
+        auto it = funcs.find(name);
+        double points = 1;
+        for (size_t i = 0; i < b.size(); i++) {
+            int64_t min, extent;
+            if (!const_interval(b[i], &min, &extent)) {
+                extent = (it != funcs.end()) ? it->second.extents[i] : fallback_extent;
+            }
+            points *= extent;
+        }
+        return points;
+    }
+
+    // One tile of a function computed at root, at the start of its
+    // estimated region.
+    Box tile_box(const FuncInfo &g, const vector<int64_t> &tile) const {
+        Box b;
+        for (size_t i = 0; i < g.extents.size(); i++) {
+            b.push_back(Interval((int)g.mins[i], (int)(g.mins[i] + tile[i] - 1)));
+        }
+        return b;
+    }
+
+    // The regions of all functions touched while computing one tile of
+    // g, including the given functions computed at each tile.
+    map<string, Box> tile_regions(const FuncInfo &g, const vector<int64_t> &tile,
+                                  const vector<string> &members) const {
+        map<string, Box> seed;
+        seed[g.func.name()] = tile_box(g, tile);
+        return propagate(seed, [&](const string &name) {
+                return (name == g.func.name() ||
+                        funcs.at(name).inlined ||
+                        std::find(members.begin(), members.end(), name) != members.end());
+            });
+    }
+
+    // The bytes touched while computing one tile of g: the tile
+    // itself, the functions computed at it, and what they load.
+    double tile_footprint(const FuncInfo &g, const vector<int64_t> &tile,
+                          const vector<string> &members) const {
+        double bytes = 0;
+        for (const auto &r : tile_regions(g, tile, members)) {
+            auto it = funcs.find(r.first);
+            if (it != funcs.end()) {
+                if (!it->second.inlined) {
+                    bytes += box_points(r.first, r.second) * it->second.bytes_per_point;
+                }
+            } else if (image_bytes.count(r.first)) {
+                bytes += box_points(r.first, r.second) * image_bytes.at(r.first);
+            }
+        }
+        return bytes;
+    }
+
+    bool tileable(const FuncInfo &f) const {
+        return (!f.fixed &&
+                !f.inlined &&
+                !f.func.has_extern_definition() &&
+                !f.func.has_update_definition() &&
+                !f.extents.empty());
+    }
+
+    void compute_estimated_regions() {
+        map<string, Box> seed;
+        fallback_extent = 1;
+        for (const Function &out : outputs) {
+            const vector<Bound> &estimates = out.schedule().estimates();
+            Box b;
+            for (const string &arg : out.args()) {
+                const Bound *est = nullptr;
+                for (const Bound &e : estimates) {
+                    if (e.var == arg) {
+                        est = &e;
+                    }
+                }
+                user_assert(est)
+                    << "Can't auto-schedule a pipeline because output " << out.name()
+                    << " has no estimate for dimension " << arg
+                    << ". Use Func::estimate to provide one.\n";
+                const int64_t *min = as_const_int(simplify(est->min));
+                const int64_t *extent = as_const_int(simplify(est->extent));
+                user_assert(min && extent)
+                    << "The estimate for dimension " << arg << " of " << out.name()
+                    << " must be constant.\n";
+                b.push_back(Interval((int)*min, (int)(*min + *extent - 1)));
+                fallback_extent = std::max(fallback_extent, *extent);
+            }
+            seed[out.name()] = b;
+        }
+
+        map<string, Box> regions = propagate(seed, [](const string &) {return true;});
+
+        for (const string &name : order) {
+            FuncInfo &info = funcs[name];
+            const vector<string> args = info.func.args();
+            auto r = regions.find(name);
+            for (size_t i = 0; i < args.size(); i++) {
+                int64_t min = 0, extent = fallback_extent;
+                if (r != regions.end() && i < r->second.size()) {
+                    if (!const_interval(r->second[i], &min, &extent)) {
+                        min = 0;
+                        extent = fallback_extent;
+                    }
+                }
+                info.mins.push_back(min);
+                info.extents.push_back(std::max(extent, (int64_t)1));
+                info.points *= info.extents.back();
+            }
+        }
+    }
+
+    void compute_costs() {
+        for (const string &name : order) {
+            FuncInfo &info = funcs[name];
+            const Function &f = info.func;
+
+            for (Type t : f.output_types()) {
+                info.bytes_per_point += t.bytes();
+                info.values_per_point++;
+            }
+
+            if (f.has_extern_definition()) {
+                // We know nothing about the cost of extern stages,
+                // and they can't be rescheduled.
+                for (const ExternFuncArgument &arg : f.extern_arguments()) {
+                    if (arg.is_func()) {
+                        Function producer(arg.func);
+                        funcs[producer.name()].must_root = true;
+                    }
+                }
+                continue;
+            }
+
+            CountOps pure;
+            for (Expr v : f.values()) {
+                v.accept(&pure);
+            }
+            info.ops += pure.ops * info.points;
+            for (const auto &c : pure.calls) {
+                info.calls[c.first] += c.second * info.points;
+            }
+            image_bytes.insert(pure.image_bytes.begin(), pure.image_bytes.end());
+
+            const vector<string> args = f.args();
+            for (const Definition &u : f.updates()) {
+                // The update runs once per point of its reduction
+                // domain, for each value of the pure vars it uses.
+                double points = 1;
+                for (const ReductionVariable &rv : u.schedule().rvars()) {
+                    const int64_t *extent = as_const_int(simplify(rv.extent));
+                    points *= extent ? *extent : 1;
+                }
+                for (size_t i = 0; i < u.args().size(); i++) {
+                    const Variable *v = u.args()[i].as<Variable>();
+                    if (v && i < args.size() && v->name == args[i]) {
+                        points *= info.extents[i];
+                    }
+                }
+
+                CountOps update;
+                for (Expr e : u.args()) {
+                    e.accept(&update);
+                }
+                for (Expr e : u.values()) {
+                    e.accept(&update);
+                }
+                info.ops += update.ops * points;
+                for (const auto &c : update.calls) {
+                    if (c.first != f.name()) {
+                        info.calls[c.first] += c.second * points;
+                    }
+                }
+                image_bytes.insert(update.image_bytes.begin(), update.image_bytes.end());
+            }
+        }
+    }
+
+    // Inline a function into its consumers when recomputing it at
+    // every use costs less than storing it and loading it back.
+    void choose_inlining() {
+        for (const string &name : order) {
+            FuncInfo &f = funcs[name];
+            if (f.is_output || f.fixed || f.must_root || !f.func.can_be_inlined()) {
+                continue;
+            }
+
+            double evaluations = 0;
+            for (const auto &c : funcs) {
+                auto it = c.second.calls.find(name);
+                if (!c.second.inlined && it != c.second.calls.end()) {
+                    evaluations += it->second;
+                }
+            }
+            if (evaluations == 0) {
+                continue;
+            }
+
+            double loads = 0;
+            for (const auto &c : f.calls) {
+                loads += c.second;
+            }
+
+            // Inlined, each evaluation redoes the arithmetic and
+            // the loads of one point.
+            double inline_cost = evaluations * (f.ops + loads) / f.points;
+
+            // Otherwise each point is computed once and stored, and
+            // each evaluation is a load. This assumes it will be
+            // computed at tiles of its consumers, so the values stay
+            // in cache.
+            double store_cost = f.ops + loads + 2 * f.points * f.values_per_point + evaluations;
+
+            if (inline_cost > store_cost) {
+                continue;
+            }
+
+            debug(2) << "auto_schedule: inlining " << name << "\n";
+            f.inlined = true;
+            for (auto &c : funcs) {
+                auto it = c.second.calls.find(name);
+                if (c.second.inlined || it == c.second.calls.end()) {
+                    continue;
+                }
+                double n = it->second / f.points;
+                c.second.calls.erase(it);
+                c.second.ops += n * f.ops;
+                for (const auto &p : f.calls) {
+                    c.second.calls[p.first] += n * p.second;
+                }
+            }
+        }
+    }
+
+    // Pick the largest tile whose working set fits in cache, while
+    // leaving enough tiles to keep every core busy.
+    void choose_tile(FuncInfo &g) {
+        size_t dims = g.extents.size();
+        vector<int64_t> inner_sizes, outer_sizes;
+        if (dims == 1) {
+            inner_sizes = {64, 128, 256, 512, 1024, 2048, 4096, 8192, 16384};
+            outer_sizes = {1};
+        } else {
+            inner_sizes = {16, 32, 64, 128, 256, 512};
+            outer_sizes = {4, 8, 16, 32, 64, 128, 256};
+        }
+
+        vector<int64_t> best;
+        bool best_fits = false, best_parallel = false;
+        double best_points = 0, best_footprint = 0;
+        for (int64_t t0 : inner_sizes) {
+            for (int64_t t1 : outer_sizes) {
+                vector<int64_t> tile(dims, 1);
+                tile[0] = std::min(t0, g.extents[0]);
+                if (dims > 1) {
+                    tile[1] = std::min(t1, g.extents[1]);
+                }
+
+                double tiles = 1, points = 1;
+                for (size_t d = 0; d < dims; d++) {
+                    tiles *= (g.extents[d] + tile[d] - 1) / tile[d];
+                    points *= tile[d];
+                }
+                double footprint = tile_footprint(g, tile, g.members);
+                bool fits = footprint <= cache_budget();
+                bool parallel = tiles >= params.parallelism;
+
+                bool better;
+                if (best.empty() || fits != best_fits) {
+                    better = best.empty() || fits;
+                } else if (!fits) {
+                    better = footprint < best_footprint;
+                } else if (parallel != best_parallel) {
+                    better = parallel;
+                } else {
+                    better = points > best_points;
+                }
+                if (better) {
+                    best = tile;
+                    best_fits = fits;
+                    best_parallel = parallel;
+                    best_points = points;
+                    best_footprint = footprint;
+                }
+            }
+        }
+        g.tile = best;
+        debug(2) << "auto_schedule: tile of " << g.func.name() << " uses "
+                 << best_footprint << " bytes\n";
+    }
+
+    // Decide whether f should be computed at tiles of its only
+    // consumer's group. This saves the memory traffic of storing f
+    // and loading it back, at the cost of recomputing it where tiles
+    // overlap.
+    bool try_group(FuncInfo &f) {
+        if (f.is_output || f.fixed || f.must_root ||
+            f.func.has_extern_definition() || f.func.has_update_definition()) {
+            return false;
+        }
+
+        const FuncInfo *consumer = nullptr;
+        for (const auto &c : funcs) {
+            if (!c.second.inlined && c.second.calls.count(f.func.name())) {
+                if (consumer) {
+                    return false;
+                }
+                consumer = &c.second;
+            }
+        }
+        if (!consumer || consumer->fixed) {
+            return false;
+        }
+        FuncInfo &g = funcs[consumer->group_root.empty() ? consumer->func.name() : consumer->group_root];
+        if (!tileable(g) || g.tile.empty()) {
+            return false;
+        }
+        bool split = false;
+        for (size_t d = 0; d < g.extents.size(); d++) {
+            split |= g.is_split(d);
+        }
+        if (!split) {
+            return false;
+        }
+
+        vector<string> members = g.members;
+        members.push_back(f.func.name());
+        map<string, Box> regions = tile_regions(g, g.tile, members);
+        auto r = regions.find(f.func.name());
+        if (r == regions.end()) {
+            return false;
+        }
+        double tiles = 1;
+        for (size_t d = 0; d < g.extents.size(); d++) {
+            tiles *= g.trips(d);
+        }
+        double computed = tiles * box_points(f.func.name(), r->second);
+
+        double loads = 0;
+        for (const auto &c : f.calls) {
+            loads += c.second;
+        }
+        double recompute_cost = std::max(computed / f.points - 1, 0.0) * (f.ops + loads);
+        double saved = 2 * f.points * f.values_per_point * (params.balance - 1);
+        if (recompute_cost >= saved ||
+            tile_footprint(g, g.tile, members) > cache_budget()) {
+            return false;
+        }
+
+        debug(2) << "auto_schedule: computing " << f.func.name()
+                 << " at tiles of " << g.func.name() << "\n";
+        f.group_root = g.func.name();
+        g.members.push_back(f.func.name());
+        return true;
+    }
+
+    void choose_groups() {
+        // Consumers first, so each function's consumer has already
+        // been placed.
+        for (auto it = order.rbegin(); it != order.rend(); ++it) {
+            FuncInfo &f = funcs[*it];
+            if (f.inlined || f.fixed) {
+                continue;
+            }
+            if (!try_group(f) && tileable(f)) {
+                choose_tile(f);
+            }
+        }
+    }
+
+    // Writes the schedule as source, and applies it.
+    class Writer {
+        std::ostringstream header, src;
+        set<string> vars;
+        vector<string> directives;
+        string stage_name;
+
+    public:
+        string var(const string &name) {
+            vars.insert(name);
+            return sanitize(name);
+        }
+
+        void begin(const string &name) {
+            stage_name = name;
+            directives.clear();
+        }
+
+        void add(const string &directive) {
+            directives.push_back(directive);
+        }
+
+        void end() {
+            if (directives.empty()) {
+                return;
+            }
+            src << stage_name;
+            for (const string &d : directives) {
+                src << "\n    ." << d;
+            }
+            src << ";\n";
+        }
+
+        void comment(const string &text) {
+            header << "// " << text << "\n";
+        }
+
+        string str() const {
+            std::ostringstream o;
+            o << header.str();
+            if (!vars.empty()) {
+                o << "Var ";
+                bool first = true;
+                for (const string &v : vars) {
+                    if (!first) {
+                        o << ", ";
+                    }
+                    first = false;
+                    o << sanitize(v) << "(\"" << v << "\")";
+                }
+                o << ";\n";
+            }
+            return o.str() + src.str();
+        }
+    };
+
+    void apply_root(FuncInfo &g, Writer &w) {
+        Func func(g.func);
+        const string name = sanitize(g.func.name());
+        const vector<string> args = g.func.args();
+        const int vector_size = target.natural_vector_size(g.func.output_types()[0]);
+
+        w.begin(name);
+        if (!g.is_output) {
+            func.compute_root();
+            w.add("compute_root()");
+        }
+
+        if (g.tile.empty()) {
+            // Stages with update or extern definitions aren't tiled.
+            if (g.func.has_pure_definition() && !g.extents.empty()) {
+                if (g.extents[0] >= vector_size) {
+                    func.vectorize(Var(args[0]), vector_size);
+                    w.add("vectorize(" + w.var(args[0]) + ", " + std::to_string(vector_size) + ")");
+                }
+                if (args.size() > 1 && g.extents.back() > 1) {
+                    func.parallel(Var(args.back()));
+                    w.add("parallel(" + w.var(args.back()) + ")");
+                }
+            }
+            w.end();
+            for (size_t i = 0; i < g.func.updates().size(); i++) {
+                apply_update(g, (int)i, w);
+            }
+            return;
+        }
+
+        size_t dims = args.size();
+        vector<string> inner(dims);
+        for (size_t d = 0; d < std::min(dims, (size_t)2); d++) {
+            if (g.is_split(d)) {
+                inner[d] = args[d] + "_i";
+                func.split(Var(args[d]), Var(args[d]), Var(inner[d]), (int)g.tile[d]);
+                w.add("split(" + w.var(args[d]) + ", " + w.var(args[d]) + ", " +
+                      w.var(inner[d]) + ", " + std::to_string(g.tile[d]) + ")");
+            }
+        }
+        if (dims > 1 && g.is_split(0) && g.is_split(1)) {
+            func.reorder(Var(inner[0]), Var(inner[1]), Var(args[0]), Var(args[1]));
+            w.add("reorder(" + w.var(inner[0]) + ", " + w.var(inner[1]) + ", " +
+                  w.var(args[0]) + ", " + w.var(args[1]) + ")");
+        }
+
+        // The innermost loop over points within a tile.
+        const string innermost = g.is_split(0) ? inner[0] : args[0];
+        if (std::min(g.tile[0], g.extents[0]) >= vector_size) {
+            func.vectorize(Var(innermost), vector_size);
+            w.add("vectorize(" + w.var(innermost) + ", " + std::to_string(vector_size) + ")");
+        }
+
+        // The loops over tiles, innermost first.
+        vector<size_t> tile_loops;
+        for (size_t d = 0; d < dims; d++) {
+            if (d >= 2 || g.is_split(d)) {
+                tile_loops.push_back(d);
+            }
+        }
+        string compute_at_var = tile_loops.empty() ? "" : args[tile_loops[0]];
+
+        // Parallelize the outermost loop that does anything, fused
+        // with the next one in if it has too few iterations.
+        for (size_t i = tile_loops.size(); i > 0; i--) {
+            size_t d = tile_loops[i - 1];
+            if (g.trips(d) <= 1) {
+                continue;
+            }
+            string par = args[d];
+            if (g.trips(d) < params.parallelism && i > 1 && g.trips(tile_loops[i - 2]) > 1) {
+                const string &in = args[tile_loops[i - 2]];
+                string fused = in + "_" + par;
+                func.fuse(Var(in), Var(par), Var(fused));
+                w.add("fuse(" + w.var(in) + ", " + w.var(par) + ", " + w.var(fused) + ")");
+                if (compute_at_var == in || compute_at_var == par) {
+                    compute_at_var = fused;
+                }
+                par = fused;
+            }
+            func.parallel(Var(par));
+            w.add("parallel(" + w.var(par) + ")");
+            break;
+        }
+        w.end();
+
+        // The functions computed at each tile.
+        map<string, Box> regions = tile_regions(g, g.tile, g.members);
+        for (auto it = order.begin(); it != order.end(); ++it) {
+            if (std::find(g.members.begin(), g.members.end(), *it) == g.members.end()) {
+                continue;
+            }
+            const FuncInfo &m = funcs.at(*it);
+            Func member(m.func);
+            w.begin(sanitize(*it));
+            member.compute_at(func, Var(compute_at_var));
+            w.add("compute_at(" + name + ", " + w.var(compute_at_var) + ")");
+
+            const string &x = m.func.args()[0];
+            int member_vector_size = target.natural_vector_size(m.func.output_types()[0]);
+            int64_t min, extent;
+            if (const_interval(regions.at(*it)[0], &min, &extent) && extent >= member_vector_size) {
+                member.vectorize(Var(x), member_vector_size);
+                w.add("vectorize(" + w.var(x) + ", " + std::to_string(member_vector_size) + ")");
+            }
+            w.end();
+        }
+    }
+
+    // Vectorize and parallelize an update over the pure vars it
+    // leaves alone.
+    void apply_update(const FuncInfo &f, int idx, Writer &w) {
+        const Definition &u = f.func.update(idx);
+        const vector<string> args = f.func.args();
+        Stage stage = Func(f.func).update(idx);
+        w.begin(sanitize(f.func.name()) + ".update(" + std::to_string(idx) + ")");
+
+        auto pure_var = [&](size_t d) {
+            const Variable *v = d < u.args().size() ? u.args()[d].as<Variable>() : nullptr;
+            return v && v->name == args[d];
+        };
+
+        int vector_size = target.natural_vector_size(f.func.output_types()[0]);
+        if (!args.empty() && pure_var(0) && f.extents[0] >= vector_size) {
+            stage.vectorize(Var(args[0]), vector_size);
+            w.add("vectorize(" + w.var(args[0]) + ", " + std::to_string(vector_size) + ")");
+        }
+        if (args.size() > 1 && pure_var(args.size() - 1) && f.extents.back() > 1) {
+            stage.parallel(Var(args.back()));
+            w.add("parallel(" + w.var(args.back()) + ")");
+        }
+        w.end();
+    }
+
+public:
+    AutoScheduler(const vector<Function> &outputs, const Target &target, const MachineParams &params) :
+        target(target), params(params), outputs(outputs), fallback_extent(1) {
+        for (const Function &out : outputs) {
+            map<string, Function> calls = find_transitive_calls(out);
+            env.insert(calls.begin(), calls.end());
+        }
+        order = realization_order(outputs, env);
+
+        for (const string &name : order) {
+            FuncInfo &info = funcs[name];
+            info.func = env.at(name);
+            for (const Function &out : outputs) {
+                info.is_output |= out.same_as(info.func);
+            }
+            // Leave alone anything the user has already scheduled.
+            bool touched = info.func.schedule().touched();
+            for (const Definition &u : info.func.updates()) {
+                touched |= u.schedule().touched();
+            }
+            info.fixed = touched || (!info.is_output && !info.func.schedule().compute_level().is_inline());
+        }
+    }
+
+    string run() {
+        user_assert(target.arch != Target::ArchUnknown && !target.has_gpu_feature())
+            << "auto_schedule only supports CPU targets. Can't schedule for " << target.to_string() << "\n";
+
+        compute_estimated_regions();
+        compute_costs();
+        choose_inlining();
+        choose_groups();
+
+        Writer w;
+        w.comment("Schedule for " + target.to_string() + " from auto_schedule with machine params " +
+                  params.to_string());
+
+        vector<string> inlined, fixed;
+        for (const string &name : order) {
+            const FuncInfo &f = funcs.at(name);
+            if (f.inlined) {
+                inlined.push_back(name);
+            } else if (f.fixed) {
+                fixed.push_back(name);
+            }
+        }
+        if (!inlined.empty()) {
+            string names;
+            for (const string &n : inlined) {
+                names += (names.empty() ? "" : ", ") + n;
+            }
+            w.comment("Inlined: " + names);
+        }
+        if (!fixed.empty()) {
+            string names;
+            for (const string &n : fixed) {
+                names += (names.empty() ? "" : ", ") + n;
+            }
+            w.comment("Already scheduled: " + names);
+        }
+
+        for (const string &name : order) {
+            FuncInfo &f = funcs.at(name);
+            if (!f.inlined && !f.fixed && f.group_root.empty()) {
+                apply_root(f, w);
+            }
+        }
+        return w.str();
+    }
+};
+
+}  // namespace
+
+string generate_schedules(const vector<Function> &outputs,
+                          const Target &target,
+                          const MachineParams &arch_params) {
+    return AutoScheduler(outputs, target, arch_params).run();
+}
+
+}
+}
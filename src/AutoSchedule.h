@@ -0,0 +1,32 @@
+#ifndef HALIDE_INTERNAL_AUTO_SCHEDULE_H
+#define HALIDE_INTERNAL_AUTO_SCHEDULE_H
+
+/** \file
+ *
+ * Defines the method that automatically schedules a pipeline for a
+ * CPU target.
+ */
+
+#include <string>
+#include <vector>
+
+#include "Function.h"
+#include "Pipeline.h"
+#include "Target.h"
+
+namespace Halide {
+namespace Internal {
+
+/** Choose and apply schedules for the functions in the pipeline that
+ * computes the given outputs, using estimates of the size of the
+ * outputs and a cost model of arithmetic and memory traffic on the
+ * described machine. Returns the schedule as C++ source. See
+ * Pipeline::auto_schedule. */
+std::string generate_schedules(const std::vector<Function> &outputs,
+                               const Target &target,
+                               const MachineParams &arch_params);
+
+}
+}
+
+#endif
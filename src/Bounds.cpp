@@ -13,6 +13,7 @@
 #include "ExprUsesVar.h"
 #include "IRMutator.h"
 #include "CSE.h"
+#include "FindCalls.h"
 
 namespace Halide {
 namespace Internal {
@@ -1436,12 +1437,109 @@ Interval compute_pure_function_definition_value_bounds(
     return result;
 }
 
+namespace {
+
+void get_algorithm(const Definition &def, vector<Expr> *result) {
+    result->insert(result->end(), def.values().begin(), def.values().end());
+    for (const Specialization &s : def.specializations()) {
+        result->push_back(s.condition);
+        get_algorithm(s.definition, result);
+    }
+}
+
+// The value bounds of the Functions called by f.
+FuncValueBounds bounds_of_callees(const Function &f, const FuncValueBounds &fb) {
+    FuncValueBounds result;
+    for (const auto &callee : find_direct_calls(f)) {
+        for (auto it = fb.lower_bound(make_pair(callee.first, 0));
+             it != fb.end() && it->first.first == callee.first; ++it) {
+            result.insert(*it);
+        }
+    }
+    return result;
+}
+
+bool same_interval(const Interval &a, const Interval &b) {
+    return equal(a.min, b.min) && equal(a.max, b.max);
+}
+
+}  // namespace
+
+void FuncValueBoundsCache::set_algorithm(const map<string, Function> &env) {
+    algorithm.clear();
+    for (const auto &iter : env) {
+        get_algorithm(iter.second.definition(), &algorithm[iter.first]);
+    }
+    for (auto it = entries.begin(); it != entries.end(); ) {
+        if (algorithm.count(it->first)) {
+            ++it;
+        } else {
+            it = entries.erase(it);
+        }
+    }
+}
+
+bool FuncValueBoundsCache::lookup(const Function &f, const FuncValueBounds &fb, vector<Interval> *result) const {
+    auto alg = algorithm.find(f.name());
+    auto entry = entries.find(f.name());
+    if (alg == algorithm.end() || entry == entries.end()) {
+        return false;
+    }
+
+    const vector<Expr> &a = alg->second, &b = entry->second.algorithm;
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++) {
+        if (!a[i].same_as(b[i])) {
+            return false;
+        }
+    }
+
+    FuncValueBounds inputs = bounds_of_callees(f, fb);
+    if (inputs.size() != entry->second.inputs.size()) {
+        return false;
+    }
+    for (auto i = inputs.cbegin(), j = entry->second.inputs.cbegin(); i != inputs.end(); ++i, ++j) {
+        if (i->first != j->first || !same_interval(i->second, j->second)) {
+            return false;
+        }
+    }
+
+    *result = entry->second.bounds;
+    return true;
+}
+
+void FuncValueBoundsCache::insert(const Function &f, const FuncValueBounds &fb, const vector<Interval> &result) {
+    auto alg = algorithm.find(f.name());
+    if (alg == algorithm.end()) {
+        // Made during lowering, so there's nothing to identify it by
+        // next time.
+        return;
+    }
+    Entry &entry = entries[f.name()];
+    entry.algorithm = alg->second;
+    entry.inputs = bounds_of_callees(f, fb);
+    entry.bounds = result;
+}
+
 FuncValueBounds compute_function_value_bounds(const vector<string> &order,
-                                              const map<string, Function> &env) {
+                                              const map<string, Function> &env,
+                                              FuncValueBoundsCache *cache) {
     FuncValueBounds fb;
 
     for (size_t i = 0; i < order.size(); i++) {
         Function f = env.find(order[i])->second;
+
+        vector<Interval> cached;
+        if (cache && f.is_pure() && cache->lookup(f, fb, &cached)) {
+            debug(2) << "Reusing bounds on values of func " << order[i] << "\n";
+            for (int j = 0; j < f.outputs(); j++) {
+                fb[make_pair(f.name(), j)] = cached[j];
+            }
+            continue;
+        }
+
         const vector<string> f_args = f.args();
         for (int j = 0; j < f.outputs(); j++) {
             pair<string, int> key = make_pair(f.name(), j);
@@ -1474,6 +1572,14 @@ FuncValueBounds compute_function_value_bounds(const vector<string> &order,
                      << " for func " << order[i]
                      << " are: " << result.min << ", " << result.max << "\n";
         }
+
+        if (cache && f.is_pure()) {
+            vector<Interval> result;
+            for (int j = 0; j < f.outputs(); j++) {
+                result.push_back(fb[make_pair(f.name(), j)]);
+            }
+            cache->insert(f, fb, result);
+        }
     }
 
     return fb;
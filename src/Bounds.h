@@ -139,10 +139,42 @@ Box box_touched(Stmt s, std::string fn,
                 const FuncValueBounds &func_bounds = FuncValueBounds());
 // @}
 
+/** The value bounds of each Function computed by a previous
+ * compilation, kept so that recompiling a pipeline after changing
+ * only its schedule doesn't recompute them. An entry is reused when
+ * the Function's definition is the same one the user wrote last time
+ * and the value bounds of everything it calls are unchanged. */
+class FuncValueBoundsCache {
+    struct Entry {
+        // The user's definition, compared by identity.
+        std::vector<Expr> algorithm;
+        // The value bounds of the called Functions the result depends on.
+        FuncValueBounds inputs;
+        std::vector<Interval> bounds;
+    };
+    std::map<std::string, Entry> entries;
+    std::map<std::string, std::vector<Expr>> algorithm;
+
+public:
+    /** Record the definitions of a pipeline's Functions, before
+     * lowering makes copies of them. Drops entries for Functions no
+     * longer in the pipeline. */
+    void set_algorithm(const std::map<std::string, Function> &env);
+
+    /** Look up the value bounds of a pure Function, given the value
+     * bounds of the Functions before it in the realization order. */
+    bool lookup(const Function &f, const FuncValueBounds &fb, std::vector<Interval> *result) const;
+
+    /** Remember the value bounds just computed for a pure Function. */
+    void insert(const Function &f, const FuncValueBounds &fb, const std::vector<Interval> &result);
+};
+
 /** Compute the maximum and minimum possible value for each function
- * in an environment. */
+ * in an environment. If a cache is given, reuse the bounds of
+ * Functions whose definitions haven't changed since it was filled. */
 FuncValueBounds compute_function_value_bounds(const std::vector<std::string> &order,
-                                              const std::map<std::string, Function> &env);
+                                              const std::map<std::string, Function> &env,
+                                              FuncValueBoundsCache *cache = nullptr);
 
 EXPORT void bounds_test();
 
@@ -9,6 +9,7 @@
 #include "Var.h"
 #include "Lerp.h"
 #include "Simplify.h"
+#include "Deinterleave.h"
 
 namespace Halide {
 namespace Internal {
@@ -65,6 +66,7 @@ const string globals =
     "int halide_start_clock(void *ctx);\n"
     "int64_t halide_current_time_ns(void *ctx);\n"
     "void halide_profiler_pipeline_end(void *, void *);\n"
+    "void halide_semaphore_close(void *, void *);\n"
     "}\n"
     "\n"
 
@@ -168,6 +170,125 @@ const string globals =
     "\n";
 }
 
+namespace {
+// Support code for vector types, which use the GCC/Clang vector
+// extensions. Only emitted for modules that contain vector code.
+// Operations that map directly onto the vector extensions are
+// emitted as plain operators; everything else goes through these
+// helpers, most of which are simple loops over the lanes that the C
+// compiler turns into vector code.
+const string vector_helpers =
+    "#if !defined(__GNUC__) && !defined(__clang__)\n"
+    "#error \"Vector code emitted by the Halide C backend requires GCC or Clang\"\n"
+    "#endif\n"
+    // GCC warns that passing vectors wider than the target's
+    // registers changes the ABI. The helpers are all inline, so
+    // this doesn't matter.
+    "#if !defined(__clang__)\n"
+    "#pragma GCC diagnostic ignored \"-Wpsabi\"\n"
+    "#endif\n"
+    "template<typename To, typename From> struct halide_vector_converter {\n"
+    " static To convert(const From &v) {\n"
+    "  To r;\n"
+    "  for (size_t i = 0; i < sizeof(r) / sizeof(r[0]); i++) r[i] = v[i];\n"
+    "  return r;\n"
+    " }\n"
+    "};\n"
+    "template<typename T> struct halide_vector_converter<T, T> {\n"
+    " static T convert(const T &v) {return v;}\n"
+    "};\n"
+    "template<typename To, typename From> inline To halide_vector_convert(const From &v) {\n"
+    " return halide_vector_converter<To, From>::convert(v);\n"
+    "}\n"
+    "template<typename V, typename T> inline V halide_vector_broadcast(T s) {\n"
+    " V r;\n"
+    " for (size_t i = 0; i < sizeof(r) / sizeof(r[0]); i++) r[i] = s;\n"
+    " return r;\n"
+    "}\n"
+    "template<typename V, typename T> inline V halide_vector_ramp(T base, T stride) {\n"
+    " V r;\n"
+    " for (size_t i = 0; i < sizeof(r) / sizeof(r[0]); i++) r[i] = base + (T)i * stride;\n"
+    " return r;\n"
+    "}\n"
+    "template<typename V, typename T> inline V halide_vector_load(const T *p) {\n"
+    " V r;\n"
+    " memcpy(&r, p, sizeof(r));\n"
+    " return r;\n"
+    "}\n"
+    "template<typename V, typename T> inline void halide_vector_store(T *p, const V &v) {\n"
+    " memcpy(p, &v, sizeof(v));\n"
+    "}\n"
+    "template<typename V, typename T, typename I> inline V halide_vector_gather(const T *p, const I &idx) {\n"
+    " V r;\n"
+    " for (size_t i = 0; i < sizeof(r) / sizeof(r[0]); i++) r[i] = p[idx[i]];\n"
+    " return r;\n"
+    "}\n"
+    "template<typename V, typename T, typename I, typename M> inline V halide_vector_gather(const T *p, const I &idx, const M &pred) {\n"
+    " V r = {};\n"
+    " for (size_t i = 0; i < sizeof(r) / sizeof(r[0]); i++) if (pred[i]) r[i] = p[idx[i]];\n"
+    " return r;\n"
+    "}\n"
+    "template<typename T, typename I, typename V> inline void halide_vector_scatter(T *p, const I &idx, const V &v) {\n"
+    " for (size_t i = 0; i < sizeof(v) / sizeof(v[0]); i++) p[idx[i]] = v[i];\n"
+    "}\n"
+    "template<typename T, typename I, typename V, typename M> inline void halide_vector_scatter(T *p, const I &idx, const V &v, const M &pred) {\n"
+    " for (size_t i = 0; i < sizeof(v) / sizeof(v[0]); i++) if (pred[i]) p[idx[i]] = v[i];\n"
+    "}\n"
+    // Vectors of bools are masks of 0 or -1 in each lane, as produced
+    // by comparisons, so their lanes can have any width.
+    "template<typename M, typename V> inline V halide_vector_select(const M &m, const V &a, const V &b) {\n"
+    " typedef decltype(a < a) W;\n"
+    " W mask = halide_vector_convert<W>(m), ai, bi;\n"
+    " memcpy(&ai, &a, sizeof(a));\n"
+    " memcpy(&bi, &b, sizeof(b));\n"
+    " W ri = (ai & mask) | (bi & ~mask);\n"
+    " V r;\n"
+    " memcpy(&r, &ri, sizeof(r));\n"
+    " return r;\n"
+    "}\n"
+    "template<typename A, typename B> inline A halide_vector_and(const A &a, const B &b) {\n"
+    " return a & halide_vector_convert<A>(b);\n"
+    "}\n"
+    "template<typename A, typename B> inline A halide_vector_or(const A &a, const B &b) {\n"
+    " return a | halide_vector_convert<A>(b);\n"
+    "}\n";
+
+// The name of the typedef for a vector type.
+string vector_type_name(Type type) {
+    internal_assert(type.is_vector());
+    ostringstream oss;
+    oss << "halide_";
+    if (type.is_bool()) {
+        oss << "bool";
+    } else if (type.is_float()) {
+        oss << (type.bits() == 32 ? "float" : "double");
+    } else {
+        oss << (type.is_uint() ? "uint" : "int") << type.bits();
+    }
+    oss << "x" << type.lanes() << "_t";
+    return oss.str();
+}
+
+// Find all the vector types used in some code.
+class VectorTypesUsed : public IRGraphVisitor {
+    using IRGraphVisitor::include;
+
+    void include(const Expr &e) {
+        if (e.type().is_vector()) {
+            typedefs[vector_type_name(e.type())] = e.type();
+            // The bool type with the same number of lanes is used
+            // for the results of comparisons and selects.
+            Type mask = Bool(e.type().lanes());
+            typedefs[vector_type_name(mask)] = mask;
+        }
+        IRGraphVisitor::include(e);
+    }
+
+public:
+    std::map<string, Type> typedefs;
+};
+}
+
 CodeGen_C::CodeGen_C(ostream &s, OutputKind output_kind, const std::string &guard) : IRPrinter(s), id("$$ BAD ID $$"), output_kind(output_kind), extern_c_open(false) {
     if (is_header()) {
         // If it's a header, emit an include guard.
@@ -209,8 +330,10 @@ namespace {
 string type_to_c_type(Type type, bool include_space, bool c_plus_plus = true) {
     bool needs_space = true;
     ostringstream oss;
-    user_assert(type.lanes() == 1) << "Can't use vector types when compiling to C (yet)\n";
-    if (type.is_float()) {
+    if (type.is_vector()) {
+        user_assert(!type.is_handle()) << "Can't use vectors of handles when compiling to C\n";
+        oss << vector_type_name(type);
+    } else if (type.is_float()) {
         if (type.bits() == 32) {
             oss << "float";
         } else if (type.bits() == 64) {
@@ -365,7 +488,9 @@ class ExternCallPrototypes : public IRGraphVisitor {
     }
 
     void emit_function_decl(ostream &stream, const Call *op, const std::string &name) {
-        stream << type_to_c_type(op->type, true) << " " << name << "(";
+        // Calls to vector versions of extern functions are emitted as
+        // calls to the scalar version for each lane.
+        stream << type_to_c_type(op->type.element_of(), true) << " " << name << "(";
         if (function_takes_user_context(name)) {
             stream << "void *";
             if (!op->args.empty()) {
@@ -379,7 +504,7 @@ class ExternCallPrototypes : public IRGraphVisitor {
             if (op->args[i].as<StringImm>()) {
                 stream << "const char *";
             } else {
-              stream << type_to_c_type(op->args[i].type(), true);
+              stream << type_to_c_type(op->args[i].type().element_of(), true);
             }
         }
         stream << ");\n";
@@ -446,6 +571,25 @@ public:
 }
 
 void CodeGen_C::compile(const Module &input) {
+    if (!is_header()) {
+        VectorTypesUsed v;
+        for (const auto &f : input.functions()) {
+            f.body.accept(&v);
+        }
+        if (!v.typedefs.empty()) {
+            stream << vector_helpers;
+            for (const auto &t : v.typedefs) {
+                Type elem = t.second.element_of();
+                // Lanes of bool vectors are stored as bytes.
+                int bytes = t.second.lanes() * (elem.is_bool() ? 1 : elem.bytes());
+                user_assert((bytes & (bytes - 1)) == 0)
+                    << "Can't emit a vector of type " << t.second
+                    << " to C, because its size in bytes is not a power of two.\n";
+                stream << "typedef " << type_to_c_type(elem.is_bool() ? Int(8) : elem, true)
+                       << t.first << " __attribute__((vector_size(" << bytes << ")));\n";
+            }
+        }
+    }
     for (const auto &b : input.buffers()) {
         compile(b);
     }
@@ -737,6 +881,14 @@ string CodeGen_C::print_expr(Expr e) {
     return id;
 }
 
+string CodeGen_C::print_expr_with_mask_type(Expr e) {
+    string id = print_expr(e);
+    if (e.type().is_vector() && e.type().is_bool()) {
+        id = "halide_vector_convert<" + print_type(e.type()) + ">(" + id + ")";
+    }
+    return id;
+}
+
 void CodeGen_C::print_stmt(Stmt s) {
     s.accept(this);
 }
@@ -748,7 +900,14 @@ string CodeGen_C::print_assignment(Type t, const std::string &rhs) {
     if (cached == cache.end()) {
         id = unique_name('_');
         do_indent();
-        stream << print_type(t, AppendSpace) << id << " = " << rhs << ";\n";
+        if (t.is_vector() && t.is_bool()) {
+            // The lanes of a vector of bools have the width of
+            // whatever was compared to make it.
+            stream << "auto ";
+        } else {
+            stream << print_type(t, AppendSpace);
+        }
+        stream << id << " = " << rhs << ";\n";
         cache[rhs] = id;
     } else {
         id = cached->second;
@@ -779,7 +938,18 @@ void CodeGen_C::visit(const Variable *op) {
 }
 
 void CodeGen_C::visit(const Cast *op) {
-    print_assignment(op->type, "(" + print_type(op->type) + ")(" + print_expr(op->value) + ")");
+    if (op->type.is_vector()) {
+        if (op->type.is_bool()) {
+            print_expr(op->value != make_zero(op->value.type()));
+        } else if (op->value.type().is_bool()) {
+            // Masks are 0 or -1 in each lane.
+            print_assignment(op->type, "halide_vector_convert<" + print_type(op->type) + ">(-" + print_expr(op->value) + ")");
+        } else {
+            print_assignment(op->type, "halide_vector_convert<" + print_type(op->type) + ">(" + print_expr(op->value) + ")");
+        }
+    } else {
+        print_assignment(op->type, "(" + print_type(op->type) + ")(" + print_expr(op->value) + ")");
+    }
 }
 
 void CodeGen_C::visit_binop(Type t, Expr a, Expr b, const char * op) {
@@ -804,7 +974,12 @@ void CodeGen_C::visit(const Div *op) {
     int bits;
     if (is_const_power_of_two_integer(op->b, &bits)) {
         ostringstream oss;
-        oss << print_expr(op->a) << " >> " << bits;
+        oss << print_expr(op->a) << " >> ";
+        if (op->type.is_vector()) {
+            oss << print_expr(make_const(op->type, bits));
+        } else {
+            oss << bits;
+        }
         print_assignment(op->type, oss.str());
     } else if (op->type.is_int()) {
         print_expr(lower_euclidean_div(op->a, op->b));
@@ -817,7 +992,12 @@ void CodeGen_C::visit(const Mod *op) {
     int bits;
     if (is_const_power_of_two_integer(op->b, &bits)) {
         ostringstream oss;
-        oss << print_expr(op->a) << " & " << ((1 << bits)-1);
+        oss << print_expr(op->a) << " & ";
+        if (op->type.is_vector()) {
+            oss << print_expr(make_const(op->type, (1 << bits)-1));
+        } else {
+            oss << ((1 << bits)-1);
+        }
         print_assignment(op->type, oss.str());
     } else if (op->type.is_int()) {
         print_expr(lower_euclidean_mod(op->a, op->b));
@@ -827,11 +1007,19 @@ void CodeGen_C::visit(const Mod *op) {
 }
 
 void CodeGen_C::visit(const Max *op) {
-    print_expr(Call::make(op->type, "max", {op->a, op->b}, Call::Extern));
+    if (op->type.is_vector()) {
+        print_expr(Select::make(op->a > op->b, op->a, op->b));
+    } else {
+        print_expr(Call::make(op->type, "max", {op->a, op->b}, Call::Extern));
+    }
 }
 
 void CodeGen_C::visit(const Min *op) {
-    print_expr(Call::make(op->type, "min", {op->a, op->b}, Call::Extern));
+    if (op->type.is_vector()) {
+        print_expr(Select::make(op->a < op->b, op->a, op->b));
+    } else {
+        print_expr(Call::make(op->type, "min", {op->a, op->b}, Call::Extern));
+    }
 }
 
 void CodeGen_C::visit(const EQ *op) {
@@ -859,15 +1047,31 @@ void CodeGen_C::visit(const GE *op) {
 }
 
 void CodeGen_C::visit(const Or *op) {
-    visit_binop(op->type, op->a, op->b, "||");
+    if (op->type.is_vector()) {
+        string a = print_expr(op->a);
+        string b = print_expr(op->b);
+        print_assignment(op->type, "halide_vector_or(" + a + ", " + b + ")");
+    } else {
+        visit_binop(op->type, op->a, op->b, "||");
+    }
 }
 
 void CodeGen_C::visit(const And *op) {
-    visit_binop(op->type, op->a, op->b, "&&");
+    if (op->type.is_vector()) {
+        string a = print_expr(op->a);
+        string b = print_expr(op->b);
+        print_assignment(op->type, "halide_vector_and(" + a + ", " + b + ")");
+    } else {
+        visit_binop(op->type, op->a, op->b, "&&");
+    }
 }
 
 void CodeGen_C::visit(const Not *op) {
-    print_assignment(op->type, "!(" + print_expr(op->a) + ")");
+    if (op->type.is_vector()) {
+        print_assignment(op->type, "~" + print_expr(op->a));
+    } else {
+        print_assignment(op->type, "!(" + print_expr(op->a) + ")");
+    }
 }
 
 void CodeGen_C::visit(const IntImm *op) {
@@ -1015,22 +1219,40 @@ void CodeGen_C::visit(const Call *op) {
         stream << print_type(op->args[1].type(), AppendSpace)
                << result_id << ";\n";
 
-        string cond_id = print_expr(op->args[0]);
+        Expr cond = op->args[0];
+        if (const Broadcast *b = cond.as<Broadcast>()) {
+            cond = b->value;
+        }
+        if (cond.type().is_vector()) {
+            // Evaluate each lane separately, so that the values are
+            // still only computed where the condition holds.
+            for (int i = 0; i < op->type.lanes(); i++) {
+                string lane = print_expr(extract_lane(op, i));
+                do_indent();
+                stream << result_id << "[" << i << "] = ";
+                if (op->type.is_bool()) {
+                    stream << "-(int8_t)";
+                }
+                stream << lane << ";\n";
+            }
+        } else {
+            string cond_id = print_expr(cond);
 
-        do_indent();
-        stream << "if (" << cond_id << ")\n";
-        open_scope();
-        string true_case = print_expr(op->args[1]);
-        do_indent();
-        stream << result_id << " = " << true_case << ";\n";
-        close_scope("if " + cond_id);
-        do_indent();
-        stream << "else\n";
-        open_scope();
-        string false_case = print_expr(op->args[2]);
-        do_indent();
-        stream << result_id << " = " << false_case << ";\n";
-        close_scope("if " + cond_id + " else");
+            do_indent();
+            stream << "if (" << cond_id << ")\n";
+            open_scope();
+            string true_case = print_expr_with_mask_type(op->args[1]);
+            do_indent();
+            stream << result_id << " = " << true_case << ";\n";
+            close_scope("if " + cond_id);
+            do_indent();
+            stream << "else\n";
+            open_scope();
+            string false_case = print_expr_with_mask_type(op->args[2]);
+            do_indent();
+            stream << result_id << " = " << false_case << ";\n";
+            close_scope("if " + cond_id + " else");
+        }
 
         rhs << result_id;
     } else if (op->is_intrinsic(Call::abs)) {
@@ -1166,6 +1388,35 @@ void CodeGen_C::visit(const Call *op) {
                op->call_type == Call::PureIntrinsic) {
         // TODO: other intrinsics
         internal_error << "Unhandled intrinsic in C backend: " << op->name << '\n';
+    } else if (op->type.is_vector()) {
+        // Call the scalar version of the function for each lane.
+        vector<string> args(op->args.size());
+        for (size_t i = 0; i < op->args.size(); i++) {
+            args[i] = print_expr(op->args[i]);
+        }
+        string result_id = unique_name('_');
+        string lane = unique_name('i');
+        do_indent();
+        stream << print_type(op->type, AppendSpace) << result_id << ";\n";
+        do_indent();
+        stream << "for (int " << lane << " = 0; " << lane << " < " << op->type.lanes() << "; " << lane << "++) "
+               << result_id << "[" << lane << "] = ";
+        if (op->type.is_bool()) {
+            stream << "-(int8_t)";
+        }
+        stream << op->name << "(";
+        if (function_takes_user_context(op->name)) {
+            stream << (have_user_context ? "__user_context_, " : "nullptr, ");
+        }
+        for (size_t i = 0; i < op->args.size(); i++) {
+            if (i > 0) stream << ", ";
+            stream << args[i];
+            if (op->args[i].type().is_vector()) {
+                stream << "[" << lane << "]";
+            }
+        }
+        stream << ");\n";
+        rhs << result_id;
     } else {
         // Generic calls
         vector<string> args(op->args.size());
@@ -1189,6 +1440,34 @@ void CodeGen_C::visit(const Call *op) {
 }
 
 void CodeGen_C::visit(const Load *op) {
+    if (op->type.is_vector()) {
+        Type t = op->type.element_of();
+        string ptr = print_name(op->name);
+        if (!allocations.contains(op->name) || allocations.get(op->name).type != t) {
+            ptr = "((const " + print_type(t) + " *)" + ptr + ")";
+        }
+
+        const Ramp *ramp = op->index.as<Ramp>();
+        string vec_type = print_type(op->type);
+        ostringstream rhs;
+        if (ramp && is_one(ramp->stride) && is_one(op->predicate) && !t.is_bool()) {
+            string base = print_expr(ramp->base);
+            rhs << "halide_vector_load<" << vec_type << ">(" << ptr << " + " << base << ")";
+        } else {
+            // Fall back to loading each lane separately.
+            string index = print_expr(op->index);
+            if (t.is_bool()) {
+                rhs << "-";
+            }
+            rhs << "halide_vector_gather<" << vec_type << ">(" << ptr << ", " << index;
+            if (!is_one(op->predicate)) {
+                rhs << ", " << print_expr(op->predicate);
+            }
+            rhs << ")";
+        }
+        print_assignment(op->type, rhs.str());
+        return;
+    }
 
     Type t = op->type;
     bool type_cast_needed =
@@ -1216,6 +1495,33 @@ void CodeGen_C::visit(const Store *op) {
 
     Type t = op->value.type();
 
+    if (t.is_vector()) {
+        Type elem = t.element_of();
+        string ptr = print_name(op->name);
+        if (!allocations.contains(op->name) || allocations.get(op->name).type != elem) {
+            ptr = "((" + print_type(elem) + " *)" + ptr + ")";
+        }
+
+        const Ramp *ramp = op->index.as<Ramp>();
+        string id_value = print_expr(op->value);
+        if (ramp && is_one(ramp->stride) && is_one(op->predicate) && !elem.is_bool()) {
+            string base = print_expr(ramp->base);
+            do_indent();
+            stream << "halide_vector_store(" << ptr << " + " << base << ", " << id_value << ");\n";
+        } else {
+            // Fall back to storing each lane separately.
+            string index = print_expr(op->index);
+            string predicate;
+            if (!is_one(op->predicate)) {
+                predicate = ", " + print_expr(op->predicate);
+            }
+            do_indent();
+            stream << "halide_vector_scatter(" << ptr << ", " << index << ", " << id_value << predicate << ");\n";
+        }
+        cache.clear();
+        return;
+    }
+
     bool type_cast_needed =
         t.is_handle() ||
         !allocations.contains(op->name) ||
@@ -1251,6 +1557,16 @@ void CodeGen_C::visit(const Let *op) {
 }
 
 void CodeGen_C::visit(const Select *op) {
+    if (op->condition.type().is_vector()) {
+        // The two values must have the same type, so convert vectors
+        // of bools made by different comparisons to the same width.
+        string cond = print_expr(op->condition);
+        string true_val = print_expr_with_mask_type(op->true_value);
+        string false_val = print_expr_with_mask_type(op->false_value);
+        print_assignment(op->type, "halide_vector_select(" + cond + ", " + true_val + ", " + false_val + ")");
+        return;
+    }
+
     ostringstream rhs;
     string true_val = print_expr(op->true_value);
     string false_val = print_expr(op->false_value);
@@ -1355,11 +1671,15 @@ void CodeGen_C::visit(const Allocate *op) {
                            << op->name << " is constant but exceeds 2^31 - 1.\n";
             } else {
                 size_id = print_expr(Expr(static_cast<int32_t>(constant_size)));
-                if (can_allocation_fit_on_stack(stack_bytes)) {
-                    on_stack = true;
+                if (op->memory_type == MemoryType::Register) {
+                    validate_register_allocation(op);
                 }
+                on_stack = allocation_goes_on_stack(op->name, op->memory_type, stack_bytes);
             }
         } else {
+            // Asserts if the memory type needs a constant size.
+            allocation_goes_on_stack(op->name, op->memory_type, 0);
+
             // Check that the allocation is not scalar (if it were scalar
             // it would have constant size).
             internal_assert(op->extents.size() > 0);
@@ -1481,8 +1801,62 @@ void CodeGen_C::visit(const Evaluate *op) {
     stream << "(void)" << id << ";\n";
 }
 
+void CodeGen_C::visit(const Ramp *op) {
+    string base = print_expr(op->base);
+    string stride = print_expr(op->stride);
+    print_assignment(op->type, "halide_vector_ramp<" + print_type(op->type) + ">(" + base + ", " + stride + ")");
+}
+
+void CodeGen_C::visit(const Broadcast *op) {
+    string value = print_expr(op->value);
+    if (op->type.is_bool()) {
+        value = "(int8_t)-" + value;
+    }
+    print_assignment(op->type, "halide_vector_broadcast<" + print_type(op->type) + ">(" + value + ")");
+}
+
 void CodeGen_C::visit(const Shuffle *op) {
-    internal_error << "Cannot emit vector code to C\n";
+    // Find the vector and lane each index refers to.
+    vector<string> vectors;
+    vector<int> vector_of_index, lane_of_index;
+    for (const Expr &v : op->vectors) {
+        vectors.push_back(print_expr(v));
+        for (int i = 0; i < v.type().lanes(); i++) {
+            vector_of_index.push_back((int)vectors.size() - 1);
+            lane_of_index.push_back(i);
+        }
+    }
+
+    // Write a lane of the result, as a scalar.
+    auto lane = [&](int index) {
+        const Expr &v = op->vectors[vector_of_index[index]];
+        string result = vectors[vector_of_index[index]];
+        if (v.type().is_vector()) {
+            result += "[" + std::to_string(lane_of_index[index]) + "]";
+            if (v.type().is_bool()) {
+                result = "(" + result + " != 0)";
+            }
+        }
+        return result;
+    };
+
+    if (op->type.is_scalar()) {
+        print_assignment(op->type, lane(op->indices[0]));
+        return;
+    }
+
+    string result_id = unique_name('_');
+    do_indent();
+    stream << print_type(op->type, AppendSpace) << result_id << ";\n";
+    for (size_t i = 0; i < op->indices.size(); i++) {
+        do_indent();
+        stream << result_id << "[" << i << "] = ";
+        if (op->type.is_bool()) {
+            stream << "-(int8_t)";
+        }
+        stream << lane(op->indices[i]) << ";\n";
+    }
+    id = result_id;
 }
 
 void CodeGen_C::test() {
@@ -1498,9 +1872,9 @@ void CodeGen_C::test() {
     Stmt s = Store::make("buf", e, x, Parameter(), const_true());
     s = LetStmt::make("x", beta+1, s);
     s = Block::make(s, Free::make("tmp.stack"));
-    s = Allocate::make("tmp.stack", Int(32), {127}, const_true(), s);
+    s = Allocate::make("tmp.stack", Int(32), MemoryType::Auto, {127}, const_true(), s);
     s = Block::make(s, Free::make("tmp.heap"));
-    s = Allocate::make("tmp.heap", Int(32), {43, beta}, const_true(), s);
+    s = Allocate::make("tmp.heap", Int(32), MemoryType::Auto, {43, beta}, const_true(), s);
 
     Module m("", get_host_target());
     m.append(LoweredFunc("test1", args, s, LoweredFunc::External));
@@ -1617,6 +1991,33 @@ void CodeGen_C::test() {
 
     }
 
+    {
+        // Vector code uses the vector extensions of GCC and Clang.
+        Expr ramp = Ramp::make(x * 8, 1, 8);
+        Expr load = Load::make(Int(32, 8), "buf", ramp, Buffer<>(), Parameter(), const_true(8));
+        Expr value = select(load > 0, load * 2, Broadcast::make(beta, 8));
+        Stmt s = Store::make("buf", value, ramp, Parameter(), const_true(8));
+        s = LetStmt::make("x", beta, s);
+
+        Module m("", get_host_target());
+        m.append(LoweredFunc("test2", args, s, LoweredFunc::External));
+
+        ostringstream source;
+        {
+            CodeGen_C cg(source, CodeGen_C::CImplementation);
+            cg.compile(m);
+        }
+        string src = source.str();
+        for (const char *expected : {"typedef int32_t halide_int32x8_t __attribute__((vector_size(32)));\n",
+                                     "typedef int8_t halide_boolx8_t __attribute__((vector_size(8)));\n",
+                                     "halide_vector_load<halide_int32x8_t>(_buf + ",
+                                     "halide_vector_select(",
+                                     "halide_vector_store(_buf + "}) {
+            internal_assert(src.find(expected) != string::npos)
+                << "Vector source code does not contain: " << expected << "\n"
+                << "Actual source code:\n" << src;
+        }
+    }
 
     std::cout << "CodeGen_C test passed\n";
 }
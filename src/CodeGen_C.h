@@ -65,6 +65,12 @@ protected:
      * resulting var */
     std::string print_expr(Expr);
 
+    /** Emit an expression as an assignment, then return the id of the
+     * resulting var. Vectors of bools are converted to the type's
+     * typedef, rather than having lanes as wide as whatever was
+     * compared to make them. */
+    std::string print_expr_with_mask_type(Expr);
+
     /** Emit a statement */
     void print_stmt(Stmt);
 
@@ -178,6 +184,8 @@ protected:
     void visit(const Realize *);
     void visit(const IfThenElse *);
     void visit(const Evaluate *);
+    void visit(const Ramp *);
+    void visit(const Broadcast *);
     void visit(const Shuffle *);
 
     void visit_binop(Type t, Expr a, Expr b, const char *op);
@@ -1,4 +1,5 @@
 #include <iostream>
+#include <mutex>
 #include <sstream>
 
 #include "LLVM_Headers.h"
@@ -51,6 +52,9 @@ CodeGen_Hexagon::CodeGen_Hexagon(Target t) : CodeGen_Posix(t) {
 std::unique_ptr<llvm::Module> CodeGen_Hexagon::compile(const Module &module) {
     auto llvm_module = CodeGen_Posix::compile(module);
     static bool options_processed = false;
+    // Modules for different targets may be compiled concurrently.
+    static std::mutex options_mutex;
+    std::lock_guard<std::mutex> lock(options_mutex);
 
     // TODO: This should be set on the module itself, or some other
     // safer way to pass this through to the target specific lowering
@@ -2,6 +2,9 @@
 #include "IROperator.h"
 #include "CSE.h"
 #include "Debug.h"
+#include "IRPrinter.h"
+#include "Simplify.h"
+#include "Substitute.h"
 
 namespace Halide {
 namespace Internal {
@@ -131,6 +134,8 @@ bool function_takes_user_context(const std::string &name) {
         "halide_profiler_pipeline_start",
         "halide_profiler_pipeline_end",
         "halide_profiler_stack_peak_update",
+        "halide_scratch_arena_malloc",
+        "halide_scratch_arena_free",
         "halide_spawn_thread",
         "halide_device_release",
         "halide_start_clock",
@@ -181,6 +186,78 @@ bool can_allocation_fit_on_stack(int64_t size) {
     return (size <= 1024 * 16);
 }
 
+bool allocation_goes_on_stack(const std::string &name, MemoryType memory_type, int64_t constant_bytes) {
+    switch (memory_type) {
+    case MemoryType::Stack:
+    case MemoryType::Register:
+        user_assert(constant_bytes > 0)
+            << "Allocation " << name << " is stored in " << memory_type
+            << ", so its size must be a constant.\n";
+        return true;
+    case MemoryType::Heap:
+    case MemoryType::Arena:
+        return false;
+    case MemoryType::Auto:
+        break;
+    }
+    return constant_bytes > 0 && can_allocation_fit_on_stack(constant_bytes);
+}
+
+namespace {
+
+class ValidateRegisterAllocation : public IRVisitor {
+    const std::string &name;
+
+    // The enclosing lets, innermost last. Indices are usually written
+    // in terms of the mins of loops that have since been unrolled.
+    std::vector<std::pair<std::string, Expr>> lets;
+
+    using IRVisitor::visit;
+
+    void visit(const LetStmt *op) {
+        op->value.accept(this);
+        lets.push_back({op->name, op->value});
+        op->body.accept(this);
+        lets.pop_back();
+    }
+
+    void check_index(Expr index) {
+        for (size_t i = lets.size(); i > 0; i--) {
+            index = substitute(lets[i - 1].first, lets[i - 1].second, index);
+        }
+        index = simplify(index);
+        const Ramp *r = index.as<Ramp>();
+        bool constant = r ? (is_const(r->base) && is_const(r->stride)) : is_const(index);
+        user_assert(constant)
+            << "Allocation " << name << " is stored in registers, but it is accessed at "
+            << "the non-constant index " << index << ". Unroll the loops over it.\n";
+    }
+
+    void visit(const Load *op) {
+        if (op->name == name) {
+            check_index(op->index);
+        }
+        IRVisitor::visit(op);
+    }
+
+    void visit(const Store *op) {
+        if (op->name == name) {
+            check_index(op->index);
+        }
+        IRVisitor::visit(op);
+    }
+
+public:
+    ValidateRegisterAllocation(const std::string &n) : name(n) {}
+};
+
+}  // namespace
+
+void validate_register_allocation(const Allocate *op) {
+    ValidateRegisterAllocation validate(op->name);
+    op->body.accept(&validate);
+}
+
 Expr lower_euclidean_div(Expr a, Expr b) {
     internal_assert(a.type() == b.type());
     // IROperator's div_round_to_zero will replace this with a / b for
@@ -51,6 +51,16 @@ bool function_takes_user_context(const std::string &name);
  * non-positive. */
 bool can_allocation_fit_on_stack(int64_t size);
 
+/** Given the memory type of an allocation, and its size in bytes if
+ * that is a constant (zero otherwise), return True if it goes on the
+ * stack. Asserts if the memory type requires the stack but the size
+ * isn't constant. */
+bool allocation_goes_on_stack(const std::string &name, MemoryType memory_type, int64_t constant_bytes);
+
+/** Assert that every access to an allocation placed in registers
+ * (see MemoryType::Register) is at a constant index. */
+void validate_register_allocation(const Allocate *op);
+
 /** Given a Halide Euclidean division/mod operation, define it in terms of
  * div_round_to_zero or mod_round_to_zero. */
 ///@{
@@ -5,6 +5,7 @@
 
 #include "IRPrinter.h"
 #include "CodeGen_LLVM.h"
+#include "CompileProfile.h"
 #include "CPlusPlusMangle.h"
 #include "IROperator.h"
 #include "Debug.h"
@@ -480,7 +481,9 @@ MangledNames get_mangled_names(const LoweredFunc &f, const Target &target) {
 }  // namespace
 
 std::unique_ptr<llvm::Module> CodeGen_LLVM::compile(const Module &input) {
+    CompilePassTimer pass_timer;
     init_module();
+    pass_timer.end_pass("llvm runtime linking");
 
     debug(1) << "Target triple of initial module: " << module->getTargetTriple() << "\n";
 
@@ -534,6 +537,7 @@ std::unique_ptr<llvm::Module> CodeGen_LLVM::compile(const Module &input) {
     // Verify the module is ok
     verifyModule(*module);
     debug(2) << "Done generating llvm bitcode\n";
+    pass_timer.end_pass("llvm ir generation");
 
     // Optimize
     CodeGen_LLVM::optimize_module();
@@ -978,12 +982,15 @@ void CodeGen_LLVM::optimize_module() {
     b.populateModulePassManager(module_pass_manager);
 
     // Run optimization passes
+    CompilePassTimer pass_timer;
     function_pass_manager.doInitialization();
     for (llvm::Module::iterator i = module->begin(); i != module->end(); i++) {
         function_pass_manager.run(*i);
     }
     function_pass_manager.doFinalization();
+    pass_timer.end_pass("llvm function passes");
     module_pass_manager.run(*module);
+    pass_timer.end_pass("llvm module passes");
 
     debug(3) << "After LLVM optimizations:\n";
     if (debug::debug_level >= 2) {
@@ -80,7 +80,7 @@ int CodeGen_Posix::allocation_padding(Type type) const {
     return type.bytes();
 }
 
-CodeGen_Posix::Allocation CodeGen_Posix::create_allocation(const std::string &name, Type type,
+CodeGen_Posix::Allocation CodeGen_Posix::create_allocation(const std::string &name, Type type, MemoryType memory_type,
                                                            const std::vector<Expr> &extents, Expr condition,
                                                            Expr new_expr, std::string free_function) {
     Value *llvm_size = nullptr;
@@ -93,11 +93,16 @@ CodeGen_Posix::Allocation CodeGen_Posix::create_allocation(const std::string &na
         if (stack_bytes > target.maximum_buffer_size()) {
             const string str_max_size = target.has_feature(Target::LargeBuffers) ? "2^63 - 1" : "2^31 - 1";
             user_error << "Total size for allocation " << name << " is constant but exceeds " << str_max_size << ".";
-        } else if (!can_allocation_fit_on_stack(stack_bytes)) {
+        } else if (new_expr.defined() ||
+                   !allocation_goes_on_stack(name, memory_type, stack_bytes)) {
             stack_bytes = 0;
             llvm_size = codegen(Expr(constant_bytes));
         }
     } else {
+        if (!new_expr.defined()) {
+            // Asserts if the memory type needs a constant size.
+            allocation_goes_on_stack(name, memory_type, 0);
+        }
         llvm_size = codegen_allocation_size(name, type, extents);
     }
 
@@ -259,7 +264,11 @@ void CodeGen_Posix::visit(const Allocate *alloc) {
                    << alloc->name << "\n";
     }
 
-    Allocation allocation = create_allocation(alloc->name, alloc->type,
+    if (alloc->memory_type == MemoryType::Register) {
+        validate_register_allocation(alloc);
+    }
+
+    Allocation allocation = create_allocation(alloc->name, alloc->type, alloc->memory_type,
                                               alloc->extents, alloc->condition,
                                               alloc->new_expr, alloc->free_function);
     sym_push(alloc->name + ".host", allocation.ptr);
@@ -0,0 +1,183 @@
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+#include "CompileProfile.h"
+#include "IRVisitor.h"
+
+namespace Halide {
+
+using std::string;
+using std::vector;
+
+double CompileProfile::total_seconds() const {
+    double total = 0;
+    for (const CompilePassProfile &p : passes) {
+        total += p.seconds;
+    }
+    return total;
+}
+
+string CompileProfile::to_json() const {
+    std::ostringstream json;
+    json << "{\"total_seconds\": " << total_seconds() << ", \"passes\": [";
+    for (size_t i = 0; i < passes.size(); i++) {
+        const CompilePassProfile &p = passes[i];
+        if (i > 0) json << ",";
+        json << "\n  {\"name\": \"";
+        for (char c : p.name) {
+            if (c == '"' || c == '\\') json << '\\';
+            json << c;
+        }
+        json << "\", \"seconds\": " << p.seconds
+             << ", \"peak_memory_bytes\": " << p.peak_memory
+             << ", \"peak_memory_increase_bytes\": " << p.peak_memory_increase
+             << ", \"ir_nodes\": " << p.ir_nodes << "}";
+    }
+    json << "\n]}\n";
+    return json.str();
+}
+
+string CompileProfile::to_text() const {
+    vector<CompilePassProfile> sorted = passes;
+    std::stable_sort(sorted.begin(), sorted.end(),
+                     [](const CompilePassProfile &a, const CompilePassProfile &b) {
+                         return a.seconds > b.seconds;
+                     });
+    double total = total_seconds();
+
+    std::ostringstream text;
+    text << "Compilation took " << total << "s\n"
+         << std::left << std::setw(40) << "pass"
+         << std::right << std::setw(12) << "ms"
+         << std::setw(8) << "%"
+         << std::setw(14) << "peak MB"
+         << std::setw(14) << "+MB"
+         << std::setw(12) << "IR nodes" << "\n";
+    for (const CompilePassProfile &p : sorted) {
+        text << std::left << std::setw(40) << p.name << std::right << std::fixed
+             << std::setw(12) << std::setprecision(3) << p.seconds * 1000
+             << std::setw(8) << std::setprecision(1) << (total > 0 ? 100 * p.seconds / total : 0)
+             << std::setw(14) << std::setprecision(1) << p.peak_memory / (1024.0 * 1024.0)
+             << std::setw(14) << std::setprecision(1) << p.peak_memory_increase / (1024.0 * 1024.0)
+             << std::setw(12);
+        if (p.ir_nodes >= 0) {
+            text << p.ir_nodes;
+        } else {
+            text << "-";
+        }
+        text << "\n";
+    }
+    return text.str();
+}
+
+namespace Internal {
+
+namespace {
+
+// The profile being collected on this thread, if any.
+thread_local CompileProfile *current_profile = nullptr;
+
+uint64_t peak_memory_bytes() {
+#ifdef _WIN32
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#ifdef __APPLE__
+    return (uint64_t)usage.ru_maxrss;
+#else
+    // Linux reports kilobytes.
+    return (uint64_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+class CountIRNodes : public IRGraphVisitor {
+public:
+    using IRGraphVisitor::visit;
+
+    size_t count(const Stmt &s) {
+        if (s.defined()) {
+            include(s);
+        }
+        return visited.size();
+    }
+};
+
+}
+
+CompileProfile *current_compile_profile() {
+    return current_profile;
+}
+
+CompileProfileScope::CompileProfileScope(CompileProfile *dest, bool report)
+    : dest(dest), active(false), report(report) {
+    if (current_profile) {
+        // An enclosing scope is already collecting.
+        return;
+    }
+    size_t env_defined = 0;
+    get_env_variable("HL_COMPILE_PROFILE", env_defined);
+    if (dest || (report && env_defined)) {
+        active = true;
+        current_profile = &profile;
+    }
+}
+
+CompileProfileScope::~CompileProfileScope() {
+    if (!active) return;
+    current_profile = nullptr;
+
+    size_t env_defined = 0;
+    string format = get_env_variable("HL_COMPILE_PROFILE", env_defined);
+    if (report && env_defined && format != "0") {
+        if (format == "json") {
+            std::cerr << profile.to_json();
+        } else {
+            std::cerr << profile.to_text();
+        }
+    }
+    if (dest) {
+        *dest = profile;
+    }
+}
+
+CompilePassTimer::CompilePassTimer()
+    : start(std::chrono::steady_clock::now()), start_peak_memory(0) {
+    if (current_profile) {
+        start_peak_memory = peak_memory_bytes();
+    }
+}
+
+void CompilePassTimer::end_pass(const string &name, const Stmt &s) {
+    if (!current_profile) return;
+    auto end = std::chrono::steady_clock::now();
+    uint64_t end_peak_memory = peak_memory_bytes();
+
+    CompilePassProfile p;
+    p.name = name;
+    p.seconds = std::chrono::duration<double>(end - start).count();
+    p.peak_memory = end_peak_memory;
+    p.peak_memory_increase = end_peak_memory - std::min(start_peak_memory, end_peak_memory);
+    p.ir_nodes = s.defined() ? (int64_t)CountIRNodes().count(s) : -1;
+    current_profile->passes.push_back(p);
+
+    // Don't charge the time spent counting nodes to the next pass.
+    start = std::chrono::steady_clock::now();
+    start_peak_memory = end_peak_memory;
+}
+
+void CompilePassTimer::end_pass(const string &name) {
+    end_pass(name, Stmt());
+}
+
+}
+}
@@ -0,0 +1,100 @@
+#ifndef HALIDE_COMPILE_PROFILE_H
+#define HALIDE_COMPILE_PROFILE_H
+
+/** \file
+ *
+ * Defines a structured record of where time and memory go while
+ * compiling a pipeline, broken down by lowering pass and by phase of
+ * LLVM code generation.
+ */
+
+#include <chrono>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "Expr.h"
+#include "Util.h"
+
+namespace Halide {
+
+/** The cost of one phase of compilation. */
+struct CompilePassProfile {
+    /** The name of the lowering pass or code generation phase. */
+    std::string name;
+
+    /** Wall-clock time spent in the phase. */
+    double seconds;
+
+    /** The peak resident memory of the process at the end of the
+     * phase, and how much the phase raised it, in bytes. Zero on
+     * platforms where this can't be measured. */
+    uint64_t peak_memory, peak_memory_increase;
+
+    /** The number of distinct IR nodes in the statement produced by
+     * the phase, or -1 for phases that don't produce Halide IR. */
+    int64_t ir_nodes;
+};
+
+/** The phases of one compilation, in the order they ran. */
+struct CompileProfile {
+    std::vector<CompilePassProfile> passes;
+
+    EXPORT double total_seconds() const;
+
+    /** Render the profile as a JSON object with a "passes" array. */
+    EXPORT std::string to_json() const;
+
+    /** Render the profile as a table, slowest phases first. */
+    EXPORT std::string to_text() const;
+};
+
+namespace Internal {
+
+/** Collect a CompileProfile for the compilation done on this thread
+ * while the scope is alive. Scopes nest: only the outermost one
+ * collects, so a compile_to_* method and the compile_to_module call
+ * inside it produce a single profile. When the outermost scope ends,
+ * the profile is stored in dest (if non-null), and printed to stderr
+ * if the environment variable HL_COMPILE_PROFILE is set: as JSON if
+ * its value is "json", otherwise as a table. If dest is null and
+ * HL_COMPILE_PROFILE is unset, nothing is collected. */
+class CompileProfileScope {
+    CompileProfile profile;
+    CompileProfile *dest;
+    bool active, report;
+
+public:
+    /** If report is false, the profile is only stored in dest, and
+     * never printed. Used to collect the profile of work handed off
+     * to another thread, which is then merged into the profile of
+     * the thread that handed it off. */
+    EXPORT CompileProfileScope(CompileProfile *dest, bool report = true);
+    EXPORT ~CompileProfileScope();
+};
+
+/** The profile being collected on this thread, if any. */
+EXPORT CompileProfile *current_compile_profile();
+
+/** Times consecutive phases of compilation. Each call to end_pass
+ * records the time since the timer was made or since the previous
+ * call, under the given name, into the profile being collected on
+ * this thread. Does nothing if no profile is being collected. */
+class CompilePassTimer {
+    std::chrono::steady_clock::time_point start;
+    uint64_t start_peak_memory;
+
+public:
+    EXPORT CompilePassTimer();
+
+    /** End a phase that produced the given statement. */
+    EXPORT void end_pass(const std::string &name, const Stmt &s);
+
+    /** End a phase that doesn't produce Halide IR. */
+    EXPORT void end_pass(const std::string &name);
+};
+
+}
+}
+
+#endif
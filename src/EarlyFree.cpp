@@ -183,7 +183,7 @@ class InjectEarlyFrees : public IRMutator {
             inject_marker.inject_device_free = last_use.found_device_malloc;
             stmt = inject_marker.mutate(stmt);
         } else {
-            stmt = Allocate::make(alloc->name, alloc->type, alloc->extents, alloc->condition,
+            stmt = Allocate::make(alloc->name, alloc->type, alloc->memory_type, alloc->extents, alloc->condition,
                                   Block::make(alloc->body, make_free(alloc->name, last_use.found_device_malloc)),
                                   alloc->new_expr);
         }
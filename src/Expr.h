@@ -90,6 +90,14 @@ struct IRNode {
      * often breaks when linking external libraries compiled
      * without it), and we only want it for IR nodes. */
     virtual IRNodeType type_info() const = 0;
+
+    /** IR nodes are created and destroyed in huge numbers during
+     * lowering, so they are allocated from a pool rather than
+     * directly from the heap. See IRArena.h. */
+    // @{
+    EXPORT static void *operator new(size_t size);
+    EXPORT static void operator delete(void *ptr, size_t size);
+    // @}
 };
 
 template<>
@@ -327,6 +335,29 @@ const DeviceAPI all_device_apis[] = {DeviceAPI::None,
                                      DeviceAPI::Metal,
                                      DeviceAPI::Hexagon};
 
+/** An enum describing where the storage of a Func lives. See
+ * Func::store_in. */
+enum class MemoryType {
+    /** Let Halide choose: small allocations of constant size go on
+     * the stack, and everything else on the heap. */
+    Auto,
+
+    /** The stack. The size of the allocation must be a constant. */
+    Stack,
+
+    /** The heap, through halide_malloc and halide_free. */
+    Heap,
+
+    /** Registers. The size of the allocation must be a constant, and
+     * every access to it must be at a constant index once the loops
+     * over it have been unrolled and vectorized. */
+    Register,
+
+    /** The scratch arena of the pipeline, which persists between
+     * calls (see Target::ScratchArena). */
+    Arena
+};
+
 namespace Internal {
 
 /** An enum describing a type of loop traversal. Used in schedules, and in
@@ -272,6 +272,30 @@ const std::string &Stage::name() const {
     return stage_name;
 }
 
+namespace {
+// Is this update definition a commutative and associative reduction
+// into elements that don't depend on its RVars? Each element is then
+// only carried over the RVars, so vectorizing one of them is safe
+// (see vectorize_loops).
+bool is_vectorizable_reduction(const string &stage_name, const Definition &definition) {
+    if (definition.is_init() || definition.values().size() != 1) {
+        return false;
+    }
+    for (const Expr &arg : definition.args()) {
+        for (const ReductionVariable &rv : definition.schedule().rvars()) {
+            if (expr_uses_var(arg, rv.var)) {
+                return false;
+            }
+        }
+    }
+    vector<string> tmp = split_string(stage_name, ".update(");
+    internal_assert(!tmp.empty() && !tmp[0].empty());
+    ProveAssociativityResult prover_result =
+        prove_associativity(tmp[0], definition.args(), definition.values());
+    return prover_result.is_associative && prover_result.is_commutative;
+}
+}
+
 void Stage::set_dim_type(VarOrRVar var, ForType t) {
     bool found = false;
     vector<Dim> &dims = definition.schedule().dims();
@@ -285,7 +309,9 @@ void Stage::set_dim_type(VarOrRVar var, ForType t) {
             if (!dims[i].is_pure() && var.is_rvar &&
                 (t == ForType::Vectorized || t == ForType::Parallel ||
                  t == ForType::GPUBlock || t == ForType::GPUThread)) {
-                user_assert(definition.schedule().allow_race_conditions())
+                bool vector_reduction = (t == ForType::Vectorized &&
+                                         is_vectorizable_reduction(stage_name, definition));
+                user_assert(vector_reduction || definition.schedule().allow_race_conditions())
                     << "In schedule for " << stage_name
                     << ", marking var " << var.name()
                     << " as parallel or vectorized may introduce a race"
@@ -1853,6 +1879,24 @@ Func &Func::memoize() {
     return *this;
 }
 
+Func &Func::async() {
+    invalidate_cache();
+    func.schedule().async() = true;
+    return *this;
+}
+
+Func &Func::loop_carry() {
+    invalidate_cache();
+    func.schedule().loop_carry() = true;
+    return *this;
+}
+
+Func &Func::store_in(MemoryType t) {
+    invalidate_cache();
+    func.schedule().memory_type() = t;
+    return *this;
+}
+
 Stage Func::specialize(Expr c) {
     invalidate_cache();
     return Stage(func.definition(), name(), args(), func.schedule().storage_dims()).specialize(c);
@@ -1928,6 +1972,37 @@ Func &Func::bound(Var var, Expr min, Expr extent) {
     return *this;
 }
 
+Func &Func::estimate(Var var, Expr min, Expr extent) {
+    user_assert(min.defined() && extent.defined())
+        << "Estimate of " << var.name() << " in " << name() << " must have a min and an extent\n";
+    user_assert(Int(32).can_represent(min.type()) && Int(32).can_represent(extent.type()))
+        << "Can't represent estimate of " << var.name() << " in " << name() << " in int32\n";
+
+    bool found = false;
+    for (size_t i = 0; i < func.args().size(); i++) {
+        if (var.name() == func.args()[i]) {
+            found = true;
+        }
+    }
+    user_assert(found)
+        << "Can't provide an estimate for variable " << var.name()
+        << " of function " << name()
+        << " because " << var.name()
+        << " is not one of the pure variables of " << name() << ".\n";
+
+    // A later estimate for the same variable replaces the earlier one.
+    std::vector<Bound> &estimates = func.schedule().estimates();
+    for (size_t i = 0; i < estimates.size(); i++) {
+        if (estimates[i].var == var.name()) {
+            estimates.erase(estimates.begin() + i);
+            break;
+        }
+    }
+    Bound b = {var.name(), cast<int32_t>(min), cast<int32_t>(extent), Expr(), Expr()};
+    estimates.push_back(b);
+    return *this;
+}
+
 Func &Func::bound_extent(Var var, Expr extent) {
     return bound(var, Expr(), extent);
 }
@@ -2319,6 +2394,24 @@ Func &Func::trace_realizations() {
     return *this;
 }
 
+Func &Func::trace_summaries() {
+    invalidate_cache();
+    func.trace_summaries();
+    return *this;
+}
+
+Func &Func::trace_sampled(int every_n) {
+    invalidate_cache();
+    func.trace_sampled(every_n);
+    return *this;
+}
+
+Func &Func::trace_region(const std::vector<std::pair<Expr, Expr>> &region) {
+    invalidate_cache();
+    func.trace_region(region);
+    return *this;
+}
+
 void Func::debug_to_file(const string &filename) {
     invalidate_cache();
     func.debug_file() = filename;
@@ -1114,7 +1114,10 @@ public:
      * task_size. After this call, var refers to the outer dimension of
      * the split. The inner dimension has a new anonymous name. If you
      * wish to mutate it, or schedule with respect to it, do the split
-     * manually. */
+     * manually. The task size is the grain of work the thread pool
+     * schedules; when parallel loops are nested, the number of tasks
+     * each loop produces is what the runtime uses to decide how many
+     * threads to keep awake. */
     EXPORT Func &parallel(VarOrRVar var, Expr task_size, TailStrategy tail = TailStrategy::Auto);
 
     /** Mark a dimension to be computed all-at-once as a single
@@ -1154,6 +1157,13 @@ public:
      * runtime error will occur when you try to run your pipeline. */
     EXPORT Func &bound(Var var, Expr min, Expr extent);
 
+    /** Tell the auto-scheduler the range over which this function is
+     * expected to be evaluated. Unlike bound, this has no effect on
+     * the generated code. Every dimension of every output of a
+     * Pipeline passed to Pipeline::auto_schedule needs an estimate,
+     * and they must be constants. */
+    EXPORT Func &estimate(Var var, Expr min, Expr extent);
+
     /** Expand the region computed so that the min coordinates is
      * congruent to 'remainder' modulo 'modulus', and the extent is a
      * multiple of 'modulus'. For example, f.align_bounds(x, 2) forces
@@ -1730,6 +1740,31 @@ public:
      */
     EXPORT Func &memoize();
 
+    /** Produce this Func on a separate task that runs concurrently
+     * with the code that consumes it, e.g. to overlap a slow extern
+     * stage with the computation downstream of it. The consumer
+     * waits on a semaphore until each iteration of the producer it
+     * needs has completed. If the storage of the Func is folded into
+     * a circular buffer (see Func::store_at and Func::fold_storage),
+     * the producer may run as far ahead of the consumer as the fold
+     * allows. The loops between the store_at and compute_at levels
+     * must be serial. Requires a thread pool that can run at least
+     * two tasks at once.
+     */
+    EXPORT Func &async();
+
+    /** Carry values loaded in one iteration of the innermost serial
+     * loops of this Func to the next iteration in registers, instead
+     * of loading them again. This helps stencils, where each
+     * iteration loads mostly the same values as the previous one
+     * shifted by one. Along the vectorized dimension, overlapping
+     * vector loads are replaced by aligned ones that are rotated
+     * from one iteration to the next. The number of values carried
+     * is limited by how many vector registers the target has. Has no
+     * effect on loops that run on a GPU or on Hexagon.
+     */
+    EXPORT Func &loop_carry();
+
 
     /** Allocate storage for this function within f's loop over
      * var. Scheduling storage is optional, and can be used to
@@ -1840,6 +1875,19 @@ public:
      * outside the outermost loop. */
     EXPORT Func &store_root();
 
+    /** Choose where the storage of this Func lives, instead of letting
+     * Halide choose stack or heap based on its size (see
+     * MemoryType). For example, a small per-tile buffer that is
+     * accessed only at constant indices once the loops over it are
+     * unrolled can be kept in registers, and a large buffer computed
+     * on every call can be taken from the pipeline's scratch arena
+     * instead of being allocated each time. It is an error to place
+     * storage on the stack or in registers if its size isn't a
+     * constant. It is also an error to call this on an output of
+     * the pipeline, as its storage belongs to the caller. Has no
+     * effect on storage inside loops that run on a device. */
+    EXPORT Func &store_in(MemoryType memory_type);
+
     /** Aggressively inline all uses of this function. This is the
      * default schedule, so you're unlikely to need to call this. For
      * a Func with an update definition, that means it gets computed
@@ -1885,6 +1933,27 @@ public:
      * halide_trace. */
     EXPORT Func &trace_realizations();
 
+    /** Trace the realizations and productions of this Func, and at the
+     * end of each production emit a halide_trace_summary event with
+     * the minimum and maximum value stored. Stores made by the tasks
+     * of parallel loops are combined into the same summary. This
+     * costs a min and max per store instead of a call to
+     * halide_trace, so it is cheap enough to leave on in
+     * production. */
+    EXPORT Func &trace_summaries();
+
+    /** Only emit one in every every_n of the loads and stores traced
+     * for this Func. The events kept are chosen by hashing their
+     * coordinates, so the same sites are traced on every run. The
+     * filtering happens in the generated code, so the skipped events
+     * cost no more than a hash. */
+    EXPORT Func &trace_sampled(int every_n);
+
+    /** Only emit traced loads and stores of this Func with
+     * coordinates inside the given region, specified as a min and
+     * extent per dimension. */
+    EXPORT Func &trace_region(const std::vector<std::pair<Expr, Expr>> &region);
+
     /** Get a handle on the internal halide function that this Func
      * represents. Useful if you want to do introspection on Halide
      * functions */
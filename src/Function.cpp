@@ -47,12 +47,18 @@ struct FunctionContents {
     std::string extern_function_name;
     bool extern_is_c_plus_plus;
 
-    bool trace_loads, trace_stores, trace_realizations;
+    bool trace_loads, trace_stores, trace_realizations, trace_summaries;
+
+    // Filters applied to traced loads and stores.
+    int trace_sample_rate;
+    // The min and extent of each dimension.
+    std::vector<std::pair<Expr, Expr>> traced_region;
 
     bool frozen;
 
     FunctionContents() : extern_is_c_plus_plus(false), trace_loads(false),
                          trace_stores(false), trace_realizations(false),
+                         trace_summaries(false), trace_sample_rate(1),
                          frozen(false) {}
 
     void accept(IRVisitor *visitor) const {
@@ -84,6 +90,11 @@ struct FunctionContents {
                 }
             }
         }
+
+        for (const std::pair<Expr, Expr> &r : traced_region) {
+            r.first.accept(visitor);
+            r.second.accept(visitor);
+        }
     }
 
     // Pass an IRMutator through to all Exprs referenced in the FunctionContents
@@ -102,6 +113,11 @@ struct FunctionContents {
                 }
             }
         }
+
+        for (std::pair<Expr, Expr> &r : traced_region) {
+            r.first = mutator->mutate(r.first);
+            r.second = mutator->mutate(r.second);
+        }
     }
 };
 
@@ -308,6 +324,9 @@ void deep_copy_function_contents_helper(const IntrusivePtr<FunctionContents> &sr
     dst->trace_loads = src->trace_loads;
     dst->trace_stores = src->trace_stores;
     dst->trace_realizations = src->trace_realizations;
+    dst->trace_summaries = src->trace_summaries;
+    dst->trace_sample_rate = src->trace_sample_rate;
+    dst->traced_region = src->traced_region;
     dst->frozen = src->frozen;
     dst->output_buffers = src->output_buffers;
 
@@ -836,6 +855,29 @@ bool Function::is_tracing_stores() const {
 bool Function::is_tracing_realizations() const {
     return contents->trace_realizations;
 }
+void Function::trace_summaries() {
+    contents->trace_summaries = true;
+}
+bool Function::is_tracing_summaries() const {
+    return contents->trace_summaries;
+}
+void Function::trace_sampled(int every_n) {
+    user_assert(every_n > 0)
+        << "Func " << name() << " can't trace one in every " << every_n << " events.\n";
+    contents->trace_sample_rate = every_n;
+}
+int Function::trace_sample_rate() const {
+    return contents->trace_sample_rate;
+}
+void Function::trace_region(const std::vector<std::pair<Expr, Expr>> &region) {
+    user_assert(region.size() == (size_t)dimensions())
+        << "Traced region for Func " << name() << " has " << region.size()
+        << " dimensions, but the Func has " << dimensions() << ".\n";
+    contents->traced_region = region;
+}
+const std::vector<std::pair<Expr, Expr>> &Function::traced_region() const {
+    return contents->traced_region;
+}
 
 void Function::freeze() {
     contents->frozen = true;
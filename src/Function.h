@@ -232,6 +232,12 @@ public:
     EXPORT bool is_tracing_loads() const;
     EXPORT bool is_tracing_stores() const;
     EXPORT bool is_tracing_realizations() const;
+    EXPORT void trace_summaries();
+    EXPORT bool is_tracing_summaries() const;
+    EXPORT void trace_sampled(int every_n);
+    EXPORT int trace_sample_rate() const;
+    EXPORT void trace_region(const std::vector<std::pair<Expr, Expr>> &region);
+    EXPORT const std::vector<std::pair<Expr, Expr>> &traced_region() const;
     // @}
 
     /** Mark function as frozen, which means it cannot accept new
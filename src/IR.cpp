@@ -378,7 +378,8 @@ namespace Internal {
         return node;
     }
 
-    Stmt Allocate::make(std::string name, Type type, const std::vector<Expr> &extents,
+    Stmt Allocate::make(std::string name, Type type, MemoryType memory_type,
+                        const std::vector<Expr> &extents,
                         Expr condition, Stmt body,
                         Expr new_expr, std::string free_function) {
         for (size_t i = 0; i < extents.size(); i++) {
@@ -392,6 +393,7 @@ namespace Internal {
         Allocate * node = new Allocate;
         node->name = name;
         node->type = type;
+        node->memory_type = memory_type;
         node->extents = extents;
         node->new_expr = new_expr;
         node->free_function = free_function;
@@ -0,0 +1,207 @@
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "IRArena.h"
+#include "Expr.h"
+
+namespace Halide {
+namespace Internal {
+
+namespace {
+
+// Block sizes are multiples of the granularity. Larger nodes come
+// from the heap.
+const size_t granularity = 16;
+const size_t max_pooled_size = 512;
+const size_t num_size_classes = max_pooled_size / granularity;
+const size_t slab_size = 64 * 1024;
+
+// A thread keeps at most this many free blocks of each size before
+// handing half of them back to the shared pool, so that memory freed
+// on one thread can be reused by another.
+const size_t max_cached_blocks = 4096;
+
+struct FreeBlock {
+    FreeBlock *next;
+};
+
+struct FreeList {
+    FreeBlock *head;
+    size_t count;
+
+    void push(FreeBlock *b) {
+        b->next = head;
+        head = b;
+        count++;
+    }
+
+    FreeBlock *pop() {
+        FreeBlock *b = head;
+        head = b->next;
+        count--;
+        return b;
+    }
+};
+
+// State shared between threads. Deliberately leaked, because nodes
+// can be freed by static destructors that run after ours would.
+struct SharedPool {
+    std::mutex mutex;
+    FreeList free[num_size_classes];
+    // Unused tails of slabs from threads that have exited.
+    std::vector<std::pair<char *, char *>> partial_slabs;
+    std::atomic<size_t> bytes_reserved;
+
+    SharedPool() : free(), bytes_reserved(0) {}
+};
+
+SharedPool &shared_pool() {
+    static SharedPool *pool = new SharedPool;
+    return *pool;
+}
+
+bool pool_enabled() {
+    static bool enabled = []() {
+        size_t defined = 0;
+        std::string value = get_env_variable("HL_IR_ARENA", defined);
+        return !(defined && value == "0");
+    }();
+    return enabled;
+}
+
+// The per-thread part of the pool. This is trivially destructible,
+// so it remains usable even after the thread's destructors have run
+// and it has been flushed.
+struct ThreadCache {
+    FreeList free[num_size_classes];
+    char *slab_next, *slab_end;
+    bool registered, flushed;
+};
+
+thread_local ThreadCache thread_cache;
+
+void flush_thread_cache() {
+    ThreadCache &tc = thread_cache;
+    SharedPool &pool = shared_pool();
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    for (size_t c = 0; c < num_size_classes; c++) {
+        while (tc.free[c].count) {
+            pool.free[c].push(tc.free[c].pop());
+        }
+    }
+    if (tc.slab_next != tc.slab_end) {
+        pool.partial_slabs.emplace_back(tc.slab_next, tc.slab_end);
+    }
+    tc.slab_next = tc.slab_end = nullptr;
+    tc.flushed = true;
+}
+
+// Gives the thread's cached blocks back to the shared pool when the
+// thread exits.
+struct ThreadCacheFlusher {
+    ~ThreadCacheFlusher() {
+        flush_thread_cache();
+    }
+};
+
+void *allocate_slow(ThreadCache &tc, size_t c) {
+    if (!tc.registered) {
+        static thread_local ThreadCacheFlusher flusher;
+        (void)flusher;
+        tc.registered = true;
+    }
+
+    size_t block_size = (c + 1) * granularity;
+    SharedPool &pool = shared_pool();
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        if (tc.flushed) {
+            // We're in a destructor running at thread exit. Don't
+            // cache anything more on this thread.
+            if (pool.free[c].count) {
+                return pool.free[c].pop();
+            }
+            return ::operator new(block_size);
+        }
+
+        // Take some blocks freed by other threads.
+        if (pool.free[c].count) {
+            for (size_t i = 0; i < max_cached_blocks / 2 && pool.free[c].count; i++) {
+                tc.free[c].push(pool.free[c].pop());
+            }
+            return tc.free[c].pop();
+        }
+
+        if ((size_t)(tc.slab_end - tc.slab_next) < block_size && !pool.partial_slabs.empty()) {
+            std::tie(tc.slab_next, tc.slab_end) = pool.partial_slabs.back();
+            pool.partial_slabs.pop_back();
+        }
+    }
+
+    if ((size_t)(tc.slab_end - tc.slab_next) < block_size) {
+        // Waste the tail of the current slab.
+        tc.slab_next = (char *)::operator new(slab_size);
+        tc.slab_end = tc.slab_next + slab_size;
+        pool.bytes_reserved += slab_size;
+    }
+
+    void *result = tc.slab_next;
+    tc.slab_next += block_size;
+    return result;
+}
+
+}  // namespace
+
+void *allocate_ir_node(size_t size) {
+    if (size > max_pooled_size || !pool_enabled()) {
+        return ::operator new(size);
+    }
+    size_t c = (size - 1) / granularity;
+    ThreadCache &tc = thread_cache;
+    if (tc.free[c].count) {
+        return tc.free[c].pop();
+    }
+    return allocate_slow(tc, c);
+}
+
+void free_ir_node(void *ptr, size_t size) {
+    if (size > max_pooled_size || !pool_enabled()) {
+        ::operator delete(ptr);
+        return;
+    }
+    size_t c = (size - 1) / granularity;
+    ThreadCache &tc = thread_cache;
+    if (tc.flushed) {
+        SharedPool &pool = shared_pool();
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        pool.free[c].push((FreeBlock *)ptr);
+        return;
+    }
+    tc.free[c].push((FreeBlock *)ptr);
+    if (tc.free[c].count > max_cached_blocks) {
+        SharedPool &pool = shared_pool();
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        while (tc.free[c].count > max_cached_blocks / 2) {
+            pool.free[c].push(tc.free[c].pop());
+        }
+    }
+}
+
+size_t ir_arena_bytes_reserved() {
+    return shared_pool().bytes_reserved;
+}
+
+void *IRNode::operator new(size_t size) {
+    return allocate_ir_node(size);
+}
+
+void IRNode::operator delete(void *ptr, size_t size) {
+    free_ir_node(ptr, size);
+}
+
+}
+}
@@ -0,0 +1,34 @@
+#ifndef HALIDE_IR_ARENA_H
+#define HALIDE_IR_ARENA_H
+
+/** \file
+ * Defines the allocator used for IR nodes.
+ */
+
+#include <stddef.h>
+
+#include "Util.h"
+
+namespace Halide {
+namespace Internal {
+
+/** Allocate memory for an IR node. Lowering creates and destroys
+ * huge numbers of small, short-lived nodes, so small nodes come from
+ * per-thread free lists of recycled blocks, carved from large slabs,
+ * rather than from the general-purpose heap. Memory in the pool is
+ * reused for new nodes but never returned to the system. Set the
+ * environment variable HL_IR_ARENA=0 to allocate every node with
+ * operator new instead (e.g. to use a memory checker). */
+void *allocate_ir_node(size_t size);
+
+/** Return the memory for an IR node of the given size to the pool. */
+void free_ir_node(void *ptr, size_t size);
+
+/** The number of bytes of slabs the IR node pool has reserved from
+ * the heap so far. */
+EXPORT size_t ir_arena_bytes_reserved();
+
+}
+}
+
+#endif
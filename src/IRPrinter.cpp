@@ -89,6 +89,27 @@ ostream &operator<<(ostream &out, const DeviceAPI &api) {
     return out;
 }
 
+ostream &operator<<(ostream &out, const MemoryType &t) {
+    switch (t) {
+    case MemoryType::Auto:
+        out << "Auto";
+        break;
+    case MemoryType::Stack:
+        out << "Stack";
+        break;
+    case MemoryType::Heap:
+        out << "Heap";
+        break;
+    case MemoryType::Register:
+        out << "Register";
+        break;
+    case MemoryType::Arena:
+        out << "Arena";
+        break;
+    }
+    return out;
+}
+
 namespace Internal {
 
 void IRPrinter::test() {
@@ -115,7 +136,7 @@ void IRPrinter::test() {
                                                          {string("y"), y, 3}, Call::Extern));
     Stmt block = Block::make(assertion, pipeline);
     Stmt let_stmt = LetStmt::make("y", 17, block);
-    Stmt allocate = Allocate::make("buf", f32, {1023}, const_true(), let_stmt);
+    Stmt allocate = Allocate::make("buf", f32, MemoryType::Auto, {1023}, const_true(), let_stmt);
 
     ostringstream source;
     source << allocate;
@@ -564,6 +585,9 @@ void IRPrinter::visit(const Allocate *op) {
         print(op->extents[i]);
     }
     stream << "]";
+    if (op->memory_type != MemoryType::Auto) {
+        stream << " in " << op->memory_type;
+    }
     if (!is_one(op->condition)) {
         stream << " if ";
         print(op->condition);
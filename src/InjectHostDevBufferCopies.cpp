@@ -539,7 +539,7 @@ class InjectBufferCopies : public IRMutator {
         // If this buffer is only ever touched on gpu, nuke the host-side allocation.
         if (!buf_info.host_touched) {
             debug(4) << "Eliding host alloc for " << op->name << "\n";
-            stmt = Allocate::make(op->name, op->type, op->extents, const_false(), op->body);
+            stmt = Allocate::make(op->name, op->type, op->memory_type, op->extents, const_false(), op->body);
         } else if (buf_info.on_single_device &&
                    buf_info.dev_touched) {
             debug(4) << "Making combined host/device alloc for " << op->name << "\n";
@@ -567,7 +567,7 @@ class InjectBufferCopies : public IRMutator {
             // would be possible to keep a map between host pointers
             // and dev ones to facilitate this, but it seems better to
             // just register a destructor with the buffer creation.)
-            inner_body = Allocate::make(op->name, op->type, op->extents, op->condition, inner_body,
+            inner_body = Allocate::make(op->name, op->type, op->memory_type, op->extents, op->condition, inner_body,
                                         Call::make(Handle(), Call::buffer_get_host,
                                                    { Variable::make(type_of<struct buffer_t *>(), op->name + ".buffer") },
                                                    Call::Extern),
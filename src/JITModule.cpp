@@ -1,7 +1,10 @@
 #include <string>
 #include <stdint.h>
+#include <stdio.h>
+#include <fstream>
 #include <mutex>
 #include <set>
+#include <sstream>
 
 #ifndef _WIN32
 #include <sys/mman.h>
@@ -14,7 +17,10 @@
 #include "Debug.h"
 #include "LLVM_Output.h"
 #include "CodeGen_LLVM.h"
+#include "CompileProfile.h"
 #include "Pipeline.h"
+#include "IRPrinter.h"
+#include "Util.h"
 
 
 #ifdef _MSC_VER
@@ -233,6 +239,79 @@ public:
     }
 };
 
+
+// Stores MCJIT's object code for a module in a file, and hands it
+// back instead of generating it again when the file already
+// exists. Files are written under a temporary name and then renamed,
+// so concurrent processes sharing a cache directory never see a
+// partial object.
+class JITObjectCache : public llvm::ObjectCache {
+    string path;
+
+public:
+    JITObjectCache(const string &path) : path(path) {}
+
+    void notifyObjectCompiled(const llvm::Module *, llvm::MemoryBufferRef obj) override {
+        string tmp = path + unique_name('_') + ".tmp";
+        {
+            std::ofstream out(tmp.c_str(), std::ios::binary);
+            out.write(obj.getBufferStart(), obj.getBufferSize());
+            if (!out) {
+                debug(1) << "Could not write JIT cache entry " << tmp << "\n";
+                return;
+            }
+        }
+        if (rename(tmp.c_str(), path.c_str()) != 0) {
+            remove(tmp.c_str());
+        }
+        debug(2) << "Saved JIT object to " << path << "\n";
+    }
+
+    std::unique_ptr<llvm::MemoryBuffer> getObject(const llvm::Module *) override {
+        std::ifstream in(path.c_str(), std::ios::binary);
+        if (!in) {
+            return nullptr;
+        }
+        std::ostringstream contents;
+        contents << in.rdbuf();
+        debug(2) << "Loaded JIT object from " << path << "\n";
+        return llvm::MemoryBuffer::getMemBufferCopy(contents.str(), path);
+    }
+};
+
+// A stable name for the object code generated for a module: a digest
+// of its LLVM bitcode, which holds everything code generation sees
+// (including the types of all arguments and values, constant
+// buffers, and the target), along with the LLVM version doing the
+// code generation and the build of Halide that produced the
+// bitcode. Only computed when there is a cache to look in, as
+// writing out the bitcode isn't free.
+string jit_cache_key(const llvm::Module &module, const LoweredFunc &fn) {
+    size_t cache_dir_defined = 0;
+    string cache_dir = get_env_variable("HL_JIT_CACHE_DIR", cache_dir_defined);
+    if (!cache_dir_defined || cache_dir.empty()) {
+        return string();
+    }
+
+    std::ostringstream key;
+    key << "Halide built " << __DATE__ << " " << __TIME__ << "\n"
+        << "LLVM_VERSION " << LLVM_VERSION << "\n"
+        << "entrypoint " << fn.name << "\n";
+
+    llvm::SmallString<4096> bitcode;
+    llvm::raw_svector_ostream bitcode_stream(bitcode);
+    WriteBitcodeToFile(&module, bitcode_stream);
+
+    llvm::MD5 hash;
+    hash.update(key.str());
+    hash.update(bitcode.str());
+    llvm::MD5::MD5Result result;
+    hash.final(result);
+    llvm::SmallString<32> digest;
+    llvm::MD5::stringifyResult(result, digest);
+    return digest.str().str();
+}
+
 }
 
 JITModule::JITModule() {
@@ -243,15 +322,20 @@ JITModule::JITModule(const Module &m, const LoweredFunc &fn,
                      const std::vector<JITModule> &dependencies) {
     jit_module = new JITModuleContents();
     std::unique_ptr<llvm::Module> llvm_module(compile_module_to_llvm_module(m, jit_module->context));
+    string cache_key = jit_cache_key(*llvm_module, fn);
     std::vector<JITModule> deps_with_runtime = dependencies;
     std::vector<JITModule> shared_runtime = JITSharedRuntime::get(llvm_module.get(), m.target());
     deps_with_runtime.insert(deps_with_runtime.end(), shared_runtime.begin(), shared_runtime.end());
-    compile_module(std::move(llvm_module), fn.name, m.target(), deps_with_runtime);
+    compile_module(std::move(llvm_module), fn.name, m.target(), deps_with_runtime,
+                   std::vector<std::string>(), cache_key);
 }
 
 void JITModule::compile_module(std::unique_ptr<llvm::Module> m, const string &function_name, const Target &target,
                                const std::vector<JITModule> &dependencies,
-                               const std::vector<std::string> &requested_exports) {
+                               const std::vector<std::string> &requested_exports,
+                               const std::string &cache_key) {
+
+    CompilePassTimer pass_timer;
 
     // Ensure that LLVM is initialized
     CodeGen_LLVM::initialize_llvm();
@@ -314,6 +398,19 @@ void JITModule::compile_module(std::unique_ptr<llvm::Module> m, const string &fu
         ee->RegisterJITEventListener(listeners[i]);
     }
 
+    // If there's a cache directory, let MCJIT fetch the object code
+    // from it (or save the object code to it) rather than always
+    // running code generation.
+    std::unique_ptr<JITObjectCache> object_cache;
+    if (!cache_key.empty()) {
+        size_t cache_dir_defined = 0;
+        string cache_dir = get_env_variable("HL_JIT_CACHE_DIR", cache_dir_defined);
+        if (cache_dir_defined && !cache_dir.empty()) {
+            object_cache.reset(new JITObjectCache(cache_dir + "/" + cache_key + ".o"));
+            ee->setObjectCache(object_cache.get());
+        }
+    }
+
     // Retrieve function pointers from the compiled module (which also
     // triggers compilation)
     debug(1) << "JIT compiling " << module_name << "\n";
@@ -336,6 +433,10 @@ void JITModule::compile_module(std::unique_ptr<llvm::Module> m, const string &fu
     debug(2) << "Finalizing object\n";
     ee->finalizeObject();
     memory_manager->work_around_llvm_bugs();
+    if (object_cache) {
+        ee->setObjectCache(nullptr);
+    }
+    pass_timer.end_pass(function_name.empty() ? "llvm jit runtime machine code" : "llvm jit machine code");
 
     // Do any target-specific post-compilation module meddling
     for (size_t i = 0; i < listeners.size(); i++) {
@@ -457,6 +558,43 @@ void JITModule::memoization_cache_set_size(int64_t size) const {
     }
 }
 
+void JITModule::memoization_cache_set_eviction_policy(halide_memoization_eviction_policy_t policy) const {
+    std::map<std::string, Symbol>::const_iterator f =
+        exports().find("halide_memoization_cache_set_eviction_policy");
+    if (f != exports().end()) {
+        return (reinterpret_bits<void (*)(halide_memoization_eviction_policy_t)>(f->second.address))(policy);
+    }
+}
+
+void JITModule::memoization_cache_get_stats(halide_memoization_cache_stats_t *stats) const {
+    std::map<std::string, Symbol>::const_iterator f =
+        exports().find("halide_memoization_cache_get_stats");
+    if (f != exports().end()) {
+        return (reinterpret_bits<void (*)(halide_memoization_cache_stats_t *)>(f->second.address))(stats);
+    }
+    *stats = halide_memoization_cache_stats_t();
+}
+
+int JITModule::memoization_cache_set_persistent_store(const std::string &path, int64_t size) const {
+    std::map<std::string, Symbol>::const_iterator f =
+        exports().find("halide_memoization_cache_set_persistent_store");
+    if (f != exports().end()) {
+        return (reinterpret_bits<int (*)(void *, const char *, int64_t)>(f->second.address))
+            (nullptr, path.empty() ? nullptr : path.c_str(), size);
+    }
+    return -1;
+}
+
+uint64_t JITModule::scratch_arena_required_size(const std::string &pipeline_name) const {
+    std::map<std::string, Symbol>::const_iterator f =
+        exports().find("halide_scratch_arena_required_size");
+    if (f != exports().end()) {
+        return (reinterpret_bits<uint64_t (*)(void *, const char *)>(f->second.address))
+            (nullptr, pipeline_name.c_str());
+    }
+    return 0;
+}
+
 bool JITModule::compiled() const {
   return jit_module->execution_engine != nullptr;
 }
@@ -467,6 +605,7 @@ JITHandlers runtime_internal_handlers;
 JITHandlers default_handlers;
 JITHandlers active_handlers;
 int64_t default_cache_size;
+halide_memoization_eviction_policy_t default_eviction_policy = halide_memoization_evict_lru;
 
 void merge_handlers(JITHandlers &base, const JITHandlers &addins) {
     if (addins.custom_print) {
@@ -744,6 +883,9 @@ JITModule &make_module(llvm::Module *for_module, Target target,
             if (default_cache_size != 0) {
                 runtime.memoization_cache_set_size(default_cache_size);
             }
+            if (default_eviction_policy != halide_memoization_evict_lru) {
+                runtime.memoization_cache_set_eviction_policy(default_eviction_policy);
+            }
 
             runtime.jit_module->name = "MainShared";
         } else {
@@ -862,5 +1004,32 @@ void JITSharedRuntime::memoization_cache_set_size(int64_t size) {
     }
 }
 
+void JITSharedRuntime::memoization_cache_set_eviction_policy(halide_memoization_eviction_policy_t policy) {
+    std::lock_guard<std::mutex> lock(shared_runtimes_mutex);
+
+    if (policy != default_eviction_policy) {
+        default_eviction_policy = policy;
+        shared_runtimes(MainShared).memoization_cache_set_eviction_policy(policy);
+    }
+}
+
+void JITSharedRuntime::memoization_cache_get_stats(halide_memoization_cache_stats_t *stats) {
+    std::lock_guard<std::mutex> lock(shared_runtimes_mutex);
+
+    shared_runtimes(MainShared).memoization_cache_get_stats(stats);
+}
+
+int JITSharedRuntime::memoization_cache_set_persistent_store(const std::string &path, int64_t size) {
+    std::lock_guard<std::mutex> lock(shared_runtimes_mutex);
+
+    return shared_runtimes(MainShared).memoization_cache_set_persistent_store(path, size);
+}
+
+uint64_t JITSharedRuntime::scratch_arena_required_size(const std::string &pipeline_name) {
+    std::lock_guard<std::mutex> lock(shared_runtimes_mutex);
+
+    return shared_runtimes(MainShared).scratch_arena_required_size(pipeline_name);
+}
+
 }
 }
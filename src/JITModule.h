@@ -107,17 +107,26 @@ struct JITModule {
     EXPORT Symbol find_symbol_by_name(const std::string &) const;
 
     /** Take an llvm module and compile it. The requested exports will
-        be available via the exports method. */
+        be available via the exports method. If cache_key is non-empty
+        and the environment variable HL_JIT_CACHE_DIR names a
+        directory, the object code is saved there under that key, and
+        reloaded instead of being regenerated on later calls with the
+        same key (including from other processes). */
     EXPORT void compile_module(std::unique_ptr<llvm::Module> mod,
                                const std::string &function_name, const Target &target,
                                const std::vector<JITModule> &dependencies = std::vector<JITModule>(),
-                               const std::vector<std::string> &requested_exports = std::vector<std::string>());
+                               const std::vector<std::string> &requested_exports = std::vector<std::string>(),
+                               const std::string &cache_key = std::string());
 
     /** Encapsulate device (GPU) and buffer interactions. */
     EXPORT int copy_to_device(struct buffer_t *buf) const;
     EXPORT int copy_to_host(struct buffer_t *buf) const;
     EXPORT int device_free(struct buffer_t *buf) const;
     EXPORT void memoization_cache_set_size(int64_t size) const;
+    EXPORT void memoization_cache_set_eviction_policy(halide_memoization_eviction_policy_t policy) const;
+    EXPORT void memoization_cache_get_stats(halide_memoization_cache_stats_t *stats) const;
+    EXPORT int memoization_cache_set_persistent_store(const std::string &path, int64_t size) const;
+    EXPORT uint64_t scratch_arena_required_size(const std::string &pipeline_name) const;
 
     /** Return true if compile_module has been called on this module. */
     EXPORT bool compiled() const;
@@ -156,6 +165,22 @@ public:
      */
     EXPORT static void memoization_cache_set_size(int64_t size);
 
+    /** Select the eviction policy used by memoization caching. */
+    EXPORT static void memoization_cache_set_eviction_policy(halide_memoization_eviction_policy_t policy);
+
+    /** Get the hit, miss and eviction counters of the memoization
+     * cache used by JIT compiled pipelines. */
+    EXPORT static void memoization_cache_get_stats(halide_memoization_cache_stats_t *stats);
+
+    /** Back the memoization cache with a file shared between
+     * processes. See halide_memoization_cache_set_persistent_store. An
+     * empty path closes the store. Returns 0 on success. */
+    EXPORT static int memoization_cache_set_persistent_store(const std::string &path, int64_t size = 0);
+
+    /** The size in bytes the scratch arena of a JIT compiled pipeline
+     * needs to be. See halide_scratch_arena_required_size. */
+    EXPORT static uint64_t scratch_arena_required_size(const std::string &pipeline_name);
+
     EXPORT static void release_all();
 };
 
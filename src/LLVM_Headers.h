@@ -22,11 +22,13 @@
 #include <llvm/ExecutionEngine/MCJIT.h>
 #include <llvm/ExecutionEngine/SectionMemoryManager.h>
 #include <llvm/ExecutionEngine/JITEventListener.h>
+#include <llvm/ExecutionEngine/ObjectCache.h>
 
 #include <llvm/IR/Verifier.h>
 #include <llvm/Linker/Linker.h>
 #include "llvm/Support/ErrorHandling.h"
 #include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MD5.h>
 #if LLVM_VERSION >= 40
 #include <llvm/Bitcode/BitcodeReader.h>
 #include <llvm/Bitcode/BitcodeWriter.h>
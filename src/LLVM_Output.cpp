@@ -4,6 +4,7 @@
 #include "CodeGen_LLVM.h"
 #include "CodeGen_C.h"
 #include "CodeGen_Internal.h"
+#include "CompileProfile.h"
 
 #include <iostream>
 #include <fstream>
@@ -22,6 +23,7 @@ std::unique_ptr<llvm::raw_fd_ostream> make_raw_fd_ostream(const std::string &fil
 }
 
 void emit_file(llvm::Module &module, Internal::LLVMOStream& out, llvm::TargetMachine::CodeGenFileType file_type) {
+    Internal::CompilePassTimer pass_timer;
     Internal::debug(1) << "emit_file.Compiling to native code...\n";
     Internal::debug(2) << "Target triple: " << module.getTargetTriple() << "\n";
 
@@ -65,6 +67,8 @@ void emit_file(llvm::Module &module, Internal::LLVMOStream& out, llvm::TargetMac
     target_machine->addPassesToEmitFile(pass_manager, out, file_type);
 
     pass_manager.run(module);
+    pass_timer.end_pass(file_type == llvm::TargetMachine::CGFT_ObjectFile ?
+                        "llvm emit object" : "llvm emit assembly");
 }
 
 std::unique_ptr<llvm::Module> compile_module_to_llvm_module(const Module &module, llvm::LLVMContext &context) {
@@ -1,3 +1,6 @@
+#include <map>
+#include <mutex>
+
 #include "LLVM_Runtime_Linker.h"
 #include "LLVM_Headers.h"
 
@@ -89,8 +92,11 @@ DECLARE_CPP_INITMOD(hexagon_host)
 DECLARE_CPP_INITMOD(ios_io)
 DECLARE_CPP_INITMOD(linux_clock)
 DECLARE_CPP_INITMOD(linux_host_cpu_count)
+DECLARE_CPP_INITMOD(linux_memoization_store)
 DECLARE_CPP_INITMOD(linux_opengl_context)
+DECLARE_CPP_INITMOD(linux_perf_counters)
 DECLARE_CPP_INITMOD(matlab)
+DECLARE_CPP_INITMOD(memoization_store_stubs)
 DECLARE_CPP_INITMOD(metadata)
 DECLARE_CPP_INITMOD(mingw_math)
 DECLARE_CPP_INITMOD(module_aot_ref_count)
@@ -105,6 +111,7 @@ DECLARE_CPP_INITMOD(osx_clock)
 DECLARE_CPP_INITMOD(osx_get_symbol)
 DECLARE_CPP_INITMOD(osx_host_cpu_count)
 DECLARE_CPP_INITMOD(osx_opengl_context)
+DECLARE_CPP_INITMOD(perf_counters_stubs)
 DECLARE_CPP_INITMOD(posix_allocator)
 DECLARE_CPP_INITMOD(posix_clock)
 DECLARE_CPP_INITMOD(posix_error_handler)
@@ -118,6 +125,7 @@ DECLARE_CPP_INITMOD(profiler_inlined)
 DECLARE_CPP_INITMOD(qurt_allocator)
 DECLARE_CPP_INITMOD(qurt_hvx)
 DECLARE_CPP_INITMOD(runtime_api)
+DECLARE_CPP_INITMOD(scratch_arena)
 DECLARE_CPP_INITMOD(ssp)
 DECLARE_CPP_INITMOD(thread_pool)
 DECLARE_CPP_INITMOD(to_string)
@@ -591,31 +599,18 @@ void add_underscores_to_posix_calls_on_windows(llvm::Module *m) {
     }
 }
 
-/** Create an llvm module containing the support code for a given target. */
-std::unique_ptr<llvm::Module> get_initial_module_for_target(Target t, llvm::LLVMContext *c, bool for_shared_jit_runtime, bool just_gpu) {
-    enum InitialModuleType {
-        ModuleAOT,
-        ModuleAOTNoRuntime,
-        ModuleJITShared,
-        ModuleJITInlined,
-        ModuleGPU
-    } module_type;
+namespace {
 
-    if (t.has_feature(Target::JIT)) {
-        if (just_gpu) {
-            module_type = ModuleGPU;
-        } else if (for_shared_jit_runtime) {
-            module_type = ModuleJITShared;
-        } else {
-            module_type = ModuleJITInlined;
-        }
-    } else if (t.has_feature(Target::NoRuntime)) {
-        module_type = ModuleAOTNoRuntime;
-    } else {
-        module_type = ModuleAOT;
-    }
+enum InitialModuleType {
+    ModuleAOT,
+    ModuleAOTNoRuntime,
+    ModuleJITShared,
+    ModuleJITInlined,
+    ModuleGPU
+};
 
-    //    Halide::Internal::debug(0) << "Getting initial module type " << (int)module_type << "\n";
+/** Parse and link the runtime modules for a given target. */
+std::unique_ptr<llvm::Module> link_initial_module_for_target(Target t, llvm::LLVMContext *c, InitialModuleType module_type) {
 
     internal_assert(t.bits == 32 || t.bits == 64);
     bool bits_64 = (t.bits == 64);
@@ -724,6 +719,12 @@ std::unique_ptr<llvm::Module> get_initial_module_for_target(Target t, llvm::LLVM
             modules.push_back(get_initmod_tracing(c, bits_64, debug));
             modules.push_back(get_initmod_write_debug_image(c, bits_64, debug));
             modules.push_back(get_initmod_cache(c, bits_64, debug));
+            modules.push_back(get_initmod_scratch_arena(c, bits_64, debug));
+            if (t.os == Target::Linux || t.os == Target::Android) {
+                modules.push_back(get_initmod_linux_memoization_store(c, bits_64, debug));
+            } else {
+                modules.push_back(get_initmod_memoization_store_stubs(c, bits_64, debug));
+            }
             modules.push_back(get_initmod_to_string(c, bits_64, debug));
 
             modules.push_back(get_initmod_device_interface(c, bits_64, debug));
@@ -734,6 +735,11 @@ std::unique_ptr<llvm::Module> get_initial_module_for_target(Target t, llvm::LLVM
             if (t.arch != Target::MIPS && t.os != Target::NoOS) {
                 // MIPS doesn't support the atomics the profiler requires.
                 modules.push_back(get_initmod_profiler(c, bits_64, debug));
+                if ((t.os == Target::Linux || t.os == Target::Android) && t.arch == Target::X86) {
+                    modules.push_back(get_initmod_linux_perf_counters(c, bits_64, debug));
+                } else {
+                    modules.push_back(get_initmod_perf_counters_stubs(c, bits_64, debug));
+                }
             }
 
             if (t.has_feature(Target::MSAN)) {
@@ -889,6 +895,54 @@ std::unique_ptr<llvm::Module> get_initial_module_for_target(Target t, llvm::LLVM
     return std::move(modules[0]);
 }
 
+// Linked runtime modules, serialized as bitcode. Every compilation
+// uses its own LLVMContext, so a module can't be shared between them
+// directly, but parsing one already-linked module is much cheaper
+// than parsing and linking dozens of separate ones.
+std::mutex runtime_cache_mutex;
+std::map<std::pair<std::string, int>, std::string> runtime_cache;
+
+}  // namespace
+
+/** Create an llvm module containing the support code for a given target. */
+std::unique_ptr<llvm::Module> get_initial_module_for_target(Target t, llvm::LLVMContext *c, bool for_shared_jit_runtime, bool just_gpu) {
+    InitialModuleType module_type;
+    if (t.has_feature(Target::JIT)) {
+        if (just_gpu) {
+            module_type = ModuleGPU;
+        } else if (for_shared_jit_runtime) {
+            module_type = ModuleJITShared;
+        } else {
+            module_type = ModuleJITInlined;
+        }
+    } else if (t.has_feature(Target::NoRuntime)) {
+        module_type = ModuleAOTNoRuntime;
+    } else {
+        module_type = ModuleAOT;
+    }
+
+    std::pair<std::string, int> key(t.to_string(), (int)module_type);
+    {
+        std::lock_guard<std::mutex> lock(runtime_cache_mutex);
+        auto it = runtime_cache.find(key);
+        if (it != runtime_cache.end()) {
+            Internal::debug(2) << "Reusing linked runtime for " << key.first << "\n";
+            return parse_bitcode_file(it->second, c, "halide_runtime");
+        }
+    }
+
+    std::unique_ptr<llvm::Module> module = link_initial_module_for_target(t, c, module_type);
+
+    std::string bitcode;
+    llvm::raw_string_ostream out(bitcode);
+    WriteBitcodeToFile(module.get(), out);
+    out.flush();
+
+    std::lock_guard<std::mutex> lock(runtime_cache_mutex);
+    runtime_cache.emplace(key, std::move(bitcode));
+    return module;
+}
+
 #ifdef WITH_PTX
 std::unique_ptr<llvm::Module> get_initial_module_for_ptx_device(Target target, llvm::LLVMContext *c) {
     std::vector<std::unique_ptr<llvm::Module>> modules;
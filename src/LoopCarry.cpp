@@ -6,6 +6,7 @@
 #include "IREquality.h"
 #include "ExprUsesVar.h"
 #include "CSE.h"
+#include "Target.h"
 
 #include <algorithm>
 
@@ -181,6 +182,120 @@ Expr step_forwards(Expr e, const Scope<Expr> &linear) {
     }
 }
 
+/** Rewrite dense vector loads from the same buffer that are offset
+ * from each other by constants, and that advance by a whole vector
+ * per loop iteration (e.g. a stencil along the vectorized dimension
+ * that is wider than the vector), as slices of loads at whole
+ * multiples of the vector width from the leftmost one. Each of those
+ * is one of the previous iteration's shifted down by one, so they form
+ * chains that can be carried, rotating each vector along instead of
+ * reloading overlapping, misaligned ones. */
+class RotateVectorLoads {
+    const Scope<Expr> &linear;
+    const Scope<int> &in_consume;
+
+    struct Group {
+        const Load *leftmost;
+        vector<pair<const Load *, int>> loads;
+    };
+
+public:
+    RotateVectorLoads(const Scope<Expr> &l, const Scope<int> &c) : linear(l), in_consume(c) {}
+
+    Stmt mutate(Stmt s) {
+        FindLoads find_loads;
+        s.accept(&find_loads);
+
+        vector<Group> groups;
+        for (const Load *load : find_loads.result) {
+            const Ramp *ramp = load->index.as<Ramp>();
+            int lanes = load->type.lanes();
+            if (!ramp || !is_one(ramp->stride) || !is_one(load->predicate) ||
+                !(load->image.defined() || load->param.defined() || in_consume.contains(load->name))) {
+                continue;
+            }
+            Expr step = is_linear(ramp->base, linear);
+            if (!step.defined() || !is_const(step, lanes)) {
+                continue;
+            }
+
+            bool grouped = false;
+            for (Group &g : groups) {
+                if (g.leftmost->name != load->name || g.leftmost->type != load->type) continue;
+                Expr delta = simplify(ramp->base - g.leftmost->index.as<Ramp>()->base);
+                const int64_t *offset = as_const_int(delta);
+                if (!offset) continue;
+                if (*offset < 0) {
+                    // This one is the new leftmost.
+                    for (auto &l : g.loads) {
+                        l.second -= (int)*offset;
+                    }
+                    g.leftmost = load;
+                    g.loads.push_back({load, 0});
+                } else {
+                    g.loads.push_back({load, (int)*offset});
+                }
+                grouped = true;
+                break;
+            }
+            if (!grouped) {
+                groups.push_back({load, {{load, 0}}});
+            }
+        }
+
+        for (const Group &g : groups) {
+            int lanes = g.leftmost->type.lanes();
+            int rightmost = 0;
+            for (const auto &l : g.loads) {
+                rightmost = std::max(rightmost, l.second);
+            }
+
+            // A misaligned load at offset k is a slice of the blocks
+            // on either side of it. We can only use the block to the
+            // right if the original loads already touched all of it.
+            auto can_rotate = [&](int k) {
+                return k % lanes == 0 || (k / lanes + 1) * lanes <= rightmost;
+            };
+            bool any_misaligned = false;
+            for (const auto &l : g.loads) {
+                any_misaligned = any_misaligned || (l.second % lanes != 0 && can_rotate(l.second));
+            }
+            if (!any_misaligned) {
+                continue;
+            }
+
+            Expr base = g.leftmost->index.as<Ramp>()->base;
+            map<int, Expr> blocks;
+            auto block = [&](int b) {
+                Expr &e = blocks[b];
+                if (!e.defined()) {
+                    e = Load::make(g.leftmost->type, g.leftmost->name,
+                                   Ramp::make(simplify(base + b * lanes), 1, lanes),
+                                   g.leftmost->image, g.leftmost->param,
+                                   const_true(lanes));
+                }
+                return e;
+            };
+
+            for (const auto &l : g.loads) {
+                if (!can_rotate(l.second)) {
+                    continue;
+                }
+                int b = l.second / lanes, r = l.second % lanes;
+                Expr replacement;
+                if (r == 0) {
+                    replacement = block(b);
+                } else {
+                    replacement = Shuffle::make_slice(Shuffle::make_concat({block(b), block(b + 1)}),
+                                                      r, 1, lanes);
+                }
+                s = graph_substitute(Expr(l.first), replacement, s);
+            }
+        }
+        return s;
+    }
+};
+
 /** Carry loads over a single For loop body. */
 class LoopCarryOverLoop : public IRMutator {
     // Track vars that step linearly with loop iterations
@@ -193,6 +308,12 @@ class LoopCarryOverLoop : public IRMutator {
 
     int max_carried_values;
 
+    // If positive, carried vectors wider than this many bits count as
+    // more than one value.
+    int vector_bits;
+
+    bool rotate_vectors;
+
     using IRMutator::visit;
 
     void visit(const LetStmt *op) {
@@ -251,6 +372,10 @@ class LoopCarryOverLoop : public IRMutator {
         // exponential runtime.
         Stmt graph_stmt = substitute_in_all_lets(orig_stmt);
 
+        if (rotate_vectors) {
+            graph_stmt = RotateVectorLoads(linear, in_consume).mutate(graph_stmt);
+        }
+
         // Find all the loads in these stmts.
         FindLoads find_loads;
         graph_stmt.accept(&find_loads);
@@ -350,21 +475,38 @@ class LoopCarryOverLoop : public IRMutator {
         // Only keep the top N carried values. Otherwise we'll just
         // spray stack spills everywhere. This is ugly, because we're
         // relying on a heuristic.
+        auto cost = [&](int i) {
+            Type t = loads[i][0]->type;
+            if (vector_bits <= 0) {
+                return 1;
+            }
+            return std::max(1, (t.bits() * t.lanes() + vector_bits - 1) / vector_bits);
+        };
         vector<vector<int>> trimmed;
-        size_t sz = 0;
+        int sz = 0;
         for (const vector<int> &c : chains) {
-            if (sz + c.size() > (size_t)max_carried_values) {
-                if (sz < (size_t)max_carried_values - 1) {
+            int chain_cost = 0;
+            size_t fits = 0;
+            while (fits < c.size() && sz + chain_cost + cost(c[fits]) <= max_carried_values) {
+                chain_cost += cost(c[fits]);
+                fits++;
+            }
+            if (fits < c.size()) {
+                if (fits > 1) {
                     // Take a partial chain
-                    trimmed.emplace_back(c.begin(), c.begin() + max_carried_values - sz);
+                    trimmed.emplace_back(c.begin(), c.begin() + fits);
                 }
                 break;
             }
             trimmed.push_back(c);
-            sz += c.size();
+            sz += chain_cost;
         }
         chains.swap(trimmed);
 
+        if (chains.empty()) {
+            return orig_stmt;
+        }
+
         // We now have chains of the form:
         // f[x] <- f[x+1] <- ... <- f[x+N-1]
 
@@ -480,8 +622,10 @@ class LoopCarryOverLoop : public IRMutator {
     }
 
 public:
-    LoopCarryOverLoop(const string &var, const Scope<int> &s, int max_carried_values)
-        : in_consume(s), max_carried_values(max_carried_values) {
+    LoopCarryOverLoop(const string &var, const Scope<int> &s, int max_carried_values,
+                      int vector_bits, bool rotate_vectors)
+        : in_consume(s), max_carried_values(max_carried_values),
+          vector_bits(vector_bits), rotate_vectors(rotate_vectors) {
         linear.push(var, 1);
     }
 
@@ -499,8 +643,24 @@ class LoopCarry : public IRMutator {
     using IRMutator::visit;
 
     int max_carried_values;
+    int vector_bits;
+    bool rotate_vectors;
+    // If non-null, only carry values over the loops of these funcs.
+    const set<string> *funcs;
     Scope<int> in_consume;
 
+    bool should_carry_over(const string &loop) {
+        if (!funcs) {
+            return true;
+        }
+        for (const string &f : *funcs) {
+            if (starts_with(loop, f + ".s")) {
+                return true;
+            }
+        }
+        return false;
+    }
+
     void visit(const ProducerConsumer *op) {
         if (op->is_producer) {
             IRMutator::visit(op);
@@ -513,9 +673,16 @@ class LoopCarry : public IRMutator {
     }
 
     void visit(const For *op) {
-        if (op->for_type == ForType::Serial && !is_one(op->extent)) {
+        if (funcs &&
+            op->device_api != DeviceAPI::None &&
+            op->device_api != DeviceAPI::Host) {
+            // Device code gets its own treatment in its backend.
+            stmt = op;
+        } else if (op->for_type == ForType::Serial && !is_one(op->extent) &&
+                   should_carry_over(op->name)) {
             Stmt body = mutate(op->body);
-            LoopCarryOverLoop carry(op->name, in_consume, max_carried_values);
+            LoopCarryOverLoop carry(op->name, in_consume, max_carried_values,
+                                    vector_bits, rotate_vectors);
             body = carry.mutate(body);
             if (body.same_as(op->body)) {
                 stmt = op;
@@ -526,7 +693,7 @@ class LoopCarry : public IRMutator {
             // Inject the scratch buffer allocations.
             for (const auto &alloc : carry.allocs) {
                 stmt = Block::make(substitute(op->name, op->min, alloc.initial_stores), stmt);
-                stmt = Allocate::make(alloc.name, alloc.type, {alloc.size}, const_true(), stmt);
+                stmt = Allocate::make(alloc.name, alloc.type, MemoryType::Stack, {alloc.size}, const_true(), stmt);
             }
             if (!carry.allocs.empty()) {
                 stmt = IfThenElse::make(op->extent > 0, stmt);
@@ -538,14 +705,44 @@ class LoopCarry : public IRMutator {
     }
 
 public:
-    LoopCarry(int max_carried_values) : max_carried_values(max_carried_values) {}
+    LoopCarry(int max_carried_values, int vector_bits, bool rotate_vectors, const set<string> *funcs)
+        : max_carried_values(max_carried_values), vector_bits(vector_bits),
+          rotate_vectors(rotate_vectors), funcs(funcs) {}
 };
 
 }
 
 
 Stmt loop_carry(Stmt s, int max_carried_values) {
-    s = LoopCarry(max_carried_values).mutate(s);
+    s = LoopCarry(max_carried_values, 0, false, nullptr).mutate(s);
+    return s;
+}
+
+Stmt loop_carry(Stmt s, const Target &t, const set<string> &funcs) {
+    if (funcs.empty()) {
+        return s;
+    }
+
+    int vector_bits = t.natural_vector_size(UInt(8)) * 8;
+
+    // Leave half the vector registers for the computation that uses
+    // the carried values.
+    int vector_registers;
+    if (t.arch == Target::X86) {
+        vector_registers = (t.has_feature(Target::AVX512) ||
+                            t.has_feature(Target::AVX512_KNL) ||
+                            t.has_feature(Target::AVX512_Skylake) ||
+                            t.has_feature(Target::AVX512_Cannonlake)) ? 32 : 16;
+        if (t.bits == 32) {
+            vector_registers = 8;
+        }
+    } else if (t.arch == Target::ARM) {
+        vector_registers = t.bits == 64 ? 32 : 16;
+    } else {
+        vector_registers = 16;
+    }
+
+    s = LoopCarry(vector_registers / 2, vector_bits, true, &funcs).mutate(s);
     return s;
 }
 
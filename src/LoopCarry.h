@@ -1,7 +1,11 @@
 #ifndef HALIDE_LOOP_CARRY_H
 #define HALIDE_LOOP_CARRY_H
 
+#include <set>
+#include <string>
+
 #include "Expr.h"
+#include "Target.h"
 
 namespace Halide {
 namespace Internal {
@@ -10,10 +14,19 @@ namespace Internal {
  * induction variables instead of redoing the load. If the loads are
  * predicated, the predicates need to match. Can be an optimization or
  * pessimization depending on how good the L1 cache is on the architecture
- * and how many memory issue slots there are. Currently only intended
- * for Hexagon. */
+ * and how many memory issue slots there are. On Hexagon this runs on
+ * everything. */
 Stmt loop_carry(Stmt, int max_carried_values = 8);
 
+/** The version of loop_carry used on CPU targets, for the loops of
+ * the Funcs scheduled with Func::loop_carry. Also carries vectors
+ * along the vectorized dimension of stencils, by rewriting
+ * overlapping, misaligned vector loads as slices of aligned ones that
+ * rotate from one iteration to the next. Carried values are counted
+ * in native vector registers, and at most half of the target's
+ * vector registers are used (e.g. 16 of the 32 on AVX-512). */
+Stmt loop_carry(Stmt, const Target &t, const std::set<std::string> &funcs);
+
 }
 }
 
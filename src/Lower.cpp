@@ -8,10 +8,12 @@
 #include "AddImageChecks.h"
 #include "AddParameterChecks.h"
 #include "AllocationBoundsInference.h"
+#include "AsyncProducers.h"
 #include "Bounds.h"
 #include "BoundsInference.h"
 #include "CSE.h"
 #include "CanonicalizeGPUVars.h"
+#include "CompileProfile.h"
 #include "Debug.h"
 #include "DebugToFile.h"
 #include "DeepCopy.h"
@@ -32,6 +34,7 @@
 #include "IRPrinter.h"
 #include "LoopCarry.h"
 #include "Memoization.h"
+#include "MemoryPlanning.h"
 #include "OffloadSDS.h"
 #include "PartitionLoops.h"
 #include "Prefetch.h"
@@ -70,7 +73,9 @@ using std::vector;
 using std::map;
 
 Stmt lower(const vector<Function> &output_funcs, const string &pipeline_name,
-           const Target &t, const vector<IRMutator *> &custom_passes) {
+           const Target &t, const vector<IRMutator *> &custom_passes,
+           FuncValueBoundsCache *cache) {
+    CompilePassTimer pass_timer;
 
     // Compute an environment
     map<string, Function> env;
@@ -79,6 +84,10 @@ Stmt lower(const vector<Function> &output_funcs, const string &pipeline_name,
         env.insert(more_funcs.begin(), more_funcs.end());
     }
 
+    if (cache) {
+        cache->set_algorithm(env);
+    }
+
     // Create a deep-copy of the entire graph of Funcs.
     vector<Function> outputs;
     std::tie(outputs, env) = deep_copy(output_funcs, env);
@@ -97,20 +106,24 @@ Stmt lower(const vector<Function> &output_funcs, const string &pipeline_name,
     // Try to simplify the RHS/LHS of a function definition by propagating its
     // specializations' conditions
     simplify_specializations(env);
+    pass_timer.end_pass("realization_order");
 
     bool any_memoized = false;
 
     debug(1) << "Creating initial loop nests...\n";
     Stmt s = schedule_functions(outputs, order, env, t, any_memoized);
+    pass_timer.end_pass("schedule_functions", s);
     debug(2) << "Lowering after creating initial loop nests:\n" << s << '\n';
 
     debug(1) << "Canonicalizing GPU var names...\n";
     s = canonicalize_gpu_vars(s);
+    pass_timer.end_pass("canonicalize_gpu_vars", s);
     debug(2) << "Lowering after canonicalizing GPU var names:\n" << s << '\n';
 
     if (any_memoized) {
         debug(1) << "Injecting memoization...\n";
         s = inject_memoization(s, env, pipeline_name, outputs);
+        pass_timer.end_pass("inject_memoization", s);
         debug(2) << "Lowering after injecting memoization:\n" << s << '\n';
     } else {
         debug(1) << "Skipping injecting memoization...\n";
@@ -118,25 +131,30 @@ Stmt lower(const vector<Function> &output_funcs, const string &pipeline_name,
 
     debug(1) << "Injecting prefetches...\n";
     s = inject_prefetch(s, env);
+    pass_timer.end_pass("inject_prefetch", s);
     debug(2) << "Lowering after injecting prefetches:\n" << s << "\n\n";
 
     debug(1) << "Injecting tracing...\n";
     s = inject_tracing(s, pipeline_name, env, outputs);
+    pass_timer.end_pass("inject_tracing", s);
     debug(2) << "Lowering after injecting tracing:\n" << s << '\n';
 
     debug(1) << "Adding checks for parameters\n";
     s = add_parameter_checks(s, t);
+    pass_timer.end_pass("add_parameter_checks", s);
     debug(2) << "Lowering after injecting parameter checks:\n" << s << '\n';
 
     // Compute the maximum and minimum possible value of each
     // function. Used in later bounds inference passes.
     debug(1) << "Computing bounds of each function's value\n";
-    FuncValueBounds func_bounds = compute_function_value_bounds(order, env);
+    FuncValueBounds func_bounds = compute_function_value_bounds(order, env, cache);
+    pass_timer.end_pass("compute_function_value_bounds");
 
     // The checks will be in terms of the symbols defined by bounds
     // inference.
     debug(1) << "Adding checks for images\n";
     s = add_image_checks(s, outputs, t, order, env, func_bounds);
+    pass_timer.end_pass("add_image_checks", s);
     debug(2) << "Lowering after injecting image checks:\n" << s << '\n';
 
     // This pass injects nested definitions of variable names, so we
@@ -144,18 +162,22 @@ Stmt lower(const vector<Function> &output_funcs, const string &pipeline_name,
     // can still simplify Exprs).
     debug(1) << "Performing computation bounds inference...\n";
     s = bounds_inference(s, outputs, order, env, func_bounds, t);
+    pass_timer.end_pass("bounds_inference", s);
     debug(2) << "Lowering after computation bounds inference:\n" << s << '\n';
 
     debug(1) << "Performing sliding window optimization...\n";
     s = sliding_window(s, env);
+    pass_timer.end_pass("sliding_window", s);
     debug(2) << "Lowering after sliding window:\n" << s << '\n';
 
     debug(1) << "Performing allocation bounds inference...\n";
     s = allocation_bounds_inference(s, env, func_bounds);
+    pass_timer.end_pass("allocation_bounds_inference", s);
     debug(2) << "Lowering after allocation bounds inference:\n" << s << '\n';
 
     debug(1) << "Removing code that depends on undef values...\n";
     s = remove_undef(s);
+    pass_timer.end_pass("remove_undef", s);
     debug(2) << "Lowering after removing code that depends on undef values:\n" << s << "\n\n";
 
     // This uniquifies the variable names, so we're good to simplify
@@ -163,45 +185,60 @@ Stmt lower(const vector<Function> &output_funcs, const string &pipeline_name,
     // equivalence means semantic equivalence.
     debug(1) << "Uniquifying variable names...\n";
     s = uniquify_variable_names(s);
+    pass_timer.end_pass("uniquify_variable_names", s);
     debug(2) << "Lowering after uniquifying variable names:\n" << s << "\n\n";
 
     debug(1) << "Performing storage folding optimization...\n";
     s = storage_folding(s, env);
+    pass_timer.end_pass("storage_folding", s);
     debug(2) << "Lowering after storage folding:\n" << s << '\n';
 
     debug(1) << "Injecting debug_to_file calls...\n";
     s = debug_to_file(s, outputs, env);
+    pass_timer.end_pass("debug_to_file", s);
     debug(2) << "Lowering after injecting debug_to_file calls:\n" << s << '\n';
 
     debug(1) << "Simplifying...\n"; // without removing dead lets, because storage flattening needs the strides
     s = simplify(s, false);
+    pass_timer.end_pass("simplify (first)", s);
     debug(2) << "Lowering after first simplification:\n" << s << "\n\n";
 
     debug(1) << "Dynamically skipping stages...\n";
     s = skip_stages(s, order);
+    pass_timer.end_pass("skip_stages", s);
     debug(2) << "Lowering after dynamically skipping stages:\n" << s << "\n\n";
 
+    debug(1) << "Forking async producers...\n";
+    s = fork_async_producers(s, env);
+    pass_timer.end_pass("fork_async_producers", s);
+    debug(2) << "Lowering after forking async producers:\n" << s << "\n\n";
+
     debug(1) << "Destructuring tuple-valued realizations...\n";
     s = split_tuples(s, env);
+    pass_timer.end_pass("split_tuples", s);
     debug(2) << "Lowering after destructuring tuple-valued realizations:\n" << s << "\n\n";
 
     if (t.has_feature(Target::OpenGL)) {
         debug(1) << "Injecting image intrinsics...\n";
         s = inject_image_intrinsics(s, env);
+        pass_timer.end_pass("inject_image_intrinsics", s);
         debug(2) << "Lowering after image intrinsics:\n" << s << "\n\n";
     }
 
     debug(3) << "Offloading function to programmable logic...\n";
     s = offload_functions(s, outputs, env);
+    pass_timer.end_pass("offload_functions", s);
     debug(3) << "Lowering after offloading function to programmable logic:\n" << s << "\n\n";
 
     debug(1) << "Performing storage flattening...\n";
     s = storage_flattening(s, outputs, env, t);
+    pass_timer.end_pass("storage_flattening", s);
     debug(2) << "Lowering after storage flattening:\n" << s << "\n\n";
 
     if (any_memoized) {
         debug(1) << "Rewriting memoized allocations...\n";
         s = rewrite_memoized_allocations(s, env);
+        pass_timer.end_pass("rewrite_memoized_allocations", s);
         debug(2) << "Lowering after rewriting memoized allocations:\n" << s << "\n\n";
     } else {
         debug(1) << "Skipping rewriting memoized allocations...\n";
@@ -213,16 +250,19 @@ Stmt lower(const vector<Function> &output_funcs, const string &pipeline_name,
         (t.arch != Target::Hexagon && (t.features_any_of({Target::HVX_64, Target::HVX_128})))) {
         debug(1) << "Selecting a GPU API for GPU loops...\n";
         s = select_gpu_api(s, t);
+        pass_timer.end_pass("select_gpu_api", s);
         debug(2) << "Lowering after selecting a GPU API:\n" << s << "\n\n";
 
         debug(1) << "Injecting host <-> dev buffer copies...\n";
         s = inject_host_dev_buffer_copies(s, t);
+        pass_timer.end_pass("inject_host_dev_buffer_copies", s);
         debug(2) << "Lowering after injecting host <-> dev buffer copies:\n" << s << "\n\n";
     }
 
     if (t.has_feature(Target::OpenGL)) {
         debug(1) << "Injecting OpenGL texture intrinsics...\n";
         s = inject_opengl_intrinsics(s);
+        pass_timer.end_pass("inject_opengl_intrinsics", s);
         debug(2) << "Lowering after OpenGL intrinsics:\n" << s << "\n\n";
     }
 
@@ -230,81 +270,134 @@ Stmt lower(const vector<Function> &output_funcs, const string &pipeline_name,
         t.has_feature(Target::OpenGLCompute)) {
         debug(1) << "Injecting per-block gpu synchronization...\n";
         s = fuse_gpu_thread_loops(s);
+        pass_timer.end_pass("fuse_gpu_thread_loops", s);
         debug(2) << "Lowering after injecting per-block gpu synchronization:\n" << s << "\n\n";
     }
 
     debug(1) << "Simplifying...\n";
     s = simplify(s);
+    pass_timer.end_pass("simplify (second)", s);
     s = unify_duplicate_lets(s);
+    pass_timer.end_pass("unify_duplicate_lets", s);
     s = remove_trivial_for_loops(s);
+    pass_timer.end_pass("remove_trivial_for_loops", s);
     debug(2) << "Lowering after second simplifcation:\n" << s << "\n\n";
 
     debug(1) << "Unrolling...\n";
     s = unroll_loops(s);
+    pass_timer.end_pass("unroll_loops", s);
     s = simplify(s);
+    pass_timer.end_pass("simplify (after unroll_loops)", s);
     debug(2) << "Lowering after unrolling:\n" << s << "\n\n";
 
     debug(1) << "Vectorizing...\n";
     s = vectorize_loops(s, t);
+    pass_timer.end_pass("vectorize_loops", s);
     s = simplify(s);
+    pass_timer.end_pass("simplify (after vectorize_loops)", s);
     debug(2) << "Lowering after vectorizing:\n" << s << "\n\n";
 
     debug(1) << "Detecting vector interleavings...\n";
     s = rewrite_interleavings(s);
+    pass_timer.end_pass("rewrite_interleavings", s);
     s = simplify(s);
+    pass_timer.end_pass("simplify (after rewrite_interleavings)", s);
     debug(2) << "Lowering after rewriting vector interleavings:\n" << s << "\n\n";
 
     debug(1) << "Partitioning loops to simplify boundary conditions...\n";
     s = partition_loops(s);
+    pass_timer.end_pass("partition_loops", s);
     s = simplify(s);
+    pass_timer.end_pass("simplify (after partition_loops)", s);
     debug(2) << "Lowering after partitioning loops:\n" << s << "\n\n";
 
     debug(1) << "Trimming loops to the region over which they do something...\n";
     s = trim_no_ops(s);
+    pass_timer.end_pass("trim_no_ops", s);
     debug(2) << "Lowering after loop trimming:\n" << s << "\n\n";
 
+    set<string> loop_carry_funcs;
+    for (const auto &p : env) {
+        if (p.second.schedule().loop_carry()) {
+            loop_carry_funcs.insert(p.first);
+        }
+    }
+    if (!loop_carry_funcs.empty() && t.arch != Target::Hexagon) {
+        debug(1) << "Carrying loaded values over loops...\n";
+        s = loop_carry(s, t, loop_carry_funcs);
+        pass_timer.end_pass("loop_carry", s);
+        debug(2) << "Lowering after carrying loaded values over loops:\n" << s << "\n\n";
+    }
+
     debug(1) << "Injecting early frees...\n";
     s = inject_early_frees(s);
+    pass_timer.end_pass("inject_early_frees", s);
     debug(2) << "Lowering after injecting early frees:\n" << s << "\n\n";
 
+    debug(1) << "Sharing storage between allocations...\n";
+    s = plan_memory(s);
+    pass_timer.end_pass("plan_memory", s);
+    debug(2) << "Lowering after sharing storage between allocations:\n" << s << "\n\n";
+
+    bool any_arena = false;
+    for (const auto &p : env) {
+        any_arena = any_arena || p.second.schedule().memory_type() == MemoryType::Arena;
+    }
+    if (any_arena || t.has_feature(Target::ScratchArena)) {
+        debug(1) << "Allocating from the scratch arena...\n";
+        s = use_scratch_arena(s, pipeline_name, t.has_feature(Target::ScratchArena));
+        pass_timer.end_pass("use_scratch_arena", s);
+        debug(2) << "Lowering after allocating from the scratch arena:\n" << s << "\n\n";
+    }
+
     if (t.has_feature(Target::Profile)) {
         debug(1) << "Injecting profiling...\n";
         s = inject_profiling(s, pipeline_name);
+        pass_timer.end_pass("inject_profiling", s);
         debug(2) << "Lowering after injecting profiling:\n" << s << "\n\n";
     }
 
     if (t.has_feature(Target::FuzzFloatStores)) {
         debug(1) << "Fuzzing floating point stores...\n";
         s = fuzz_float_stores(s);
+        pass_timer.end_pass("fuzz_float_stores", s);
         debug(2) << "Lowering after fuzzing floating point stores:\n" << s << "\n\n";
     }
 
     debug(1) << "Simplifying...\n";
     s = common_subexpression_elimination(s);
+    pass_timer.end_pass("common_subexpression_elimination", s);
 
     if (t.has_feature(Target::OpenGL)) {
         debug(1) << "Detecting varying attributes...\n";
         s = find_linear_expressions(s);
+        pass_timer.end_pass("find_linear_expressions", s);
         debug(2) << "Lowering after detecting varying attributes:\n" << s << "\n\n";
 
         debug(1) << "Moving varying attribute expressions out of the shader...\n";
         s = setup_gpu_vertex_buffer(s);
+        pass_timer.end_pass("setup_gpu_vertex_buffer", s);
         debug(2) << "Lowering after removing varying attributes:\n" << s << "\n\n";
     }
 
     s = remove_dead_allocations(s);
+    pass_timer.end_pass("remove_dead_allocations", s);
     s = remove_trivial_for_loops(s);
+    pass_timer.end_pass("remove_trivial_for_loops", s);
     s = simplify(s);
+    pass_timer.end_pass("simplify (final)", s);
     debug(1) << "Lowering after final simplification:\n" << s << "\n\n";
 
     debug(1) << "Splitting off Hexagon offload...\n";
     s = inject_hexagon_rpc(s, t);
+    pass_timer.end_pass("inject_hexagon_rpc", s);
     debug(2) << "Lowering after splitting off Hexagon offload:\n" << s << '\n';
 
     if (!custom_passes.empty()) {
         for (size_t i = 0; i < custom_passes.size(); i++) {
             debug(1) << "Running custom lowering pass " << i << "...\n";
             s = custom_passes[i]->mutate(s);
+            pass_timer.end_pass("custom lowering pass " + std::to_string(i), s);
             debug(1) << "Lowering after custom pass " << i << ":\n" << s << "\n\n";
         }
     }
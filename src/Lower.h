@@ -14,13 +14,17 @@ namespace Halide {
 namespace Internal {
 
 class IRMutator;
+class FuncValueBoundsCache;
 
 /** Given a halide function with a schedule, create a statement that
  * evaluates it. Automatically pulls in all the functions f depends
- * on. Some stages of lowering may be target-specific. */
+ * on. Some stages of lowering may be target-specific. If a cache is
+ * given, analyses that depend only on the algorithm are reused from
+ * the last time the same Functions were lowered. */
 EXPORT Stmt lower(const std::vector<Function> &output_funcs,
                                   const std::string &pipeline_name, const Target &t,
-                  const std::vector<IRMutator *> &custom_passes = std::vector<IRMutator *>());
+                  const std::vector<IRMutator *> &custom_passes = std::vector<IRMutator *>(),
+                  FuncValueBoundsCache *cache = nullptr);
 
 void lower_test();
 
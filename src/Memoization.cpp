@@ -1,13 +1,16 @@
 #include "Memoization.h"
 #include "Error.h"
+#include "FindCalls.h"
 #include "IRMutator.h"
 #include "IROperator.h"
+#include "IRPrinter.h"
 #include "Param.h"
 #include "Scope.h"
 #include "Util.h"
 #include "Var.h"
 
 #include <map>
+#include <sstream>
 
 namespace Halide {
 namespace Internal {
@@ -143,11 +146,103 @@ public:
 
 typedef std::pair<FindParameterDependencies::DependencyKey, FindParameterDependencies::DependencyInfo> DependencyKeyInfoPair;
 
+// IRPrinter doesn't print the types of variables, loads and calls, so
+// write them out alongside the printed definitions.
+class PrintTypes : public IRGraphVisitor {
+    using IRGraphVisitor::visit;
+
+    void visit(const Variable *op) {
+        stream << op->name << ":" << op->type << ";";
+    }
+
+    void visit(const Load *op) {
+        stream << op->name << ":" << op->type << ";";
+        IRGraphVisitor::visit(op);
+    }
+
+    void visit(const Call *op) {
+        stream << op->name << ":" << op->type << ":" << (int)op->call_type << ";";
+        IRGraphVisitor::visit(op);
+    }
+
+public:
+    std::ostream &stream;
+    PrintTypes(std::ostream &s) : stream(s) {}
+};
+
+// A 64-bit hash of a Function and everything it calls, the name of the
+// pipeline it is in, and the build of Halide that compiled it. Unlike
+// the address of a string in the generated code, this is the same
+// every time the same pipeline is compiled, in any process, so it can
+// identify results kept in the persistent store between runs.
+uint64_t stable_identity(const Function &function, const std::string &top_level_name) {
+    std::ostringstream stream;
+    stream << "Halide built " << __DATE__ << " " << __TIME__ << "\n"
+           << top_level_name << "\n";
+    PrintTypes types(stream);
+    for (const auto &p : find_transitive_calls(function)) {
+        const Function &f = p.second;
+        stream << "func " << f.name() << "\n";
+        for (const Type &t : f.output_types()) {
+            stream << t << ";";
+        }
+        stream << "\n";
+        if (f.has_extern_definition()) {
+            stream << "extern " << f.extern_function_name() << "(";
+            for (const ExternFuncArgument &arg : f.extern_arguments()) {
+                if (arg.is_func()) {
+                    stream << Function(arg.func).name();
+                } else if (arg.is_expr()) {
+                    stream << arg.expr;
+                } else if (arg.is_buffer()) {
+                    stream << arg.buffer.name();
+                } else if (arg.is_image_param()) {
+                    stream << arg.image_param.name() << ":" << arg.image_param.type();
+                }
+                stream << ",";
+            }
+            stream << ")\n";
+        }
+        std::vector<Definition> definitions = f.updates();
+        if (f.has_pure_definition()) {
+            definitions.insert(definitions.begin(), f.definition());
+        }
+        for (const Definition &d : definitions) {
+            for (const ReductionVariable &rv : d.schedule().rvars()) {
+                stream << rv.var << "=[" << rv.min << ", " << rv.extent << "] ";
+            }
+            stream << f.name() << "(";
+            for (const Expr &e : d.args()) {
+                stream << e << ",";
+            }
+            stream << ") = (";
+            for (const Expr &e : d.values()) {
+                stream << e << ",";
+            }
+            stream << ")";
+            if (d.predicate().defined()) {
+                stream << " if " << d.predicate();
+            }
+            stream << "\n";
+        }
+        f.accept(&types);
+        stream << "\n";
+    }
+
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ULL;
+    for (char c : stream.str()) {
+        hash = (hash ^ (uint8_t)c) * 1099511628211ULL;
+    }
+    return hash;
+}
+
 class KeyInfo {
     FindParameterDependencies dependencies;
     Expr key_size_expr;
     const std::string &top_level_name;
     const std::string &function_name;
+    uint64_t identity;
 
     size_t parameters_alignment() {
         int32_t max_alignment = 0;
@@ -194,7 +289,8 @@ class KeyInfo {
 
 public:
   KeyInfo(const Function &function, const std::string &name)
-        : top_level_name(name), function_name(function.name())
+        : top_level_name(name), function_name(function.name()),
+          identity(stable_identity(function, name))
     {
         dependencies.visit_function(function);
         size_t size_so_far = 0;
@@ -205,6 +301,8 @@ public:
 #else
         size_so_far += Handle().bytes() + 4;
 #endif
+        size_so_far = (size_so_far + 3) & ~3;
+        size_so_far += 8;
 
         size_t needed_alignment = parameters_alignment();
         if (needed_alignment > 1) {
@@ -282,6 +380,27 @@ public:
         index += 4;
 #endif
 
+        // The identity of the Func that doesn't depend on where the
+        // code was loaded, written as two 32-bit halves so it only
+        // needs four byte alignment. The persistent store (see
+        // halide_memoization_cache_lookup) keys on this and what
+        // follows, and ignores the pointer and counter above.
+        while (alignment % 4) {
+            writes.push_back(Store::make(key_name, Cast::make(UInt(8), 0), index,
+                                         Parameter(), const_true()));
+            index = index + 1;
+            alignment++;
+        }
+        writes.push_back(Store::make(key_name,
+                                     make_const(UInt(32), identity & 0xffffffff),
+                                     (index / 4), Parameter(), const_true()));
+        index += 4;
+        writes.push_back(Store::make(key_name,
+                                     make_const(UInt(32), identity >> 32),
+                                     (index / 4), Parameter(), const_true()));
+        index += 4;
+        alignment += 8;
+
         size_t needed_alignment = parameters_alignment();
         if (needed_alignment > 1) {
             while (alignment % needed_alignment) {
@@ -433,7 +552,7 @@ private:
 
             Stmt generate_key = Block::make(key_info.generate_key(cache_key_name), computed_bounds_let);
             Stmt cache_key_alloc =
-                Allocate::make(cache_key_name, UInt(8), {key_info.key_size()},
+                Allocate::make(cache_key_name, UInt(8), MemoryType::Auto, {key_info.key_size()},
                                const_true(), generate_key);
 
             stmt = Realize::make(op->name, op->types, op->bounds, op->condition, cache_key_alloc);
@@ -571,7 +690,7 @@ private:
                 const Allocate *allocation = allocations[i - 1];
 
                 // Make the allocation node
-                body = Allocate::make(allocation->name, allocation->type, allocation->extents, allocation->condition, body,
+                body = Allocate::make(allocation->name, allocation->type, allocation->memory_type, allocation->extents, allocation->condition, body,
                                       Call::make(Handle(), Call::buffer_get_host,
                                                  { Variable::make(type_of<struct buffer_t *>(), allocation->name + ".buffer") }, Call::Extern),
                                       "halide_memoization_cache_release");
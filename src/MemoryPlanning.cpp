@@ -0,0 +1,395 @@
+#include <algorithm>
+#include <map>
+#include <set>
+
+#include "MemoryPlanning.h"
+#include "CodeGen_Internal.h"
+#include "Debug.h"
+#include "IRMutator.h"
+#include "IROperator.h"
+#include "Simplify.h"
+
+namespace Halide {
+namespace Internal {
+
+using std::map;
+using std::set;
+using std::string;
+using std::vector;
+
+namespace {
+
+// Find the names of all the variables an expression refers to.
+class FindVariables : public IRVisitor {
+    using IRVisitor::visit;
+
+    void visit(const Variable *op) {
+        names.insert(op->name);
+    }
+
+public:
+    set<string> names;
+};
+
+// Does a statement refer to the buffer_t of an allocation? Buffers
+// with a buffer_t may be handed to extern stages or to a device API,
+// which may hold on to the host pointer, so we leave them alone.
+class UsesBufferT : public IRVisitor {
+    const string name;
+
+    using IRVisitor::visit;
+
+    void visit(const Variable *op) {
+        if (op->name == name) {
+            result = true;
+        }
+    }
+
+public:
+    bool result = false;
+    UsesBufferT(const string &n) : name(n + ".buffer") {}
+};
+
+// The allocations and frees in a region of straight-line code (one
+// that doesn't descend into loops or conditions), numbered in
+// program order.
+struct RegionAllocation {
+    const Allocate *op;
+    // The first and last statement inside the allocation.
+    int begin, end;
+    // The statement that marks the allocation dead, or -1 if there
+    // isn't one in this region.
+    int free = -1;
+    // The LetStmts of this region enclosing the allocation.
+    set<string> lets;
+    // The allocation whose storage this one shares, if any.
+    string slab;
+};
+
+class ScanRegion {
+    vector<string> lets;
+    int next = 0;
+
+public:
+    vector<RegionAllocation> allocations;
+    map<string, int> index;
+
+    void scan(Stmt s) {
+        if (const Allocate *op = s.as<Allocate>()) {
+            int idx = (int)allocations.size();
+            RegionAllocation alloc;
+            alloc.op = op;
+            alloc.begin = next;
+            alloc.lets.insert(lets.begin(), lets.end());
+            allocations.push_back(alloc);
+            index[op->name] = idx;
+            scan(op->body);
+            allocations[idx].end = next - 1;
+        } else if (const Block *op = s.as<Block>()) {
+            scan(op->first);
+            if (op->rest.defined()) {
+                scan(op->rest);
+            }
+        } else if (const LetStmt *op = s.as<LetStmt>()) {
+            lets.push_back(op->name);
+            scan(op->body);
+            lets.pop_back();
+        } else if (const ProducerConsumer *op = s.as<ProducerConsumer>()) {
+            scan(op->body);
+        } else if (const Free *op = s.as<Free>()) {
+            auto it = index.find(op->name);
+            if (it != index.end()) {
+                allocations[it->second].free = next;
+            }
+            next++;
+        } else {
+            next++;
+        }
+    }
+};
+
+// Is this an allocation whose storage we may place inside another
+// allocation, or use to hold others?
+bool is_candidate(const RegionAllocation &alloc) {
+    const Allocate *op = alloc.op;
+    if (alloc.free < 0 ||
+        op->extents.empty() ||
+        op->new_expr.defined() ||
+        !op->free_function.empty() ||
+        !is_one(op->condition) ||
+        op->type.is_handle() ||
+        (op->memory_type != MemoryType::Auto &&
+         op->memory_type != MemoryType::Heap)) {
+        return false;
+    }
+
+    // Small allocations of constant size go on the stack, where the
+    // backends already reuse them.
+    int64_t constant_bytes = (int64_t)op->constant_allocation_size() * op->type.bytes();
+    if (allocation_goes_on_stack(op->name, op->memory_type, std::max(constant_bytes, (int64_t)0))) {
+        return false;
+    }
+
+    UsesBufferT uses(op->name);
+    op->body.accept(&uses);
+    return !uses.result;
+}
+
+// The size of an allocation in bytes. Computed in 64 bits, as the
+// product of the extents of an allocation of a wide type may not fit
+// in 32.
+Expr allocation_bytes(const Allocate *op) {
+    Expr bytes = make_const(Int(64), op->type.bytes());
+    for (Expr e : op->extents) {
+        bytes *= cast<int64_t>(e);
+    }
+    return bytes;
+}
+
+class PlanMemory : public IRMutator {
+    using IRMutator::visit;
+
+    // The allocations of the region being rewritten.
+    map<string, RegionAllocation> region;
+
+    // The size in elements of each allocation that holds others (as
+    // an Int(64)), and the last allocation placed in it.
+    map<string, Expr> slab_extent;
+    map<string, string> last_in_slab;
+
+    void visit(const For *op) {
+        if (op->device_api != DeviceAPI::None &&
+            op->device_api != DeviceAPI::Host) {
+            // Device code manages its own memory.
+            stmt = op;
+        } else {
+            IRMutator::visit(op);
+        }
+    }
+
+    void visit(const Offload *op) {
+        stmt = op;
+    }
+
+    void visit(const Allocate *op) {
+        stmt = plan_region(op);
+    }
+
+    Stmt plan_region(Stmt s) {
+        ScanRegion scan;
+        scan.scan(s);
+
+        // Greedily place each allocation in the storage of the first
+        // enclosing allocation that is dead by the time it starts.
+        vector<int> slabs;
+        map<int, int> last_free;
+        for (int i = 0; i < (int)scan.allocations.size(); i++) {
+            RegionAllocation &b = scan.allocations[i];
+            if (!is_candidate(b)) {
+                continue;
+            }
+
+            FindVariables vars;
+            for (Expr e : b.op->extents) {
+                e.accept(&vars);
+            }
+
+            bool placed = false;
+            for (int j : slabs) {
+                const RegionAllocation &a = scan.allocations[j];
+                if (a.begin > b.begin || b.end > a.end || last_free[j] >= b.begin) {
+                    continue;
+                }
+                // The size of b needs to be known where a is
+                // allocated.
+                bool size_known = true;
+                for (const string &v : vars.names) {
+                    size_known = size_known && (!b.lets.count(v) || a.lets.count(v));
+                }
+                if (!size_known) {
+                    continue;
+                }
+                debug(3) << "Placing " << b.op->name << " in the storage of " << a.op->name << "\n";
+                b.slab = a.op->name;
+                last_free[j] = b.free;
+                placed = true;
+                break;
+            }
+            if (!placed) {
+                slabs.push_back(i);
+                last_free[i] = b.free;
+            }
+        }
+
+        map<string, RegionAllocation> old_region;
+        map<string, Expr> old_slab_extent;
+        map<string, string> old_last_in_slab;
+        region.swap(old_region);
+        slab_extent.swap(old_slab_extent);
+        last_in_slab.swap(old_last_in_slab);
+
+        for (const RegionAllocation &alloc : scan.allocations) {
+            region[alloc.op->name] = alloc;
+        }
+        // The widest element type placed in each slab.
+        map<string, int> slab_padding;
+        for (const RegionAllocation &b : scan.allocations) {
+            if (b.slab.empty()) {
+                continue;
+            }
+            const Allocate *a = region[b.slab].op;
+            Expr &extent = slab_extent[b.slab];
+            if (!extent.defined()) {
+                extent = allocation_bytes(a);
+            }
+            extent = max(extent, allocation_bytes(b.op));
+            slab_padding[b.slab] = std::max(slab_padding[b.slab], b.op->type.bytes());
+            last_in_slab[b.slab] = b.op->name;
+        }
+        for (auto &p : slab_extent) {
+            // The backends pad each allocation by one element of its
+            // own type, so that vector loads may run a little past the
+            // end. The slab only gets padded by one element of its
+            // type, which may be narrower than the allocations placed
+            // in it, so add their padding here.
+            int bytes = region[p.first].op->type.bytes();
+            p.second = simplify((p.second + slab_padding[p.first] + bytes - 1) / bytes);
+        }
+
+        s = rewrite_region(s);
+
+        region.swap(old_region);
+        slab_extent.swap(old_slab_extent);
+        last_in_slab.swap(old_last_in_slab);
+        return s;
+    }
+
+    Stmt rewrite_region(Stmt s) {
+        if (const Allocate *op = s.as<Allocate>()) {
+            Stmt body = rewrite_region(op->body);
+            const string &slab = region[op->name].slab;
+            if (!slab.empty()) {
+                const Allocate *a = region[slab].op;
+                Expr storage = Call::make(Handle(), Call::address_of,
+                                          {Load::make(a->type, a->name, 0, Buffer<>(), Parameter(), const_true())},
+                                          Call::Intrinsic);
+                return Allocate::make(op->name, op->type, op->memory_type, op->extents, op->condition, body,
+                                      storage, "halide_device_host_nop_free");
+            } else if (slab_extent.count(op->name)) {
+                Expr extent = slab_extent[op->name];
+                Stmt alloc = Allocate::make(op->name, op->type, op->memory_type, {cast<int32_t>(extent)}, op->condition, body);
+                Expr max_extent = make_const(Int(64), 0x7fffffff);
+                Expr check = simplify(extent <= max_extent);
+                if (!is_one(check)) {
+                    Expr bytes = cast<uint64_t>(extent * op->type.bytes());
+                    Expr max_bytes = cast<uint64_t>(max_extent * op->type.bytes());
+                    Expr error = Call::make(Int(32), "halide_error_buffer_allocation_too_large",
+                                            {op->name, bytes, max_bytes}, Call::Extern);
+                    alloc = Block::make(AssertStmt::make(check, error), alloc);
+                }
+                return alloc;
+            } else {
+                return Allocate::make(op->name, op->type, op->memory_type, op->extents, op->condition, body,
+                                      op->new_expr, op->free_function);
+            }
+        } else if (const Block *op = s.as<Block>()) {
+            Stmt first = rewrite_region(op->first);
+            Stmt rest = op->rest.defined() ? rewrite_region(op->rest) : Stmt();
+            if (is_no_op(first)) {
+                return rest;
+            } else if (!rest.defined() || is_no_op(rest)) {
+                return first;
+            } else {
+                return Block::make(first, rest);
+            }
+        } else if (const LetStmt *op = s.as<LetStmt>()) {
+            return LetStmt::make(op->name, op->value, rewrite_region(op->body));
+        } else if (const ProducerConsumer *op = s.as<ProducerConsumer>()) {
+            return ProducerConsumer::make(op->name, op->is_producer, rewrite_region(op->body));
+        } else if (const Free *op = s.as<Free>()) {
+            if (slab_extent.count(op->name)) {
+                // Freed after the last allocation placed in it instead.
+                return Evaluate::make(0);
+            }
+            auto it = region.find(op->name);
+            if (it != region.end() && !it->second.slab.empty() &&
+                last_in_slab[it->second.slab] == op->name) {
+                return Block::make(s, Free::make(it->second.slab));
+            }
+            return s;
+        } else {
+            return IRMutator::mutate(s);
+        }
+    }
+};
+
+class UseScratchArena : public IRMutator {
+    const string &pipeline_name;
+    // Whether to use the arena for all heap allocations, or only for
+    // those stored in MemoryType::Arena.
+    bool all_heap;
+
+    using IRMutator::visit;
+
+    void visit(const For *op) {
+        if (op->device_api != DeviceAPI::None &&
+            op->device_api != DeviceAPI::Host) {
+            stmt = op;
+        } else {
+            IRMutator::visit(op);
+        }
+    }
+
+    void visit(const Offload *op) {
+        stmt = op;
+    }
+
+    void visit(const Allocate *op) {
+        IRMutator::visit(op);
+
+        if (op->extents.empty() ||
+            op->new_expr.defined() ||
+            !op->free_function.empty()) {
+            return;
+        }
+        if (op->memory_type != MemoryType::Arena) {
+            int64_t constant_bytes = (int64_t)op->constant_allocation_size() * op->type.bytes();
+            if (!all_heap ||
+                op->memory_type != MemoryType::Auto ||
+                allocation_goes_on_stack(op->name, op->memory_type, std::max(constant_bytes, (int64_t)0))) {
+                return;
+            }
+        }
+
+        // Pad the allocation with an extra scalar, as for heap
+        // allocations made by the backends.
+        Expr size = make_const(UInt(64), op->type.bytes());
+        for (Expr e : op->extents) {
+            size *= cast<uint64_t>(e);
+        }
+        size += op->type.bytes();
+        size = simplify(select(op->condition, size, make_zero(UInt(64))));
+
+        Expr storage = Call::make(Handle(), "halide_scratch_arena_malloc",
+                                  {pipeline_name, size}, Call::Extern);
+        op = stmt.as<Allocate>();
+        stmt = Allocate::make(op->name, op->type, op->memory_type, op->extents, op->condition, op->body,
+                              storage, "halide_scratch_arena_free");
+    }
+
+public:
+    UseScratchArena(const string &p, bool a) : pipeline_name(p), all_heap(a) {}
+};
+
+}  // namespace
+
+Stmt plan_memory(Stmt s) {
+    return PlanMemory().mutate(s);
+}
+
+Stmt use_scratch_arena(Stmt s, const string &pipeline_name, bool all_heap) {
+    return UseScratchArena(pipeline_name, all_heap).mutate(s);
+}
+
+}
+}
@@ -0,0 +1,36 @@
+#ifndef HALIDE_MEMORY_PLANNING_H
+#define HALIDE_MEMORY_PLANNING_H
+
+/** \file
+ * Defines the lowering passes that decide where the storage of heap
+ * allocations comes from.
+ */
+
+#include <string>
+
+#include "IR.h"
+
+namespace Halide {
+namespace Internal {
+
+/** Find heap allocations that are only live after an enclosing
+ * allocation has been marked dead (see inject_early_frees), and place
+ * them in the storage of the enclosing allocation instead. The
+ * enclosing allocation grows to the largest size required of it, and
+ * is freed once the last allocation placed in it is dead. This
+ * reduces the peak memory use of pipelines with chains of stages
+ * computed at the same level, and the number of calls to
+ * halide_malloc. Must run after inject_early_frees. */
+Stmt plan_memory(Stmt s);
+
+/** Take the allocations of a pipeline stored in MemoryType::Arena from
+ * its scratch arena, which persists between calls (see
+ * halide_scratch_arena_malloc), instead of from halide_malloc. If
+ * all_heap is true (for Target::ScratchArena), do the same for every
+ * allocation that would otherwise go on the heap. */
+Stmt use_scratch_arena(Stmt s, const std::string &pipeline_name, bool all_heap);
+
+}
+}
+
+#endif
@@ -1,11 +1,15 @@
 #include "Module.h"
 
 #include <array>
+#include <atomic>
+#include <exception>
 #include <fstream>
+#include <thread>
 
 #include "CodeGen_C.h"
 #include "CodeGen_Internal.h"
 #include "CodeGen_SDS.h"
+#include "CompileProfile.h"
 #include "Debug.h"
 #include "LLVM_Headers.h"
 #include "LLVM_Output.h"
@@ -69,6 +73,61 @@ private:
 };
 
 
+// A piece of code generation that can run independently of the others.
+struct CompileTask {
+    std::string label;
+    std::function<void()> work;
+};
+
+// Run the tasks on a pool of threads. Each task compiles its own
+// Module in its own LLVMContext, so they share no mutable state. If
+// a profile is being collected, each task's phases are added to it,
+// labelled with the task, in task order.
+void run_compile_tasks(const std::vector<CompileTask> &tasks) {
+    CompileProfile *profile = current_compile_profile();
+    std::vector<CompileProfile> task_profiles(tasks.size());
+    std::vector<std::exception_ptr> errors(tasks.size());
+    std::atomic<size_t> next_task(0);
+
+    auto worker = [&]() {
+        for (size_t i = next_task++; i < tasks.size(); i = next_task++) {
+#ifdef WITH_EXCEPTIONS
+            try {
+#endif
+                CompileProfileScope scope(profile ? &task_profiles[i] : nullptr, false);
+                tasks[i].work();
+#ifdef WITH_EXCEPTIONS
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+#endif
+        }
+    };
+
+    size_t num_threads = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), tasks.size());
+    debug(1) << "Running " << tasks.size() << " compilation tasks on " << num_threads << " threads\n";
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < num_threads; i++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (std::thread &t : threads) {
+        t.join();
+    }
+
+    for (size_t i = 0; i < tasks.size(); i++) {
+        if (errors[i]) {
+            std::rethrow_exception(errors[i]);
+        }
+        if (profile) {
+            for (CompilePassProfile p : task_profiles[i].passes) {
+                p.name = tasks[i].label + ": " + p.name;
+                profile->passes.push_back(p);
+            }
+        }
+    }
+}
+
 // Given a pathname of the form /path/to/name.ext, append suffix before ext to produce /path/to/namesuffix.ext
 std::string add_suffix(const std::string &path, const std::string &suffix) {
     const auto found = path.rfind(".");
@@ -310,7 +369,12 @@ void compile_multitarget(const std::string &fn_name,
         return;
     }
 
+    // Lowering happens serially, as module producers generally aren't
+    // safe to call concurrently, but code generation for each target,
+    // the runtime, and the wrapper are independent of each other, and
+    // run in parallel below.
     TemporaryObjectFileDir temp_dir;
+    std::vector<CompileTask> tasks;
     std::vector<Expr> wrapper_args;
     std::vector<LoweredArgument> base_target_args;
     for (const Target &target : targets) {
@@ -357,7 +421,7 @@ void compile_multitarget(const std::string &fn_name,
         if (sub_out.object_name.empty()) {
             sub_out.object_name = temp_dir.add_temp_object_file(output_files.static_library_name, suffix, target);
         }
-        module.compile(sub_out);
+        tasks.push_back({target.to_string(), [=]() { module.compile(sub_out); }});
 
         static_assert(sizeof(uint64_t)*8 >= Target::FeatureEnd, "Features will not fit in uint64_t");
         uint64_t feature_bits = 0;
@@ -382,8 +446,8 @@ void compile_multitarget(const std::string &fn_name,
     // and add that to the result.
     if (!base_target.has_feature(Target::NoRuntime)) {
         const Target runtime_target = base_target.without_feature(Target::NoRuntime);
-        compile_standalone_runtime(Outputs().object(temp_dir.add_temp_object_file(output_files.static_library_name, "_runtime", runtime_target)),
-            runtime_target);
+        Outputs runtime_out = Outputs().object(temp_dir.add_temp_object_file(output_files.static_library_name, "_runtime", runtime_target));
+        tasks.push_back({"runtime", [=]() { compile_standalone_runtime(runtime_out, runtime_target); }});
     }
 
     Expr indirect_result = Call::make(Int(32), Call::call_cached_indirect_function, wrapper_args, Call::Intrinsic);
@@ -414,12 +478,14 @@ void compile_multitarget(const std::string &fn_name,
 
     Module wrapper_module(fn_name, wrapper_target);
     wrapper_module.append(LoweredFunc(fn_name, base_target_args, wrapper_body, LoweredFunc::External));
-    wrapper_module.compile(Outputs().object(temp_dir.add_temp_object_file(output_files.static_library_name, "_wrapper", base_target, /* in_front*/ true)));
-
+    Outputs wrapper_out = Outputs().object(temp_dir.add_temp_object_file(output_files.static_library_name, "_wrapper", base_target, /* in_front*/ true));
     if (!output_files.c_header_name.empty()) {
         debug(1) << "compile_multitarget: c_header_name " << output_files.c_header_name << "\n";
-        wrapper_module.compile(Outputs().c_header(output_files.c_header_name));
+        wrapper_out = wrapper_out.c_header(output_files.c_header_name);
     }
+    tasks.push_back({"wrapper", [=]() { wrapper_module.compile(wrapper_out); }});
+
+    run_compile_tasks(tasks);
     if (!output_files.static_library_name.empty()) {
         debug(1) << "compile_multitarget: static_library_name " << output_files.static_library_name << "\n";
         create_static_library(temp_dir.files(), base_target, output_files.static_library_name);
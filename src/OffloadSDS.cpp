@@ -1744,7 +1744,7 @@ namespace Internal {
                             }
                             // allocate internal buffer
                             new_body = Block::make(dd_stmt, new_body);
-                            new_body = Allocate::make("buffered$$" + input.first, type, expr_extents, const_true(),
+                            new_body = Allocate::make("buffered$$" + input.first, type, MemoryType::Auto, expr_extents, const_true(),
                                                       new_body);
                             debug(3) << input.first << " partitioned!\n";
                         } else {
@@ -1944,7 +1944,7 @@ namespace Internal {
                                 expr_extents.push_back(extents[i] / (stencil.is_vectorized_dim(i) ? stencil.stencil_bounds[i] : 1));
                             }
                             debug(3) << "Input duplicator:\n" << duplicator << "\n";
-                            duplicator = Allocate::make("dup$$" + input.first, type, expr_extents, const_true(), duplicator);
+                            duplicator = Allocate::make("dup$$" + input.first, type, MemoryType::Auto, expr_extents, const_true(), duplicator);
 
                             // Push the data duplicator to a list, there's a duplicator for each HW input param
                             data_duplicators.push_back(duplicator);
@@ -2127,7 +2127,7 @@ namespace Internal {
                     }
                     debug(3) << "Write it back: "
                              << write_back << "\n";
-                    data_write_back = Allocate::make("dup$$" + offload_func.name(), output_type, extents, const_true(),
+                    data_write_back = Allocate::make("dup$$" + offload_func.name(), output_type, MemoryType::Auto, extents, const_true(),
                                                      write_back);
                 }
 
@@ -2135,7 +2135,7 @@ namespace Internal {
                 {
                     const Allocate *allocate = data_write_back.as<Allocate>();
                     internal_assert(allocate);
-                    new_body = Allocate::make(allocate->name, allocate->type, allocate->extents, allocate->condition,
+                    new_body = Allocate::make(allocate->name, allocate->type, allocate->memory_type, allocate->extents, allocate->condition,
                                               Block::make(new_body, allocate->body));
                 }
 
@@ -2143,7 +2143,7 @@ namespace Internal {
                     const Allocate *allocate = data_duplicators[i].as<Allocate>();
                     internal_assert(allocate);
                     debug(3) << "Duplicate " << allocate->name << "\n";
-                    new_body = Allocate::make(allocate->name, allocate->type, allocate->extents, allocate->condition,
+                    new_body = Allocate::make(allocate->name, allocate->type, allocate->memory_type, allocate->extents, allocate->condition,
                                               Block::make(allocate->body, new_body));
                 }
 
@@ -2,6 +2,8 @@
 
 #include "Pipeline.h"
 #include "Argument.h"
+#include "AutoSchedule.h"
+#include "Bounds.h"
 #include "Func.h"
 #include "IRVisitor.h"
 #include "LLVM_Headers.h"
@@ -102,8 +104,18 @@ struct PipelineContents {
      * define_extern calls. */
     std::map<std::string, JITExtern> jit_externs;
 
+    /** Analyses of the algorithm from the last time it was
+     * lowered. These depend only on the definitions of the Funcs, so
+     * unlike the compiled code they survive schedule changes. */
+    FuncValueBoundsCache func_value_bounds;
+
+    /** Whether to record a profile of each compilation, and the most
+     * recent one recorded. */
+    bool compile_profiling;
+    CompileProfile compile_profile;
+
     PipelineContents() :
-        module("", Target()) {
+        module("", Target()), compile_profiling(false) {
         // user_context needs to be a const void * (not a non-const void *)
         // to maintain backwards compatibility with existing code.
         user_context_arg.arg = Argument("__user_context", Argument::InputScalar, type_of<const void*>(), 0);
@@ -126,6 +138,37 @@ struct PipelineContents {
     }
 };
 
+struct CallableContents {
+    mutable RefCount ref_count;
+
+    // Keeps the compiled code alive.
+    JITModule jit_module;
+    JITModule::argv_wrapper argv_function;
+    Target target;
+    JITHandlers jit_handlers;
+
+    // The arguments the user passes, in order, followed by the outputs.
+    vector<Argument> args;
+
+    // Where each argument of the jitted function comes from: an index
+    // into the user's arguments, or one of the values below.
+    enum { UserContextSlot = -1, ConstantSlot = -2 };
+    struct Slot {
+        int arg_index;
+        const void *constant;
+    };
+    vector<Slot> slots;
+
+    // Buffers embedded in the pipeline, kept alive for the constant slots.
+    vector<Buffer<>> embedded_buffers;
+
+    // Non-null if the pipeline was compiled with profiling.
+    void (*profiler_report)(void *);
+    void (*profiler_reset)();
+
+    CallableContents() : argv_function(nullptr), profiler_report(nullptr), profiler_reset(nullptr) {}
+};
+
 namespace Internal {
 template<>
 EXPORT RefCount &ref_count<PipelineContents>(const PipelineContents *p) {
@@ -136,6 +179,23 @@ template<>
 EXPORT void destroy<PipelineContents>(const PipelineContents *p) {
     delete p;
 }
+
+template<>
+EXPORT RefCount &ref_count<CallableContents>(const CallableContents *p) {
+    return p->ref_count;
+}
+
+template<>
+EXPORT void destroy<CallableContents>(const CallableContents *p) {
+    delete p;
+}
+}
+
+namespace {
+// Where a compilation of a pipeline should store its profile, if anywhere.
+CompileProfile *compile_profile_dest(const IntrusivePtr<PipelineContents> &contents) {
+    return (contents.defined() && contents->compile_profiling) ? &contents->compile_profile : nullptr;
+}
 }
 
 Pipeline::Pipeline() : contents(nullptr) {
@@ -170,6 +230,7 @@ void Pipeline::compile_to(const Outputs &output_files,
                           const string &fn_name,
                           const Target &target) {
     user_assert(defined()) << "Can't compile undefined Pipeline.\n";
+    CompileProfileScope profile_scope(compile_profile_dest(contents));
 
     for (Function f : contents->outputs) {
         user_assert(f.has_pure_definition() || f.has_extern_definition())
@@ -184,6 +245,7 @@ void Pipeline::compile_to_bitcode(const string &filename,
                                   const vector<Argument> &args,
                                   const string &fn_name,
                                   const Target &target) {
+    CompileProfileScope profile_scope(compile_profile_dest(contents));
     Module m = compile_to_module(args, fn_name, target);
     m.compile(Outputs().bitcode(output_name(filename, m, ".bc")));
 }
@@ -192,6 +254,7 @@ void Pipeline::compile_to_llvm_assembly(const string &filename,
                                         const vector<Argument> &args,
                                         const string &fn_name,
                                         const Target &target) {
+    CompileProfileScope profile_scope(compile_profile_dest(contents));
     Module m = compile_to_module(args, fn_name, target);
     m.compile(Outputs().llvm_assembly(output_name(filename, m, ".ll")));
 }
@@ -200,6 +263,7 @@ void Pipeline::compile_to_object(const string &filename,
                                  const vector<Argument> &args,
                                  const string &fn_name,
                                  const Target &target) {
+    CompileProfileScope profile_scope(compile_profile_dest(contents));
     Module m = compile_to_module(args, fn_name, target);
     const char* ext = target.os == Target::Windows && !target.has_feature(Target::MinGW) ? ".obj" : ".o";
     m.compile(Outputs().object(output_name(filename, m, ext)));
@@ -209,6 +273,7 @@ void Pipeline::compile_to_header(const string &filename,
                                  const vector<Argument> &args,
                                  const string &fn_name,
                                  const Target &target) {
+    CompileProfileScope profile_scope(compile_profile_dest(contents));
     Module m = compile_to_module(args, fn_name, target);
     m.compile(Outputs().c_header(output_name(filename, m, ".h")));
 }
@@ -217,6 +282,7 @@ void Pipeline::compile_to_assembly(const string &filename,
                                    const vector<Argument> &args,
                                    const string &fn_name,
                                    const Target &target) {
+    CompileProfileScope profile_scope(compile_profile_dest(contents));
     Module m = compile_to_module(args, fn_name, target);
     m.compile(Outputs().assembly(output_name(filename, m, ".s")));
 }
@@ -226,6 +292,7 @@ void Pipeline::compile_to_c(const string &filename,
                             const vector<Argument> &args,
                             const string &fn_name,
                             const Target &target) {
+    CompileProfileScope profile_scope(compile_profile_dest(contents));
     Module m = compile_to_module(args, fn_name, target);
     m.compile(Outputs().c_source(output_name(filename, m, ".c")));
 }
@@ -239,6 +306,7 @@ void Pipeline::compile_to_lowered_stmt(const string &filename,
                                        const vector<Argument> &args,
                                        StmtOutputFormat fmt,
                                        const Target &target) {
+    CompileProfileScope profile_scope(compile_profile_dest(contents));
     Module m = compile_to_module(args, "", target);
     Outputs outputs;
     if (fmt == HTML) {
@@ -253,6 +321,7 @@ void Pipeline::compile_to_static_library(const string &filename_prefix,
                                          const vector<Argument> &args,
                                          const std::string &fn_name,
                                          const Target &target) {
+    CompileProfileScope profile_scope(compile_profile_dest(contents));
     Module m = compile_to_module(args, fn_name, target);
     Outputs outputs = static_library_outputs(filename_prefix, target);
     m.compile(outputs);
@@ -261,6 +330,7 @@ void Pipeline::compile_to_static_library(const string &filename_prefix,
 void Pipeline::compile_to_multitarget_static_library(const std::string &filename_prefix,
                                                      const std::vector<Argument> &args,
                                                      const std::vector<Target> &targets) {
+    CompileProfileScope profile_scope(compile_profile_dest(contents));
     auto module_producer = [this, &args](const std::string &name, const Target &target) -> Module {
         return compile_to_module(args, name, target);
     };
@@ -272,6 +342,7 @@ void Pipeline::compile_to_file(const string &filename_prefix,
                                const vector<Argument> &args,
                                const std::string &fn_name,
                                const Target &target) {
+    CompileProfileScope profile_scope(compile_profile_dest(contents));
     Module m = compile_to_module(args, fn_name, target);
     Outputs outputs = Outputs().c_header(filename_prefix + ".h");
 
@@ -287,6 +358,7 @@ void Pipeline::compile_to_sdsoc(const string &filename_prefix,
                                const vector<Argument> &args,
                                const std::string &fn_name,
                                const Target &target) {
+    CompileProfileScope profile_scope(compile_profile_dest(contents));
     Module m = compile_to_module(args, fn_name, target);
     Outputs outputs = Outputs().sdsoc_header(filename_prefix + ".h");
     outputs = outputs.sdsoc_top(filename_prefix + ".cpp");
@@ -557,6 +629,7 @@ Module Pipeline::compile_to_module(const vector<Argument> &args,
                                    const Target &target,
                                    const Internal::LoweredFunc::LinkageType linkage_type) {
     user_assert(defined()) << "Can't compile undefined Pipeline\n";
+    CompileProfileScope profile_scope(compile_profile_dest(contents));
     string new_fn_name(fn_name);
     if (new_fn_name.empty()) {
         new_fn_name = generate_function_name();
@@ -592,7 +665,8 @@ Module Pipeline::compile_to_module(const vector<Argument> &args,
             custom_passes.push_back(p.pass);
         }
 
-        private_body = lower(contents->outputs, fn_name, target, custom_passes);
+        private_body = lower(contents->outputs, fn_name, target, custom_passes,
+                             &contents->func_value_bounds);
     }
 
     std::vector<std::string> namespaces;
@@ -674,6 +748,8 @@ void *Pipeline::compile_jit(const Target &target_arg) {
 
     contents->jit_target = target;
 
+    CompileProfileScope profile_scope(compile_profile_dest(contents));
+
     // Infer an arguments vector
     infer_arguments();
 
@@ -717,6 +793,80 @@ void *Pipeline::compile_jit(const Target &target_arg) {
     return jit_module.main_function();
 }
 
+string Pipeline::auto_schedule(const Target &target, const MachineParams &arch_params) {
+    user_assert(defined()) << "Pipeline is undefined\n";
+    string schedule = generate_schedules(contents->outputs, target, arch_params);
+    invalidate_cache();
+    return schedule;
+}
+
+Callable Pipeline::compile_to_callable(const vector<Argument> &args, const Target &target) {
+    user_assert(defined()) << "Pipeline is undefined\n";
+
+    compile_jit(target);
+
+    CallableContents *c = new CallableContents;
+    c->jit_module = contents->jit_module;
+    c->argv_function = contents->jit_module.argv_function();
+    internal_assert(c->argv_function);
+    c->target = contents->jit_target;
+    c->jit_handlers = contents->jit_handlers;
+
+    c->args = args;
+    for (Function out : contents->outputs) {
+        for (Parameter buf : out.output_buffers()) {
+            c->args.push_back(Argument(buf.name(), Argument::OutputBuffer,
+                                       buf.type(), buf.dimensions()));
+        }
+    }
+
+    // The jitted function takes the inferred arguments, then the outputs.
+    for (const InferredArgument &arg : contents->inferred_args) {
+        CallableContents::Slot slot = {CallableContents::ConstantSlot, nullptr};
+        if (arg.param.same_as(contents->user_context_arg.param)) {
+            slot.arg_index = CallableContents::UserContextSlot;
+        } else if (arg.buffer.defined()) {
+            c->embedded_buffers.push_back(arg.buffer);
+            slot.constant = arg.buffer.raw_buffer();
+        } else {
+            for (size_t i = 0; i < args.size(); i++) {
+                if (args[i].name == arg.arg.name) {
+                    slot.arg_index = (int)i;
+                }
+            }
+            user_assert(slot.arg_index >= 0)
+                << "Can't make a Callable because the pipeline uses parameter "
+                << arg.arg.name << ", which is not in the argument list.\n";
+        }
+        c->slots.push_back(slot);
+    }
+    for (size_t i = args.size(); i < c->args.size(); i++) {
+        CallableContents::Slot slot = {(int)i, nullptr};
+        c->slots.push_back(slot);
+    }
+
+    if (c->target.has_feature(Target::Profile)) {
+        JITModule::Symbol report_sym = c->jit_module.find_symbol_by_name("halide_profiler_report");
+        JITModule::Symbol reset_sym = c->jit_module.find_symbol_by_name("halide_profiler_reset");
+        if (report_sym.address && reset_sym.address) {
+            c->profiler_report = (void (*)(void *))(report_sym.address);
+            c->profiler_reset = (void (*)())(reset_sym.address);
+        }
+    }
+
+    return Callable(c);
+}
+
+
+void Pipeline::set_compile_profiling(bool enable) {
+    user_assert(defined()) << "Pipeline is undefined\n";
+    contents->compile_profiling = enable;
+}
+
+const CompileProfile &Pipeline::compile_profile() const {
+    user_assert(defined()) << "Pipeline is undefined\n";
+    return contents->compile_profile;
+}
 
 void Pipeline::set_error_handler(void (*handler)(void *, const char *)) {
     user_assert(defined()) << "Pipeline is undefined\n";
@@ -880,10 +1030,12 @@ struct ErrorBuffer {
 struct JITFuncCallContext {
     ErrorBuffer error_buffer;
     JITUserContext jit_context;
-    Parameter &user_context_param;
+    Parameter *user_context_param;
     bool custom_error_handler;
 
-    JITFuncCallContext(const JITHandlers &handlers, Parameter &user_context_param)
+    // If user_context_param is non-null, it's pointed at the
+    // jit_context for the duration of the call.
+    JITFuncCallContext(const JITHandlers &handlers, Parameter *user_context_param)
         : user_context_param(user_context_param) {
         void *user_context = nullptr;
         JITHandlers local_handlers = handlers;
@@ -895,7 +1047,9 @@ struct JITFuncCallContext {
             custom_error_handler = true;
         }
         JITSharedRuntime::init_jit_user_context(jit_context, user_context, local_handlers);
-        user_context_param.set_scalar(&jit_context);
+        if (user_context_param) {
+            user_context_param->set_scalar(&jit_context);
+        }
 
         debug(2) << "custom_print: " << (void *)jit_context.handlers.custom_print << '\n'
                  << "custom_malloc: " << (void *)jit_context.handlers.custom_malloc << '\n'
@@ -922,7 +1076,9 @@ struct JITFuncCallContext {
 
     void finalize(int exit_status) {
         report_if_error(exit_status);
-        user_context_param.set_scalar((void *)nullptr); // Don't leave param hanging with pointer to stack.
+        if (user_context_param) {
+            user_context_param->set_scalar((void *)nullptr); // Don't leave param hanging with pointer to stack.
+        }
     }
 };
 
@@ -1120,7 +1276,7 @@ void Pipeline::realize(Realization dst, const Target &t) {
     // user_context is just a pointer to a JITUserContext, which is a
     // member of the JITFuncCallContext which we will declare now:
 
-    JITFuncCallContext jit_context(jit_handlers(), contents->user_context_arg.param);
+    JITFuncCallContext jit_context(jit_handlers(), &contents->user_context_arg.param);
 
     // The handlers in the jit_context default to the default handlers
     // in the runtime of the shared module (e.g. halide_print_impl,
@@ -1170,7 +1326,7 @@ void Pipeline::realize(Realization dst, const Target &t) {
         JITModule::Symbol reset_sym =
             contents->jit_module.find_symbol_by_name("halide_profiler_reset");
         if (report_sym.address && reset_sym.address) {
-            void *uc = jit_context.user_context_param.get_scalar<void *>();
+            void *uc = &jit_context.jit_context;
             void (*report_fn_ptr)(void *) = (void (*)(void *))(report_sym.address);
             report_fn_ptr(uc);
 
@@ -1182,6 +1338,79 @@ void Pipeline::realize(Realization dst, const Target &t) {
     jit_context.finalize(exit_status);
 }
 
+Callable::Callable() {
+}
+
+Callable::Callable(CallableContents *c) : contents(c) {
+}
+
+bool Callable::defined() const {
+    return contents.defined();
+}
+
+const vector<Argument> &Callable::arguments() const {
+    user_assert(defined()) << "Callable is undefined\n";
+    return contents->args;
+}
+
+int Callable::call(const Arg *args, size_t num_args) const {
+    user_assert(defined()) << "Can't call an undefined Callable\n";
+    user_assert(num_args == contents->args.size())
+        << "Callable takes " << contents->args.size()
+        << " arguments, but was called with " << num_args << "\n";
+
+    for (size_t i = 0; i < num_args; i++) {
+        const Argument &a = contents->args[i];
+        if (a.is_buffer()) {
+            user_assert(args[i].is_buffer && args[i].value)
+                << "Argument " << i << " of Callable is buffer " << a.name
+                << ", but was passed a scalar or a null buffer\n";
+        } else {
+            user_assert(!args[i].is_buffer)
+                << "Argument " << i << " of Callable is scalar " << a.name
+                << ", but was passed a buffer\n";
+            user_assert(args[i].type.code() == a.type.code() &&
+                        args[i].type.bits() == a.type.bits())
+                << "Argument " << i << " of Callable is scalar " << a.name
+                << " of type " << a.type << ", but was passed a value of type "
+                << args[i].type << "\n";
+        }
+    }
+
+    JITFuncCallContext jit_context(contents->jit_handlers, nullptr);
+    const void *user_context = &jit_context.jit_context;
+
+    // Avoid allocating for all but very long argument lists.
+    const size_t max_stack_args = 32;
+    const void *stack_argv[max_stack_args];
+    vector<const void *> heap_argv;
+    const void **argv = stack_argv;
+    if (contents->slots.size() > max_stack_args) {
+        heap_argv.resize(contents->slots.size());
+        argv = heap_argv.data();
+    }
+    for (size_t i = 0; i < contents->slots.size(); i++) {
+        const CallableContents::Slot &slot = contents->slots[i];
+        if (slot.arg_index >= 0) {
+            argv[i] = args[slot.arg_index].value;
+        } else if (slot.arg_index == CallableContents::UserContextSlot) {
+            argv[i] = &user_context;
+        } else {
+            argv[i] = slot.constant;
+        }
+    }
+
+    int exit_status = contents->argv_function(argv);
+
+    if (contents->profiler_report) {
+        contents->profiler_report(&jit_context.jit_context);
+        contents->profiler_reset();
+    }
+
+    jit_context.finalize(exit_status);
+    return exit_status;
+}
+
 void Pipeline::infer_input_bounds(Realization dst) {
 
     Target target = get_jit_target_from_environment();
@@ -1217,7 +1446,7 @@ void Pipeline::infer_input_bounds(Realization dst) {
         return;
     }
 
-    JITFuncCallContext jit_context(jit_handlers(), contents->user_context_arg.param);
+    JITFuncCallContext jit_context(jit_handlers(), &contents->user_context_arg.param);
 
     int iter = 0;
     const int max_iters = 16;
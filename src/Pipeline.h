@@ -9,6 +9,7 @@
 
 #include <vector>
 
+#include "CompileProfile.h"
 #include "IntrusivePtr.h"
 #include "JITModule.h"
 #include "Module.h"
@@ -18,6 +19,8 @@
 namespace Halide {
 
 struct Argument;
+class Callable;
+struct CallableContents;
 class Func;
 struct Outputs;
 struct PipelineContents;
@@ -51,6 +54,27 @@ struct CustomLoweringPass {
 
 struct JITExtern;
 
+/** A description of the machine a pipeline will run on, for the
+ * auto-scheduler's cost model. */
+struct MachineParams {
+    /** The number of cores to keep busy. */
+    int parallelism;
+    /** The size in bytes of the last level of cache. */
+    int last_level_cache_size;
+    /** The cost of loading a value from main memory, relative to an
+     * arithmetic operation. */
+    float balance;
+
+    MachineParams(int parallelism, int llc, float balance) :
+        parallelism(parallelism), last_level_cache_size(llc), balance(balance) {}
+
+    /** Parameters that suit a typical multi-core desktop CPU. */
+    EXPORT static MachineParams generic();
+
+    /** A string of the form "parallelism,last_level_cache_size,balance". */
+    EXPORT std::string to_string() const;
+};
+
 /** A class representing a Halide pipeline. Constructed from the Func
  * or Funcs that it outputs. */
 class Pipeline {
@@ -197,6 +221,18 @@ public:
                                     const Target &target = get_target_from_environment(),
                                     const Internal::LoweredFunc::LinkageType linkage_type = Internal::LoweredFunc::External);
 
+    /** Record a CompileProfile of subsequent compilations of this
+     * Pipeline: the wall time, peak memory and IR size of each
+     * lowering pass and each phase of LLVM code generation. Setting
+     * the environment variable HL_COMPILE_PROFILE prints the same
+     * profile to stderr for every compilation, as JSON if it is set to
+     * "json", or as a table otherwise. */
+    EXPORT void set_compile_profiling(bool enable);
+
+    /** The profile of the most recent compilation done while compile
+     * profiling was enabled. */
+    EXPORT const CompileProfile &compile_profile() const;
+
    /** Eagerly jit compile the function to machine code. This
      * normally happens on the first call to realize. If you're
      * running your halide pipeline inside time-sensitive code and
@@ -207,6 +243,31 @@ public:
      */
      EXPORT void *compile_jit(const Target &target = get_jit_target_from_environment());
 
+    /** Schedule the functions in this pipeline for the given CPU
+     * target. Chooses which functions to inline, which to compute at
+     * tiles of their consumers and which to compute at root, and how
+     * to tile, vectorize and parallelize, using a cost model of
+     * arithmetic and memory traffic tuned by arch_params. Functions
+     * that have already been scheduled are left as they are. Every
+     * output needs an estimate of its size (see Func::estimate).
+     * Returns the schedule as C++ source that can be pasted into the
+     * pipeline's definition. */
+    EXPORT std::string auto_schedule(const Target &target,
+                                     const MachineParams &arch_params = MachineParams::generic());
+
+    /** Jit compile the pipeline into a Callable that takes the given
+     * arguments, followed by one buffer per output (one per tuple
+     * component for Funcs that return Tuples). Calling it passes its
+     * arguments straight to the compiled code: unlike realize, it
+     * doesn't look at the values bound to Params and ImageParams, or
+     * allocate anything, so it's suitable for calling a pipeline at a
+     * high rate on small inputs. The Callable uses the custom handlers
+     * set on this Pipeline at the time it was made, and stays valid
+     * if the Pipeline is later changed or destroyed. Every Param and
+     * ImageParam the pipeline uses must appear in args. */
+    EXPORT Callable compile_to_callable(const std::vector<Argument> &args,
+                                        const Target &target = get_jit_target_from_environment());
+
     /** Set the error handler function that be called in the case of
      * runtime errors during halide pipelines. If you are compiling
      * statically, you can also just define your own function with
@@ -480,6 +541,64 @@ public:
     const ExternCFunction &extern_c_function() const { return extern_c_function_; }
 };
 
+/** A jit-compiled pipeline with a fixed argument list. Made by
+ * Pipeline::compile_to_callable. Call it with a value for each of the
+ * arguments given to compile_to_callable, in the same order, followed
+ * by the output buffers. Buffers may be passed as Buffer<T> or
+ * buffer_t *, and scalars as values of the type of the
+ * corresponding Param:
+ \code
+ Callable c = p.compile_to_callable({input, scale});
+ c(in_buf, 0.5f, out_buf);
+ \endcode
+ * Returns the exit status of the pipeline. Errors are reported as
+ * for realize, unless a custom error handler was installed, in which
+ * case the nonzero exit status is just returned. A Callable may be
+ * called from multiple threads at once. */
+class Callable {
+    Internal::IntrusivePtr<CallableContents> contents;
+
+    struct Arg {
+        const void *value;
+        bool is_buffer;
+        Type type;
+    };
+
+    template<typename T>
+    static Arg make_arg(const Buffer<T> &buf) {
+        return {buf.raw_buffer(), true, Type()};
+    }
+
+    static Arg make_arg(buffer_t *buf) {
+        return {buf, true, Type()};
+    }
+
+    template<typename T>
+    static Arg make_arg(const T &scalar) {
+        return {&scalar, false, type_of<T>()};
+    }
+
+    EXPORT int call(const Arg *args, size_t num_args) const;
+
+    friend class Pipeline;
+    EXPORT Callable(CallableContents *contents);
+
+public:
+    /** Make an undefined Callable. */
+    EXPORT Callable();
+
+    EXPORT bool defined() const;
+
+    /** The arguments the Callable expects, including the outputs. */
+    EXPORT const std::vector<Argument> &arguments() const;
+
+    template<typename... Args>
+    int operator()(const Args &... args) const {
+        const Arg arg_array[] = {make_arg(args)..., Arg()};
+        return call(arg_array, sizeof...(Args));
+    }
+};
+
 }  // namespace Halide
 
 #endif
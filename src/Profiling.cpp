@@ -47,6 +47,10 @@ private:
 
     bool profiling_memory = true;
 
+    // The names of the LetStmts enclosing the current node, with
+    // multiplicity.
+    map<string, int> enclosing_lets;
+
     // Strip down the tuple name, e.g. f.0 into f
     string normalize_name(const string &name) {
         vector<string> v = split_string(name, ".");
@@ -70,6 +74,7 @@ private:
     Expr compute_allocation_size(const vector<Expr> &extents,
                                  const Expr &condition,
                                  const Type &type,
+                                 MemoryType memory_type,
                                  const std::string &name,
                                  bool &on_stack) {
         on_stack = true;
@@ -82,7 +87,7 @@ private:
         int32_t constant_size = Allocate::constant_allocation_size(extents, name);
         if (constant_size > 0) {
             int64_t stack_bytes = constant_size * type.bytes();
-            if (can_allocation_fit_on_stack(stack_bytes)) { // Allocation on stack
+            if (allocation_goes_on_stack(name, memory_type, stack_bytes)) { // Allocation on stack
                 return make_const(UInt(64), stack_bytes);
             }
         }
@@ -112,7 +117,16 @@ private:
         Expr condition = mutate(op->condition);
 
         bool on_stack;
-        Expr size = compute_allocation_size(new_extents, condition, op->type, op->name, on_stack);
+        Expr size;
+        const Call *storage = op->new_expr.as<Call>();
+        if (storage && storage->is_intrinsic(Call::address_of)) {
+            // This allocation lives inside the storage of another one
+            // (see plan_memory), which is already counted.
+            on_stack = false;
+            size = make_zero(UInt(64));
+        } else {
+            size = compute_allocation_size(new_extents, condition, op->type, op->memory_type, op->name, on_stack);
+        }
         internal_assert(size.type() == UInt(64));
         func_alloc_sizes.push(op->name, {on_stack, size});
 
@@ -139,7 +153,7 @@ private:
             new_expr.same_as(op->new_expr)) {
             stmt = op;
         } else {
-            stmt = Allocate::make(op->name, op->type, new_extents, condition, body, new_expr, op->free_function);
+            stmt = Allocate::make(op->name, op->type, op->memory_type, new_extents, condition, body, new_expr, op->free_function);
         }
 
         if (!is_zero(size) && !on_stack && profiling_memory) {
@@ -181,6 +195,39 @@ private:
         }
     }
 
+    void visit(const LetStmt *op) {
+        enclosing_lets[op->name]++;
+        IRMutator::visit(op);
+        if (--enclosing_lets[op->name] == 0) {
+            enclosing_lets.erase(op->name);
+        }
+    }
+
+    // The number of points computed by a produce node of the given
+    // Func, from the bounds of its pure definition, or an undefined
+    // Expr if those bounds have been simplified away.
+    Expr produced_points(const string &name) {
+        Expr points;
+        const string prefix = name + ".s0.";
+        for (auto it = enclosing_lets.lower_bound(prefix);
+             it != enclosing_lets.end() && starts_with(it->first, prefix); ++it) {
+            const string &var = it->first;
+            if (!ends_with(var, ".max") ||
+                var.find('.', prefix.size()) != var.size() - 4) {
+                continue;
+            }
+            string min_var = var.substr(0, var.size() - 4) + ".min";
+            if (!enclosing_lets.count(min_var)) {
+                return Expr();
+            }
+            Expr extent = (Variable::make(Int(32), var) -
+                           Variable::make(Int(32), min_var) + 1);
+            extent = cast<uint64_t>(max(extent, 0));
+            points = points.defined() ? points * extent : extent;
+        }
+        return points;
+    }
+
     void visit(const ProducerConsumer *op) {
         int idx;
         Stmt body;
@@ -189,6 +236,15 @@ private:
             stack.push_back(idx);
             body = mutate(op->body);
             stack.pop_back();
+
+            Expr points = produced_points(op->name);
+            if (points.defined() && profiling_memory) {
+                Expr profiler_state = Variable::make(Handle(), "profiler_state");
+                Expr profiler_pipeline_state = Variable::make(Handle(), "profiler_pipeline_state");
+                Expr count = Call::make(Int(32), "halide_profiler_count_pixels",
+                                        {profiler_state, profiler_pipeline_state, idx, points}, Call::Extern);
+                body = Block::make(Evaluate::make(count), body);
+            }
         } else {
             body = mutate(op->body);
             // At the beginning of the consume step, set the current task
@@ -226,10 +282,6 @@ private:
             Evaluate::make(Call::make(Int(32), "halide_profiler_decr_active_threads",
                                       {state}, Call::Extern));
 
-        if (update_active_threads) {
-            body = Block::make({incr_active_threads, body, decr_active_threads});
-        }
-
         // We profile by storing a token to global memory, so don't enter GPU loops
         if (op->device_api == DeviceAPI::Hexagon) {
             // TODO: This is for all offload targets that support
@@ -254,6 +306,20 @@ private:
             body = op->body;
         }
 
+        if (op->is_parallel() && !stack.empty()) {
+            // Tasks may run on threads that have never run this
+            // pipeline, so tell the profiler which Func a worker is
+            // computing as soon as it picks up a task.
+            Expr profiler_token = Variable::make(Int(32), "profiler_token");
+            Expr set_task = Call::make(Int(32), "halide_profiler_set_current_func",
+                                       {state, profiler_token, stack.back()}, Call::Extern);
+            body = Block::make(Evaluate::make(set_task), body);
+        }
+
+        if (update_active_threads) {
+            body = Block::make({incr_active_threads, body, decr_active_threads});
+        }
+
         stmt = For::make(op->name, op->min, op->extent, op->for_type, op->device_api, body);
 
         if (update_active_threads) {
@@ -318,7 +384,7 @@ Stmt inject_profiling(Stmt s, string pipeline_name) {
                                         i, Parameter(), const_true()), s);
         }
         s = Block::make(s, Free::make("profiling_func_stack_peak_buf"));
-        s = Allocate::make("profiling_func_stack_peak_buf", UInt(64), {num_funcs}, const_true(), s);
+        s = Allocate::make("profiling_func_stack_peak_buf", UInt(64), MemoryType::Auto, {num_funcs}, const_true(), s);
     }
 
     for (std::pair<string, int> p : profiling.indices) {
@@ -326,7 +392,7 @@ Stmt inject_profiling(Stmt s, string pipeline_name) {
     }
 
     s = Block::make(s, Free::make("profiling_func_names"));
-    s = Allocate::make("profiling_func_names", Handle(), {num_funcs}, const_true(), s);
+    s = Allocate::make("profiling_func_names", Handle(), MemoryType::Auto, {num_funcs}, const_true(), s);
     s = Block::make(Evaluate::make(stop_profiler), s);
 
     return s;
@@ -60,7 +60,7 @@ class RemoveDeadAllocations : public IRMutator {
         } else if (body.same_as(op->body)) {
             stmt = op;
         } else {
-            stmt = Allocate::make(op->name, op->type, op->extents, op->condition, body, op->new_expr, op->free_function);
+            stmt = Allocate::make(op->name, op->type, op->memory_type, op->extents, op->condition, body, op->new_expr, op->free_function);
         }
     }
 
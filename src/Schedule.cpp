@@ -75,9 +75,13 @@ struct ScheduleContents {
     std::vector<Dim> dims;
     std::vector<StorageDim> storage_dims;
     std::vector<Bound> bounds;
+    std::vector<Bound> estimates;
     std::vector<Prefetch> prefetches;
     std::map<std::string, IntrusivePtr<Internal::FunctionContents>> wrappers;
     bool memoized;
+    bool async;
+    bool loop_carry;
+    MemoryType memory_type;
     bool touched;
     bool allow_race_conditions;
 
@@ -85,7 +89,7 @@ struct ScheduleContents {
 	std::vector<std::string> offloaded_stages;
     std::map<std::string, int> stream_depth;
 
-    ScheduleContents() : memoized(false), touched(false), allow_race_conditions(false) {}
+    ScheduleContents() : memoized(false), async(false), loop_carry(false), memory_type(MemoryType::Auto), touched(false), allow_race_conditions(false) {}
 
     // Pass an IRMutator through to all Exprs referenced in the ScheduleContents
     void mutate(IRMutator *mutator) {
@@ -116,6 +120,14 @@ struct ScheduleContents {
                 b.remainder = mutator->mutate(b.remainder);
             }
         }
+        for (Bound &b : estimates) {
+            if (b.min.defined()) {
+                b.min = mutator->mutate(b.min);
+            }
+            if (b.extent.defined()) {
+                b.extent = mutator->mutate(b.extent);
+            }
+        }
         for (Prefetch &p : prefetches) {
             if (p.offset.defined()) {
                 p.offset = mutator->mutate(p.offset);
@@ -149,8 +161,12 @@ Schedule Schedule::deep_copy(
     copy.contents->dims = contents->dims;
     copy.contents->storage_dims = contents->storage_dims;
     copy.contents->bounds = contents->bounds;
+    copy.contents->estimates = contents->estimates;
     copy.contents->prefetches = contents->prefetches;
     copy.contents->memoized = contents->memoized;
+    copy.contents->async = contents->async;
+    copy.contents->loop_carry = contents->loop_carry;
+    copy.contents->memory_type = contents->memory_type;
     copy.contents->touched = contents->touched;
     copy.contents->allow_race_conditions = contents->allow_race_conditions;
     //FPGA's stuffs
@@ -182,6 +198,30 @@ bool Schedule::memoized() const {
     return contents->memoized;
 }
 
+bool &Schedule::async() {
+    return contents->async;
+}
+
+bool Schedule::async() const {
+    return contents->async;
+}
+
+bool &Schedule::loop_carry() {
+    return contents->loop_carry;
+}
+
+bool Schedule::loop_carry() const {
+    return contents->loop_carry;
+}
+
+MemoryType &Schedule::memory_type() {
+    return contents->memory_type;
+}
+
+MemoryType Schedule::memory_type() const {
+    return contents->memory_type;
+}
+
 bool &Schedule::touched() {
     return contents->touched;
 }
@@ -222,6 +262,14 @@ const std::vector<Bound> &Schedule::bounds() const {
     return contents->bounds;
 }
 
+std::vector<Bound> &Schedule::estimates() {
+    return contents->estimates;
+}
+
+const std::vector<Bound> &Schedule::estimates() const {
+    return contents->estimates;
+}
+
 std::vector<Prefetch> &Schedule::prefetches() {
     return contents->prefetches;
 }
@@ -311,6 +359,14 @@ void Schedule::accept(IRVisitor *visitor) const {
             b.remainder.accept(visitor);
         }
     }
+    for (const Bound &b : estimates()) {
+        if (b.min.defined()) {
+            b.min.accept(visitor);
+        }
+        if (b.extent.defined()) {
+            b.extent.accept(visitor);
+        }
+    }
     for (const Prefetch &p : prefetches()) {
         if (p.offset.defined()) {
             p.offset.accept(visitor);
@@ -227,6 +227,27 @@ public:
     bool memoized() const;
     // @}
 
+    /** This flag is set to true if the Func is computed on its own
+     * task, concurrently with its consumers. See Func::async. */
+    // @{
+    bool &async();
+    bool async() const;
+    // @}
+
+    /** This flag is set to true if values loaded in one iteration of
+     * the Func's innermost loops should be carried in registers to
+     * the next. See Func::loop_carry. */
+    // @{
+    bool &loop_carry();
+    bool loop_carry() const;
+    // @}
+
+    /** Where the storage of the Func lives. See Func::store_in. */
+    // @{
+    MemoryType &memory_type();
+    MemoryType memory_type() const;
+    // @}
+
     /** This flag is set to true if the dims list has been manipulated
      * by the user (or if a ScheduleHandle was created that could have
      * been used to manipulate it). It controls the warning that
@@ -279,6 +300,13 @@ public:
     std::vector<Bound> &bounds();
     // @}
 
+    /** Estimates of the region of a function that will be required,
+     * used only by the auto-scheduler. See \ref Func::estimate */
+    // @{
+    const std::vector<Bound> &estimates() const;
+    std::vector<Bound> &estimates();
+    // @}
+
     /** You may perform prefetching in some of the dimensions of a
      * function. See \ref Func::prefetch */
     // @{
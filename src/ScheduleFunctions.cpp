@@ -995,6 +995,11 @@ void validate_schedule(Function f, Stmt s, const Target &target, bool is_output,
     // Outputs must be compute_root and store_root. They're really
     // store_in_user_code, but store_root is close enough.
     if (is_output) {
+        user_assert(!f.schedule().async())
+            << "Func " << f.name() << " is an output, so it cannot be async.\n";
+        user_assert(f.schedule().memory_type() == MemoryType::Auto)
+            << "Func " << f.name() << " is an output, so its storage belongs"
+            << " to the caller and it cannot be scheduled with store_in.\n";
         if (store_at.is_root() && compute_at.is_root()) {
             return;
         } else {
@@ -1005,6 +1010,10 @@ void validate_schedule(Function f, Stmt s, const Target &target, bool is_output,
 
     // Inlining is allowed only if there is no specialization.
     if (store_at.is_inline() && compute_at.is_inline()) {
+        user_assert(!f.schedule().async())
+            << "Func " << f.name() << " is scheduled inline, so it"
+            << " cannot be async. Schedule it with compute_root or"
+            << " compute_at as well.\n";
         user_assert(f.definition().specializations().empty())
             << "Func " << f.name() << " is scheduled inline, so it"
             << " must not have any specializations. Specialize on the"
@@ -170,7 +170,8 @@ bool expr_is_pure(Expr e) {
 class Simplify : public IRMutator {
 public:
     Simplify(bool r, const Scope<Interval> *bi, const Scope<ModulusRemainder> *ai) :
-        simplify_lets(r) {
+        simplify_lets(r), context_epoch(0),
+        var_info(&context_epoch), bounds_info(&context_epoch), alignment_info(&context_epoch) {
         alignment_info.set_containing_scope(ai);
 
         // Only respect the constant bounds from the containing scope.
@@ -205,17 +206,82 @@ public:
     using IRMutator::mutate;
     */
 
+    // Simplifying an Expr depends only on the Expr and on the
+    // simplifier's scopes, so when the same node is mutated again
+    // while the scopes are unchanged, the previous result can be
+    // reused. Bounds inference produces Exprs that are DAGs with
+    // heavy sharing, and without this the simplifier walks each
+    // shared subtree once per path to it.
+    //
+    // Reusing a result skips counting the uses of let variables
+    // inside it, but the first mutation counted them in the same
+    // let scope, and the counts are only tested against zero.
+    Expr mutate(Expr e) {
+        if (!e.defined() ||
+            e.as<Variable>() ||
+            is_const(e)) {
+            // Not worth caching.
+            return IRMutator::mutate(e);
+        }
+
+        auto it = cache.find(e.get());
+        if (it != cache.end() && it->second.epoch == context_epoch) {
+            return it->second.result;
+        }
+
+        uint64_t epoch = context_epoch;
+        Expr result = IRMutator::mutate(e);
+
+        // If the scopes changed inside (because e contains a Let),
+        // the context this result is valid in can never recur.
+        if (epoch == context_epoch) {
+            CacheEntry &entry = cache[e.get()];
+            entry.expr = e;
+            entry.result = result;
+            entry.epoch = epoch;
+        }
+        return result;
+    }
+    using IRMutator::mutate;
+
 private:
     bool simplify_lets;
 
+    // Bumped whenever any of the scopes below change. Two visits with
+    // the same epoch see identical scopes.
+    uint64_t context_epoch;
+
+    // A Scope that bumps the context epoch when modified.
+    template<typename T>
+    class TrackedScope : public Scope<T> {
+        uint64_t *epoch;
+    public:
+        TrackedScope(uint64_t *epoch) : epoch(epoch) {}
+        void push(const std::string &name, const T &value) {
+            (*epoch)++;
+            Scope<T>::push(name, value);
+        }
+        void pop(const std::string &name) {
+            (*epoch)++;
+            Scope<T>::pop(name);
+        }
+    };
+
     struct VarInfo {
         Expr replacement;
         int old_uses, new_uses;
     };
 
-    Scope<VarInfo> var_info;
-    Scope<pair<int64_t, int64_t>> bounds_info;
-    Scope<ModulusRemainder> alignment_info;
+    struct CacheEntry {
+        // Holding the original Expr keeps its address from being reused.
+        Expr expr, result;
+        uint64_t epoch;
+    };
+    std::map<const IRNode *, CacheEntry> cache;
+
+    TrackedScope<VarInfo> var_info;
+    TrackedScope<pair<int64_t, int64_t>> bounds_info;
+    TrackedScope<ModulusRemainder> alignment_info;
 
 
     using IRMutator::visit;
@@ -4562,7 +4628,7 @@ private:
             equal(op->condition, body_if->condition)) {
             // We can move the allocation into the if body case. The
             // else case must not use it.
-            stmt = Allocate::make(op->name, op->type, new_extents,
+            stmt = Allocate::make(op->name, op->type, op->memory_type, new_extents,
                                   condition, body_if->then_case,
                                   new_expr, op->free_function);
             stmt = IfThenElse::make(body_if->condition, stmt, body_if->else_case);
@@ -4574,7 +4640,7 @@ private:
             stmt = op;
             debug(3) << op->name << "1\n";
         } else {
-            stmt = Allocate::make(op->name, op->type, new_extents,
+            stmt = Allocate::make(op->name, op->type, op->memory_type, new_extents,
                                   condition, body,
                                   new_expr, op->free_function);
 
@@ -6004,6 +6070,17 @@ void simplify_test() {
         check(e, e);
     }
 
+    // Each level of this DAG refers to the previous level twice, so
+    // walking it as a tree visits 2^64 nodes. Shared subexpressions
+    // are only simplified once.
+    {
+        Expr e = x;
+        for (int i = 0; i < 64; i++) {
+            e = select(e < 0, e, e + 1) - select(e < 0, e, e + 1);
+        }
+        check(e, 0);
+    }
+
     // This expression is used to cause infinite recursion.
     {
         Expr e = Broadcast::make(-16, 2) < (ramp(Cast::make(UInt(16), 7), Cast::make(UInt(16), 11), 2) - Broadcast::make(1, 2));
@@ -337,6 +337,12 @@ class SlidingWindowOnFunction : public IRMutator {
 
         new_body = mutate(new_body);
 
+        // We can't slide over a parallel loop, but we do slide over
+        // serial loops inside one. Each iteration of the parallel
+        // loop then starts with a warm-up that computes everything
+        // its first iteration of the serial loop needs, so the
+        // iterations don't depend on each other, and storage folding
+        // can give each thread its own circular buffer.
         if (op->for_type == ForType::Serial ||
             op->for_type == ForType::Unrolled) {
             new_body = SlidingWindowOnFunctionAndLoop(func, op->name, op->min).mutate(new_body);
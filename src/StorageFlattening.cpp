@@ -101,10 +101,12 @@ private:
         realizations.pop(op->name);
 
         vector<int> storage_permutation;
+        MemoryType memory_type;
         {
             auto iter = env.find(op->name);
             Function f = iter->second.first;
             internal_assert(iter != env.end()) << "Realize node refers to function not in environment.\n";
+            memory_type = f.schedule().memory_type();
             const vector<StorageDim> &storage_dims = f.schedule().storage_dims();
             const vector<string> &args = f.args();
             for (size_t i = 0; i < storage_dims.size(); i++) {
@@ -159,7 +161,7 @@ private:
         }
 
         // Make the allocation node
-        stmt = Allocate::make(op->name, op->types[0], extents, condition, stmt);
+        stmt = Allocate::make(op->name, op->types[0], memory_type, extents, condition, stmt);
 
         // Compute the strides
         for (int i = (int)op->bounds.size()-1; i > 0; i--) {
@@ -265,7 +267,7 @@ class PromoteToMemoryType : public IRMutator {
             for (Expr e : op->extents) {
                 extents.push_back(mutate(e));
             }
-            stmt = Allocate::make(op->name, t, extents,
+            stmt = Allocate::make(op->name, t, op->memory_type, extents,
                                   mutate(op->condition), mutate(op->body),
                                   mutate(op->new_expr), op->free_function);
         } else {
@@ -1,4 +1,5 @@
 #include "StorageFolding.h"
+#include "AsyncProducers.h"
 #include "IROperator.h"
 #include "IRMutator.h"
 #include "Simplify.h"
@@ -105,12 +106,11 @@ class AttemptStorageFoldingOfFunction : public IRMutator {
 
     void visit(const For *op) {
         if (op->for_type != ForType::Serial && op->for_type != ForType::Unrolled) {
-            // We can't proceed into a parallel for loop.
-
-            // TODO: If there's no overlap between the region touched
-            // by the threads as this loop counter varies
-            // (i.e. there's no cross-talk between threads), then it's
-            // safe to proceed.
+            // We can't proceed into a parallel for loop, because the
+            // threads would share the circular buffer. If there's no
+            // cross-talk between the threads, StorageFolding gives
+            // each of them its own copy of the storage instead (see
+            // fold_inside_parallel_loop).
             stmt = op;
             return;
         }
@@ -215,6 +215,44 @@ class AttemptStorageFoldingOfFunction : public IRMutator {
                     dims_folded.push_back(fold);
                     body = FoldStorageOfFunction(func.name(), (int)i - 1, factor).mutate(body);
 
+                    if (func.schedule().async()) {
+                        // The producer runs ahead of the consumer on
+                        // another task (see fork_async_producers), so
+                        // the slots of the circular buffer are
+                        // counted with a semaphore. Before each
+                        // iteration the producer acquires the slots
+                        // for the rows it's about to produce, and
+                        // after each iteration the consumer releases
+                        // the rows it no longer needs. The last
+                        // iteration releases everything, so that the
+                        // count is back where it started if the loop
+                        // runs again.
+                        Expr loop_var = Variable::make(Int(32), op->name);
+                        Expr is_first = loop_var == op->min;
+                        Expr is_last = loop_var == op->min + op->extent - 1;
+                        Expr to_acquire, to_release;
+                        if (min_monotonic_increasing) {
+                            Expr prev_max = substitute(op->name, loop_var - 1, max);
+                            Expr next_min = substitute(op->name, loop_var + 1, min);
+                            to_acquire = select(is_first, extent, max - prev_max);
+                            to_release = select(is_last, extent, next_min - min);
+                        } else {
+                            Expr prev_min = substitute(op->name, loop_var - 1, min);
+                            Expr next_max = substitute(op->name, loop_var + 1, max);
+                            to_acquire = select(is_first, extent, prev_min - min);
+                            to_release = select(is_last, extent, max - next_max);
+                        }
+                        string sema = func.name() + ".folding_semaphore";
+                        body = Block::make({acquire_semaphore(sema, simplify(to_acquire)),
+                                            body,
+                                            release_semaphore(sema, simplify(to_release))});
+
+                        // The semaphore counts rows of this dimension
+                        // only, so don't fold any others.
+                        stmt = For::make(op->name, op->min, op->extent, op->for_type, op->device_api, body);
+                        return;
+                    }
+
                     Expr next_var = Variable::make(Int(32), op->name) + 1;
                     Expr next_min = substitute(op->name, next_var, min);
                     if (can_prove(max < next_min)) {
@@ -283,6 +321,44 @@ private:
     }
 };
 
+// Check if a statement reads, writes, or computes a func.
+class FunctionIsTouched : public IRVisitor {
+    const string &func;
+
+    using IRVisitor::visit;
+
+    void visit(const Call *op) {
+        IRVisitor::visit(op);
+        if (op->name == func && op->call_type == Call::Halide) {
+            result = true;
+        }
+    }
+
+    void visit(const Provide *op) {
+        IRVisitor::visit(op);
+        if (op->name == func) {
+            result = true;
+        }
+    }
+
+    void visit(const ProducerConsumer *op) {
+        IRVisitor::visit(op);
+        if (op->name == func) {
+            result = true;
+        }
+    }
+
+public:
+    bool result = false;
+    FunctionIsTouched(const string &f) : func(f) {}
+};
+
+bool function_is_touched(Stmt s, const string &func) {
+    FunctionIsTouched touched(func);
+    s.accept(&touched);
+    return touched.result;
+}
+
 // Look for opportunities for storage folding in a statement
 class StorageFolding : public IRMutator {
     const map<string, Function> &env;
@@ -317,29 +393,110 @@ class StorageFolding : public IRMutator {
             // Don't attempt automatic storage folding if there is
             // more than one produce node for this func.
             bool explicit_only = count_producers(body, op->name) != 1;
-            AttemptStorageFoldingOfFunction folder(func, explicit_only);
             debug(3) << "Attempting to fold " << op->name << "\n";
-            body = folder.mutate(body);
+            Stmt folded = fold_realization(op, func, body, explicit_only);
 
-            if (body.same_as(op->body)) {
+            if (!folded.defined()) {
+                folded = fold_inside_parallel_loop(op, func, body, explicit_only);
+            }
+
+            if (folded.defined()) {
+                stmt = folded;
+            } else if (body.same_as(op->body)) {
                 stmt = op;
-            } else if (folder.dims_folded.empty()) {
-                stmt = Realize::make(op->name, op->types, op->bounds, op->condition, body);
             } else {
-                Region bounds = op->bounds;
+                stmt = Realize::make(op->name, op->types, op->bounds, op->condition, body);
+            }
+        }
+    }
 
-                for (size_t i = 0; i < folder.dims_folded.size(); i++) {
-                    int d = folder.dims_folded[i].dim;
-                    Expr f = folder.dims_folded[i].factor;
-                    internal_assert(d >= 0 &&
-                                    d < (int)bounds.size());
+    // Try to fold the storage of a realization with the given
+    // body. Returns the folded realization, or an undefined Stmt if
+    // nothing could be folded.
+    Stmt fold_realization(const Realize *op, Function func, Stmt body, bool explicit_only) {
+        AttemptStorageFoldingOfFunction folder(func, explicit_only);
+        body = folder.mutate(body);
 
-                    bounds[d] = Range(0, f);
-                }
+        if (folder.dims_folded.empty()) {
+            return Stmt();
+        }
+
+        Region bounds = op->bounds;
 
-                stmt = Realize::make(op->name, op->types, bounds, op->condition, body);
+        for (size_t i = 0; i < folder.dims_folded.size(); i++) {
+            int d = folder.dims_folded[i].dim;
+            Expr f = folder.dims_folded[i].factor;
+            internal_assert(d >= 0 &&
+                            d < (int)bounds.size());
+
+            bounds[d] = Range(0, f);
+        }
+
+        Stmt s = Realize::make(op->name, op->types, bounds, op->condition, body);
+
+        if (func.schedule().async()) {
+            internal_assert(folder.dims_folded.size() == 1);
+            s = make_semaphore(op->name + ".folding_semaphore",
+                               folder.dims_folded[0].factor, s);
+        }
+        return s;
+    }
+
+    // A common schedule is to parallelize over strips of the output
+    // and slide a stored-at-root producer within each strip. The
+    // producer can't be folded over the serial loop inside the
+    // parallel one, because all the threads would share the same
+    // circular buffer. If each iteration of the parallel loop computes
+    // everything it needs itself (sliding window gives each strip a
+    // warm-up), we can move the realization inside the parallel loop
+    // instead, so that each thread gets its own storage, and fold
+    // that. We only do this if it results in a fold, because otherwise
+    // each thread would allocate the entire buffer. Returns an
+    // undefined Stmt on failure.
+    Stmt fold_inside_parallel_loop(const Realize *op, Function func, Stmt s, bool explicit_only) {
+        if (const For *loop = s.as<For>()) {
+            if (loop->for_type != ForType::Parallel) {
+                return Stmt();
+            }
+            Box provided = box_provided(loop->body, op->name);
+            Box required = box_required(loop->body, op->name);
+            if (!box_contains(provided, required)) {
+                debug(3) << "Not moving " << op->name << " inside parallel loop over " << loop->name
+                         << " because its iterations communicate through it\n";
+                return Stmt();
+            }
+            Stmt body = fold_realization(op, func, loop->body, explicit_only);
+            if (!body.defined()) {
+                // There may be another parallel loop further in.
+                body = fold_inside_parallel_loop(op, func, loop->body, explicit_only);
+            }
+            if (!body.defined()) {
+                return Stmt();
+            }
+            debug(3) << "Folded " << op->name << " inside parallel loop over " << loop->name << "\n";
+            return For::make(loop->name, loop->min, loop->extent, loop->for_type, loop->device_api, body);
+        } else if (const LetStmt *let = s.as<LetStmt>()) {
+            Stmt body = fold_inside_parallel_loop(op, func, let->body, explicit_only);
+            return body.defined() ? LetStmt::make(let->name, let->value, body) : Stmt();
+        } else if (const ProducerConsumer *pc = s.as<ProducerConsumer>()) {
+            if (pc->name == op->name) {
+                return Stmt();
+            }
+            Stmt body = fold_inside_parallel_loop(op, func, pc->body, explicit_only);
+            return body.defined() ? ProducerConsumer::make(pc->name, pc->is_producer, body) : Stmt();
+        } else if (const Block *block = s.as<Block>()) {
+            // Only one side may touch the storage.
+            bool first_uses = function_is_touched(block->first, op->name);
+            bool rest_uses = function_is_touched(block->rest, op->name);
+            if (first_uses && !rest_uses) {
+                Stmt first = fold_inside_parallel_loop(op, func, block->first, explicit_only);
+                return first.defined() ? Block::make(first, block->rest) : Stmt();
+            } else if (rest_uses && !first_uses) {
+                Stmt rest = fold_inside_parallel_loop(op, func, block->rest, explicit_only);
+                return rest.defined() ? Block::make(block->first, rest) : Stmt();
             }
         }
+        return Stmt();
     }
 
 public:
@@ -1,6 +1,7 @@
 #include "Tracing.h"
 #include "IRMutator.h"
 #include "IROperator.h"
+#include "Substitute.h"
 #include "runtime/HalideRuntime.h"
 
 namespace Halide {
@@ -13,6 +14,7 @@ int tracing_level() {
 
 using std::vector;
 using std::map;
+using std::pair;
 using std::string;
 
 struct TraceEventBuilder {
@@ -54,6 +56,275 @@ public:
 private:
     using IRMutator::visit;
 
+    // The enclosing vectorized loop and the LetStmts inside it, as
+    // (name, value) pairs, innermost last. The loop contributes its
+    // min. Trace filters are evaluated for the first lane of a
+    // vector, so that they stay scalar when the loop is vectorized.
+    vector<pair<string, Expr>> vector_lets;
+    int vectorized_depth = 0;
+    const For *vector_loop = nullptr;
+
+    // The number of enclosing loops that run on a device.
+    int device_depth = 0;
+
+    // An accumulator for the minimum and maximum values stored to a
+    // Func that traces summaries. There is one per production, and
+    // one per task inside parallel loops, which is combined into the
+    // production's once the loop is done.
+    struct SummaryScope {
+        Function func;
+        string name;
+        // The type of each value index stored to within the scope.
+        map<int, Type> values;
+    };
+    vector<SummaryScope> summary_scopes;
+
+    // Per-lane accumulators for the stores in the enclosing
+    // vectorized loop, so that vectorizing the loop doesn't make the
+    // lanes race on a single accumulator. Reduced into the enclosing
+    // scope's accumulator after the loop.
+    struct LaneAccumulator {
+        string lanes, scope_buf;
+        Type type;
+    };
+    vector<LaneAccumulator> lane_accumulators;
+
+    static Expr load(Type t, const string &buf, Expr idx) {
+        return Load::make(t, buf, idx, Buffer<>(), Parameter(), const_true());
+    }
+
+    static Stmt store(const string &buf, Expr value, Expr idx) {
+        return Store::make(buf, value, idx, Parameter(), const_true());
+    }
+
+    // Initialize the min and max at idx and idx + 1 of an accumulator.
+    static Stmt init_accumulator(const string &buf, Type t, Expr idx) {
+        return Block::make(store(buf, t.max(), idx), store(buf, t.min(), idx + 1));
+    }
+
+    // The mins and extents of the pure definition of a Func.
+    static vector<Expr> pure_region(const Function &f) {
+        vector<Expr> coords;
+        const vector<string> f_args = f.args();
+        for (int i = 0; i < f.dimensions(); i++) {
+            Expr min = Variable::make(Int(32), f.name() + ".s0." + f_args[i] + ".min");
+            Expr max = Variable::make(Int(32), f.name() + ".s0." + f_args[i] + ".max");
+            coords.push_back(min);
+            coords.push_back((max + 1) - min);
+        }
+        return coords;
+    }
+
+    // Allocate the accumulators of a summary scope around s, and
+    // initialize them before it.
+    static Stmt allocate_accumulators(const SummaryScope &scope, Stmt s) {
+        for (const auto &v : scope.values) {
+            string buf = scope.name + "." + std::to_string(v.first);
+            s = Block::make(init_accumulator(buf, v.second, 0), s);
+            s = Allocate::make(buf, v.second, MemoryType::Auto, {2}, const_true(), s);
+        }
+        return s;
+    }
+
+    // Allocate the accumulators of a production's summary scope
+    // around s, and emit a summary event for each value stored at the
+    // end.
+    Stmt wrap_summary_scope(const SummaryScope &scope, Stmt s) {
+        for (const auto &v : scope.values) {
+            string buf = scope.name + "." + std::to_string(v.first);
+            TraceEventBuilder builder;
+            builder.func = scope.func.name();
+            builder.event = halide_trace_summary;
+            builder.type = v.second.with_lanes(2);
+            builder.value = {load(v.second, buf, 0), load(v.second, buf, 1)};
+            builder.coordinates = pure_region(scope.func);
+            builder.value_index = v.first;
+            builder.parent_id = Variable::make(Int(32), scope.func.name() + ".trace_id");
+            s = Block::make(s, Evaluate::make(builder.build()));
+        }
+        return allocate_accumulators(scope, s);
+    }
+
+    // Give each task of a parallel loop its own accumulators, and
+    // combine them into the enclosing scopes of the same Funcs after
+    // the loop. Each task copies its results to its own slot of a
+    // buffer allocated around the loop, so the tasks don't race, and
+    // the slots are reduced serially once they are all done.
+    static Stmt combine_task_scopes(const vector<SummaryScope> &tasks,
+                                    const vector<SummaryScope *> &outers, const For *loop) {
+        Expr task_idx = (Variable::make(Int(32), loop->name) - loop->min) * 2;
+        Stmt body = loop->body;
+        for (const SummaryScope &task : tasks) {
+            for (const auto &v : task.values) {
+                string buf = task.name + "." + std::to_string(v.first);
+                body = Block::make({body,
+                                    store(buf + ".tasks", load(v.second, buf, 0), task_idx),
+                                    store(buf + ".tasks", load(v.second, buf, 1), task_idx + 1)});
+            }
+            body = allocate_accumulators(task, body);
+        }
+        Stmt s = For::make(loop->name, loop->min, loop->extent, loop->for_type, loop->device_api, body);
+
+        for (size_t i = 0; i < tasks.size(); i++) {
+            for (const auto &v : tasks[i].values) {
+                Type t = v.second;
+                string slots = tasks[i].name + "." + std::to_string(v.first) + ".tasks";
+                string outer_buf = outers[i]->name + "." + std::to_string(v.first);
+                outers[i]->values[v.first] = t;
+
+                string idx_name = unique_name('t');
+                Expr idx = Variable::make(Int(32), idx_name) * 2;
+                Stmt reduce =
+                    Block::make(store(outer_buf, min(load(t, outer_buf, 0), load(t, slots, idx)), 0),
+                                store(outer_buf, max(load(t, outer_buf, 1), load(t, slots, idx + 1)), 1));
+                reduce = For::make(idx_name, 0, loop->extent, ForType::Serial, DeviceAPI::None, reduce);
+                s = Block::make(s, reduce);
+                s = Allocate::make(slots, t, MemoryType::Auto, {loop->extent * 2}, const_true(), s);
+            }
+        }
+        return s;
+    }
+
+    // The condition under which loads and stores of f at the given
+    // coordinates are traced, or an undefined Expr to trace them all.
+    Expr trace_filter(const Function &f, const vector<Expr> &coords) {
+        Expr cond;
+        const vector<pair<Expr, Expr>> &region = f.traced_region();
+        for (size_t i = 0; i < region.size() && i < coords.size(); i++) {
+            Expr inside = (coords[i] >= region[i].first &&
+                           coords[i] < region[i].first + region[i].second);
+            cond = cond.defined() ? (cond && inside) : inside;
+        }
+        int rate = f.trace_sample_rate();
+        if (rate > 1) {
+            // Hash the coordinates, so that the same sites are
+            // sampled on every run.
+            Expr h = make_zero(UInt(32));
+            for (Expr c : coords) {
+                h = (h + cast<uint32_t>(c)) * make_const(UInt(32), 0x9e3779b1);
+                h = h ^ (h >> make_const(UInt(32), 15));
+            }
+            Expr sampled = (h % make_const(UInt(32), rate)) == make_zero(UInt(32));
+            cond = cond.defined() ? (cond && sampled) : sampled;
+        }
+        if (cond.defined()) {
+            for (size_t i = vector_lets.size(); i > 0; i--) {
+                cond = substitute(vector_lets[i - 1].first, vector_lets[i - 1].second, cond);
+            }
+        }
+        return cond;
+    }
+
+    // Only make a trace call if the filter passes.
+    static Expr filter_trace(Expr trace, Expr filter) {
+        if (!filter.defined()) {
+            return trace;
+        }
+        return Call::make(Int(32), Call::if_then_else,
+                          {filter, trace, make_zero(Int(32))}, Call::PureIntrinsic);
+    }
+
+    void visit(const LetStmt *op) {
+        if (vectorized_depth > 0) {
+            vector_lets.push_back({op->name, op->value});
+            IRMutator::visit(op);
+            vector_lets.pop_back();
+        } else {
+            IRMutator::visit(op);
+        }
+    }
+
+    void visit(const For *op) {
+        bool on_device = ((op->device_api != DeviceAPI::None &&
+                           op->device_api != DeviceAPI::Host) ||
+                          op->for_type == ForType::GPUBlock ||
+                          op->for_type == ForType::GPUThread ||
+                          op->for_type == ForType::SDSPipeline);
+
+        if (on_device) {
+            device_depth++;
+            IRMutator::visit(op);
+            device_depth--;
+        } else if (op->for_type == ForType::Vectorized) {
+            const For *old_vector_loop = vector_loop;
+            vector<LaneAccumulator> old_lane_accumulators;
+            old_lane_accumulators.swap(lane_accumulators);
+            vector_loop = op;
+            vectorized_depth++;
+            vector_lets.push_back({op->name, op->min});
+
+            IRMutator::visit(op);
+
+            vector_lets.pop_back();
+            vectorized_depth--;
+            vector_loop = old_vector_loop;
+
+            // Reduce the per-lane accumulators of the loop into the
+            // enclosing scopes.
+            const int64_t *extent = as_const_int(op->extent);
+            for (const LaneAccumulator &acc : lane_accumulators) {
+                internal_assert(extent);
+                string lane_name = unique_name('t');
+                Expr lane = Variable::make(Int(32), lane_name);
+                Stmt init = For::make(lane_name, 0, (int)*extent, ForType::Serial, DeviceAPI::None,
+                                      init_accumulator(acc.lanes, acc.type, lane * 2));
+                lane_name = unique_name('t');
+                lane = Variable::make(Int(32), lane_name);
+                Stmt reduce =
+                    Block::make(store(acc.scope_buf, min(load(acc.type, acc.scope_buf, 0),
+                                                         load(acc.type, acc.lanes, lane * 2)), 0),
+                                store(acc.scope_buf, max(load(acc.type, acc.scope_buf, 1),
+                                                         load(acc.type, acc.lanes, lane * 2 + 1)), 1));
+                reduce = For::make(lane_name, 0, (int)*extent, ForType::Serial, DeviceAPI::None, reduce);
+                stmt = Block::make({init, stmt, reduce});
+                stmt = Allocate::make(acc.lanes, acc.type, MemoryType::Auto, {(int)*extent * 2}, const_true(), stmt);
+            }
+            lane_accumulators.swap(old_lane_accumulators);
+        } else if (op->for_type == ForType::Parallel && !summary_scopes.empty()) {
+            // Give each task its own accumulators, for the innermost
+            // scope of each Func that traces summaries, and combine
+            // them into that scope after the loop.
+            size_t first_new = summary_scopes.size();
+            for (size_t i = 0; i < first_new; i++) {
+                bool found = false;
+                for (size_t j = first_new; j < summary_scopes.size(); j++) {
+                    found |= summary_scopes[j].func.same_as(summary_scopes[i].func);
+                }
+                if (!found) {
+                    SummaryScope scope;
+                    scope.func = summary_scopes[i].func;
+                    scope.name = unique_name("trace_summary_" + scope.func.name());
+                    summary_scopes.push_back(scope);
+                }
+            }
+
+            IRMutator::visit(op);
+
+            vector<SummaryScope> task_scopes(summary_scopes.begin() + first_new, summary_scopes.end());
+            summary_scopes.resize(first_new);
+
+            // Each task scope was made for the innermost enclosing
+            // scope of the same Func.
+            vector<SummaryScope *> outers;
+            for (const SummaryScope &task : task_scopes) {
+                SummaryScope *outer = nullptr;
+                for (size_t i = first_new; i > 0 && !outer; i--) {
+                    if (summary_scopes[i - 1].func.same_as(task.func)) {
+                        outer = &summary_scopes[i - 1];
+                    }
+                }
+                internal_assert(outer);
+                outers.push_back(outer);
+            }
+
+            op = stmt.as<For>();
+            internal_assert(op);
+            stmt = combine_task_scopes(task_scopes, outers, op);
+        } else {
+            IRMutator::visit(op);
+        }
+    }
+
     void visit(const Call *op) {
 
         // Calls inside of an address_of don't count, but we want to
@@ -127,6 +398,9 @@ private:
             builder.parent_id = trace_parent;
             builder.value_index = op->value_index;
             Expr trace = builder.build();
+            if (op->call_type == Call::Halide) {
+                trace = filter_trace(trace, trace_filter(env.find(op->name)->second, op->args));
+            }
 
             expr = Let::make(value_var_name, op,
                              Call::make(op->type, Call::return_second,
@@ -147,6 +421,7 @@ private:
 
         if (f.is_tracing_stores() || (global_level > 1)) {
             // Wrap each expr in a tracing call
+            Expr filter = trace_filter(f, op->args);
 
             const vector<Expr> &values = op->values;
             vector<Expr> traces(op->values.size());
@@ -164,7 +439,7 @@ private:
                 builder.type = t;
                 builder.value_index = (int)i;
                 builder.value = {value_var};
-                Expr trace = builder.build();
+                Expr trace = filter_trace(builder.build(), filter);
 
                 traces[i] = Let::make(value_var_name, values[i],
                                       Call::make(t, Call::return_second,
@@ -172,9 +447,73 @@ private:
             }
 
             stmt = Provide::make(op->name, traces, op->args);
+            op = stmt.as<Provide>();
+        }
+
+        if (f.is_tracing_summaries() && device_depth == 0) {
+            summarize_stores(f, op);
         }
     }
 
+    // Update the innermost summary accumulators of f with the values
+    // stored by a Provide.
+    void summarize_stores(const Function &f, const Provide *op) {
+        SummaryScope *scope = nullptr;
+        for (size_t i = summary_scopes.size(); i > 0; i--) {
+            if (summary_scopes[i - 1].func.same_as(f)) {
+                scope = &summary_scopes[i - 1];
+                break;
+            }
+        }
+        if (!scope) return;
+
+        // Stores in vectorized loops go to per-lane accumulators
+        // indexed by the loop variable. Give up on nested vectorized
+        // loops.
+        Expr lane_idx = 0;
+        if (vector_loop) {
+            if (vectorized_depth > 1 || !is_const(vector_loop->extent)) {
+                return;
+            }
+            lane_idx = (Variable::make(Int(32), vector_loop->name) - vector_loop->min) * 2;
+        }
+
+        vector<Expr> values = op->values;
+        vector<pair<string, Expr>> lets;
+        vector<Stmt> updates;
+        for (size_t i = 0; i < values.size(); i++) {
+            Type t = values[i].type();
+            if (t.is_handle() || t.is_bool()) continue;
+            string buf = scope->name + "." + std::to_string(i);
+            scope->values[(int)i] = t;
+            if (vector_loop) {
+                string lanes = buf + ".lanes." + vector_loop->name;
+                bool found = false;
+                for (const LaneAccumulator &acc : lane_accumulators) {
+                    found |= (acc.lanes == lanes);
+                }
+                if (!found) {
+                    lane_accumulators.push_back({lanes, buf, t});
+                }
+                buf = lanes;
+            }
+
+            string value_name = unique_name('t');
+            Expr value_var = Variable::make(t, value_name);
+            lets.push_back({value_name, values[i]});
+            values[i] = value_var;
+            updates.push_back(store(buf, min(load(t, buf, lane_idx), value_var), lane_idx));
+            updates.push_back(store(buf, max(load(t, buf, lane_idx + 1), value_var), lane_idx + 1));
+        }
+        if (updates.empty()) return;
+
+        Stmt s = Block::make(Provide::make(op->name, values, op->args), Block::make(updates));
+        for (size_t i = lets.size(); i > 0; i--) {
+            s = LetStmt::make(lets[i - 1].first, lets[i - 1].second, s);
+        }
+        stmt = s;
+    }
+
     void visit(const Realize *op) {
         IRMutator::visit(op);
         op = stmt.as<Realize>();
@@ -183,7 +522,7 @@ private:
         map<string, Function>::const_iterator iter = env.find(op->name);
         if (iter == env.end()) return;
         Function f = iter->second;
-        if (f.is_tracing_realizations() || global_level > 0) {
+        if (f.is_tracing_realizations() || f.is_tracing_summaries() || global_level > 0) {
             // Throw a tracing call before and after the realize body
             TraceEventBuilder builder;
             builder.func = op->name;
@@ -214,27 +553,34 @@ private:
     }
 
     void visit(const ProducerConsumer *op) {
-        IRMutator::visit(op);
+        map<string, Function>::const_iterator iter = env.find(op->name);
+        if (op->is_producer && iter != env.end() && iter->second.is_tracing_summaries()) {
+            SummaryScope scope;
+            scope.func = iter->second;
+            scope.name = unique_name("trace_summary_" + op->name);
+            summary_scopes.push_back(scope);
+            IRMutator::visit(op);
+            scope = summary_scopes.back();
+            summary_scopes.pop_back();
+            op = stmt.as<ProducerConsumer>();
+            internal_assert(op);
+            stmt = ProducerConsumer::make(op->name, op->is_producer,
+                                          wrap_summary_scope(scope, op->body));
+        } else {
+            IRMutator::visit(op);
+        }
         op = stmt.as<ProducerConsumer>();
         internal_assert(op);
-        map<string, Function>::const_iterator iter = env.find(op->name);
         if (iter == env.end()) return;
         Function f = iter->second;
-        if (f.is_tracing_realizations() || global_level > 0) {
+        if (f.is_tracing_realizations() || f.is_tracing_summaries() || global_level > 0) {
             // Throw a tracing call around each pipeline event
             TraceEventBuilder builder;
             builder.func = op->name;
             builder.parent_id = Variable::make(Int(32), op->name + ".trace_id");
 
             // Use the size of the pure step
-            const vector<string> f_args = f.args();
-            for (int i = 0; i < f.dimensions(); i++) {
-                Expr min = Variable::make(Int(32), f.name() + ".s0." + f_args[i] + ".min");
-                Expr max = Variable::make(Int(32), f.name() + ".s0." + f_args[i] + ".max");
-                Expr extent = (max + 1) - min;
-                builder.coordinates.push_back(min);
-                builder.coordinates.push_back(extent);
-            }
+            builder.coordinates = pure_region(f);
 
             builder.event = (op->is_producer ?
                              halide_trace_end_produce :
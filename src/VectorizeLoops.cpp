@@ -1,6 +1,7 @@
 #include <algorithm>
 
 #include "VectorizeLoops.h"
+#include "Associativity.h"
 #include "IRMutator.h"
 #include "Scope.h"
 #include "IRPrinter.h"
@@ -349,6 +350,27 @@ public:
     }
 };
 
+class LoadsFrom : public IRVisitor {
+    const string &name;
+
+    using IRVisitor::visit;
+
+    void visit(const Load *op) {
+        result = result || op->name == name;
+        IRVisitor::visit(op);
+    }
+
+public:
+    bool result = false;
+    LoadsFrom(const string &n) : name(n) {}
+};
+
+bool loads_from(Expr e, const string &name) {
+    LoadsFrom loads(name);
+    e.accept(&loads);
+    return loads.result;
+}
+
 // Substitutes a vector for a scalar var in a Stmt. Used on the
 // body of every vectorized loop.
 class VectorSubs : public IRMutator {
@@ -653,6 +675,13 @@ class VectorSubs : public IRMutator {
 
         if (predicate.same_as(op->predicate) && value.same_as(op->value) && index.same_as(op->index)) {
             stmt = op;
+        } else if (index.type().is_scalar() && value.type().is_vector() &&
+                   loads_from(op->value, op->name)) {
+            // Every lane reads and writes the same element, so they
+            // must run one after the other. Reductions we can
+            // vectorize have been rewritten already (see
+            // vectorize_reduction).
+            stmt = scalarize(op);
         } else {
             int lanes = std::max(predicate.type().lanes(), std::max(value.type().lanes(), index.type().lanes()));
             stmt = Store::make(op->name, widen(value, lanes), widen(index, lanes),
@@ -848,7 +877,7 @@ class VectorSubs : public IRMutator {
         // The variable itself could still exist inside an inner scalarized block.
         body = substitute(v, Variable::make(Int(32), var), body);
 
-        stmt = Allocate::make(op->name, op->type, new_extents, op->condition, body, new_expr, op->free_function);
+        stmt = Allocate::make(op->name, op->type, op->memory_type, new_extents, op->condition, body, new_expr, op->free_function);
     }
 
     Stmt scalarize(Stmt s) {
@@ -907,18 +936,205 @@ public:
     }
 };
 
+// Replace loads from a buffer at the index of a store to it with calls
+// to a Func of the same name, so that prove_associativity sees them as
+// the self-reference of an update definition.
+class LoadsToSelfReference : public IRMutator {
+    const Store *store;
+
+    using IRMutator::visit;
+
+    void visit(const Load *op) {
+        if (op->name == store->name) {
+            if (is_one(op->predicate) && equal(op->index, store->index)) {
+                expr = Call::make(op->type, op->name, {store->index}, Call::Halide);
+                return;
+            }
+            other_loads = true;
+        }
+        IRMutator::visit(op);
+    }
+
+public:
+    bool other_loads = false;
+    LoadsToSelfReference(const Store *s) : store(s) {}
+};
+
+// Find the single store in the body of a loop, looking through lets
+// and conditions with no else case. The names of the lets are added
+// to the scope.
+const Store *find_single_store(Stmt s, Scope<int> &inner) {
+    while (true) {
+        if (const LetStmt *l = s.as<LetStmt>()) {
+            inner.push(l->name, 0);
+            s = l->body;
+        } else if (const IfThenElse *i = s.as<IfThenElse>()) {
+            if (i->else_case.defined()) {
+                return nullptr;
+            }
+            s = i->then_case;
+        } else {
+            return s.as<Store>();
+        }
+    }
+}
+
+// Is a store an update of a single element with a commutative and
+// associative operator, where the element doesn't depend on the
+// variables in the scope? If so, return the operator.
+bool match_reduction(const Store *store, const Scope<int> &inner, AssociativeOp &result) {
+    if (!is_one(store->predicate) ||
+        store->value.type().is_vector() ||
+        store->value.type().is_bool() ||
+        store->index.type() != Int(32) ||
+        expr_uses_vars(store->index, inner)) {
+        return false;
+    }
+
+    LoadsToSelfReference self_ref(store);
+    Expr value = self_ref.mutate(store->value);
+    if (self_ref.other_loads) {
+        return false;
+    }
+
+    ProveAssociativityResult prover = prove_associativity(store->name, {store->index}, {value});
+    if (!prover.is_associative || !prover.is_commutative ||
+        prover.ops.size() != 1 || !prover.ops[0].x.second.defined()) {
+        return false;
+    }
+    result = prover.ops[0];
+    return true;
+}
+
+Expr apply_op(const AssociativeOp &op, Expr x, Expr y) {
+    return substitute(op.y.first, y, substitute(op.x.first, x, op.op));
+}
+
+// Combine the lanes of a vector with an associative operator, halving
+// the vector each step. This happens once, after the loop, so it
+// needs to be cheap rather than optimal. Each step is a pair of
+// shuffles and one vector op, which LLVM lowers to ordinary
+// shuffle-and-add sequences. Which instructions it picks is up to the
+// backend.
+Expr horizontal_reduce(const AssociativeOp &op, Expr v) {
+    int lanes = v.type().lanes();
+    while (lanes % 2 == 0) {
+        lanes /= 2;
+        v = apply_op(op, Shuffle::make_slice(v, 0, 1, lanes), Shuffle::make_slice(v, lanes, 1, lanes));
+    }
+    Expr result = Shuffle::make_slice(v, 0, 1, 1);
+    for (int i = 1; i < lanes; i++) {
+        result = apply_op(op, result, Shuffle::make_slice(v, i, 1, 1));
+    }
+    return result;
+}
+
+class ReplaceStore : public IRMutator {
+    const Store *old_store;
+    Stmt new_store;
+
+    using IRMutator::visit;
+
+    void visit(const Store *op) {
+        stmt = (op == old_store) ? new_store : op;
+    }
+
+public:
+    ReplaceStore(const Store *o, Stmt n) : old_store(o), new_store(n) {}
+};
+
+// Rewrite a loop nest that reduces into a single element, whose
+// innermost loop is vectorized, so that each lane of the vectorized
+// loop accumulates into its own partial result. The partial results
+// are combined with the element once the outermost loop of the nest
+// is done.
+Stmt vectorize_reduction(Stmt nest, const For *vector_loop,
+                         const Store *store, const AssociativeOp &op) {
+    int lanes = vector_loop->extent.as<IntImm>()->value;
+    Type t = store->value.type();
+    string partial = unique_name(store->name + ".partial");
+
+    auto load_partial = [&](Expr index) {
+        return Load::make(t.with_lanes(index.type().lanes()), partial, index,
+                          Buffer<>(), Parameter(), const_true(index.type().lanes()));
+    };
+
+    Expr lane = Variable::make(Int(32), vector_loop->name) - vector_loop->min;
+    Stmt update = Store::make(partial, apply_op(op, load_partial(lane), op.y.second),
+                              lane, Parameter(), const_true());
+    nest = ReplaceStore(store, update).mutate(nest);
+
+    string init_var = partial + ".lane";
+    Expr init_lane = Variable::make(Int(32), init_var);
+    Stmt init = For::make(init_var, 0, lanes, ForType::Vectorized, vector_loop->device_api,
+                          Store::make(partial, op.identity, init_lane, Parameter(), const_true()));
+
+    Expr old_value = Load::make(t, store->name, store->index, Buffer<>(), store->param, const_true());
+    Expr reduced = horizontal_reduce(op, load_partial(Ramp::make(0, 1, lanes)));
+    Stmt final_store = Store::make(store->name, apply_op(op, old_value, reduced),
+                                   store->index, store->param, const_true());
+
+    Stmt s = Block::make({init, nest, final_store});
+    return Allocate::make(partial, t, MemoryType::Stack, {lanes}, const_true(), s);
+}
+
 // Vectorize all loops marked as such in a Stmt
 class VectorizeLoops : public IRMutator {
     const Target &target;
     bool in_hexagon;
+    bool in_device;
 
     using IRMutator::visit;
 
+    // If the loop is a vectorized loop that reduces into a single
+    // element (e.g. a vectorized RVar of an associative update), or a
+    // serial loop directly around one, rewrite it to accumulate
+    // partial results per lane.
+    Stmt try_vectorize_reduction(const For *for_loop) {
+        if (in_device) {
+            return Stmt();
+        }
+
+        Scope<int> inner;
+        const For *vector_loop = for_loop;
+        if (for_loop->for_type == ForType::Serial) {
+            // Accumulate across the serial loop too, if the element
+            // doesn't depend on it.
+            inner.push(for_loop->name, 0);
+            Stmt body = for_loop->body;
+            while (const LetStmt *l = body.as<LetStmt>()) {
+                inner.push(l->name, 0);
+                body = l->body;
+            }
+            vector_loop = body.as<For>();
+            if (!vector_loop ||
+                vector_loop->for_type != ForType::Vectorized ||
+                !vector_loop->extent.as<IntImm>()) {
+                return Stmt();
+            }
+        }
+
+        inner.push(vector_loop->name, 0);
+        const Store *store = find_single_store(vector_loop->body, inner);
+        AssociativeOp op;
+        if (!store || !match_reduction(store, inner, op)) {
+            return Stmt();
+        }
+        debug(3) << "Vectorizing reduction into " << store->name << " over " << for_loop->name << "\n";
+        return vectorize_reduction(for_loop, vector_loop, store, op);
+    }
+
     void visit(const For *for_loop) {
         bool old_in_hexagon = in_hexagon;
         if (for_loop->device_api == DeviceAPI::Hexagon) {
             in_hexagon = true;
         }
+        bool old_in_device = in_device;
+        if (for_loop->device_api != DeviceAPI::None &&
+            for_loop->device_api != DeviceAPI::Host &&
+            for_loop->device_api != DeviceAPI::Hexagon) {
+            in_device = true;
+        }
 
         if (for_loop->for_type == ForType::Vectorized) {
             const IntImm *extent = for_loop->extent.as<IntImm>();
@@ -929,21 +1145,34 @@ class VectorizeLoops : public IRMutator {
                            << "constant extent > 1\n";
             }
 
-            // Replace the var with a ramp within the body
-            Expr for_var = Variable::make(Int(32), for_loop->name);
-            Expr replacement = Ramp::make(for_loop->min, 1, extent->value);
-            stmt = VectorSubs(for_loop->name, replacement, in_hexagon, target).mutate(for_loop->body);
+            Stmt reduction = try_vectorize_reduction(for_loop);
+            if (reduction.defined()) {
+                stmt = mutate(reduction);
+            } else {
+                // Replace the var with a ramp within the body
+                Expr for_var = Variable::make(Int(32), for_loop->name);
+                Expr replacement = Ramp::make(for_loop->min, 1, extent->value);
+                stmt = VectorSubs(for_loop->name, replacement, in_hexagon, target).mutate(for_loop->body);
+            }
+        } else if (for_loop->for_type == ForType::Serial) {
+            Stmt reduction = try_vectorize_reduction(for_loop);
+            if (reduction.defined()) {
+                stmt = mutate(reduction);
+            } else {
+                IRMutator::visit(for_loop);
+            }
         } else {
             IRMutator::visit(for_loop);
         }
 
+        in_device = old_in_device;
         if (for_loop->device_api == DeviceAPI::Hexagon) {
             in_hexagon = old_in_hexagon;
         }
     }
 
 public:
-    VectorizeLoops(const Target &t) : target(t), in_hexagon(false) {}
+    VectorizeLoops(const Target &t) : target(t), in_hexagon(false), in_device(false) {}
 };
 
 } // Anonymous namespace
@@ -13,7 +13,10 @@ namespace Internal {
 
 /** Take a statement with for loops marked for vectorization, and turn
  * them into single statements that operate on vectors. The loops in
- * question must have constant extent.
+ * question must have constant extent. Loops that update a single
+ * element with a commutative and associative operator (e.g. the
+ * vectorized RVar of a sum or a dot product) accumulate a partial
+ * result per lane instead, which are combined at the end.
  */
 Stmt vectorize_loops(Stmt s, const Target &t);
 
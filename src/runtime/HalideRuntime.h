@@ -149,6 +149,37 @@ extern struct halide_thread *halide_spawn_thread(void (*f)(void *), void *closur
 /** Join a thread. */
 extern void halide_join_thread(struct halide_thread *);
 
+/** Counting semaphores used to synchronize the producer and consumer
+ * sides of an async Func (see Func::async). The storage is owned by
+ * the generated code and must be initialized with
+ * halide_semaphore_init before use. */
+struct halide_semaphore_t {
+    uint64_t _private[2];
+};
+
+/** Set the count of a semaphore. Returns zero. */
+extern int halide_semaphore_init(struct halide_semaphore_t *, int n);
+
+/** Add n to the count of a semaphore, waking anyone waiting on
+ * it. Returns the new count. */
+extern int halide_semaphore_release(struct halide_semaphore_t *, int n);
+
+/** Block until the count of a semaphore is at least n, then subtract
+ * n from it. The default thread pool makes sure that blocked tasks
+ * don't stop other pending tasks from running, by adding threads
+ * beyond the requested number if needed. Returns zero, or
+ * halide_error_code_generic_error if the semaphore is closed before
+ * the count is high enough. */
+extern int halide_semaphore_acquire(struct halide_semaphore_t *, int n);
+
+/** Close a semaphore: no more releases are coming, so acquires that
+ * the count can't satisfy fail instead of blocking. Each side of an
+ * async Func's fork closes the semaphore it releases when its task
+ * exits, so that if it fails the other side doesn't wait for it
+ * forever. Takes a void pointer so that it can be used as a
+ * destructor in generated code. */
+extern void halide_semaphore_close(void *user_context, void *);
+
 /** Set the number of threads used by Halide's thread pool. Returns
  * the old number.
  *
@@ -303,7 +334,14 @@ enum halide_trace_event_code_t {halide_trace_load = 0,
                                 halide_trace_consume = 6,
                                 halide_trace_end_consume = 7,
                                 halide_trace_begin_pipeline = 8,
-                                halide_trace_end_pipeline = 9};
+                                halide_trace_end_pipeline = 9,
+                                /** The minimum and maximum values
+                                 * stored by a production, for Funcs
+                                 * that trace summaries. The value is a
+                                 * two-lane vector of min and max, and
+                                 * the coordinates are the region
+                                 * produced. */
+                                halide_trace_summary = 10};
 
 struct halide_trace_event_t {
     /** The name of the Func or Pipeline that this event refers to */
@@ -441,7 +479,10 @@ struct halide_trace_packet_t {
  * Halide checks the for existence of an environment variable called
  * HL_TRACE_FILE and opens that file. If HL_TRACE_FILE is not defined,
  * it outputs trace information to stdout in a human-readable
- * format. */
+ * format. Binary trace packets are batched into large buffers that a
+ * background thread writes to the file. The file is brought up to
+ * date at the end of every pipeline, when the trace file changes, and
+ * by halide_shutdown_trace. */
 extern void halide_set_trace_file(int fd);
 
 /** Halide calls this to retrieve the file descriptor to write binary
@@ -452,8 +493,9 @@ extern void halide_set_trace_file(int fd);
  * information to stdout. */
 extern int halide_get_trace_file(void *user_context);
 
-/** If tracing is writing to a file. This call closes that file
- * (flushing the trace). Returns zero on success. */
+/** If tracing is writing to a file. This call flushes any buffered
+ * trace packets, stops the trace writer thread, and closes the file
+ * if Halide opened it. Returns zero on success. */
 extern int halide_shutdown_trace();
 
 /** All Halide GPU or device backend implementations much provide an interface
@@ -605,6 +647,98 @@ extern void halide_memoization_cache_release(void *user_context, void *host);
  */
 extern void halide_memoization_cache_cleanup();
 
+/** The policies the default memoization cache can use to choose which
+ * entry to evict when it is over its size limit. */
+typedef enum halide_memoization_eviction_policy_t {
+    /** Evict the least recently used entry that is not in use. */
+    halide_memoization_evict_lru = 0,
+    /** Among the least recently used entries, evict the one whose
+     * recomputation (measured as the time between the cache miss and
+     * the store) saves the least time per byte, weighted by how often
+     * it has been hit. */
+    halide_memoization_evict_cost_aware = 1
+} halide_memoization_eviction_policy_t;
+
+/** Select the eviction policy used by the memoization cache. The
+ * default is halide_memoization_evict_lru. */
+extern void halide_memoization_cache_set_eviction_policy(halide_memoization_eviction_policy_t policy);
+
+/** Counters describing the behavior of the memoization cache since it
+ * was last cleaned up. */
+struct halide_memoization_cache_stats_t {
+    /** Number of lookups satisfied from the cache, including those
+     * satisfied from the persistent store. */
+    uint64_t hits;
+    /** Number of lookups satisfied from the persistent store. */
+    uint64_t persistent_hits;
+    /** Number of lookups that had to compute the result. */
+    uint64_t misses;
+    /** Number of results added to the cache. */
+    uint64_t stores;
+    /** Number of entries evicted to stay within the size limit. */
+    uint64_t evictions;
+    /** Number of entries currently in the cache. */
+    uint64_t entries;
+    /** Current and maximum size of the cache in bytes. */
+    int64_t current_size, max_size;
+};
+
+/** Fill in the counters of the memoization cache. */
+extern void halide_memoization_cache_get_stats(struct halide_memoization_cache_stats_t *stats);
+
+/** Back the memoization cache with a memory-mapped file at the given
+ * path, shared by every process that uses the same path. Results that
+ * miss in the in-process cache are looked up in the file, and every
+ * stored result is also written to it, so warm entries survive
+ * restarts and are shared across a pool of processes. The size (in
+ * bytes, 0 for a default of 64 MB) only applies when the file is
+ * created; when it fills up, the file is cleared. Passing a NULL path
+ * closes the store. If this is never called, the environment variable
+ * HL_MEMOIZATION_STORE names the file and HL_MEMOIZATION_STORE_SIZE
+ * its size in megabytes. Only supported on Linux and Android; returns
+ * a halide_error_code_t on failure. */
+extern int halide_memoization_cache_set_persistent_store(void *user_context, const char *path, int64_t size);
+
+/** Pipelines compiled with Target::ScratchArena take their heap
+ * allocations from an arena that belongs to the pipeline and persists
+ * between calls, instead of calling halide_malloc and halide_free for
+ * each one. By default the runtime owns the arena: whenever a call
+ * needs more than it holds, the extra allocations fall back to
+ * halide_malloc, and once they have all been freed the arena grows to
+ * the largest size needed so far. In the steady state, calls do no
+ * allocator work at all. The memory of an arena the runtime owns
+ * comes from the system malloc, not halide_malloc, as it outlives the
+ * calls (and user contexts) that asked for it. Arenas are named by
+ * the pipeline name, and may be used by several threads at once. */
+// @{
+
+/** Allocate from and free to the arena of a pipeline. Called by the
+ * generated code. Allocations of zero bytes return NULL. */
+extern void *halide_scratch_arena_malloc(void *user_context, const char *pipeline_name, uint64_t size);
+extern void halide_scratch_arena_free(void *user_context, void *ptr);
+
+/** The size in bytes an arena would need to have held all the
+ * allocations of the calls to the pipeline so far, or zero if the
+ * pipeline hasn't run. Run the pipeline once on representative inputs
+ * to find out how much memory to pass to
+ * halide_scratch_arena_set_memory. */
+extern uint64_t halide_scratch_arena_required_size(void *user_context, const char *pipeline_name);
+
+/** Give the arena of a pipeline caller-owned memory to allocate from,
+ * e.g. a region shared by several pipelines that never run at once.
+ * It must be aligned to 128 bytes, so that allocations carved from it
+ * are as aligned as those from halide_malloc. The arena never grows
+ * past it. Passing NULL hands ownership of the arena back to the
+ * runtime. Fails with halide_error_code_generic_error if the pipeline
+ * is running or the memory is misaligned. */
+extern int halide_scratch_arena_set_memory(void *user_context, const char *pipeline_name,
+                                           void *host, uint64_t size);
+
+/** Free the memory of every arena the runtime owns. Must be called at
+ * a time when no pipeline that uses an arena is running. */
+extern void halide_scratch_arena_cleanup();
+// @}
+
 /** Create a unique file with a name of the form prefixXXXXXsuffix in an arbitrary
  * (but writable) directory; this is typically $TMP or /tmp, but the specific
  * location is not guaranteed. (Note that the exact form of the file name
@@ -876,7 +1010,8 @@ typedef enum halide_target_feature_t {
     halide_target_feature_avx512_knl = 39, ///< Enable the AVX512 features supported by Knight's Landing chips, such as the Xeon Phi x200. This includes the base AVX512 set, and also AVX512-CD and AVX512-ER.
     halide_target_feature_avx512_skylake = 40, ///< Enable the AVX512 features supported by Skylake Xeon server processors. This adds AVX512-VL, AVX512-BW, and AVX512-DQ to the base set. The main difference from the base AVX512 set is better support for small integer ops. Note that this does not include the Knight's Landing features. Note also that these features are not available on Skylake desktop and mobile processors.
     halide_target_feature_avx512_cannonlake = 41, ///< Enable the AVX512 features expected to be supported by future Cannonlake processors. This includes all of the Skylake features, plus AVX512-IFMA and AVX512-VBMI.
-    halide_target_feature_end = 42 ///< A sentinel. Every target is considered to have this feature, and setting this feature does nothing.
+    halide_target_feature_scratch_arena = 42, ///< Take heap allocations from an arena that persists between calls to the pipeline. See halide_scratch_arena_malloc.
+    halide_target_feature_end = 43 ///< A sentinel. Every target is considered to have this feature, and setting this feature does nothing.
 } halide_target_feature_t;
 
 /** This function is called internally by Halide in some situations to determine
@@ -1092,6 +1227,14 @@ struct halide_profiler_func_stats {
     /** The average number of thread pool worker threads active while computing this Func. */
     uint64_t active_threads_numerator, active_threads_denominator;
 
+    /** Hardware counter totals for this Func, summed over all
+     * threads. Only gathered when hardware counters are enabled. See
+     * halide_profiler_set_hardware_counters. */
+    uint64_t cycles, instructions, cache_misses, branch_misses;
+
+    /** The number of points computed by the pure definition of this Func. */
+    uint64_t pixels;
+
     /** The name of this Func. A global constant string. */
     const char *name;
 
@@ -1175,6 +1318,16 @@ struct halide_profiler_state {
 
     /** Is the profiler thread running. */
     bool started;
+
+    /** Per-thread event buffers for the timeline, or NULL if no
+     * timeline is being recorded. See
+     * halide_profiler_set_timeline_file. */
+    void *timeline;
+
+    /** Per-thread hardware counter state, or NULL if hardware
+     * counters are not being gathered. See
+     * halide_profiler_set_hardware_counters. */
+    void *counters;
 };
 
 /** Profiler func ids with special meanings. */
@@ -1206,6 +1359,32 @@ extern void halide_profiler_reset();
  * reset. Also happens at process exit. */
 extern void halide_profiler_report(void *user_context);
 
+/** Record a timeline of profiled pipelines in addition to the
+ * sampled statistics. Each thread logs when it starts and stops
+ * running each Func, when it picks up and finishes parallel tasks,
+ * and the heap usage of each pipeline after every allocation, into a
+ * ring buffer of its own. When the report is printed, the events are
+ * written to the given path as Chrome trace JSON, which can be loaded
+ * into chrome://tracing or Perfetto. If this is never called, the
+ * environment variable HL_PROFILER_TIMELINE names the file. Passing
+ * NULL stops recording. Must not be called while a pipeline is
+ * running. Returns a halide_error_code_t. */
+extern int halide_profiler_set_timeline_file(const char *path);
+
+/** Gather hardware performance counters (cycles, instructions,
+ * last-level cache misses and branch misses) for each thread running
+ * profiled code, and attribute them to the Func the thread is
+ * running. The report then includes instructions per cycle and
+ * misses per point computed for each Func. Reading the counters costs
+ * a system call every time a thread switches Func, so expect some
+ * slowdown for finely interleaved schedules. Currently only
+ * supported on x86 Linux; elsewhere the counters are reported as
+ * unavailable. If this is never called, setting the environment
+ * variable HL_PROFILER_COUNTERS to 1 enables them. Pass zero to
+ * stop gathering them. Must not be called while a pipeline is
+ * running. Returns a halide_error_code_t. */
+extern int halide_profiler_set_hardware_counters(int enable);
+
 /// \name "Float16" functions
 /// These functions operate of bits (``uint16_t``) representing a half
 /// precision floating point number (IEEE-754 2008 binary16).
@@ -3,12 +3,14 @@
 #include "printer.h"
 #include "scoped_mutex_lock.h"
 
-// This is temporary code. In particular, the hash table is stupid and
-// currently thread safety is accomplished via large granularity spin
-// locks. It is mainly intended to prove the programming model and
-// runtime interface for memoization. We'll improve the implementation
-// later. In the meantime, on some platforms it can be replaced by a
-// platform specific LRU cache such as libcache from Apple.
+// The memoization cache is split into a fixed number of shards, each
+// with its own mutex, its own resizable hash table and its own
+// recency list. A key picks its shard from the high bits of its hash
+// and its bucket from the low bits, so threads looking up unrelated
+// keys rarely contend for the same lock. The size budget is global:
+// the total size is tracked atomically and a store that pushes the
+// cache over budget evicts from its own shard first, then from the
+// others, never holding more than one shard lock at a time.
 
 namespace Halide { namespace Runtime { namespace Internal {
 
@@ -76,12 +78,13 @@ WEAK bool bounds_equal(const buffer_t &buf1, const buffer_t &buf2) {
 }
 
 // Each host block has extra space to store a header just before the contents.
-// 16 is chosen to keep that alignment.
+// 32 is chosen to keep 16 byte alignment while leaving room for the
+// time of the miss, which the cost-aware eviction policy uses.
 // The header holds the cache key hash and pointer to the hash entry.
 //
 // This is an optimization the number of cycles it takes for the cache
 // to operate.
-const size_t extra_bytes_host_bytes = 16;
+const size_t extra_bytes_host_bytes = 32;
 
 struct CacheEntry {
     CacheEntry *next;
@@ -92,6 +95,9 @@ struct CacheEntry {
     uint32_t hash;
     uint32_t in_use_count; // 0 if none returned from halide_cache_lookup
     uint32_t tuple_count;
+    uint32_t hit_count;
+    uint64_t size; // Sum of the sizes of all tuple buffers
+    int64_t compute_cost_ns; // Time between the miss and the store, 0 if not measured
     buffer_t computed_bounds;
     buffer_t buf[1];
     // ADDITIONAL buffer_t STRUCTS HERE
@@ -107,6 +113,7 @@ struct CacheEntry {
 struct CacheBlockHeader {
     CacheEntry *entry;
     uint32_t hash;
+    int64_t miss_time_ns;
 };
 
 WEAK CacheBlockHeader *get_pointer_to_header(uint8_t * host) {
@@ -123,6 +130,9 @@ WEAK bool CacheEntry::init(const uint8_t *cache_key, size_t cache_key_size,
     hash = key_hash;
     in_use_count = 0;
     tuple_count = tuples;
+    hit_count = 0;
+    size = 0;
+    compute_cost_ns = 0;
 
     key = (uint8_t *)halide_malloc(NULL, key_size);
     if (key == NULL) {
@@ -136,6 +146,7 @@ WEAK bool CacheEntry::init(const uint8_t *cache_key, size_t cache_key_size,
     }
     for (uint32_t i = 0; i < tuple_count; i++) {
         buffer(i) = *tuple_buffers[i];
+        size += buf_size(tuple_buffers[i]);
     }
     return true;
 }
@@ -153,42 +164,194 @@ WEAK buffer_t &CacheEntry::buffer(int32_t i) {
     return buf_ptr[i];
 }
 
-WEAK uint32_t djb_hash(const uint8_t *key, size_t key_size)  {
-    uint32_t h = 5381;
-    for (size_t i = 0; i < key_size; i++) {
-      h = (h << 5) + h + key[i];
+// A 64-bit multiplicative hash (after MurmurHash64A) that consumes
+// the key eight bytes at a time. Cache keys are tens to hundreds of
+// bytes long, so this is several times faster than hashing a byte at
+// a time, and it mixes the high bits well enough to pick shards from.
+WEAK uint32_t hash_key(const uint8_t *key, size_t key_size) {
+    const uint64_t m = 0xc6a4a7935bd1e995ULL;
+    const int r = 47;
+    uint64_t h = 0x9e3779b97f4a7c15ULL ^ (key_size * m);
+
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= key_size; i += sizeof(uint64_t)) {
+        uint64_t k;
+        __builtin_memcpy(&k, key + i, sizeof(k));
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+    }
+    if (i < key_size) {
+        uint64_t tail = 0;
+        for (size_t j = 0; i + j < key_size; j++) {
+            tail |= ((uint64_t)key[i + j]) << (8 * j);
+        }
+        h ^= tail;
+        h *= m;
     }
-    return h;
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return (uint32_t)(h ^ (h >> 32));
 }
 
-WEAK halide_mutex memoization_lock;
-
-const size_t kHashTableSize = 256;
-
-WEAK CacheEntry *cache_entries[kHashTableSize];
+// Cache keys begin with the address of a string in the generated code
+// and a counter incremented by each compilation (see
+// Memoization.cpp), which are only meaningful in this process. The
+// persistent store keys on the rest of the key, which starts with a
+// hash of the pipeline and the Func that is the same in every process.
+const int32_t kProcessLocalKeyBytes = sizeof(void *) + 4;
+
+// The number of shards must be a power of two. The top
+// kShardBits of a hash select the shard, and the remaining low bits
+// select the bucket within it.
+const uint32_t kShardBits = 4;
+const uint32_t kNumShards = 1 << kShardBits;
+const uint32_t kInitialBucketCount = 64;
+const uint32_t kMaxBucketCount = 1 << (32 - kShardBits);
+// Grow a shard's table when it holds more than this many entries per bucket.
+const uint32_t kMaxLoadFactor = 2;
+// The cost-aware policy considers this many of the least recently
+// used entries when picking one to evict.
+const int kCostAwareWindow = 8;
+
+struct CacheShard {
+    halide_mutex lock;
+    CacheEntry **buckets;
+    uint32_t bucket_count;
+    uint32_t entry_count;
+    CacheEntry *most_recently_used;
+    CacheEntry *least_recently_used;
+    uint64_t hits, misses, stores, evictions;
+    CacheEntry *initial_buckets[kInitialBucketCount];
+};
 
-WEAK CacheEntry *most_recently_used = NULL;
-WEAK CacheEntry *least_recently_used = NULL;
+WEAK CacheShard cache_shards[kNumShards];
 
 const uint64_t kDefaultCacheSize = 1 << 20;
 WEAK int64_t max_cache_size = kDefaultCacheSize;
 WEAK int64_t current_cache_size = 0;
+WEAK uint64_t persistent_hits = 0;
+
+WEAK halide_memoization_eviction_policy_t eviction_policy = halide_memoization_evict_lru;
+
+WEAK uint32_t shard_index_for_hash(uint32_t h) {
+    return h >> (32 - kShardBits);
+}
+
+// Tables start out in storage inside the shard, so a cache that only
+// ever sees a handful of keys never allocates a table.
+WEAK void ensure_buckets(CacheShard &shard) {
+    if (shard.buckets == NULL) {
+        shard.buckets = shard.initial_buckets;
+        shard.bucket_count = kInitialBucketCount;
+    }
+}
+
+WEAK CacheEntry *&bucket_for_hash(CacheShard &shard, uint32_t h) {
+    return shard.buckets[h & (shard.bucket_count - 1)];
+}
+
+// Double the size of a shard's table. If the allocation fails the
+// shard keeps its current table; lookups get slower but stay correct.
+WEAK void grow_buckets(CacheShard &shard) {
+    uint32_t new_count = shard.bucket_count * 2;
+    if (new_count > kMaxBucketCount) {
+        return;
+    }
+    CacheEntry **new_buckets = (CacheEntry **)halide_malloc(NULL, new_count * sizeof(CacheEntry *));
+    if (new_buckets == NULL) {
+        return;
+    }
+    for (uint32_t i = 0; i < new_count; i++) {
+        new_buckets[i] = NULL;
+    }
+    for (uint32_t i = 0; i < shard.bucket_count; i++) {
+        CacheEntry *entry = shard.buckets[i];
+        while (entry != NULL) {
+            CacheEntry *next = entry->next;
+            CacheEntry *&bucket = new_buckets[entry->hash & (new_count - 1)];
+            entry->next = bucket;
+            bucket = entry;
+            entry = next;
+        }
+    }
+    if (shard.buckets != shard.initial_buckets) {
+        halide_free(NULL, shard.buckets);
+    }
+    shard.buckets = new_buckets;
+    shard.bucket_count = new_count;
+}
+
+WEAK void unlink_from_bucket(CacheShard &shard, CacheEntry *entry) {
+    CacheEntry **link = &bucket_for_hash(shard, entry->hash);
+    while (*link != entry) {
+        halide_assert(NULL, *link != NULL);
+        link = &(*link)->next;
+    }
+    *link = entry->next;
+    entry->next = NULL;
+}
+
+WEAK void unlink_from_recency_list(CacheShard &shard, CacheEntry *entry) {
+    if (entry->more_recent != NULL) {
+        entry->more_recent->less_recent = entry->less_recent;
+    } else {
+        halide_assert(NULL, shard.most_recently_used == entry);
+        shard.most_recently_used = entry->less_recent;
+    }
+    if (entry->less_recent != NULL) {
+        entry->less_recent->more_recent = entry->more_recent;
+    } else {
+        halide_assert(NULL, shard.least_recently_used == entry);
+        shard.least_recently_used = entry->more_recent;
+    }
+    entry->more_recent = NULL;
+    entry->less_recent = NULL;
+}
+
+WEAK void push_most_recent(CacheShard &shard, CacheEntry *entry) {
+    entry->more_recent = NULL;
+    entry->less_recent = shard.most_recently_used;
+    if (shard.most_recently_used != NULL) {
+        shard.most_recently_used->more_recent = entry;
+    }
+    shard.most_recently_used = entry;
+    if (shard.least_recently_used == NULL) {
+        shard.least_recently_used = entry;
+    }
+}
+
+WEAK bool entry_matches(CacheEntry *entry, uint32_t h, const uint8_t *cache_key, int32_t size,
+                        const buffer_t *computed_bounds, int32_t tuple_count, buffer_t **tuple_buffers) {
+    if (entry->hash != h || entry->key_size != (size_t)size ||
+        entry->tuple_count != (uint32_t)tuple_count ||
+        !keys_equal(entry->key, cache_key, size) ||
+        !bounds_equal(entry->computed_bounds, *computed_bounds)) {
+        return false;
+    }
+    for (int32_t i = 0; i < tuple_count; i++) {
+        if (!bounds_equal(entry->buffer(i), *tuple_buffers[i])) {
+            return false;
+        }
+    }
+    return true;
+}
 
 #if CACHE_DEBUGGING
-WEAK void validate_cache() {
-    print(NULL) << "validating cache, "
-                << "current size " << current_cache_size
-                << " of maximum " << max_cache_size << "\n";
+WEAK void validate_shard(CacheShard &shard) {
     int entries_in_hash_table = 0;
-    for (size_t i = 0; i < kHashTableSize; i++) {
-        CacheEntry *entry = cache_entries[i];
+    for (size_t i = 0; shard.buckets != NULL && i < shard.bucket_count; i++) {
+        CacheEntry *entry = shard.buckets[i];
         while (entry != NULL) {
             entries_in_hash_table++;
-            if (entry->more_recent == NULL && entry != most_recently_used) {
+            if (entry->more_recent == NULL && entry != shard.most_recently_used) {
                 halide_print(NULL, "cache invalid case 1\n");
                 __builtin_trap();
             }
-            if (entry->less_recent == NULL && entry != least_recently_used) {
+            if (entry->less_recent == NULL && entry != shard.least_recently_used) {
                 halide_print(NULL, "cache invalid case 2\n");
                 __builtin_trap();
             }
@@ -196,13 +359,13 @@ WEAK void validate_cache() {
         }
     }
     int entries_from_mru = 0;
-    CacheEntry *mru_chain = most_recently_used;
+    CacheEntry *mru_chain = shard.most_recently_used;
     while (mru_chain != NULL) {
         entries_from_mru++;
         mru_chain = mru_chain->less_recent;
     }
     int entries_from_lru = 0;
-    CacheEntry *lru_chain = least_recently_used;
+    CacheEntry *lru_chain = shard.least_recently_used;
     while (lru_chain != NULL) {
         entries_from_lru++;
         lru_chain = lru_chain->more_recent;
@@ -210,7 +373,8 @@ WEAK void validate_cache() {
     print(NULL) << "hash entries " << entries_in_hash_table
                 << ", mru entries " << entries_from_mru
                 << ", lru entries " << entries_from_lru << "\n";
-    if (entries_in_hash_table != entries_from_mru) {
+    if (entries_in_hash_table != entries_from_mru ||
+        entries_in_hash_table != (int)shard.entry_count) {
         halide_print(NULL, "cache invalid case 3\n");
         __builtin_trap();
     }
@@ -221,62 +385,159 @@ WEAK void validate_cache() {
 }
 #endif
 
-WEAK void prune_cache() {
+// Pick the entry to evict from a shard, or NULL if every entry in it
+// is in use. Must be called with the shard lock held.
+WEAK CacheEntry *choose_victim(CacheShard &shard) {
+    CacheEntry *victim = NULL;
+    double victim_score = 0;
+    int candidates = 0;
+    for (CacheEntry *entry = shard.least_recently_used; entry != NULL; entry = entry->more_recent) {
+        if (entry->in_use_count != 0) {
+            continue;
+        }
+        if (eviction_policy == halide_memoization_evict_lru) {
+            return entry;
+        }
+        // Among the least recently used entries, evict the one that
+        // saves the least recomputation per byte it occupies.
+        double score = ((double)entry->compute_cost_ns + 1) * ((double)entry->hit_count + 1) /
+            ((double)entry->size + 1);
+        if (victim == NULL || score < victim_score) {
+            victim = entry;
+            victim_score = score;
+        }
+        if (++candidates == kCostAwareWindow) {
+            break;
+        }
+    }
+    return victim;
+}
+
+// Evict entries from a shard until the cache is within budget or
+// nothing in the shard can be evicted. Must be called with the shard
+// lock held.
+WEAK void prune_shard(CacheShard &shard) {
 #if CACHE_DEBUGGING
-    validate_cache();
+    validate_shard(shard);
 #endif
-    CacheEntry *prune_candidate = least_recently_used;
-    while (current_cache_size > max_cache_size &&
-           prune_candidate != NULL) {
-        CacheEntry *more_recent = prune_candidate->more_recent;
-
-        if (prune_candidate->in_use_count == 0) {
-            uint32_t h = prune_candidate->hash;
-            uint32_t index = h % kHashTableSize;
-
-            // Remove from hash table
-            CacheEntry *prev_hash_entry = cache_entries[index];
-            if (prev_hash_entry == prune_candidate) {
-                cache_entries[index] = prune_candidate->next;
-            } else {
-                while (prev_hash_entry != NULL && prev_hash_entry->next != prune_candidate) {
-                    prev_hash_entry = prev_hash_entry->next;
-                }
-                halide_assert(NULL, prev_hash_entry != NULL);
-                prev_hash_entry->next = prune_candidate->next;
-            }
+    while (current_cache_size > max_cache_size) {
+        CacheEntry *victim = choose_victim(shard);
+        if (victim == NULL) {
+            break;
+        }
+        unlink_from_bucket(shard, victim);
+        unlink_from_recency_list(shard, victim);
+        shard.entry_count--;
+        shard.evictions++;
+        __sync_sub_and_fetch(&current_cache_size, (int64_t)victim->size);
+        victim->destroy();
+        halide_free(NULL, victim);
+    }
+#if CACHE_DEBUGGING
+    validate_shard(shard);
+#endif
+}
 
-            // Remove from less recent chain.
-            if (least_recently_used == prune_candidate) {
-                least_recently_used = more_recent;
-            }
-            if (more_recent != NULL) {
-                more_recent->less_recent = prune_candidate->less_recent;
+// Bring the whole cache within budget, visiting the shards in order
+// starting from first_shard. Must be called with no shard lock held.
+WEAK void prune_cache(uint32_t first_shard) {
+    for (uint32_t i = 0; i < kNumShards && current_cache_size > max_cache_size; i++) {
+        CacheShard &shard = cache_shards[(first_shard + i) & (kNumShards - 1)];
+        ScopedMutexLock lock(&shard.lock);
+        prune_shard(shard);
+    }
+}
+
+// Add a computed result to the in-process cache, taking ownership of
+// the tuple buffers. Results read from the persistent store count as
+// hits rather than stores. Must be called with no shard lock held.
+WEAK void store_in_memory(void *user_context, const uint8_t *cache_key, int32_t size,
+                          buffer_t *computed_bounds, int32_t tuple_count, buffer_t **tuple_buffers,
+                          bool from_persistent_store) {
+    CacheBlockHeader *first_header = get_pointer_to_header(tuple_buffers[0]->host);
+    uint32_t h = first_header->hash;
+    int64_t compute_cost_ns = 0;
+    if (first_header->miss_time_ns != 0) {
+        compute_cost_ns = halide_current_time_ns(user_context) - first_header->miss_time_ns;
+    }
+
+    uint32_t shard_index = shard_index_for_hash(h);
+    CacheShard &shard = cache_shards[shard_index];
+
+    {
+        ScopedMutexLock lock(&shard.lock);
+        ensure_buckets(shard);
+
+#if CACHE_DEBUGGING
+        debug_print_key(user_context, "halide_memoization_cache_store", cache_key, size);
+
+        debug_print_buffer(user_context, "computed_bounds", *computed_bounds);
+
+        {
+            for (int32_t i = 0; i < tuple_count; i++) {
+                buffer_t *buf = tuple_buffers[i];
+                debug_print_buffer(user_context, "Allocation bounds", *buf);
             }
+        }
+#endif
 
-            // Remove from more recent chain.
-            if (most_recently_used == prune_candidate) {
-                most_recently_used = prune_candidate->less_recent;
+        CacheEntry *entry = bucket_for_hash(shard, h);
+        while (entry != NULL) {
+            if (entry_matches(entry, h, cache_key, size, computed_bounds, tuple_count, tuple_buffers)) {
+                for (int32_t i = 0; i < tuple_count; i++) {
+                    halide_assert(user_context, entry->buffer(i).host != tuple_buffers[i]->host);
+                }
+                // This entry is still in use by the caller. Mark it as having no cache entry
+                // so halide_memoization_cache_release can free the buffer.
+                for (int32_t i = 0; i < tuple_count; i++) {
+                    get_pointer_to_header(tuple_buffers[i]->host)->entry = NULL;
+                }
+                return;
             }
-            if (prune_candidate->less_recent != NULL) {
-                prune_candidate->less_recent = more_recent;
+            entry = entry->next;
+        }
+
+        void *entry_storage = halide_malloc(NULL, sizeof(CacheEntry) + sizeof(buffer_t) * (tuple_count - 1));
+        CacheEntry *new_entry = (CacheEntry *)entry_storage;
+        if (new_entry == NULL ||
+            !new_entry->init(cache_key, size, h, *computed_bounds, tuple_count, tuple_buffers)) {
+            // This entry is still in use by the caller. Mark it as having no cache entry
+            // so halide_memoization_cache_release can free the buffer.
+            for (int32_t i = 0; i < tuple_count; i++) {
+                get_pointer_to_header(tuple_buffers[i]->host)->entry = NULL;
             }
 
-            // Decrease cache used amount.
-            for (uint32_t i = 0; i < prune_candidate->tuple_count; i++) {
-                current_cache_size -= buf_size(&prune_candidate->buffer(i));
+            if (new_entry != NULL) {
+                halide_free(user_context, new_entry);
             }
+            return;
+        }
+        new_entry->compute_cost_ns = compute_cost_ns;
+
+        CacheEntry *&bucket = bucket_for_hash(shard, h);
+        new_entry->next = bucket;
+        bucket = new_entry;
+        push_most_recent(shard, new_entry);
+        shard.entry_count++;
+        if (!from_persistent_store) {
+            shard.stores++;
+        }
+        if (shard.entry_count > shard.bucket_count * kMaxLoadFactor) {
+            grow_buckets(shard);
+        }
+
+        new_entry->in_use_count = tuple_count;
 
-            // Deallocate the entry.
-            prune_candidate->destroy();
-            halide_free(NULL, prune_candidate);
+        for (int32_t i = 0; i < tuple_count; i++) {
+            get_pointer_to_header(tuple_buffers[i]->host)->entry = new_entry;
         }
 
-        prune_candidate = more_recent;
+        __sync_add_and_fetch(&current_cache_size, (int64_t)new_entry->size);
+        prune_shard(shard);
     }
-#if CACHE_DEBUGGING
-    validate_cache();
-#endif
+
+    // If this shard had nothing left to evict, try the others.
+    prune_cache(shard_index + 1);
 }
 
 }}} // namespace Halide::Runtime::Internal
@@ -288,66 +549,51 @@ WEAK void halide_memoization_cache_set_size(int64_t size) {
         size = kDefaultCacheSize;
     }
 
-    ScopedMutexLock lock(&memoization_lock);
-
+    // Pruning reads the limit with only its own shard lock held, so
+    // hold all of them (in order, as nothing else holds two) to change
+    // it.
+    for (uint32_t s = 0; s < kNumShards; s++) {
+        halide_mutex_lock(&cache_shards[s].lock);
+    }
     max_cache_size = size;
-    prune_cache();
+    for (uint32_t s = kNumShards; s > 0; s--) {
+        halide_mutex_unlock(&cache_shards[s - 1].lock);
+    }
+    prune_cache(0);
+}
+
+WEAK void halide_memoization_cache_set_eviction_policy(halide_memoization_eviction_policy_t policy) {
+    eviction_policy = policy;
 }
 
 WEAK int halide_memoization_cache_lookup(void *user_context, const uint8_t *cache_key, int32_t size,
                                          buffer_t *computed_bounds, int32_t tuple_count, buffer_t **tuple_buffers) {
-    uint32_t h = djb_hash(cache_key, size);
-    uint32_t index = h % kHashTableSize;
+    uint32_t h = hash_key(cache_key, size);
+    CacheShard &shard = cache_shards[shard_index_for_hash(h)];
 
-    ScopedMutexLock lock(&memoization_lock);
+    {
+        ScopedMutexLock lock(&shard.lock);
+        ensure_buckets(shard);
 
 #if CACHE_DEBUGGING
-    debug_print_key(user_context, "halide_memoization_cache_lookup", cache_key, size);
+        debug_print_key(user_context, "halide_memoization_cache_lookup", cache_key, size);
 
-    debug_print_buffer(user_context, "computed_bounds", *computed_bounds);
+        debug_print_buffer(user_context, "computed_bounds", *computed_bounds);
 
-    {
-        for (int32_t i = 0; i < tuple_count; i++) {
-            buffer_t *buf = tuple_buffers[i];
-            debug_print_buffer(user_context, "Allocation bounds", *buf);
+        {
+            for (int32_t i = 0; i < tuple_count; i++) {
+                buffer_t *buf = tuple_buffers[i];
+                debug_print_buffer(user_context, "Allocation bounds", *buf);
+            }
         }
-    }
 #endif
 
-    CacheEntry *entry = cache_entries[index];
-    while (entry != NULL) {
-        if (entry->hash == h && entry->key_size == (size_t)size &&
-            keys_equal(entry->key, cache_key, size) &&
-            bounds_equal(entry->computed_bounds, *computed_bounds) &&
-            entry->tuple_count == (uint32_t)tuple_count) {
-
-            bool all_bounds_equal = true;
-
-            {
-                for (int32_t i = 0; all_bounds_equal && i < tuple_count; i++) {
-                    buffer_t *buf = tuple_buffers[i];
-                    all_bounds_equal = bounds_equal(entry->buffer(i), *buf);
-                }
-            }
-
-            if (all_bounds_equal) {
-                if (entry != most_recently_used) {
-                    halide_assert(user_context, entry->more_recent != NULL);
-                    if (entry->less_recent != NULL) {
-                        entry->less_recent->more_recent = entry->more_recent;
-                    } else {
-                        halide_assert(user_context, least_recently_used == entry);
-                        least_recently_used = entry->more_recent;
-                    }
-                    halide_assert(user_context, entry->more_recent != NULL);
-                    entry->more_recent->less_recent = entry->less_recent;
-
-                    entry->more_recent = NULL;
-                    entry->less_recent = most_recently_used;
-                    if (most_recently_used != NULL) {
-                        most_recently_used->more_recent = entry;
-                    }
-                    most_recently_used = entry;
+        CacheEntry *entry = bucket_for_hash(shard, h);
+        while (entry != NULL) {
+            if (entry_matches(entry, h, cache_key, size, computed_bounds, tuple_count, tuple_buffers)) {
+                if (entry != shard.most_recently_used) {
+                    unlink_from_recency_list(shard, entry);
+                    push_most_recent(shard, entry);
                 }
 
                 for (int32_t i = 0; i < tuple_count; i++) {
@@ -356,11 +602,22 @@ WEAK int halide_memoization_cache_lookup(void *user_context, const uint8_t *cach
                 }
 
                 entry->in_use_count += tuple_count;
+                entry->hit_count++;
+                shard.hits++;
 
                 return 0;
             }
+            entry = entry->next;
         }
-        entry = entry->next;
+
+        shard.misses++;
+    }
+
+    // The shard lock is not held while allocating storage for the
+    // result, so other threads can use the shard while we compute.
+    int64_t miss_time_ns = 0;
+    if (eviction_policy == halide_memoization_evict_cost_aware) {
+        miss_time_ns = halide_current_time_ns(user_context);
     }
 
     for (int32_t i = 0; i < tuple_count; i++) {
@@ -379,11 +636,21 @@ WEAK int halide_memoization_cache_lookup(void *user_context, const uint8_t *cach
         CacheBlockHeader *header = get_pointer_to_header(buf->host);
         header->hash = h;
         header->entry = NULL;
+        header->miss_time_ns = miss_time_ns;
     }
 
-#if CACHE_DEBUGGING
-    validate_cache();
-#endif
+    const uint8_t *stable_key = cache_key + kProcessLocalKeyBytes;
+    int32_t stable_size = size - kProcessLocalKeyBytes;
+    if (halide_memoization_persistent_lookup(user_context, stable_key, stable_size,
+                                             hash_key(stable_key, stable_size),
+                                             computed_bounds, tuple_count, tuple_buffers) == 0) {
+        // Another process (or an earlier run) computed this result.
+        // Move it into the in-process cache and report a hit; the
+        // caller releases the buffers as for any other hit.
+        __sync_add_and_fetch(&persistent_hits, 1);
+        store_in_memory(user_context, cache_key, size, computed_bounds, tuple_count, tuple_buffers, true);
+        return 0;
+    }
 
     return 1;
 }
@@ -392,114 +659,13 @@ WEAK int halide_memoization_cache_store(void *user_context, const uint8_t *cache
                                         buffer_t *computed_bounds, int32_t tuple_count, buffer_t **tuple_buffers) {
     debug(user_context) << "halide_memoization_cache_store\n";
 
-    uint32_t h = get_pointer_to_header(tuple_buffers[0]->host)->hash;
-
-    uint32_t index = h % kHashTableSize;
-
-    ScopedMutexLock lock(&memoization_lock);
-
-#if CACHE_DEBUGGING
-    debug_print_key(user_context, "halide_memoization_cache_store", cache_key, size);
-
-    debug_print_buffer(user_context, "computed_bounds", *computed_bounds);
+    const uint8_t *stable_key = cache_key + kProcessLocalKeyBytes;
+    int32_t stable_size = size - kProcessLocalKeyBytes;
+    halide_memoization_persistent_store(user_context, stable_key, stable_size,
+                                        hash_key(stable_key, stable_size),
+                                        computed_bounds, tuple_count, tuple_buffers);
+    store_in_memory(user_context, cache_key, size, computed_bounds, tuple_count, tuple_buffers, false);
 
-    {
-        for (int32_t i = 0; i < tuple_count; i++) {
-            buffer_t *buf = tuple_buffers[i];
-            debug_print_buffer(user_context, "Allocation bounds", *buf);
-        }
-    }
-#endif
-
-    CacheEntry *entry = cache_entries[index];
-    while (entry != NULL) {
-        if (entry->hash == h && entry->key_size == (size_t)size &&
-            keys_equal(entry->key, cache_key, size) &&
-            bounds_equal(entry->computed_bounds, *computed_bounds) &&
-            entry->tuple_count == (uint32_t)tuple_count) {
-
-            bool all_bounds_equal = true;
-            bool no_host_pointers_equal = true;
-            {
-                for (int32_t i = 0; all_bounds_equal && i < tuple_count; i++) {
-                    buffer_t *buf = tuple_buffers[i];
-                    all_bounds_equal = bounds_equal(entry->buffer(i), *buf);
-                    if (entry->buffer(i).host == buf->host) {
-                        no_host_pointers_equal = false;
-                    }
-                }
-            }
-            if (all_bounds_equal) {
-                halide_assert(user_context, no_host_pointers_equal);
-                // This entry is still in use by the caller. Mark it as having no cache entry
-                // so halide_memoization_cache_release can free the buffer.
-                for (int32_t i = 0; i < tuple_count; i++) {
-                    get_pointer_to_header(tuple_buffers[i]->host)->entry = NULL;
-
-                }
-                return 0;
-            }
-        }
-        entry = entry->next;
-    }
-
-    uint64_t added_size = 0;
-    {
-        for (int32_t i = 0; i < tuple_count; i++) {
-            buffer_t *buf = tuple_buffers[i];
-            added_size += buf_size(buf);
-        }
-    }
-    current_cache_size += added_size;
-    prune_cache();
-
-    void *entry_storage = halide_malloc(NULL, sizeof(CacheEntry) + sizeof(buffer_t) * (tuple_count - 1));
-    if (entry_storage == NULL) {
-        current_cache_size -= added_size;
-
-        // This entry is still in use by the caller. Mark it as having no cache entry
-        // so halide_memoization_cache_release can free the buffer.
-        for (int32_t i = 0; i < tuple_count; i++) {
-            get_pointer_to_header(tuple_buffers[i]->host)->entry = NULL;
-        }
-        return 0;
-    }
-
-    CacheEntry *new_entry = (CacheEntry *)entry_storage;
-    bool inited = new_entry->init(cache_key, size, h, *computed_bounds, tuple_count, tuple_buffers);
-    if (!inited) {
-        current_cache_size -= added_size;
-
-        // This entry is still in use by the caller. Mark it as having no cache entry
-        // so halide_memoization_cache_release can free the buffer.
-        for (int32_t i = 0; i < tuple_count; i++) {
-            get_pointer_to_header(tuple_buffers[i]->host)->entry = NULL;
-        }
-
-        halide_free(user_context, new_entry);
-        return 0;
-    }
-
-    new_entry->next = cache_entries[index];
-    new_entry->less_recent = most_recently_used;
-    if (most_recently_used != NULL) {
-        most_recently_used->more_recent = new_entry;
-    }
-    most_recently_used = new_entry;
-    if (least_recently_used == NULL) {
-        least_recently_used = new_entry;
-    }
-    cache_entries[index] = new_entry;
-
-    new_entry->in_use_count = tuple_count;
-
-    for (int32_t i = 0; i < tuple_count; i++) {
-        get_pointer_to_header(tuple_buffers[i]->host)->entry = new_entry;
-    }
-
-#if CACHE_DEBUGGING
-    validate_cache();
-#endif
     debug(user_context) << "Exiting halide_memoization_cache_store\n";
 
     return 0;
@@ -513,32 +679,71 @@ WEAK void halide_memoization_cache_release(void *user_context, void *host) {
     if (entry == NULL) {
         halide_free(user_context, header);
     } else {
-        ScopedMutexLock lock(&memoization_lock);
+        CacheShard &shard = cache_shards[shard_index_for_hash(entry->hash)];
+        ScopedMutexLock lock(&shard.lock);
 
         halide_assert(user_context, entry->in_use_count > 0);
         entry->in_use_count--;
 #if CACHE_DEBUGGING
-        validate_cache();
+        validate_shard(shard);
 #endif
     }
 
     debug(user_context) << "Exited halide_memoization_cache_release.\n";
 }
 
+WEAK void halide_memoization_cache_get_stats(struct halide_memoization_cache_stats_t *stats) {
+    stats->hits = 0;
+    stats->persistent_hits = 0;
+    stats->misses = 0;
+    stats->stores = 0;
+    stats->evictions = 0;
+    stats->entries = 0;
+    for (uint32_t s = 0; s < kNumShards; s++) {
+        CacheShard &shard = cache_shards[s];
+        ScopedMutexLock lock(&shard.lock);
+        stats->hits += shard.hits;
+        stats->misses += shard.misses;
+        stats->stores += shard.stores;
+        stats->evictions += shard.evictions;
+        stats->entries += shard.entry_count;
+    }
+    // Lookups satisfied by the persistent store missed in memory first.
+    stats->hits += persistent_hits;
+    stats->misses -= persistent_hits;
+    stats->persistent_hits = persistent_hits;
+    stats->current_size = current_cache_size;
+    stats->max_size = max_cache_size;
+}
+
 WEAK void halide_memoization_cache_cleanup() {
     debug(NULL) << "halide_memoization_cache_cleanup\n";
-    for (size_t i = 0; i < kHashTableSize; i++) {
-        CacheEntry *entry = cache_entries[i];
-        cache_entries[i] = NULL;
-        while (entry != NULL) {
-            CacheEntry *next = entry->next;
-            entry->destroy();
-            halide_free(NULL, entry);
-            entry = next;
+    for (uint32_t s = 0; s < kNumShards; s++) {
+        CacheShard &shard = cache_shards[s];
+        for (size_t i = 0; shard.buckets != NULL && i < shard.bucket_count; i++) {
+            CacheEntry *entry = shard.buckets[i];
+            shard.buckets[i] = NULL;
+            while (entry != NULL) {
+                CacheEntry *next = entry->next;
+                entry->destroy();
+                halide_free(NULL, entry);
+                entry = next;
+            }
+        }
+        if (shard.buckets != NULL && shard.buckets != shard.initial_buckets) {
+            halide_free(NULL, shard.buckets);
         }
+        shard.buckets = NULL;
+        shard.bucket_count = 0;
+        shard.entry_count = 0;
+        shard.most_recently_used = NULL;
+        shard.least_recently_used = NULL;
+        shard.hits = shard.misses = shard.stores = shard.evictions = 0;
+        halide_mutex_destroy(&shard.lock);
     }
     current_cache_size = 0;
-    halide_mutex_destroy(&memoization_lock);
+    persistent_hits = 0;
+    halide_memoization_persistent_cleanup();
 }
 
 namespace {
@@ -36,6 +36,15 @@ WEAK halide_thread *halide_spawn_thread(void (*f)(void *), void *closure) {
     return NULL;
 }
 
+WEAK bool halide_can_spawn_threads() {
+    return false;
+}
+
+WEAK uintptr_t halide_current_thread_id() {
+    // There is only ever one thread.
+    return 0;
+}
+
 WEAK void halide_mutex_destroy(halide_mutex *mutex_arg) {
 }
 
@@ -45,9 +54,54 @@ WEAK void halide_mutex_lock(halide_mutex *mutex) {
 WEAK void halide_mutex_unlock(halide_mutex *mutex) {
 }
 
+// There is only one thread, so nothing else could wake a waiter.
+WEAK void halide_cond_init(struct halide_cond *cond) {
+}
+
+WEAK void halide_cond_destroy(struct halide_cond *cond) {
+}
+
+WEAK void halide_cond_broadcast(struct halide_cond *cond) {
+}
+
+WEAK void halide_cond_wait(struct halide_cond *cond, struct halide_mutex *mutex) {
+}
+
 WEAK void halide_shutdown_thread_pool() {
 }
 
+WEAK int halide_semaphore_init(halide_semaphore_t *s, int n) {
+    // The first int is the count, and the second is whether the
+    // semaphore is closed.
+    int *sem = (int *)s;
+    sem[0] = n;
+    sem[1] = 0;
+    return 0;
+}
+
+WEAK int halide_semaphore_release(halide_semaphore_t *s, int n) {
+    *(int *)s += n;
+    return *(int *)s;
+}
+
+WEAK void halide_semaphore_close(void *user_context, void *s) {
+    ((int *)s)[1] = 1;
+}
+
+WEAK int halide_semaphore_acquire(halide_semaphore_t *s, int n) {
+    int *sem = (int *)s;
+    if (sem[0] < n) {
+        if (!sem[1]) {
+            // Tasks run one at a time to completion, so nothing could
+            // ever release this semaphore.
+            halide_error(NULL, "halide_semaphore_acquire would deadlock: async Funcs require a thread pool.");
+        }
+        return halide_error_code_generic_error;
+    }
+    sem[0] -= n;
+    return 0;
+}
+
 WEAK int halide_set_num_threads(int n) {
     if (n < 0) {
         halide_error(NULL, "halide_set_num_threads: must be >= 0.");
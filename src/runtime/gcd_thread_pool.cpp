@@ -1,4 +1,5 @@
 #include "HalideRuntime.h"
+#include "scoped_spin_lock.h"
 
 extern "C" {
 
@@ -24,6 +25,9 @@ extern long dispatch_semaphore_wait(dispatch_semaphore_t dsema, dispatch_time_t
 extern long dispatch_semaphore_signal(dispatch_semaphore_t dsema);
 extern void dispatch_release(void *object);
 
+typedef void *pthread_t;
+extern pthread_t pthread_self();
+
 
 WEAK int halide_do_task(void *user_context, halide_task_t f, int idx,
                         uint8_t *closure);
@@ -53,16 +57,20 @@ WEAK halide_thread *halide_spawn_thread(void (*f)(void *), void *closure) {
     return (halide_thread *)thread;
 }
 
+WEAK bool halide_can_spawn_threads() {
+    return true;
+}
+
+WEAK uintptr_t halide_current_thread_id() {
+    return (uintptr_t)pthread_self();
+}
+
 WEAK void halide_join_thread(halide_thread *thread_arg) {
     spawned_thread *thread = (spawned_thread *)thread_arg;
     dispatch_semaphore_wait(thread->join_semaphore, DISPATCH_TIME_FOREVER);
     free(thread);
 }
 
-// Join thread and condition variables intentionally unimplemented for
-// now on OS X. Use of them will result in linker errors. Currently
-// only the common thread pool uses them.
-
 namespace Halide { namespace Runtime { namespace Internal {
 
 WEAK int custom_num_threads = 0;
@@ -77,6 +85,19 @@ WEAK void init_mutex(void *mutex_arg) {
     mutex->semaphore = dispatch_semaphore_create(1);
 }
 
+// A condition variable is a list of waiters, each blocked on a
+// semaphore of its own. A waiter joins the list before releasing the
+// mutex, so a broadcast after that point always wakes it.
+struct gcd_cond_waiter {
+    dispatch_semaphore_t semaphore;
+    gcd_cond_waiter *next;
+};
+
+struct gcd_cond {
+    int lock;
+    gcd_cond_waiter *waiters;
+};
+
 WEAK int default_do_task(void *user_context, int (*f)(void *, int, uint8_t *),
                          int idx, uint8_t *closure) {
     return f(user_context, idx, closure);
@@ -126,6 +147,17 @@ WEAK int default_do_par_for(void *user_context, halide_task_t f,
 WEAK halide_do_task_t custom_do_task = default_do_task;
 WEAK halide_do_par_for_t custom_do_par_for = default_do_par_for;
 
+// The contents of a halide_semaphore_t. Protected by semaphore_lock.
+struct semaphore_impl {
+    int value;
+    bool closed;
+};
+
+WEAK halide_mutex semaphore_lock;
+
+// Broadcast whenever any semaphore is released or closed.
+WEAK halide_cond semaphore_changed;
+
 }}} // namespace Halide::Runtime::Internal
 
 extern "C" {
@@ -149,9 +181,91 @@ WEAK void halide_mutex_unlock(halide_mutex *mutex_arg) {
     dispatch_semaphore_signal(mutex->semaphore);
 }
 
+WEAK void halide_cond_init(struct halide_cond *cond_arg) {
+    memset(cond_arg, 0, sizeof(halide_cond));
+}
+
+WEAK void halide_cond_destroy(struct halide_cond *cond_arg) {
+}
+
+WEAK void halide_cond_broadcast(struct halide_cond *cond_arg) {
+    gcd_cond *cond = (gcd_cond *)cond_arg;
+    gcd_cond_waiter *w;
+    {
+        ScopedSpinLock lock(&cond->lock);
+        w = cond->waiters;
+        cond->waiters = NULL;
+    }
+    while (w) {
+        // The waiter may return as soon as it is signalled.
+        gcd_cond_waiter *next = w->next;
+        dispatch_semaphore_signal(w->semaphore);
+        w = next;
+    }
+}
+
+WEAK void halide_cond_wait(struct halide_cond *cond_arg, struct halide_mutex *mutex) {
+    gcd_cond *cond = (gcd_cond *)cond_arg;
+    gcd_cond_waiter w;
+    w.semaphore = dispatch_semaphore_create(0);
+    {
+        ScopedSpinLock lock(&cond->lock);
+        w.next = cond->waiters;
+        cond->waiters = &w;
+    }
+    halide_mutex_unlock(mutex);
+    dispatch_semaphore_wait(w.semaphore, DISPATCH_TIME_FOREVER);
+    dispatch_release(w.semaphore);
+    halide_mutex_lock(mutex);
+}
+
 WEAK void halide_shutdown_thread_pool() {
 }
 
+WEAK int halide_semaphore_init(halide_semaphore_t *s, int n) {
+    semaphore_impl *sem = (semaphore_impl *)s;
+    sem->value = n;
+    sem->closed = false;
+    return 0;
+}
+
+WEAK int halide_semaphore_release(halide_semaphore_t *s, int n) {
+    semaphore_impl *sem = (semaphore_impl *)s;
+    halide_mutex_lock(&semaphore_lock);
+    sem->value += n;
+    int result = sem->value;
+    halide_cond_broadcast(&semaphore_changed);
+    halide_mutex_unlock(&semaphore_lock);
+    return result;
+}
+
+WEAK void halide_semaphore_close(void *user_context, void *s) {
+    semaphore_impl *sem = (semaphore_impl *)s;
+    halide_mutex_lock(&semaphore_lock);
+    sem->closed = true;
+    halide_cond_broadcast(&semaphore_changed);
+    halide_mutex_unlock(&semaphore_lock);
+}
+
+WEAK int halide_semaphore_acquire(halide_semaphore_t *s, int n) {
+    semaphore_impl *sem = (semaphore_impl *)s;
+    halide_mutex_lock(&semaphore_lock);
+    // GCD adds threads to its pool when its workers block, so the
+    // task that will release this semaphore gets to run.
+    while (sem->value < n && !sem->closed) {
+        halide_cond_wait(&semaphore_changed, &semaphore_lock);
+    }
+    int result = 0;
+    if (sem->value < n) {
+        // Whatever would have released it failed.
+        result = halide_error_code_generic_error;
+    } else {
+        sem->value -= n;
+    }
+    halide_mutex_unlock(&semaphore_lock);
+    return result;
+}
+
 WEAK int halide_set_num_threads(int n) {
     if (n < 0) {
         halide_error(NULL, "halide_set_num_threads: must be >= 0.");
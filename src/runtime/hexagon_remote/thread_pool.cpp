@@ -41,6 +41,14 @@ struct halide_thread *halide_spawn_thread(void (*f)(void *), void *closure) {
     return (halide_thread *)t;
 }
 
+bool halide_can_spawn_threads() {
+    return true;
+}
+
+uintptr_t halide_current_thread_id() {
+    return (uintptr_t)qurt_thread_get_id();
+}
+
 void halide_join_thread(struct halide_thread *thread_arg) {
     spawned_thread *t = (spawned_thread *)thread_arg;
     int ret = 0;
@@ -0,0 +1,399 @@
+#include "HalideRuntime.h"
+#include "device_buffer_utils.h"
+#include "printer.h"
+#include "scoped_mutex_lock.h"
+
+// A persistent backing store for the memoization cache. Entries are
+// kept in a file that every process using the same path maps with
+// MAP_SHARED, so results computed by one process are visible to all
+// the others and survive restarts. Access is serialized between
+// threads of a process with a mutex and between processes with
+// flock(). The file is an append-only log of records indexed by a
+// fixed-size hash table; when a record no longer fits, the whole
+// store is cleared and filling starts again.
+
+extern "C" {
+
+extern void *mmap(void *addr, size_t length, int prot, int flags, int fd, long offset);
+extern int munmap(void *addr, size_t length);
+extern int ftruncate(int fd, long length);
+extern long lseek(int fd, long offset, int whence);
+extern int flock(int fd, int operation);
+
+}
+
+namespace Halide { namespace Runtime { namespace Internal {
+
+#define O_CREAT 64
+#define SEEK_END 2
+#define PROT_READ 1
+#define PROT_WRITE 2
+#define MAP_SHARED 1
+#define MAP_FAILED ((void *)-1)
+#define LOCK_SH 1
+#define LOCK_EX 2
+#define LOCK_UN 8
+
+const uint32_t kStoreMagic = 0x434d4c48; // "HLMC"
+// Bump this whenever the layout below changes. Stores with a
+// different version are cleared when opened.
+const uint32_t kStoreVersion = 2;
+const uint32_t kStoreBucketCount = 4096;
+const int64_t kDefaultStoreSize = 64 << 20;
+
+// All links in the file are byte offsets from the start of the
+// mapping, as every process maps the file at a different address.
+struct StoreHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t pointer_size;
+    uint32_t bucket_count;
+    uint64_t file_size;
+    // Offset one past the end of the last record.
+    uint64_t data_end;
+    // Offset of the first record in each hash chain, 0 if empty.
+    uint64_t buckets[kStoreBucketCount];
+};
+
+struct StoredBounds {
+    int32_t min[4], extent[4], stride[4];
+    int32_t elem_size;
+};
+
+// Each record is followed by tuple_count StoredBounds, the key and
+// then the contents of each tuple buffer, each part starting on a 16
+// byte boundary.
+struct StoreRecord {
+    uint64_t next;
+    uint64_t record_size;
+    uint32_t hash;
+    uint32_t key_size;
+    uint32_t tuple_count;
+    uint32_t padding;
+    StoredBounds computed_bounds;
+};
+
+WEAK halide_mutex store_lock;
+WEAK int store_fd = -1;
+WEAK uint8_t *store_base = NULL;
+WEAK uint64_t store_size = 0;
+WEAK bool store_env_checked = false;
+// False once we know there is no store: the environment has been
+// checked and nothing is open. Read without store_lock on every lookup
+// and store, so that the in-process cache doesn't serialize on it when
+// no store is configured. Must be updated with store_lock held.
+WEAK volatile bool store_maybe_open = true;
+
+WEAK void update_store_maybe_open() {
+    store_maybe_open = !store_env_checked || store_base != NULL;
+}
+
+WEAK uint64_t align_up(uint64_t x) {
+    return (x + 15) & ~(uint64_t)15;
+}
+
+WEAK StoredBounds to_stored_bounds(const buffer_t &buf) {
+    StoredBounds b;
+    for (int i = 0; i < 4; i++) {
+        b.min[i] = buf.min[i];
+        b.extent[i] = buf.extent[i];
+        b.stride[i] = buf.stride[i];
+    }
+    b.elem_size = buf.elem_size;
+    return b;
+}
+
+WEAK bool stored_bounds_equal(const StoredBounds &b, const buffer_t &buf) {
+    StoredBounds other = to_stored_bounds(buf);
+    return memcmp(&b, &other, sizeof(StoredBounds)) == 0;
+}
+
+WEAK StoreHeader *store_header() {
+    return (StoreHeader *)store_base;
+}
+
+WEAK uint64_t store_data_begin() {
+    return align_up(sizeof(StoreHeader));
+}
+
+WEAK void reset_store() {
+    StoreHeader *header = store_header();
+    header->magic = kStoreMagic;
+    header->version = kStoreVersion;
+    header->pointer_size = sizeof(void *);
+    header->bucket_count = kStoreBucketCount;
+    header->file_size = store_size;
+    header->data_end = store_data_begin();
+    for (uint32_t i = 0; i < kStoreBucketCount; i++) {
+        header->buckets[i] = 0;
+    }
+}
+
+WEAK bool store_header_valid() {
+    StoreHeader *header = store_header();
+    return (header->magic == kStoreMagic &&
+            header->version == kStoreVersion &&
+            header->pointer_size == sizeof(void *) &&
+            header->bucket_count == kStoreBucketCount &&
+            header->file_size == store_size &&
+            header->data_end >= store_data_begin() &&
+            header->data_end <= store_size);
+}
+
+// Returns the record at the given offset, or NULL if the offset does
+// not describe a record lying entirely within the used part of the
+// file. Another process could have left the file in any state, so
+// nothing read from it is trusted.
+WEAK StoreRecord *record_at(uint64_t offset) {
+    StoreHeader *header = store_header();
+    if (offset < store_data_begin() || offset + sizeof(StoreRecord) > header->data_end ||
+        (offset & 15) != 0) {
+        return NULL;
+    }
+    StoreRecord *record = (StoreRecord *)(store_base + offset);
+    if (record->record_size < sizeof(StoreRecord) ||
+        record->record_size > header->data_end - offset) {
+        return NULL;
+    }
+    return record;
+}
+
+WEAK uint64_t record_size_for(int32_t key_size, int32_t tuple_count, buffer_t **tuple_buffers) {
+    uint64_t size = align_up(sizeof(StoreRecord));
+    size += align_up(sizeof(StoredBounds) * tuple_count);
+    size += align_up(key_size);
+    for (int32_t i = 0; i < tuple_count; i++) {
+        size += align_up(buf_size(tuple_buffers[i]));
+    }
+    return size;
+}
+
+WEAK StoredBounds *record_tuple_bounds(StoreRecord *record) {
+    return (StoredBounds *)((uint8_t *)record + align_up(sizeof(StoreRecord)));
+}
+
+WEAK uint8_t *record_key(StoreRecord *record) {
+    return (uint8_t *)record_tuple_bounds(record) + align_up(sizeof(StoredBounds) * record->tuple_count);
+}
+
+WEAK StoreRecord *find_record(const uint8_t *cache_key, int32_t size, uint32_t hash,
+                              const buffer_t *computed_bounds, int32_t tuple_count,
+                              buffer_t **tuple_buffers) {
+    StoreHeader *header = store_header();
+    uint64_t offset = header->buckets[hash % kStoreBucketCount];
+    // Bound the walk so that a corrupt chain cannot loop forever.
+    for (int steps = 0; offset != 0 && steps < 1 << 20; steps++) {
+        StoreRecord *record = record_at(offset);
+        if (record == NULL) {
+            return NULL;
+        }
+        if (record->hash == hash &&
+            record->key_size == (uint32_t)size &&
+            record->tuple_count == (uint32_t)tuple_count &&
+            record->record_size == record_size_for(size, tuple_count, tuple_buffers) &&
+            stored_bounds_equal(record->computed_bounds, *computed_bounds) &&
+            memcmp(record_key(record), cache_key, size) == 0) {
+            bool all_bounds_equal = true;
+            StoredBounds *bounds = record_tuple_bounds(record);
+            for (int32_t i = 0; all_bounds_equal && i < tuple_count; i++) {
+                all_bounds_equal = stored_bounds_equal(bounds[i], *tuple_buffers[i]);
+            }
+            if (all_bounds_equal) {
+                return record;
+            }
+        }
+        offset = record->next;
+    }
+    return NULL;
+}
+
+WEAK void close_store() {
+    if (store_base != NULL) {
+        munmap(store_base, store_size);
+        store_base = NULL;
+        store_size = 0;
+    }
+    if (store_fd >= 0) {
+        close(store_fd);
+        store_fd = -1;
+    }
+}
+
+WEAK int open_store(void *user_context, const char *path, int64_t size) {
+    close_store();
+    if (path == NULL) {
+        return 0;
+    }
+    if (size <= 0) {
+        size = kDefaultStoreSize;
+    }
+    if ((uint64_t)size < 2 * store_data_begin()) {
+        size = 2 * store_data_begin();
+    }
+
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        error(user_context) << "Could not open memoization store " << path << "\n";
+        return halide_error_code_generic_error;
+    }
+
+    // The first process to open the store sets its size; later ones
+    // map whatever size is already there.
+    flock(fd, LOCK_EX);
+    long existing_size = lseek(fd, 0, SEEK_END);
+    if (existing_size < (long)(2 * store_data_begin())) {
+        if (ftruncate(fd, size) != 0) {
+            flock(fd, LOCK_UN);
+            close(fd);
+            error(user_context) << "Could not resize memoization store " << path << "\n";
+            return halide_error_code_generic_error;
+        }
+    } else {
+        size = existing_size;
+    }
+
+    void *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        flock(fd, LOCK_UN);
+        close(fd);
+        error(user_context) << "Could not map memoization store " << path << "\n";
+        return halide_error_code_generic_error;
+    }
+
+    store_fd = fd;
+    store_base = (uint8_t *)base;
+    store_size = size;
+    if (!store_header_valid()) {
+        debug(user_context) << "Initializing memoization store " << path << "\n";
+        reset_store();
+    }
+    flock(fd, LOCK_UN);
+    return 0;
+}
+
+// Open the store named by HL_MEMOIZATION_STORE the first time the
+// cache is used, unless the application has configured one
+// explicitly. Must be called with store_lock held.
+WEAK void check_store_env(void *user_context) {
+    if (!store_env_checked) {
+        store_env_checked = true;
+        const char *path = getenv("HL_MEMOIZATION_STORE");
+        if (path != NULL && store_base == NULL) {
+            const char *size_str = getenv("HL_MEMOIZATION_STORE_SIZE");
+            int64_t size = size_str ? ((int64_t)atoi(size_str)) << 20 : 0;
+            open_store(user_context, path, size);
+        }
+        update_store_maybe_open();
+    }
+}
+
+}}} // namespace Halide::Runtime::Internal
+
+extern "C" {
+
+WEAK int halide_memoization_cache_set_persistent_store(void *user_context, const char *path, int64_t size) {
+    ScopedMutexLock lock(&store_lock);
+    store_env_checked = true;
+    int result = open_store(user_context, path, size);
+    update_store_maybe_open();
+    return result;
+}
+
+WEAK int halide_memoization_persistent_lookup(void *user_context, const uint8_t *cache_key, int32_t size,
+                                              uint32_t hash, buffer_t *computed_bounds,
+                                              int32_t tuple_count, buffer_t **tuple_buffers) {
+    if (!store_maybe_open) {
+        return 1;
+    }
+    ScopedMutexLock lock(&store_lock);
+    check_store_env(user_context);
+    if (store_base == NULL) {
+        return 1;
+    }
+
+    flock(store_fd, LOCK_SH);
+    int result = 1;
+    if (store_header_valid()) {
+        StoreRecord *record = find_record(cache_key, size, hash, computed_bounds, tuple_count, tuple_buffers);
+        if (record != NULL) {
+            uint8_t *data = record_key(record) + align_up(size);
+            for (int32_t i = 0; i < tuple_count; i++) {
+                size_t bytes = buf_size(tuple_buffers[i]);
+                memcpy(tuple_buffers[i]->host, data, bytes);
+                data += align_up(bytes);
+            }
+            result = 0;
+        }
+    }
+    flock(store_fd, LOCK_UN);
+    return result;
+}
+
+WEAK void halide_memoization_persistent_store(void *user_context, const uint8_t *cache_key, int32_t size,
+                                              uint32_t hash, buffer_t *computed_bounds,
+                                              int32_t tuple_count, buffer_t **tuple_buffers) {
+    if (!store_maybe_open) {
+        return;
+    }
+    ScopedMutexLock lock(&store_lock);
+    check_store_env(user_context);
+    if (store_base == NULL) {
+        return;
+    }
+
+    uint64_t record_size = record_size_for(size, tuple_count, tuple_buffers);
+    if (record_size > store_size - store_data_begin()) {
+        // This entry could never fit.
+        return;
+    }
+
+    flock(store_fd, LOCK_EX);
+    StoreHeader *header = store_header();
+    if (!store_header_valid()) {
+        reset_store();
+    }
+    // Another process may have stored the same result since our lookup.
+    if (find_record(cache_key, size, hash, computed_bounds, tuple_count, tuple_buffers) == NULL) {
+        if (header->data_end + record_size > store_size) {
+            debug(user_context) << "Memoization store is full, clearing it\n";
+            reset_store();
+        }
+
+        uint64_t offset = header->data_end;
+        StoreRecord *record = (StoreRecord *)(store_base + offset);
+        record->record_size = record_size;
+        record->hash = hash;
+        record->key_size = size;
+        record->tuple_count = tuple_count;
+        record->padding = 0;
+        record->computed_bounds = to_stored_bounds(*computed_bounds);
+        StoredBounds *bounds = record_tuple_bounds(record);
+        for (int32_t i = 0; i < tuple_count; i++) {
+            bounds[i] = to_stored_bounds(*tuple_buffers[i]);
+        }
+        uint8_t *key = record_key(record);
+        memcpy(key, cache_key, size);
+        uint8_t *data = key + align_up(size);
+        for (int32_t i = 0; i < tuple_count; i++) {
+            size_t bytes = buf_size(tuple_buffers[i]);
+            memcpy(data, tuple_buffers[i]->host, bytes);
+            data += align_up(bytes);
+        }
+
+        // Publish the record only once it is complete.
+        uint64_t &bucket = header->buckets[hash % kStoreBucketCount];
+        record->next = bucket;
+        header->data_end = offset + record_size;
+        bucket = offset;
+    }
+    flock(store_fd, LOCK_UN);
+}
+
+WEAK void halide_memoization_persistent_cleanup() {
+    ScopedMutexLock lock(&store_lock);
+    close_store();
+    store_env_checked = false;
+    update_store_maybe_open();
+}
+
+}
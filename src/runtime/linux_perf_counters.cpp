@@ -0,0 +1,106 @@
+#include "HalideRuntime.h"
+
+// Hardware performance counters for the profiler, read with
+// perf_event_open(2). The system call number below is the x86 one, so
+// this module is only linked into x86 Linux targets. Each thread opens
+// a group of counters that only counts its own user-space events, so
+// they can be read together with a single read().
+
+extern "C" {
+
+extern long syscall(long number, ...);
+extern ssize_t read(int fd, void *buf, size_t count);
+
+}
+
+namespace Halide { namespace Runtime { namespace Internal {
+
+#ifdef BITS_64
+#define SYS_perf_event_open 298
+#else
+#define SYS_perf_event_open 336
+#endif
+
+#define PERF_TYPE_HARDWARE 0
+#define PERF_FORMAT_GROUP 8
+
+// The first version of struct perf_event_attr, which every kernel
+// with perf events accepts.
+struct perf_event_attr_v0 {
+    uint32_t type;
+    uint32_t size;
+    uint64_t config;
+    uint64_t sample_period;
+    uint64_t sample_type;
+    uint64_t read_format;
+    // disabled, inherit, pinned, exclusive, exclude_user,
+    // exclude_kernel, exclude_hv, ...
+    uint64_t flags;
+    uint32_t wakeup_events;
+    uint32_t bp_type;
+    uint64_t config1;
+};
+
+const uint64_t kPerfExcludeKernel = 1 << 5;
+const uint64_t kPerfExcludeHv = 1 << 6;
+
+// The PERF_COUNT_HW_* event for each PerfCounter.
+WEAK uint64_t perf_counter_configs[PerfCounterCount] = {
+    0, // PERF_COUNT_HW_CPU_CYCLES
+    1, // PERF_COUNT_HW_INSTRUCTIONS
+    3, // PERF_COUNT_HW_CACHE_MISSES
+    5, // PERF_COUNT_HW_BRANCH_MISSES
+};
+
+}}}  // namespace Halide::Runtime::Internal
+
+extern "C" {
+
+WEAK int halide_perf_counters_open(int *fds) {
+    for (int i = 0; i < PerfCounterCount; i++) {
+        fds[i] = -1;
+    }
+    for (int i = 0; i < PerfCounterCount; i++) {
+        perf_event_attr_v0 attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = perf_counter_configs[i];
+        attr.read_format = PERF_FORMAT_GROUP;
+        attr.flags = kPerfExcludeKernel | kPerfExcludeHv;
+        // Count the calling thread on any cpu. The first counter leads
+        // the group.
+        long fd = syscall(SYS_perf_event_open, &attr, 0, -1, i == 0 ? -1 : fds[0], 0);
+        if (fd < 0) {
+            halide_perf_counters_close(fds);
+            return -1;
+        }
+        fds[i] = (int)fd;
+    }
+    return 0;
+}
+
+WEAK int halide_perf_counters_read(const int *fds, uint64_t *values) {
+    // With PERF_FORMAT_GROUP, the leader reads as the number of
+    // counters followed by their values.
+    uint64_t buf[1 + PerfCounterCount];
+    if (read(fds[0], buf, sizeof(buf)) != (ssize_t)sizeof(buf) ||
+        buf[0] != PerfCounterCount) {
+        return -1;
+    }
+    for (int i = 0; i < PerfCounterCount; i++) {
+        values[i] = buf[i + 1];
+    }
+    return 0;
+}
+
+WEAK void halide_perf_counters_close(int *fds) {
+    for (int i = 0; i < PerfCounterCount; i++) {
+        if (fds[i] >= 0) {
+            close(fds[i]);
+            fds[i] = -1;
+        }
+    }
+}
+
+}
@@ -0,0 +1,31 @@
+#include "HalideRuntime.h"
+#include "printer.h"
+
+// Platforms without a persistent memoization store. The in-process
+// cache always misses in the store and never writes to it.
+
+extern "C" {
+
+WEAK int halide_memoization_cache_set_persistent_store(void *user_context, const char *path, int64_t size) {
+    if (path != NULL) {
+        error(user_context) << "A persistent memoization store is not supported on this platform\n";
+        return halide_error_code_generic_error;
+    }
+    return 0;
+}
+
+WEAK int halide_memoization_persistent_lookup(void *user_context, const uint8_t *cache_key, int32_t size,
+                                              uint32_t hash, buffer_t *computed_bounds,
+                                              int32_t tuple_count, buffer_t **tuple_buffers) {
+    return 1;
+}
+
+WEAK void halide_memoization_persistent_store(void *user_context, const uint8_t *cache_key, int32_t size,
+                                              uint32_t hash, buffer_t *computed_bounds,
+                                              int32_t tuple_count, buffer_t **tuple_buffers) {
+}
+
+WEAK void halide_memoization_persistent_cleanup() {
+}
+
+}
@@ -94,6 +94,62 @@ WEAK int halide_do_par_for(void *user_context, halide_task_t f,
   return (*custom_do_par_for)(user_context, f, min, size, closure);
 }
 
+// The user's do_par_for must run the tasks of an async Func
+// concurrently, so the semaphores just spin. The first int is the
+// count, and the second is whether the semaphore is closed.
+WEAK int halide_semaphore_init(halide_semaphore_t *s, int n) {
+    int *sem = (int *)s;
+    sem[0] = n;
+    sem[1] = 0;
+    return 0;
+}
+
+WEAK int halide_semaphore_release(halide_semaphore_t *s, int n) {
+    return __sync_add_and_fetch((int *)s, n);
+}
+
+WEAK void halide_semaphore_close(void *user_context, void *s) {
+    __sync_fetch_and_or((int *)s + 1, 1);
+}
+
+WEAK int halide_semaphore_acquire(halide_semaphore_t *s, int n) {
+    int *sem = (int *)s;
+    while (true) {
+        int old = __sync_fetch_and_add(&sem[0], 0);
+        if (old >= n) {
+            if (__sync_bool_compare_and_swap(&sem[0], old, old - n)) {
+                return 0;
+            }
+        } else if (__sync_fetch_and_add(&sem[1], 0)) {
+            return halide_error_code_generic_error;
+        }
+    }
+}
+
+// There is no way to start a thread of our own, so runtime modules
+// that would use a background thread do their work inline instead.
+WEAK bool halide_can_spawn_threads() {
+    return false;
+}
+
+WEAK halide_thread *halide_spawn_thread(void (*f)(void *), void *closure) {
+    return NULL;
+}
+
+WEAK void halide_join_thread(halide_thread *thread) {
+}
+
+WEAK void halide_cond_init(struct halide_cond *cond) {
+}
+
+WEAK void halide_cond_destroy(struct halide_cond *cond) {
+}
+
+WEAK void halide_cond_broadcast(struct halide_cond *cond) {
+}
+
+WEAK void halide_cond_wait(struct halide_cond *cond, struct halide_mutex *mutex) {
+}
 
 WEAK void halide_print(void *user_context, const char *msg) {
     (*custom_print)(user_context, msg);
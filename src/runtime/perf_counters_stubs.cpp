@@ -0,0 +1,19 @@
+#include "HalideRuntime.h"
+
+// Platforms without hardware performance counter support. The
+// profiler reports the counters as unavailable.
+
+extern "C" {
+
+WEAK int halide_perf_counters_open(int *fds) {
+    return -1;
+}
+
+WEAK int halide_perf_counters_read(const int *fds, uint64_t *values) {
+    return -1;
+}
+
+WEAK void halide_perf_counters_close(int *fds) {
+}
+
+}
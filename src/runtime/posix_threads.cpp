@@ -20,6 +20,7 @@ typedef long pthread_t;
 extern int pthread_create(pthread_t *, const void * attr,
                           void *(*start_routine)(void *), void * arg);
 extern int pthread_join(pthread_t thread, void **retval);
+extern pthread_t pthread_self();
 extern int pthread_cond_init(halide_cond *cond, const void *attr);
 extern int pthread_cond_wait(halide_cond *cond, halide_mutex *mutex);
 extern int pthread_cond_broadcast(halide_cond *cond);
@@ -55,6 +56,14 @@ WEAK struct halide_thread *halide_spawn_thread(void (*f)(void *), void *closure)
     return (halide_thread *)t;
 }
 
+WEAK bool halide_can_spawn_threads() {
+    return true;
+}
+
+WEAK uintptr_t halide_current_thread_id() {
+    return (uintptr_t)pthread_self();
+}
+
 WEAK void halide_join_thread(struct halide_thread *thread_arg) {
     spawned_thread *t = (spawned_thread *)thread_arg;
     void *ret = NULL;
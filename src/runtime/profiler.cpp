@@ -6,10 +6,19 @@
 // be used across many different user_contexts, so nothing it calls
 // can depend on the user context.
 
+extern "C" {
+
+extern void *fopen(const char *path, const char *mode);
+extern size_t fwrite(const void *ptr, size_t size, size_t n, void *file);
+extern int fclose(void *file);
+extern int fflush(void *file);
+
+}
+
 extern "C" {
 // Returns the address of the global halide_profiler state
 WEAK halide_profiler_state *halide_profiler_get_state() {
-    static halide_profiler_state s = {{{0}}, NULL, 1, 0, 0, 0, NULL, false};
+    static halide_profiler_state s = {{{0}}, NULL, 1, 0, 0, 0, NULL, false, NULL, NULL};
     return &s;
 }
 }
@@ -60,6 +69,11 @@ WEAK halide_profiler_pipeline_stats *find_or_create_pipeline(const char *pipelin
         p->funcs[i].stack_peak = 0;
         p->funcs[i].active_threads_numerator = 0;
         p->funcs[i].active_threads_denominator = 0;
+        p->funcs[i].cycles = 0;
+        p->funcs[i].instructions = 0;
+        p->funcs[i].cache_misses = 0;
+        p->funcs[i].branch_misses = 0;
+        p->funcs[i].pixels = 0;
     }
     s->first_free_id += num_funcs;
     s->pipelines = p;
@@ -92,6 +106,382 @@ WEAK void bill_func(halide_profiler_state *s, int func_id, uint64_t time, int ac
     // Someone must have called reset_state while a kernel was running. Do nothing.
 }
 
+const int kProfilerMaxThreads = 128;
+
+// Per-thread profiler state lives in fixed tables of slots. Each
+// thread claims a slot, keyed by its thread id, the first time it
+// records something, and is the only writer of that slot afterwards,
+// so recording takes no locks. The slot type T must have a uintptr_t
+// key that is zero while the slot is free. Sets *claimed if the slot
+// was claimed by this call.
+template<typename T>
+T *claim_thread_slot(T *slots, bool *claimed) {
+    uintptr_t key = halide_current_thread_id() + 1;
+    // Thread ids are often aligned pointers, so mix in higher bits.
+    uint32_t start = (uint32_t)((key >> 4) ^ (key >> 12)) % kProfilerMaxThreads;
+    *claimed = false;
+    for (int i = 0; i < kProfilerMaxThreads; i++) {
+        T *t = &slots[(start + i) % kProfilerMaxThreads];
+        uintptr_t k = t->key;
+        if (k == key) {
+            return t;
+        }
+        if (k == 0 && __sync_bool_compare_and_swap(&t->key, (uintptr_t)0, key)) {
+            *claimed = true;
+            return t;
+        }
+    }
+    return NULL;
+}
+
+// The timeline. Each thread appends events to a ring buffer in its
+// own slot. When a ring buffer is full, the oldest events are
+// overwritten.
+struct TimelineEventRecord {
+    uint64_t time;
+    uint64_t value;
+    int32_t func_id;
+    int32_t kind;
+};
+
+const uint64_t kTimelineEventsPerThread = 1 << 16;
+
+struct TimelineThread {
+    // The thread id plus one, or zero if the slot is free.
+    uintptr_t key;
+    uint64_t count;
+    // The number of events already written to the file.
+    uint64_t written;
+    TimelineEventRecord *events;
+};
+
+struct Timeline {
+    TimelineThread threads[kProfilerMaxThreads];
+    char path[1024];
+    // The file is opened by the first report and stays open, so that
+    // each report appends to the trace of the ones before it. The
+    // JSON array is only closed when the timeline is.
+    void *file;
+    bool first_event;
+};
+
+WEAK void close_timeline_file(Timeline *timeline) {
+    if (timeline->file) {
+        const char *footer = "\n]}\n";
+        fwrite(footer, strlen(footer), 1, timeline->file);
+        fclose(timeline->file);
+        timeline->file = NULL;
+    }
+}
+
+WEAK bool timeline_env_checked = false;
+
+WEAK void record_timeline_event(Timeline *timeline, int kind, int func_id, uint64_t value) {
+    bool claimed;
+    TimelineThread *t = claim_thread_slot(timeline->threads, &claimed);
+    if (!t) return;
+    if (claimed) {
+        t->events = (TimelineEventRecord *)malloc(kTimelineEventsPerThread * sizeof(TimelineEventRecord));
+    }
+    if (!t->events) return;
+    TimelineEventRecord &e = t->events[t->count & (kTimelineEventsPerThread - 1)];
+    e.time = halide_current_time_ns(NULL);
+    e.value = value;
+    e.func_id = func_id;
+    e.kind = kind;
+    t->count++;
+}
+
+WEAK int set_timeline_file_unlocked(halide_profiler_state *s, const char *path) {
+    Timeline *timeline = (Timeline *)s->timeline;
+    if (path == NULL) {
+        if (timeline) {
+            s->timeline = NULL;
+            close_timeline_file(timeline);
+            for (int i = 0; i < kProfilerMaxThreads; i++) {
+                free(timeline->threads[i].events);
+            }
+            free(timeline);
+        }
+        return 0;
+    }
+    if (!timeline) {
+        timeline = (Timeline *)malloc(sizeof(Timeline));
+        if (!timeline) {
+            return halide_error_code_out_of_memory;
+        }
+        memset(timeline, 0, sizeof(Timeline));
+    } else {
+        close_timeline_file(timeline);
+        for (int i = 0; i < kProfilerMaxThreads; i++) {
+            timeline->threads[i].written = timeline->threads[i].count;
+        }
+    }
+    strncpy(timeline->path, path, sizeof(timeline->path) - 1);
+    timeline->path[sizeof(timeline->path) - 1] = 0;
+    s->timeline = timeline;
+    return 0;
+}
+
+WEAK const char *func_name_for_id(halide_profiler_state *s, int func_id, halide_profiler_pipeline_stats **pipeline) {
+    for (halide_profiler_pipeline_stats *p = s->pipelines; p;
+         p = (halide_profiler_pipeline_stats *)(p->next)) {
+        if (func_id >= p->first_func_id && func_id < p->first_func_id + p->num_funcs) {
+            *pipeline = p;
+            return p->funcs[func_id - p->first_func_id].name;
+        }
+    }
+    *pipeline = NULL;
+    return NULL;
+}
+
+// Hardware counters. Each thread reads its counters whenever it
+// switches Func, and adds the difference since the last read to a
+// small per-thread table of totals keyed by func id. The tables are
+// merged into the func stats when the report is printed. Slots are
+// keyed by thread id, so a new thread that reuses the id of a thread
+// that has exited inherits the counters of the dead thread and counts
+// nothing.
+struct CounterTotals {
+    // -1 if the entry is free.
+    int32_t func_id;
+    uint64_t values[PerfCounterCount];
+};
+
+const int kCounterTotalsPerThread = 256;
+
+struct CounterThread {
+    // The thread id plus one, or zero if the slot is free.
+    uintptr_t key;
+    int fds[PerfCounterCount];
+    // Whether the counters were opened successfully.
+    bool ok;
+    // Whether the thread is currently doing work for a pipeline.
+    bool active;
+    int func_id;
+    uint64_t last[PerfCounterCount];
+    CounterTotals *totals;
+};
+
+struct Counters {
+    CounterThread threads[kProfilerMaxThreads];
+    // Set if any thread failed to open its counters.
+    bool unavailable;
+};
+
+WEAK bool counters_env_checked = false;
+
+WEAK void record_counters_event(Counters *counters, int kind, int func_id) {
+    if (kind == TimelineHeapUsage) return;
+
+    bool claimed;
+    CounterThread *t = claim_thread_slot(counters->threads, &claimed);
+    if (!t) return;
+    if (claimed) {
+        t->active = false;
+        t->func_id = -1;
+        t->totals = (CounterTotals *)malloc(kCounterTotalsPerThread * sizeof(CounterTotals));
+        t->ok = t->totals && halide_perf_counters_open(t->fds) == 0;
+        if (t->ok) {
+            for (int i = 0; i < kCounterTotalsPerThread; i++) {
+                t->totals[i].func_id = -1;
+            }
+            t->ok = halide_perf_counters_read(t->fds, t->last) == 0;
+        }
+        if (!t->ok) {
+            counters->unavailable = true;
+        }
+    }
+    if (!t->ok) return;
+
+    uint64_t now[PerfCounterCount];
+    if (halide_perf_counters_read(t->fds, now) != 0) return;
+
+    if (t->active && t->func_id >= 0) {
+        uint32_t start = (uint32_t)t->func_id % kCounterTotalsPerThread;
+        for (int i = 0; i < kCounterTotalsPerThread; i++) {
+            CounterTotals *c = &t->totals[(start + i) % kCounterTotalsPerThread];
+            if (c->func_id == -1) {
+                c->func_id = t->func_id;
+                for (int j = 0; j < PerfCounterCount; j++) {
+                    c->values[j] = 0;
+                }
+            }
+            if (c->func_id == t->func_id) {
+                for (int j = 0; j < PerfCounterCount; j++) {
+                    c->values[j] += now[j] - t->last[j];
+                }
+                break;
+            }
+        }
+    }
+    for (int j = 0; j < PerfCounterCount; j++) {
+        t->last[j] = now[j];
+    }
+
+    if (kind == TimelineSetFunc) {
+        t->func_id = func_id;
+    } else if (kind == TimelineThreadActive) {
+        t->active = true;
+    } else if (kind == TimelineThreadIdle) {
+        t->active = false;
+    }
+}
+
+WEAK int set_hardware_counters_unlocked(halide_profiler_state *s, bool enable) {
+    Counters *counters = (Counters *)s->counters;
+    if (!enable) {
+        if (counters) {
+            s->counters = NULL;
+            for (int i = 0; i < kProfilerMaxThreads; i++) {
+                CounterThread *t = &counters->threads[i];
+                if (t->ok) {
+                    halide_perf_counters_close(t->fds);
+                }
+                free(t->totals);
+            }
+            free(counters);
+        }
+        return 0;
+    }
+    if (!counters) {
+        counters = (Counters *)malloc(sizeof(Counters));
+        if (!counters) {
+            return halide_error_code_out_of_memory;
+        }
+        memset(counters, 0, sizeof(Counters));
+        s->counters = counters;
+    }
+    return 0;
+}
+
+// Move the per-thread counter totals into the func stats. Must not be
+// called while pipelines are running.
+WEAK void merge_counters(halide_profiler_state *s) {
+    Counters *counters = (Counters *)s->counters;
+    if (!counters) return;
+    for (int i = 0; i < kProfilerMaxThreads; i++) {
+        CounterThread *t = &counters->threads[i];
+        if (!t->ok) continue;
+        for (int j = 0; j < kCounterTotalsPerThread; j++) {
+            CounterTotals *c = &t->totals[j];
+            if (c->func_id == -1) continue;
+            halide_profiler_pipeline_stats *p;
+            if (func_name_for_id(s, c->func_id, &p) != NULL) {
+                halide_profiler_func_stats *f = p->funcs + c->func_id - p->first_func_id;
+                f->cycles += c->values[PerfCycles];
+                f->instructions += c->values[PerfInstructions];
+                f->cache_misses += c->values[PerfCacheMisses];
+                f->branch_misses += c->values[PerfBranchMisses];
+            }
+            c->func_id = -1;
+        }
+    }
+}
+
+WEAK void timeline_write_line(void *file, const char *line, size_t size, bool *first) {
+    if (!*first) {
+        fwrite(",\n", 2, 1, file);
+    }
+    *first = false;
+    fwrite(line, size, 1, file);
+}
+
+WEAK void timeline_write_slice(void *file, const char *name, const char *category, int tid,
+                               uint64_t begin, uint64_t end, bool *first) {
+    char line_buf[1024];
+    Printer<StringStreamPrinter, sizeof(line_buf)> sstr(NULL, line_buf);
+    sstr << "{\"name\":\"" << name << "\",\"cat\":\"" << category
+         << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << tid
+         << ",\"ts\":" << (double)begin / 1000.0
+         << ",\"dur\":" << (double)(end - begin) / 1000.0 << "}";
+    timeline_write_line(file, sstr.str(), sstr.size(), first);
+}
+
+// Write the timeline out as Chrome trace JSON. Each thread becomes a
+// track with a "busy" slice for each interval in which it was doing
+// work for a pipeline, containing a slice for each Func it ran. Heap
+// usage becomes a counter track per pipeline. Only events recorded
+// since the last call are written. Must not be called while pipelines
+// are running.
+WEAK void write_timeline(void *user_context, halide_profiler_state *s) {
+    Timeline *timeline = (Timeline *)s->timeline;
+    if (!timeline) return;
+
+    if (!timeline->file) {
+        timeline->file = fopen(timeline->path, "w");
+        if (!timeline->file) {
+            error(user_context) << "Could not open profiler timeline file " << timeline->path << "\n";
+            return;
+        }
+        const char *header = "{\"traceEvents\":[\n";
+        fwrite(header, strlen(header), 1, timeline->file);
+        timeline->first_event = true;
+    }
+    void *file = timeline->file;
+    bool &first = timeline->first_event;
+
+    char line_buf[1024];
+    Printer<StringStreamPrinter, sizeof(line_buf)> sstr(user_context, line_buf);
+
+    for (int tid = 0; tid < kProfilerMaxThreads; tid++) {
+        TimelineThread *t = &timeline->threads[tid];
+        if (!t->events || t->count == t->written) continue;
+
+        sstr.clear();
+        sstr << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << tid
+             << ",\"args\":{\"name\":\"thread " << tid << "\"}}";
+        timeline_write_line(file, sstr.str(), sstr.size(), &first);
+
+        uint64_t begin = t->count > kTimelineEventsPerThread ? t->count - kTimelineEventsPerThread : 0;
+        if (begin < t->written) {
+            begin = t->written;
+        }
+        t->written = t->count;
+        bool active = false;
+        int current_func = -1;
+        uint64_t busy_start = 0, func_start = 0;
+        for (uint64_t i = begin; i < t->count; i++) {
+            const TimelineEventRecord &e = t->events[i & (kTimelineEventsPerThread - 1)];
+            halide_profiler_pipeline_stats *p = NULL;
+            const char *name = NULL;
+            if (e.kind == TimelineSetFunc || e.kind == TimelineThreadIdle) {
+                // Close the slice of the Func that was running.
+                if (active && current_func >= 0 && e.time > func_start &&
+                    (name = func_name_for_id(s, current_func, &p)) != NULL) {
+                    timeline_write_slice(file, name, "func", tid, func_start, e.time, &first);
+                }
+                func_start = e.time;
+            }
+            if (e.kind == TimelineSetFunc) {
+                current_func = e.func_id;
+            } else if (e.kind == TimelineThreadActive) {
+                if (!active) {
+                    active = true;
+                    busy_start = e.time;
+                    func_start = e.time;
+                }
+            } else if (e.kind == TimelineThreadIdle) {
+                if (active) {
+                    timeline_write_slice(file, "busy", "thread", tid, busy_start, e.time, &first);
+                    active = false;
+                }
+            } else if (e.kind == TimelineHeapUsage) {
+                if (func_name_for_id(s, e.func_id, &p) != NULL) {
+                    sstr.clear();
+                    sstr << "{\"name\":\"heap " << p->name
+                         << "\",\"ph\":\"C\",\"pid\":0,\"tid\":" << tid
+                         << ",\"ts\":" << (double)e.time / 1000.0
+                         << ",\"args\":{\"bytes\":" << e.value << "}}";
+                    timeline_write_line(file, sstr.str(), sstr.size(), &first);
+                }
+            }
+        }
+    }
+
+    fflush(file);
+}
+
 WEAK void sampling_profiler_thread(void *) {
     halide_profiler_state *s = halide_profiler_get_state();
 
@@ -180,6 +570,22 @@ WEAK int halide_profiler_pipeline_start(void *user_context,
 
     ScopedMutexLock lock(&s->lock);
 
+    if (!counters_env_checked) {
+        counters_env_checked = true;
+        const char *enable = getenv("HL_PROFILER_COUNTERS");
+        if (enable && atoi(enable) != 0) {
+            set_hardware_counters_unlocked(s, true);
+        }
+    }
+
+    if (!timeline_env_checked) {
+        timeline_env_checked = true;
+        const char *path = getenv("HL_PROFILER_TIMELINE");
+        if (path && !s->timeline) {
+            set_timeline_file_unlocked(s, path);
+        }
+    }
+
     if (!s->started) {
         halide_start_clock(user_context);
         halide_spawn_thread(sampling_profiler_thread, NULL);
@@ -246,6 +652,11 @@ WEAK void halide_profiler_memory_allocate(void *user_context,
     uint64_t p_mem_current = __sync_add_and_fetch(&p_stats->memory_current, incr);
     sync_compare_max_and_swap(&p_stats->memory_peak, p_mem_current);
 
+    halide_profiler_state *s = halide_profiler_get_state();
+    if (s->timeline) {
+        halide_profiler_thread_event(s, TimelineHeapUsage, p_stats->first_func_id + func_id, p_mem_current);
+    }
+
     // Update per-func memory stats
     __sync_add_and_fetch(&f_stats->num_allocs, 1);
     __sync_add_and_fetch(&f_stats->memory_total, incr);
@@ -277,7 +688,12 @@ WEAK void halide_profiler_memory_free(void *user_context,
     // unless user specifically calls halide_profiler_reset().
 
     // Update per-pipeline memory stats
-    __sync_sub_and_fetch(&p_stats->memory_current, decr);
+    uint64_t p_mem_current = __sync_sub_and_fetch(&p_stats->memory_current, decr);
+
+    halide_profiler_state *s = halide_profiler_get_state();
+    if (s->timeline) {
+        halide_profiler_thread_event(s, TimelineHeapUsage, p_stats->first_func_id + func_id, p_mem_current);
+    }
 
     // Update per-func memory stats
     __sync_sub_and_fetch(&f_stats->memory_current, decr);
@@ -288,6 +704,12 @@ WEAK void halide_profiler_report_unlocked(void *user_context, halide_profiler_st
     char line_buf[1024];
     Printer<StringStreamPrinter, sizeof(line_buf)> sstr(user_context, line_buf);
 
+    merge_counters(s);
+    Counters *counters = (Counters *)s->counters;
+    if (counters && counters->unavailable) {
+        halide_print(user_context, "Hardware counters are unavailable on some or all threads\n");
+    }
+
     for (halide_profiler_pipeline_stats *p = s->pipelines; p;
          p = (halide_profiler_pipeline_stats *)(p->next)) {
         float t = p->time / 1000000.0f;
@@ -377,12 +799,27 @@ WEAK void halide_profiler_report_unlocked(void *user_context, halide_profiler_st
                 if (fs->stack_peak > 0) {
                     sstr << " stack: " << fs->stack_peak;
                 }
+                if (fs->cycles > 0) {
+                    sstr << " ipc: " << (float)fs->instructions / fs->cycles;
+                    sstr.erase(4);
+                    if (fs->pixels > 0) {
+                        sstr << " llc misses/pixel: " << (float)fs->cache_misses / fs->pixels;
+                        sstr.erase(2);
+                        sstr << " branch misses/pixel: " << (float)fs->branch_misses / fs->pixels;
+                        sstr.erase(2);
+                    } else {
+                        sstr << " llc misses: " << fs->cache_misses
+                             << " branch misses: " << fs->branch_misses;
+                    }
+                }
                 sstr << "\n";
 
                 halide_print(user_context, sstr.str());
             }
         }
     }
+
+    write_timeline(user_context, s);
 }
 
 WEAK void halide_profiler_report(void *user_context) {
@@ -408,6 +845,51 @@ WEAK void halide_profiler_reset() {
         free(p);
     }
     s->first_free_id = 0;
+
+    Timeline *timeline = (Timeline *)s->timeline;
+    if (timeline) {
+        for (int i = 0; i < kProfilerMaxThreads; i++) {
+            timeline->threads[i].count = 0;
+            timeline->threads[i].written = 0;
+        }
+    }
+
+    Counters *counters = (Counters *)s->counters;
+    if (counters) {
+        for (int i = 0; i < kProfilerMaxThreads; i++) {
+            CounterThread *t = &counters->threads[i];
+            if (!t->ok) continue;
+            for (int j = 0; j < kCounterTotalsPerThread; j++) {
+                t->totals[j].func_id = -1;
+            }
+        }
+    }
+}
+
+WEAK int halide_profiler_set_timeline_file(const char *path) {
+    halide_profiler_state *s = halide_profiler_get_state();
+    ScopedMutexLock lock(&s->lock);
+    timeline_env_checked = true;
+    return set_timeline_file_unlocked(s, path);
+}
+
+WEAK int halide_profiler_set_hardware_counters(int enable) {
+    halide_profiler_state *s = halide_profiler_get_state();
+    ScopedMutexLock lock(&s->lock);
+    counters_env_checked = true;
+    return set_hardware_counters_unlocked(s, enable != 0);
+}
+
+WEAK void halide_profiler_thread_event(halide_profiler_state *state,
+                                       int kind, int func_id, uint64_t value) {
+    Timeline *timeline = (Timeline *)state->timeline;
+    if (timeline) {
+        record_timeline_event(timeline, kind, func_id, value);
+    }
+    Counters *counters = (Counters *)state->counters;
+    if (counters) {
+        record_counters_event(counters, kind, func_id);
+    }
 }
 
 namespace {
@@ -425,6 +907,9 @@ WEAK void halide_profiler_shutdown() {
     // Print results. No need to lock anything because we just shut
     // down the thread.
     halide_profiler_report_unlocked(NULL, s);
+    if (s->timeline) {
+        close_timeline_file((Timeline *)s->timeline);
+    }
 
     // Leak the memory. Not all implementations of ScopedMutexLock may
     // be safe to use at static destruction time (windows).
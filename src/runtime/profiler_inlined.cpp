@@ -9,6 +9,9 @@ WEAK __attribute__((always_inline)) int halide_profiler_set_current_func(halide_
     asm volatile ("":::);
     *ptr = tok + t;
     asm volatile ("":::);
+    if (state->timeline || state->counters) {
+        halide_profiler_thread_event(state, TimelineSetFunc, tok + t, 0);
+    }
     return 0;
 }
 
@@ -17,6 +20,9 @@ WEAK __attribute__((always_inline)) int halide_profiler_incr_active_threads(hali
     asm volatile ("":::);
     int ret = __sync_fetch_and_add(ptr, 1);
     asm volatile ("":::);
+    if (state->timeline || state->counters) {
+        halide_profiler_thread_event(state, TimelineThreadActive, 0, 0);
+    }
     return ret;
 }
 
@@ -25,7 +31,20 @@ WEAK __attribute__((always_inline)) int halide_profiler_decr_active_threads(hali
     asm volatile ("":::);
     int ret = __sync_fetch_and_sub(ptr, 1);
     asm volatile ("":::);
+    if (state->timeline || state->counters) {
+        halide_profiler_thread_event(state, TimelineThreadIdle, 0, 0);
+    }
     return ret;
 }
 
+WEAK __attribute__((always_inline)) int halide_profiler_count_pixels(halide_profiler_state *state, void *pipeline_state,
+                                                                      int func_id, uint64_t n) {
+    // The point counts are only reported next to the hardware counters.
+    if (state->counters) {
+        halide_profiler_pipeline_stats *p = (halide_profiler_pipeline_stats *)pipeline_state;
+        __sync_fetch_and_add(&(p->funcs[func_id].pixels), n);
+    }
+    return 0;
+}
+
 }
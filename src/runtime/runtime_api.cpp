@@ -145,11 +145,22 @@ extern "C" __attribute__((used)) void *halide_runtime_api_functions[] = {
     (void *)&halide_profiler_pipeline_start,
     (void *)&halide_profiler_report,
     (void *)&halide_profiler_reset,
+    (void *)&halide_profiler_set_hardware_counters,
+    (void *)&halide_profiler_set_timeline_file,
     (void *)&halide_profiler_stack_peak_update,
     (void *)&halide_qurt_hvx_lock,
     (void *)&halide_qurt_hvx_unlock,
     (void *)&halide_qurt_hvx_unlock_as_destructor,
     (void *)&halide_release_jit_module,
+    (void *)&halide_scratch_arena_cleanup,
+    (void *)&halide_scratch_arena_free,
+    (void *)&halide_scratch_arena_malloc,
+    (void *)&halide_scratch_arena_required_size,
+    (void *)&halide_scratch_arena_set_memory,
+    (void *)&halide_semaphore_acquire,
+    (void *)&halide_semaphore_close,
+    (void *)&halide_semaphore_init,
+    (void *)&halide_semaphore_release,
     (void *)&halide_set_custom_can_use_target_features,
     (void *)&halide_set_custom_do_par_for,
     (void *)&halide_set_custom_do_task,
@@ -127,7 +127,22 @@ WEAK int halide_profiler_pipeline_start(void *user_context,
                                         const char *pipeline_name,
                                         int num_funcs,
                                         const uint64_t *func_names);
+// Record an event on the calling thread for the profiler timeline
+// and hardware counters. Only called when
+// halide_profiler_state::timeline or ::counters is non-NULL.
+WEAK void halide_profiler_thread_event(struct halide_profiler_state *state,
+                                       int kind, int func_id, uint64_t value);
+// Open hardware performance counters for the calling thread, one
+// file descriptor per PerfCounter. Returns 0 on success.
+WEAK int halide_perf_counters_open(int *fds);
+// Read the current values of counters opened by halide_perf_counters_open.
+WEAK int halide_perf_counters_read(const int *fds, uint64_t *values);
+WEAK void halide_perf_counters_close(int *fds);
 WEAK int halide_host_cpu_count();
+// An identifier for the calling thread, unique among live threads.
+WEAK uintptr_t halide_current_thread_id();
+// Whether halide_spawn_thread can start a thread on this platform.
+WEAK bool halide_can_spawn_threads();
 
 WEAK int halide_device_and_host_malloc(void *user_context, struct buffer_t *buf,
                                        const struct halide_device_interface_t *device_interface);
@@ -141,7 +156,7 @@ WEAK int halide_matlab_call_pipeline(void *user_context,
                                      int nlhs, mxArray **plhs, int nrhs, const mxArray **prhs);
 
 
-// Condition variables. Only available on some platforms (those that use the common thread pool).
+// Condition variables. On platforms without threads these do nothing.
 struct halide_cond {
     uint64_t _private[8];
 };
@@ -151,6 +166,18 @@ WEAK void halide_cond_destroy(struct halide_cond *cond);
 WEAK void halide_cond_broadcast(struct halide_cond *cond);
 WEAK void halide_cond_wait(struct halide_cond *cond, struct halide_mutex *mutex);
 
+// The persistent backing store of the memoization cache. The lookup
+// returns 0 and fills in the host memory of the tuple buffers on a
+// hit, and 1 on a miss. The key passed in must not depend on where
+// code is loaded, as the store outlives the process.
+WEAK int halide_memoization_persistent_lookup(void *user_context, const uint8_t *cache_key, int32_t size,
+                                              uint32_t hash, struct buffer_t *computed_bounds,
+                                              int32_t tuple_count, struct buffer_t **tuple_buffers);
+WEAK void halide_memoization_persistent_store(void *user_context, const uint8_t *cache_key, int32_t size,
+                                              uint32_t hash, struct buffer_t *computed_bounds,
+                                              int32_t tuple_count, struct buffer_t **tuple_buffers);
+WEAK void halide_memoization_persistent_cleanup();
+
 WEAK int halide_trace_helper(void *user_context,
                              const char *func,
                              void *value, int *coords,
@@ -186,6 +213,27 @@ struct CpuFeatures {
 };
 extern WEAK CpuFeatures halide_get_cpu_features();
 
+// The kinds of event recorded per thread by the profiler.
+enum ProfilerThreadEvent {
+    // The thread started running the Func func_id.
+    TimelineSetFunc = 0,
+    // The thread started or stopped doing work for a pipeline, e.g. a
+    // parallel task.
+    TimelineThreadActive = 1,
+    TimelineThreadIdle = 2,
+    // The heap usage of the pipeline containing func_id changed to value bytes.
+    TimelineHeapUsage = 3
+};
+
+// The hardware counters the profiler can attribute to Funcs.
+enum PerfCounter {
+    PerfCycles = 0,
+    PerfInstructions,
+    PerfCacheMisses,
+    PerfBranchMisses,
+    PerfCounterCount
+};
+
 template <typename T>
 __attribute__((always_inline)) void swap(T &a, T &b) {
     T t = a;
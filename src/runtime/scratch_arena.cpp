@@ -0,0 +1,223 @@
+#include "HalideRuntime.h"
+#include "printer.h"
+#include "scoped_mutex_lock.h"
+
+namespace Halide { namespace Runtime { namespace Internal {
+
+struct scratch_arena {
+    scratch_arena *next;
+    // A copy of the name, owned by the arena.
+    char *pipeline_name;
+
+    // The memory allocations are carved from, and whether the runtime
+    // allocated it (with alloc_arena_memory).
+    uint8_t *host;
+    uint64_t capacity;
+    bool owned;
+
+    // The offset of the next allocation in the memory above, and the
+    // number of allocations (in it or not) that haven't been freed
+    // yet. Freeing the most recent allocation moves the offset back
+    // to where that allocation began, and the offset goes back to zero
+    // once every allocation has been freed.
+    uint64_t used;
+    int live;
+
+    // The largest offset there would have been if every allocation had
+    // fit, i.e. the peak size the arena needs to be.
+    uint64_t required;
+};
+
+// Each allocation is preceded by a header that says where it came
+// from. Padding the header out to the alignment keeps allocations as
+// aligned as the memory they are carved from.
+struct scratch_arena_header {
+    scratch_arena *arena;
+    // Non-NULL if this allocation didn't fit in the arena and came
+    // from halide_malloc instead.
+    void *fallback;
+    // Where the allocation begins and ends in the arena (or would
+    // have, had it fit).
+    uint64_t begin, end;
+};
+
+const uint64_t scratch_arena_alignment = 128;
+
+// The memory of arenas the runtime owns comes straight from malloc
+// rather than halide_malloc. It outlives the calls that asked for it,
+// and a custom allocator (and, under the JIT, the user_context that
+// selects it) may be gone by the time halide_scratch_arena_cleanup
+// frees it.
+WEAK uint8_t *alloc_arena_memory(uint64_t size) {
+    void *orig = malloc(size + scratch_arena_alignment);
+    if (!orig) return NULL;
+    uint8_t *ptr = (uint8_t *)(((size_t)orig + scratch_arena_alignment) & ~(scratch_arena_alignment - 1));
+    ((void **)ptr)[-1] = orig;
+    return ptr;
+}
+
+WEAK void free_arena_memory(uint8_t *ptr) {
+    if (ptr) {
+        free(((void **)ptr)[-1]);
+    }
+}
+
+WEAK scratch_arena *scratch_arenas = NULL;
+WEAK halide_mutex scratch_arena_lock = { { 0 } };
+
+// Must be called with the lock held.
+WEAK scratch_arena *find_or_create_scratch_arena(const char *pipeline_name) {
+    for (scratch_arena *a = scratch_arenas; a; a = a->next) {
+        if (strcmp(a->pipeline_name, pipeline_name) == 0) {
+            return a;
+        }
+    }
+    // The name is copied, as the caller's string (e.g. one belonging to
+    // a JIT-compiled pipeline) may not outlive the arena.
+    size_t name_size = strlen(pipeline_name) + 1;
+    scratch_arena *a = (scratch_arena *)malloc(sizeof(scratch_arena) + name_size);
+    if (!a) return NULL;
+    memset(a, 0, sizeof(scratch_arena));
+    a->pipeline_name = (char *)(a + 1);
+    memcpy(a->pipeline_name, pipeline_name, name_size);
+    a->owned = true;
+    a->next = scratch_arenas;
+    scratch_arenas = a;
+    return a;
+}
+
+}}} // namespace Halide::Runtime::Internal
+
+using namespace Halide::Runtime::Internal;
+
+extern "C" {
+
+WEAK void *halide_scratch_arena_malloc(void *user_context, const char *pipeline_name, uint64_t size) {
+    if (size == 0) {
+        return NULL;
+    }
+    uint64_t bytes = ((size + scratch_arena_alignment - 1) & ~(scratch_arena_alignment - 1)) +
+        scratch_arena_alignment;
+
+    ScopedMutexLock lock(&scratch_arena_lock);
+    scratch_arena *a = find_or_create_scratch_arena(pipeline_name);
+    if (!a) {
+        return NULL;
+    }
+
+    uint8_t *block;
+    void *fallback = NULL;
+    if (a->host && a->used + bytes <= a->capacity) {
+        block = a->host + a->used;
+    } else {
+        fallback = halide_malloc(user_context, bytes);
+        if (!fallback) {
+            // Will result in a failed assertion and a call to halide_error
+            return NULL;
+        }
+        block = (uint8_t *)fallback;
+    }
+    scratch_arena_header *header = (scratch_arena_header *)block;
+    header->arena = a;
+    header->fallback = fallback;
+    header->begin = a->used;
+    header->end = a->used + bytes;
+
+    a->used += bytes;
+    a->live++;
+    if (a->used > a->required) {
+        a->required = a->used;
+    }
+    return block + scratch_arena_alignment;
+}
+
+WEAK void halide_scratch_arena_free(void *user_context, void *ptr) {
+    if (!ptr) {
+        return;
+    }
+    scratch_arena_header *header = (scratch_arena_header *)((uint8_t *)ptr - scratch_arena_alignment);
+    scratch_arena *a = header->arena;
+
+    ScopedMutexLock lock(&scratch_arena_lock);
+    if (header->fallback) {
+        halide_free(user_context, header->fallback);
+    }
+    halide_assert(user_context, a->live > 0);
+    if (header->end == a->used) {
+        // The allocations of a pipeline are mostly freed in the
+        // reverse order they were made, e.g. those inside a loop body
+        // before those around it. Give the space back so the next
+        // iteration reuses it.
+        a->used = header->begin;
+    }
+    if (--a->live == 0) {
+        a->used = 0;
+        if (a->owned && a->required > a->capacity) {
+            // Grow the arena now, while nothing is using it, so the
+            // next call doesn't need to fall back to halide_malloc.
+            free_arena_memory(a->host);
+            a->host = alloc_arena_memory(a->required);
+            a->capacity = a->host ? a->required : 0;
+        }
+    }
+}
+
+WEAK uint64_t halide_scratch_arena_required_size(void *user_context, const char *pipeline_name) {
+    ScopedMutexLock lock(&scratch_arena_lock);
+    for (scratch_arena *a = scratch_arenas; a; a = a->next) {
+        if (strcmp(a->pipeline_name, pipeline_name) == 0) {
+            return a->required;
+        }
+    }
+    return 0;
+}
+
+WEAK int halide_scratch_arena_set_memory(void *user_context, const char *pipeline_name,
+                                         void *host, uint64_t size) {
+    ScopedMutexLock lock(&scratch_arena_lock);
+    scratch_arena *a = find_or_create_scratch_arena(pipeline_name);
+    if (!a) {
+        return halide_error_code_out_of_memory;
+    }
+    if (a->live) {
+        error(user_context) << "Can't change the scratch arena of pipeline "
+                            << pipeline_name << " while it is running.\n";
+        return halide_error_code_generic_error;
+    }
+    if (host && ((size_t)host & (scratch_arena_alignment - 1)) != 0) {
+        error(user_context) << "The memory given to the scratch arena of pipeline "
+                            << pipeline_name << " isn't aligned to "
+                            << (int)scratch_arena_alignment << " bytes.\n";
+        return halide_error_code_generic_error;
+    }
+    if (a->owned) {
+        free_arena_memory(a->host);
+    }
+    a->host = (uint8_t *)host;
+    a->capacity = host ? size : 0;
+    a->owned = (host == NULL);
+    return 0;
+}
+
+WEAK void halide_scratch_arena_cleanup() {
+    ScopedMutexLock lock(&scratch_arena_lock);
+    scratch_arena *a = scratch_arenas;
+    while (a) {
+        scratch_arena *next = a->next;
+        if (a->owned) {
+            free_arena_memory(a->host);
+        }
+        free(a);
+        a = next;
+    }
+    scratch_arenas = NULL;
+}
+
+namespace {
+__attribute__((destructor))
+WEAK void halide_scratch_arena_cleanup_at_exit() {
+    halide_scratch_arena_cleanup();
+}
+}
+
+}
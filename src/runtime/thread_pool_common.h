@@ -9,7 +9,29 @@ struct work {
     uint8_t *closure;
     int active_workers;
     int exit_status;
+    // The job whose task was running on the calling thread when this
+    // job was enqueued, or NULL for a top-level parallel loop.
+    work *parent_job;
     bool running() { return next < max || active_workers > 0; }
+    int pending_tasks() { return max - next; }
+
+    // Is this job the given job, or one spawned (transitively) from
+    // inside one of its tasks?
+    bool descends_from(work *ancestor) {
+        for (work *j = this; j; j = j->parent_job) {
+            if (j == ancestor) return true;
+        }
+        return false;
+    }
+};
+
+// Records which job a thread is currently executing a task of, so
+// that parallel loops launched from inside that task can be tied to
+// their parent job. These live on the stack of the executing thread.
+struct running_task {
+    uintptr_t thread_id;
+    work *job;
+    running_task *next;
 };
 
 // The work queue and thread pool is weak, so one big work queue is shared by all halide functions
@@ -21,12 +43,23 @@ struct work_queue_t {
     // Singly linked list for job stack
     work *jobs;
 
+    // Singly linked list of tasks currently being executed, innermost
+    // first for any given thread.
+    running_task *running_tasks;
+
+    // The number of tasks currently being executed by any thread.
+    int tasks_in_flight;
+
     // Worker threads are divided into an 'A' team and a 'B' team. The
     // B team sleeps on the wakeup_b_team condition variable. The A
     // team does work. Threads transition to the B team if they wake
     // up and find that a_team_size > target_a_team_size.  Threads
     // move into the A team whenever they wake up and find that
-    // a_team_size < target_a_team_size.
+    // a_team_size < target_a_team_size. The target is the total
+    // parallelism demanded by all jobs in flight (see
+    // update_target_a_team_size), so nested parallel loops neither
+    // leave threads asleep nor wake more threads than there are
+    // tasks.
     int a_team_size, target_a_team_size;
 
     // Broadcast when a job completes.
@@ -48,6 +81,14 @@ struct work_queue_t {
     // The desired number threads doing work.
     int desired_num_threads;
 
+    // The number of threads blocked in halide_semaphore_acquire. A
+    // blocked thread isn't doing work, so extra threads are created
+    // as needed to keep desired_num_threads busy.
+    int threads_blocked;
+
+    // Broadcast whenever a semaphore is released.
+    halide_cond wakeup_semaphore_waiters;
+
     // Global flags indicating the threadpool should shut down, and
     // whether the thread pool has been initialized.
     bool shutdown, initialized;
@@ -59,6 +100,13 @@ struct work_queue_t {
 };
 WEAK work_queue_t work_queue;
 
+// The contents of a halide_semaphore_t. Protected by the work queue
+// mutex.
+struct semaphore_impl {
+    int value;
+    bool closed;
+};
+
 WEAK int default_do_task(void *user_context, halide_task_t f, int idx,
                         uint8_t *closure) {
     return f(user_context, idx, closure);
@@ -88,6 +136,53 @@ WEAK int default_desired_num_threads() {
     return desired_num_threads;
 }
 
+// Recompute the number of threads we want awake from the number of
+// tasks still to be claimed plus the number currently executing, and
+// wake the B team if that exceeds the current A team. Called with the
+// lock held whenever the set of pending tasks changes shape.
+WEAK void update_target_a_team_size() {
+    int demand = work_queue.tasks_in_flight - work_queue.threads_blocked;
+    for (work *job = work_queue.jobs; job; job = job->next_job) {
+        demand += job->pending_tasks();
+        if (demand >= work_queue.desired_num_threads) break;
+    }
+    if (demand > work_queue.desired_num_threads) {
+        demand = work_queue.desired_num_threads;
+    } else if (demand < 1) {
+        demand = 1;
+    }
+    work_queue.target_a_team_size = demand + work_queue.threads_blocked;
+    if (work_queue.target_a_team_size > work_queue.a_team_size) {
+        halide_cond_broadcast(&work_queue.wakeup_b_team);
+    }
+}
+
+// The job the calling thread is currently executing a task of, if any.
+WEAK work *current_job_already_locked() {
+    uintptr_t me = halide_current_thread_id();
+    for (running_task *t = work_queue.running_tasks; t; t = t->next) {
+        if (t->thread_id == me) return t->job;
+    }
+    return NULL;
+}
+
+// Find a job with a task to claim. Worker threads take the most
+// recently pushed job, which is the innermost level of any nested
+// parallelism. A thread that owns a job is blocked until that job
+// completes, so it only helps with its own job or with jobs spawned
+// from within its tasks; picking up unrelated work could keep it
+// busy long after its own job is done.
+WEAK work *find_job_already_locked(work *owned_job, work **prev_out) {
+    work *prev = NULL;
+    for (work *job = work_queue.jobs; job; prev = job, job = job->next_job) {
+        if (!owned_job || job->descends_from(owned_job)) {
+            *prev_out = prev;
+            return job;
+        }
+    }
+    return NULL;
+}
+
 WEAK void worker_thread_already_locked(work *owned_job) {
     // If I'm a job owner, then I was the thread that called
     // do_par_for, and I should only stay in this function until my
@@ -96,10 +191,15 @@ WEAK void worker_thread_already_locked(work *owned_job) {
     while (owned_job != NULL ? owned_job->running()
            : work_queue.running()) {
 
-        if (work_queue.jobs == NULL) {
+        work *prev = NULL;
+        work *job = find_job_already_locked(owned_job, &prev);
+
+        if (job == NULL) {
             if (owned_job) {
-                // There are no jobs pending. Wait for the last worker
-                // to signal that the job is finished.
+                // There are no jobs pending in my subtree. Wait for
+                // the last worker to signal that the job is finished,
+                // or for one of them to enqueue a nested job I can
+                // help with.
                 halide_cond_wait(&work_queue.wakeup_owners, &work_queue.mutex);
             } else if (work_queue.a_team_size <= work_queue.target_a_team_size) {
                 // There are no jobs pending. Wait until more jobs are enqueued.
@@ -113,9 +213,6 @@ WEAK void worker_thread_already_locked(work *owned_job) {
                 work_queue.a_team_size++;
             }
         } else {
-            // Grab the next job.
-            work *job = work_queue.jobs;
-
             // Claim a task from it.
             work myjob = *job;
             job->next++;
@@ -123,13 +220,26 @@ WEAK void worker_thread_already_locked(work *owned_job) {
             // If there were no more tasks pending for this job,
             // remove it from the stack.
             if (job->next == job->max) {
-                work_queue.jobs = job->next_job;
+                if (prev) {
+                    prev->next_job = job->next_job;
+                } else {
+                    work_queue.jobs = job->next_job;
+                }
             }
 
             // Increment the active_worker count so that other threads
             // are aware that this job is still in progress even
             // though there are no outstanding tasks for it.
             job->active_workers++;
+            work_queue.tasks_in_flight++;
+
+            // Note which job this thread is working on, so that any
+            // parallel loop inside the task knows its parent.
+            running_task task;
+            task.thread_id = halide_current_thread_id();
+            task.job = job;
+            task.next = work_queue.running_tasks;
+            work_queue.running_tasks = &task;
 
             // Release the lock and do the task.
             halide_mutex_unlock(&work_queue.mutex);
@@ -137,6 +247,13 @@ WEAK void worker_thread_already_locked(work *owned_job) {
                                         myjob.closure);
             halide_mutex_lock(&work_queue.mutex);
 
+            // Other threads may have pushed records on top of ours.
+            running_task **t = &work_queue.running_tasks;
+            while (*t != &task) {
+                t = &((*t)->next);
+            }
+            *t = task.next;
+
             // If this task failed, set the exit status on the job.
             if (result) {
                 job->exit_status = result;
@@ -144,6 +261,7 @@ WEAK void worker_thread_already_locked(work *owned_job) {
 
             // We are no longer active on this job
             job->active_workers--;
+            work_queue.tasks_in_flight--;
 
             // If the job is done and I'm not the owner of it, wake up
             // the owner.
@@ -161,33 +279,41 @@ WEAK void worker_thread(void *) {
     halide_mutex_unlock(&work_queue.mutex);
 }
 
+WEAK void initialize_work_queue_already_locked() {
+    if (work_queue.initialized) return;
+
+    work_queue.shutdown = false;
+    halide_cond_init(&work_queue.wakeup_owners);
+    halide_cond_init(&work_queue.wakeup_a_team);
+    halide_cond_init(&work_queue.wakeup_b_team);
+    work_queue.jobs = NULL;
+    work_queue.running_tasks = NULL;
+    work_queue.tasks_in_flight = 0;
+    work_queue.threads_blocked = 0;
+    halide_cond_init(&work_queue.wakeup_semaphore_waiters);
+
+    // Compute the desired number of threads to use. Other code
+    // can also mess with this value, but only when the work queue
+    // is locked.
+    if (!work_queue.desired_num_threads) {
+        work_queue.desired_num_threads = default_desired_num_threads();
+    }
+    work_queue.desired_num_threads = clamp_num_threads(work_queue.desired_num_threads);
+    work_queue.threads_created = 0;
+
+    // Everyone starts on the a team.
+    work_queue.a_team_size = work_queue.desired_num_threads;
+
+    work_queue.initialized = true;
+}
+
 WEAK int default_do_par_for(void *user_context, halide_task_t f,
                             int min, int size, uint8_t *closure) {
     // Grab the lock. If it hasn't been initialized yet, then the
     // field will be zero-initialized because it's a static global.
     halide_mutex_lock(&work_queue.mutex);
 
-    if (!work_queue.initialized) {
-        work_queue.shutdown = false;
-        halide_cond_init(&work_queue.wakeup_owners);
-        halide_cond_init(&work_queue.wakeup_a_team);
-        halide_cond_init(&work_queue.wakeup_b_team);
-        work_queue.jobs = NULL;
-
-        // Compute the desired number of threads to use. Other code
-        // can also mess with this value, but only when the work queue
-        // is locked.
-        if (!work_queue.desired_num_threads) {
-            work_queue.desired_num_threads = default_desired_num_threads();
-        }
-        work_queue.desired_num_threads = clamp_num_threads(work_queue.desired_num_threads);
-        work_queue.threads_created = 0;
-
-        // Everyone starts on the a team.
-        work_queue.a_team_size = work_queue.desired_num_threads;
-
-        work_queue.initialized = true;
-    }
+    initialize_work_queue_already_locked();
 
     while (work_queue.threads_created < work_queue.desired_num_threads - 1) {
         // We might need to make some new threads, if work_queue.desired_num_threads has
@@ -206,31 +332,23 @@ WEAK int default_do_par_for(void *user_context, halide_task_t f,
     job.exit_status = 0;     // The job hasn't failed yet
     job.active_workers = 0;  // Nobody is working on this yet
 
-    if (!work_queue.jobs && size < work_queue.desired_num_threads) {
-        // If there's no nested parallelism happening and there are
-        // fewer tasks to do than threads, then set the target A team
-        // size so that some threads will put themselves to sleep
-        // until a larger job arrives.
-        work_queue.target_a_team_size = size;
-    } else {
-        // Otherwise the target A team size is
-        // desired_num_threads. This may still be less than
-        // threads_created if desired_num_threads has been reduced by
-        // other code.
-        work_queue.target_a_team_size = work_queue.desired_num_threads;
-    }
+    job.parent_job = current_job_already_locked();
 
     // Push the job onto the stack.
     job.next_job = work_queue.jobs;
     work_queue.jobs = &job;
 
+    // Size the A team to the total demand, including this job's
+    // tasks. This may wake up the B team.
+    update_target_a_team_size();
+
     // Wake up our A team.
     halide_cond_broadcast(&work_queue.wakeup_a_team);
 
-    // If there are fewer threads than we would like on the a team,
-    // wake up the b team too.
-    if (work_queue.target_a_team_size > work_queue.a_team_size) {
-        halide_cond_broadcast(&work_queue.wakeup_b_team);
+    // If this is a nested job, the owners of the enclosing jobs may
+    // be asleep waiting for their workers. They can help with this.
+    if (job.parent_job) {
+        halide_cond_broadcast(&work_queue.wakeup_owners);
     }
 
     // Do some work myself.
@@ -288,7 +406,72 @@ WEAK void halide_shutdown_thread_pool() {
     halide_cond_destroy(&work_queue.wakeup_owners);
     halide_cond_destroy(&work_queue.wakeup_a_team);
     halide_cond_destroy(&work_queue.wakeup_b_team);
+    halide_cond_destroy(&work_queue.wakeup_semaphore_waiters);
     work_queue.initialized = false;
 }
 
+WEAK int halide_semaphore_init(halide_semaphore_t *s, int n) {
+    semaphore_impl *sem = (semaphore_impl *)s;
+    sem->value = n;
+    sem->closed = false;
+    return 0;
+}
+
+WEAK void halide_semaphore_close(void *user_context, void *s) {
+    semaphore_impl *sem = (semaphore_impl *)s;
+    halide_mutex_lock(&work_queue.mutex);
+    sem->closed = true;
+    if (work_queue.initialized) {
+        halide_cond_broadcast(&work_queue.wakeup_semaphore_waiters);
+    }
+    halide_mutex_unlock(&work_queue.mutex);
+}
+
+WEAK int halide_semaphore_release(halide_semaphore_t *s, int n) {
+    semaphore_impl *sem = (semaphore_impl *)s;
+    halide_mutex_lock(&work_queue.mutex);
+    sem->value += n;
+    int result = sem->value;
+    if (work_queue.initialized) {
+        halide_cond_broadcast(&work_queue.wakeup_semaphore_waiters);
+    }
+    halide_mutex_unlock(&work_queue.mutex);
+    return result;
+}
+
+WEAK int halide_semaphore_acquire(halide_semaphore_t *s, int n) {
+    semaphore_impl *sem = (semaphore_impl *)s;
+    halide_mutex_lock(&work_queue.mutex);
+    if (sem->value < n && !sem->closed) {
+        initialize_work_queue_already_locked();
+
+        // The task that will release this semaphore may still be
+        // pending. Make sure there's a thread to run it, even if
+        // that takes us over the desired number of threads.
+        work_queue.threads_blocked++;
+        while (work_queue.threads_created < work_queue.desired_num_threads - 1 + work_queue.threads_blocked &&
+               work_queue.threads_created < MAX_THREADS) {
+            work_queue.threads[work_queue.threads_created++] =
+                halide_spawn_thread(worker_thread, NULL);
+            work_queue.a_team_size++;
+        }
+        update_target_a_team_size();
+
+        while (sem->value < n && !sem->closed) {
+            halide_cond_wait(&work_queue.wakeup_semaphore_waiters, &work_queue.mutex);
+        }
+
+        work_queue.threads_blocked--;
+        update_target_a_team_size();
+    }
+    if (sem->value < n) {
+        // Whatever would have released it failed.
+        halide_mutex_unlock(&work_queue.mutex);
+        return halide_error_code_generic_error;
+    }
+    sem->value -= n;
+    halide_mutex_unlock(&work_queue.mutex);
+    return 0;
+}
+
 }
@@ -15,6 +15,292 @@ WEAK int halide_trace_file_lock = 0;
 WEAK bool halide_trace_file_initialized = false;
 WEAK bool halide_trace_file_internally_opened = false;
 
+// A lock that many threads may hold at once in shared mode, or one
+// thread in exclusive mode. Threads waiting for exclusive access
+// take priority over new shared holders.
+struct SharedExclusiveSpinLock {
+    volatile uint32_t lock;
+
+    static const uint32_t exclusive_held_mask = 0x80000000;
+    static const uint32_t exclusive_waiting_mask = 0x40000000;
+    static const uint32_t shared_mask = 0x3fffffff;
+
+    __attribute__((always_inline)) void acquire_shared() {
+        while (1) {
+            uint32_t x = lock & shared_mask;
+            if (__sync_bool_compare_and_swap(&lock, x, x + 1)) {
+                return;
+            }
+        }
+    }
+
+    __attribute__((always_inline)) void release_shared() {
+        __sync_fetch_and_sub(&lock, 1);
+    }
+
+    __attribute__((always_inline)) void acquire_exclusive() {
+        while (1) {
+            __sync_fetch_and_or(&lock, exclusive_waiting_mask);
+            if (__sync_bool_compare_and_swap(&lock, exclusive_waiting_mask, exclusive_held_mask)) {
+                return;
+            }
+        }
+    }
+
+    __attribute__((always_inline)) void release_exclusive() {
+        __sync_fetch_and_and(&lock, ~exclusive_held_mask);
+    }
+};
+
+// Binary trace packets are batched into a ring of large buffers
+// instead of being written one at a time. Threads append to the
+// current buffer concurrently, reserving space with an atomic add
+// while holding the lock in shared mode. The thread whose packet
+// first doesn't fit seals the buffer under the exclusive lock and
+// moves on to the next one in the ring. Sealed buffers are written to
+// the trace file in order by a background thread, which sleeps until a
+// buffer is sealed. If the writer thread falls behind, or the platform
+// has no threads to start one on, the sealing thread writes them
+// itself.
+const uint32_t kTraceBufferSize = 1 << 20;
+const int kTraceBufferCount = 4;
+
+enum TraceBufferState {
+    TraceBufferFree = 0,
+    TraceBufferFilling = 1,
+    TraceBufferSealed = 2
+};
+
+struct TraceBuffer {
+    // Bytes reserved so far. May run past the end of the buffer once
+    // a packet didn't fit.
+    uint32_t cursor;
+    // The number of bytes of valid packets. Set by the thread whose
+    // reservation first ran past the end, or when sealing early.
+    uint32_t used;
+    volatile int state;
+    uint8_t data[kTraceBufferSize];
+};
+
+struct TraceWriter {
+    SharedExclusiveSpinLock lock;
+    TraceBuffer *buffers[kTraceBufferCount];
+    // The buffer being filled.
+    int current;
+    // The next sealed buffer to write out, in ring order.
+    int next_to_write;
+    // The file the buffered packets belong to.
+    int fd;
+    // Serializes the actual writes to the file.
+    halide_mutex write_lock;
+    // Signalled when a buffer is sealed or the writer thread should
+    // stop. Waited on with write_lock held.
+    halide_cond wake_writer;
+    halide_thread *thread;
+    bool stop_thread;
+};
+
+WEAK TraceWriter trace_writer;
+
+// Write the oldest sealed buffer to the file, if there is one. Must
+// hold the write lock. Returns whether anything was written.
+WEAK bool write_next_sealed_buffer_locked() {
+    TraceWriter &w = trace_writer;
+    bool wrote = false;
+    TraceBuffer *b = w.buffers[w.next_to_write];
+    if (b && b->state == TraceBufferSealed) {
+        size_t written = write(w.fd, b->data, b->used);
+        if (written != b->used) {
+            halide_print(NULL, "Can't write to trace file\n");
+        }
+        __sync_synchronize();
+        b->state = TraceBufferFree;
+        w.next_to_write = (w.next_to_write + 1) % kTraceBufferCount;
+        wrote = true;
+    }
+    return wrote;
+}
+
+WEAK bool write_next_sealed_buffer() {
+    TraceWriter &w = trace_writer;
+    halide_mutex_lock(&w.write_lock);
+    bool wrote = write_next_sealed_buffer_locked();
+    halide_mutex_unlock(&w.write_lock);
+    return wrote;
+}
+
+WEAK void trace_writer_thread(void *) {
+    TraceWriter &w = trace_writer;
+    halide_mutex_lock(&w.write_lock);
+    while (!w.stop_thread) {
+        if (!write_next_sealed_buffer_locked()) {
+            halide_cond_wait(&w.wake_writer, &w.write_lock);
+        }
+    }
+    halide_mutex_unlock(&w.write_lock);
+}
+
+// Seal the current buffer and make the next one in the ring current,
+// waiting for it to be written out first if necessary. Must hold the
+// exclusive lock.
+WEAK void advance_trace_buffer() {
+    TraceWriter &w = trace_writer;
+    TraceBuffer *b = w.buffers[w.current];
+    if (b->cursor <= kTraceBufferSize) {
+        b->used = b->cursor;
+    }
+    __sync_synchronize();
+    b->state = TraceBufferSealed;
+
+    if (w.thread) {
+        halide_mutex_lock(&w.write_lock);
+        halide_cond_broadcast(&w.wake_writer);
+        halide_mutex_unlock(&w.write_lock);
+    } else {
+        // No writer thread, so write the sealed buffer out now.
+        write_next_sealed_buffer();
+    }
+
+    w.current = (w.current + 1) % kTraceBufferCount;
+    if (!w.buffers[w.current]) {
+        w.buffers[w.current] = (TraceBuffer *)malloc(sizeof(TraceBuffer));
+        halide_assert(NULL, w.buffers[w.current] && "Out of memory allocating trace buffer");
+        w.buffers[w.current]->state = TraceBufferFree;
+    }
+    TraceBuffer *next = w.buffers[w.current];
+    while (next->state == TraceBufferSealed) {
+        write_next_sealed_buffer();
+    }
+    next->cursor = 0;
+    next->used = 0;
+    next->state = TraceBufferFilling;
+}
+
+// Write out everything buffered so far. Must hold the exclusive lock.
+WEAK void flush_trace_buffers() {
+    TraceWriter &w = trace_writer;
+    TraceBuffer *b = w.buffers[w.current];
+    if (!b) return;
+    if (b->cursor > 0) {
+        advance_trace_buffer();
+    }
+    while (write_next_sealed_buffer()) {
+    }
+}
+
+// Write all of a block of memory to a file. Returns whether it all got
+// written.
+WEAK bool write_fully(int fd, const void *data, size_t size) {
+    return size == 0 || (data && write(fd, data, size) == (ssize_t)size);
+}
+
+// Append a packet to the buffers for the given file, starting the
+// writer thread on first use if the platform has threads.
+WEAK void buffer_trace_packet(int fd, const halide_trace_packet_t &header,
+                              const halide_trace_event_t *e,
+                              uint32_t coords_bytes, uint32_t value_bytes, uint32_t name_bytes) {
+    TraceWriter &w = trace_writer;
+    uint32_t size = header.size;
+
+    if (w.fd != fd || !w.buffers[w.current]) {
+        w.lock.acquire_exclusive();
+        if (w.fd != fd) {
+            flush_trace_buffers();
+            w.fd = fd;
+        }
+        if (!w.buffers[w.current]) {
+            w.buffers[w.current] = (TraceBuffer *)malloc(sizeof(TraceBuffer));
+            halide_assert(NULL, w.buffers[w.current] && "Out of memory allocating trace buffer");
+            w.buffers[w.current]->cursor = 0;
+            w.buffers[w.current]->used = 0;
+            w.buffers[w.current]->state = TraceBufferFilling;
+            if (halide_can_spawn_threads()) {
+                halide_cond_init(&w.wake_writer);
+                w.stop_thread = false;
+                w.thread = halide_spawn_thread(trace_writer_thread, NULL);
+            }
+        }
+        w.lock.release_exclusive();
+    }
+
+    while (1) {
+        w.lock.acquire_shared();
+        TraceBuffer *b = w.buffers[w.current];
+        uint32_t offset = __sync_fetch_and_add(&b->cursor, size);
+        if (offset + size <= kTraceBufferSize) {
+            uint8_t *dst = b->data + offset;
+            memcpy(dst, &header, sizeof(header));
+            dst += sizeof(header);
+            if (e->coordinates) {
+                memcpy(dst, e->coordinates, coords_bytes);
+            }
+            dst += coords_bytes;
+            if (e->value) {
+                memcpy(dst, e->value, value_bytes);
+            }
+            dst += value_bytes;
+            memcpy(dst, e->func, name_bytes);
+            dst += name_bytes;
+            memset(dst, 0, size - (uint32_t)sizeof(header) - coords_bytes - value_bytes - name_bytes);
+            w.lock.release_shared();
+            return;
+        }
+        if (offset <= kTraceBufferSize) {
+            // This is the first reservation that didn't fit, so
+            // everything before it is valid.
+            b->used = offset;
+        }
+        w.lock.release_shared();
+
+        w.lock.acquire_exclusive();
+        if (w.buffers[w.current] == b) {
+            advance_trace_buffer();
+        }
+        if (size > kTraceBufferSize) {
+            // This packet will never fit in a buffer. Write it
+            // directly, after everything before it.
+            flush_trace_buffers();
+            uint32_t zero = 0;
+            uint32_t padding_bytes = size - (uint32_t)sizeof(header) - coords_bytes - value_bytes - name_bytes;
+            halide_mutex_lock(&w.write_lock);
+            bool ok = (write_fully(fd, &header, sizeof(header)) &&
+                       write_fully(fd, e->coordinates, coords_bytes) &&
+                       write_fully(fd, e->value, value_bytes) &&
+                       write_fully(fd, e->func, name_bytes) &&
+                       write_fully(fd, &zero, padding_bytes));
+            halide_mutex_unlock(&w.write_lock);
+            w.lock.release_exclusive();
+            halide_assert(NULL, ok && "Can't write to trace file");
+            return;
+        }
+        w.lock.release_exclusive();
+    }
+}
+
+// Flush the trace buffers and stop the writer thread.
+WEAK void shutdown_trace_writer() {
+    TraceWriter &w = trace_writer;
+    w.lock.acquire_exclusive();
+    flush_trace_buffers();
+    if (w.thread) {
+        halide_mutex_lock(&w.write_lock);
+        w.stop_thread = true;
+        halide_cond_broadcast(&w.wake_writer);
+        halide_mutex_unlock(&w.write_lock);
+        halide_join_thread(w.thread);
+        w.thread = NULL;
+        halide_cond_destroy(&w.wake_writer);
+    }
+    for (int i = 0; i < kTraceBufferCount; i++) {
+        free(w.buffers[i]);
+        w.buffers[i] = NULL;
+    }
+    w.current = 0;
+    w.next_to_write = 0;
+    w.fd = 0;
+    w.lock.release_exclusive();
+}
+
 WEAK int32_t default_trace(void *user_context, const halide_trace_event_t *e) {
     static int32_t ids = 1;
 
@@ -30,7 +316,6 @@ WEAK int32_t default_trace(void *user_context, const halide_trace_event_t *e) {
         uint32_t name_bytes = strlen(e->func) + 1;
         uint32_t total_size_without_padding = header_bytes + value_bytes + coords_bytes + name_bytes;
         uint32_t total_size = (total_size_without_padding + 3) & ~3;
-        uint32_t padding_bytes = total_size - total_size_without_padding;
 
         // The packet header
         halide_trace_packet_t header;
@@ -42,21 +327,14 @@ WEAK int32_t default_trace(void *user_context, const halide_trace_event_t *e) {
         header.value_index = e->value_index;
         header.dimensions = e->dimensions;
 
-        size_t written = 0;
-        {
-            ScopedSpinLock lock(&halide_trace_file_lock);
-            written += write(fd, &header, sizeof(header));
-            if (e->coordinates) {
-                written += write(fd, e->coordinates, coords_bytes);
-            }
-            if (e->value) {
-                written += write(fd, e->value, value_bytes);
-            }
-            written += write(fd, e->func, name_bytes);
-            uint32_t zero = 0;
-            written += write(fd, &zero, padding_bytes);
+        buffer_trace_packet(fd, header, e, coords_bytes, value_bytes, name_bytes);
+
+        // Make the trace file complete whenever a pipeline finishes.
+        if (e->event == halide_trace_end_pipeline) {
+            trace_writer.lock.acquire_exclusive();
+            flush_trace_buffers();
+            trace_writer.lock.release_exclusive();
         }
-        halide_assert(user_context, written == total_size && "Can't write to trace file");
 
     } else {
         uint8_t buffer[4096];
@@ -77,18 +355,21 @@ WEAK int32_t default_trace(void *user_context, const halide_trace_event_t *e) {
                                      "Consume",
                                      "End consume",
                                      "Begin pipeline",
-                                     "End pipeline"};
+                                     "End pipeline",
+                                     "Summary"};
 
-        // Only print out the value on stores and loads.
-        bool print_value = (e->event < 2);
+        // Only print out the value on stores, loads and summaries.
+        bool print_value = (e->event < 2 || e->event == halide_trace_summary);
+        // Only loads and stores have a vector of coordinates per dimension.
+        bool vector_coords = (e->type.lanes > 1 && e->event < 2);
 
         ss << event_types[e->event] << " " << e->func << "." << e->value_index << "(";
-        if (e->type.lanes > 1) {
+        if (vector_coords) {
             ss << "<";
         }
         for (int i = 0; i < e->dimensions; i++) {
             if (i > 0) {
-                if ((e->type.lanes > 1) && (i % e->type.lanes) == 0) {
+                if (vector_coords && (i % e->type.lanes) == 0) {
                     ss << ">, <";
                 } else {
                     ss << ", ";
@@ -96,7 +377,7 @@ WEAK int32_t default_trace(void *user_context, const halide_trace_event_t *e) {
             }
             ss << e->coordinates[i];
         }
-        if (e->type.lanes > 1) {
+        if (vector_coords) {
             ss << ">)";
         } else {
             ss << ")";
@@ -174,6 +455,11 @@ WEAK trace_fn halide_set_custom_trace(trace_fn t) {
 }
 
 WEAK void halide_set_trace_file(int fd) {
+    if (fd != halide_trace_file) {
+        trace_writer.lock.acquire_exclusive();
+        flush_trace_buffers();
+        trace_writer.lock.release_exclusive();
+    }
     halide_trace_file = fd;
     halide_trace_file_initialized = true;
 }
@@ -206,6 +492,7 @@ WEAK int32_t halide_trace(void *user_context, const halide_trace_event_t *e) {
 }
 
 WEAK int halide_shutdown_trace() {
+    shutdown_trace_writer();
     if (halide_trace_file_internally_opened) {
         int ret = close(halide_trace_file);
         halide_trace_file = 0;
@@ -242,7 +529,7 @@ WEAK int halide_trace_helper(void *user_context,
     event.event = (halide_trace_event_code_t)code;
     event.parent_id = parent_id;
     event.value_index = value_index;
-    if (event.type.lanes > 1) {
+    if (event.type.lanes > 1 && code < 2) {
         dimensions *= event.type.lanes;
     }
     event.dimensions = dimensions;
@@ -26,6 +26,7 @@ extern WIN32API void DeleteCriticalSection(CriticalSection *);
 extern WIN32API void EnterCriticalSection(CriticalSection *);
 extern WIN32API void LeaveCriticalSection(CriticalSection *);
 extern WIN32API int32_t WaitForSingleObject(Thread, int32_t timeout);
+extern WIN32API uint32_t GetCurrentThreadId();
 extern WIN32API bool InitOnceExecuteOnce(InitOnce *, bool WIN32API (*f)(InitOnce *, void *, void **), void *, void **);
 
 } // extern "C"
@@ -65,6 +66,14 @@ WEAK halide_thread *halide_spawn_thread(void(*f)(void *), void *closure) {
     return (halide_thread *)t;
 }
 
+WEAK bool halide_can_spawn_threads() {
+    return true;
+}
+
+WEAK uintptr_t halide_current_thread_id() {
+    return (uintptr_t)GetCurrentThreadId();
+}
+
 WEAK void halide_join_thread(halide_thread *thread_arg) {
     spawned_thread *thread = (spawned_thread *)thread_arg;
     WaitForSingleObject(thread->handle, -1);
@@ -0,0 +1,163 @@
+#include "Halide.h"
+#include <stdio.h>
+
+using namespace Halide;
+
+size_t custom_malloc_size = 0;
+
+void *my_malloc(void *user_context, size_t x) {
+    custom_malloc_size = x;
+    void *orig = malloc(x+32);
+    void *ptr = (void *)((((size_t)orig + 32) >> 5) << 5);
+    ((void **)ptr)[-1] = orig;
+    return ptr;
+}
+
+void my_free(void *user_context, void *ptr) {
+    free(((void**)ptr)[-1]);
+}
+
+#ifdef _WIN32
+#define DLLEXPORT __declspec(dllexport)
+#else
+#define DLLEXPORT
+#endif
+
+// An extern stage that writes x * 3 + y, and fails on rows 10 and up.
+extern "C" DLLEXPORT
+int failing_rows(buffer_t *out) {
+    if (out->host == nullptr) {
+        return 0;
+    }
+    if (out->min[1] + out->extent[1] > 10) {
+        return -1;
+    }
+    for (int y = 0; y < out->extent[1]; y++) {
+        for (int x = 0; x < out->extent[0]; x++) {
+            int *dst = (int *)out->host + x * out->stride[0] + y * out->stride[1];
+            *dst = (x + out->min[0]) * 3 + y + out->min[1];
+        }
+    }
+    return 0;
+}
+
+bool error_occurred = false;
+extern "C" DLLEXPORT
+void my_halide_error(void *user_context, const char *msg) {
+    printf("Expected: %s\n", msg);
+    error_occurred = true;
+}
+
+int main(int argc, char **argv) {
+    Var x, y;
+
+    {
+        // Two independent async producers, computed at root.
+        Func f, g, h;
+        f(x, y) = x + y;
+        g(x, y) = x * y;
+        h(x, y) = f(x, y) + g(x, y);
+        f.compute_root().async();
+        g.compute_root().async();
+
+        Buffer<int> out = h.realize(64, 64);
+        for (int y = 0; y < out.height(); y++) {
+            for (int x = 0; x < out.width(); x++) {
+                int correct = x + y + x * y;
+                if (out(x, y) != correct) {
+                    printf("out(%d, %d) = %d instead of %d\n", x, y, out(x, y), correct);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    {
+        // An async producer that slides down a circular buffer. The
+        // producer can only run as far ahead as the fold allows.
+        Func f, g;
+        f(x, y) = x * 3 + y;
+        g(x, y) = f(x, y - 1) + f(x, y) + f(x, y + 1);
+        f.store_root().compute_at(g, y).async();
+
+        g.set_custom_allocator(my_malloc, my_free);
+
+        Buffer<int> out = g.realize(100, 1000);
+        for (int y = 0; y < out.height(); y++) {
+            for (int x = 0; x < out.width(); x++) {
+                int correct = x * 9 + y * 3;
+                if (out(x, y) != correct) {
+                    printf("out(%d, %d) = %d instead of %d\n", x, y, out(x, y), correct);
+                    return -1;
+                }
+            }
+        }
+
+        size_t expected_size = 100*4*sizeof(int) + sizeof(int);
+        if (custom_malloc_size == 0 || custom_malloc_size != expected_size) {
+            printf("Scratch space allocated was %d instead of %d\n", (int)custom_malloc_size, (int)expected_size);
+            return -1;
+        }
+    }
+
+    {
+        // The same with an explicit fold, inside a parallel loop over
+        // strips of the output.
+        Func f, g;
+        Var yo, yi;
+        f(x, y) = x * 3 + y;
+        g(x, y) = f(x, y - 1) + f(x, y + 1);
+        g.split(y, yo, yi, 16).parallel(yo);
+        f.store_at(g, yo).compute_at(g, yi).fold_storage(y, 3).async();
+
+        Buffer<int> out = g.realize(100, 256);
+        for (int y = 0; y < out.height(); y++) {
+            for (int x = 0; x < out.width(); x++) {
+                int correct = x * 6 + y * 2;
+                if (out(x, y) != correct) {
+                    printf("out(%d, %d) = %d instead of %d\n", x, y, out(x, y), correct);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    {
+        // An async extern producer that fails. The consumer must not
+        // wait for it forever.
+        Func f, g;
+        f.define_extern("failing_rows", {}, Int(32), 2);
+        g(x, y) = f(x, y) * 2;
+        f.compute_root().async();
+
+        error_occurred = false;
+        g.set_error_handler(&my_halide_error);
+        g.realize(100, 100);
+        if (!error_occurred) {
+            printf("There was supposed to be an error\n");
+            return -1;
+        }
+    }
+
+    {
+        // A consumer that fails while its async producer is waiting
+        // for space in the circular buffer.
+        Func f, g, h;
+        f(x, y) = x * 3 + y;
+        h.define_extern("failing_rows", {}, Int(32), 2);
+        g(x, y) = f(x, y - 1) + f(x, y + 1) + h(x, y);
+        f.store_root().compute_at(g, y).async();
+        h.compute_at(g, y);
+
+        error_occurred = false;
+        g.set_error_handler(&my_halide_error);
+        g.realize(100, 1000);
+        if (!error_occurred) {
+            printf("There was supposed to be an error\n");
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
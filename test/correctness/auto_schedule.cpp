@@ -0,0 +1,81 @@
+#include "Halide.h"
+#include <stdio.h>
+
+using namespace Halide;
+
+// Build the same pipeline each time, so that the auto-scheduled
+// version can be checked against the default schedule.
+Func make_pipeline(ImageParam input) {
+    Var x("x"), y("y");
+    Func clamped("clamped"), brighter("brighter"), blur_x("blur_x"), blur_y("blur_y");
+    Func hist("hist"), out("out");
+
+    clamped(x, y) = input(clamp(x, 0, input.width() - 1), clamp(y, 0, input.height() - 1));
+    brighter(x, y) = clamped(x, y) * 2 + 1;
+    blur_x(x, y) = (brighter(x - 1, y) + brighter(x, y) + brighter(x + 1, y)) / 3;
+    blur_y(x, y) = (blur_x(x, y - 1) + blur_x(x, y) + blur_x(x, y + 1)) / 3;
+
+    // A reduction, which can't be inlined.
+    RDom r(0, 64);
+    hist(x) = 0;
+    hist(x) += blur_y(x, r) % 7;
+
+    out(x, y) = blur_y(x, y) + hist(x % 64);
+    return out;
+}
+
+int main(int argc, char **argv) {
+    Target target = get_jit_target_from_environment();
+    if (target.has_gpu_feature()) {
+        printf("Skipping test because the auto-scheduler only supports CPU targets\n");
+        return 0;
+    }
+
+    ImageParam input(Int(32), 2, "input");
+    Buffer<int> in(1100, 1100);
+    in.for_each_element([&](int x, int y) { in(x, y) = (x * 17 + y * 31) % 101; });
+    input.set(in);
+
+    Buffer<int> reference = make_pipeline(input).realize(1024, 1024, target);
+
+    Func out = make_pipeline(input);
+    Var x("x"), y("y");
+    out.estimate(x, 0, 1024).estimate(y, 0, 1024);
+
+    Pipeline p(out);
+    std::string schedule = p.auto_schedule(target);
+    printf("%s", schedule.c_str());
+
+    if (schedule.find("parallel") == std::string::npos ||
+        schedule.find("vectorize") == std::string::npos) {
+        printf("The schedule should vectorize and parallelize the output\n");
+        return -1;
+    }
+    if (schedule.find("Inlined: clamped") == std::string::npos) {
+        printf("The boundary condition should have been inlined\n");
+        return -1;
+    }
+    if (schedule.find("hist\n    .compute_root()") == std::string::npos) {
+        printf("The reduction should be computed at root\n");
+        return -1;
+    }
+
+    Buffer<int> result = p.realize(1024, 1024, target);
+    for (int y = 0; y < 1024; y++) {
+        for (int x = 0; x < 1024; x++) {
+            if (result(x, y) != reference(x, y)) {
+                printf("result(%d, %d) = %d instead of %d\n", x, y, result(x, y), reference(x, y));
+                return -1;
+            }
+        }
+    }
+
+    MachineParams params(4, 1024 * 1024, 20);
+    if (params.to_string() != "4,1048576,20") {
+        printf("Bad MachineParams string: %s\n", params.to_string().c_str());
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
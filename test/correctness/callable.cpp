@@ -0,0 +1,83 @@
+#include "Halide.h"
+#include <stdio.h>
+
+using namespace Halide;
+
+bool error_occurred = false;
+void my_error_handler(void *user_context, const char *msg) {
+    error_occurred = true;
+}
+
+int main(int argc, char **argv) {
+    ImageParam input(Int(32), 2, "input");
+    Param<int> offset("offset");
+    Param<float> scale("scale");
+
+    Func f("f"), g("g");
+    Var x("x"), y("y");
+    f(x, y) = input(x, y) + offset;
+    g(x, y) = Tuple(f(x, y) * 2, cast<float>(f(x, y)) * scale);
+
+    Pipeline p(g);
+    // The Callable's arguments may be in any order.
+    Callable c = p.compile_to_callable({scale, input, offset});
+
+    if (c.arguments().size() != 5 ||
+        c.arguments()[1].name != "input" ||
+        !c.arguments()[3].is_output()) {
+        printf("Wrong argument list for Callable\n");
+        return -1;
+    }
+
+    Buffer<int> in(16, 16);
+    in.for_each_element([&](int x, int y) { in(x, y) = x * 3 + y; });
+    Buffer<int> out0(16, 16);
+    Buffer<float> out1(16, 16);
+
+    for (int i = 0; i < 10; i++) {
+        // Values bound to the Params are ignored.
+        offset.set(1000);
+        int result = c(0.5f, in, i, out0, out1);
+        if (result != 0) {
+            printf("Callable returned %d\n", result);
+            return -1;
+        }
+        for (int y = 0; y < 16; y++) {
+            for (int x = 0; x < 16; x++) {
+                int correct = x * 3 + y + i;
+                if (out0(x, y) != correct * 2 || out1(x, y) != correct * 0.5f) {
+                    printf("out(%d, %d) = {%d, %f} instead of {%d, %f}\n",
+                           x, y, out0(x, y), out1(x, y), correct * 2, correct * 0.5f);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    // Raw buffer_t pointers work too, and the output can be a crop.
+    Buffer<int> small0(8, 8);
+    Buffer<float> small1(8, 8);
+    small0.set_min(4, 4);
+    small1.set_min(4, 4);
+    c(2.0f, in.raw_buffer(), 7, small0.raw_buffer(), small1);
+    if (small0(4, 4) != (4 * 3 + 4 + 7) * 2 || small1(11, 11) != (11 * 3 + 11 + 7) * 2.0f) {
+        printf("Wrong output for cropped buffers\n");
+        return -1;
+    }
+
+    // Errors go to the handler installed when the Callable was made.
+    Func h("h");
+    h(x) = input(x, 0);
+    Pipeline q(h);
+    q.set_error_handler(my_error_handler);
+    Callable d = q.compile_to_callable({input});
+    Buffer<int> too_big(32);
+    int result = d(in, too_big);
+    if (result == 0 || !error_occurred) {
+        printf("Accessing the input out of bounds should have been an error\n");
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,73 @@
+#include "Halide.h"
+#include <stdio.h>
+#include <string>
+
+using namespace Halide;
+
+const CompilePassProfile *find_pass(const CompileProfile &profile, const std::string &name) {
+    for (const CompilePassProfile &p : profile.passes) {
+        if (p.name == name) return &p;
+    }
+    return nullptr;
+}
+
+int main(int argc, char **argv) {
+    Func f, g;
+    Var x, y;
+    f(x, y) = x + y;
+    g(x, y) = f(x - 1, y) + f(x + 1, y);
+    f.compute_at(g, y);
+    g.vectorize(x, 8).parallel(y);
+
+    Pipeline p(g);
+    p.set_compile_profiling(true);
+    p.compile_jit();
+
+    const CompileProfile &profile = p.compile_profile();
+    if (profile.passes.empty()) {
+        printf("Compile profile is empty\n");
+        return -1;
+    }
+
+    const char *expected[] = {"schedule_functions", "bounds_inference", "vectorize_loops",
+                              "simplify (final)", "llvm ir generation", "llvm module passes",
+                              "llvm jit machine code"};
+    for (const char *name : expected) {
+        const CompilePassProfile *pass = find_pass(profile, name);
+        if (!pass) {
+            printf("Compile profile has no entry for %s:\n%s", name, profile.to_text().c_str());
+            return -1;
+        }
+        if (pass->seconds < 0) {
+            printf("Pass %s took negative time\n", name);
+            return -1;
+        }
+    }
+
+    if (find_pass(profile, "bounds_inference")->ir_nodes <= 0) {
+        printf("Lowering passes should report the size of the IR\n");
+        return -1;
+    }
+    if (find_pass(profile, "llvm module passes")->ir_nodes != -1) {
+        printf("LLVM phases should not report a Halide IR size\n");
+        return -1;
+    }
+
+    std::string json = profile.to_json();
+    if (json.find("\"passes\"") == std::string::npos ||
+        json.find("\"bounds_inference\"") == std::string::npos) {
+        printf("Bad JSON profile:\n%s", json.c_str());
+        return -1;
+    }
+
+    // Recompiling for the same target reuses the jit module and
+    // leaves the profile alone.
+    p.compile_jit();
+    if (p.compile_profile().passes.size() != profile.passes.size()) {
+        printf("Reusing the jit module should not change the profile\n");
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -1,5 +1,7 @@
 #include "Halide.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "test/common/halide_test_dirs.h"
 
@@ -27,6 +29,31 @@ void testCompileToOutput(Func j) {
     Internal::assert_file_exists(expected_h);
 }
 
+// Code generation for each target and the runtime runs in parallel;
+// check that their compile profiles are still collected.
+void testCompileProfile(Func j) {
+    std::string fn_object = Internal::get_test_tmp_dir() + "compile_to_multitarget_profiled";
+    std::vector<Target> targets = {
+        Target("host-debug"),
+        Target("host"),
+    };
+    Pipeline p(j);
+    p.set_compile_profiling(true);
+    p.compile_to_multitarget_static_library(fn_object, j.infer_arguments(), targets);
+
+    const char *prefixes[] = {"runtime: ", "wrapper: "};
+    for (const char *prefix : prefixes) {
+        bool found = false;
+        for (const CompilePassProfile &pass : p.compile_profile().passes) {
+            found |= pass.name.compare(0, strlen(prefix), prefix) == 0;
+        }
+        if (!found) {
+            printf("No compile profile entries for %s\n%s", prefix, p.compile_profile().to_text().c_str());
+            exit(-1);
+        }
+    }
+}
+
 int main(int argc, char **argv) {
     Param<float> factor("factor");
     Func f, g, h, j;
@@ -41,6 +68,7 @@ int main(int argc, char **argv) {
     h.compute_root();
 
     testCompileToOutput(j);
+    testCompileProfile(j);
 
     printf("Success!\n");
     return 0;
@@ -0,0 +1,92 @@
+#include "Halide.h"
+#include <stdio.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace Halide;
+using namespace Halide::Internal;
+
+std::atomic<int> failures(0);
+
+// Build and simplify lots of small expressions.
+void churn(int seed) {
+    Expr x = Variable::make(Int(32), "x");
+    for (int round = 0; round < 20; round++) {
+        Expr e = x;
+        int correct = 0;
+        for (int i = 0; i < 200; i++) {
+            int k = (seed * 31 + round * 7 + i) % 13;
+            e = select(x > k, e + k, e + k);
+            correct += k;
+        }
+        Expr s = simplify(e - x);
+        const int64_t *result = as_const_int(s);
+        if (!result || *result != correct) {
+            failures++;
+        }
+    }
+}
+
+// Make a batch of nodes of several sizes on this thread.
+std::vector<Expr> make_batch(int n) {
+    std::vector<Expr> batch;
+    Expr x = Variable::make(Int(32), "x");
+    for (int i = 0; i < n; i++) {
+        batch.push_back(Add::make(x, IntImm::make(Int(32), i)));
+    }
+    return batch;
+}
+
+int main(int argc, char **argv) {
+    // Many threads building and freeing IR at once.
+    {
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 8; t++) {
+            threads.emplace_back(churn, t);
+        }
+        for (std::thread &t : threads) {
+            t.join();
+        }
+        if (failures) {
+            printf("%d expressions simplified incorrectly\n", (int)failures);
+            return -1;
+        }
+    }
+
+    // Nodes allocated on one thread and freed on another. The memory
+    // should come back into use rather than the pool growing every
+    // round.
+    {
+        const int n = 100000;
+        size_t reserved_after_first_round = 0;
+        for (int round = 0; round < 10; round++) {
+            std::vector<Expr> batch;
+            std::thread producer([&]() { batch = make_batch(n); });
+            producer.join();
+
+            for (int i = 0; i < n; i++) {
+                const Add *add = batch[i].as<Add>();
+                const int64_t *b = add ? as_const_int(add->b) : nullptr;
+                if (!b || *b != i) {
+                    printf("Node %d of round %d was corrupted\n", i, round);
+                    return -1;
+                }
+            }
+            batch.clear();
+
+            if (round == 0) {
+                reserved_after_first_round = ir_arena_bytes_reserved();
+            }
+        }
+        size_t reserved = ir_arena_bytes_reserved();
+        if (reserved > 2 * reserved_after_first_round) {
+            printf("The IR node pool grew from %d to %d bytes reusing the same number of nodes\n",
+                   (int)reserved_after_first_round, (int)reserved);
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,174 @@
+#include "Halide.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+#ifndef _WIN32
+#include <dirent.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+using namespace Halide;
+
+#ifndef _WIN32
+int count_cache_entries(const std::string &dir) {
+    int count = 0;
+    DIR *d = opendir(dir.c_str());
+    if (!d) return -1;
+    while (dirent *e = readdir(d)) {
+        std::string name = e->d_name;
+        if (name.size() > 2 && name.substr(name.size() - 2) == ".o") {
+            count++;
+        }
+    }
+    closedir(d);
+    return count;
+}
+
+// Build the same pipeline from scratch, with stable names, so that
+// it lowers to the same IR every time.
+Buffer<int> run_pipeline(int offset) {
+    Func f("cached_f"), g("cached_g");
+    Var x("x"), y("y");
+    Param<int> p("p");
+    f(x, y) = x * y + p;
+    g(x, y) = f(x, y) + f(x + 1, y);
+    f.compute_at(g, y);
+    g.parallel(y);
+    p.set(offset);
+    return g.realize(64, 64);
+}
+
+// Two pipelines that are the same except for the signedness of a
+// parameter, and so print the same.
+template<typename T>
+int run_param_pipeline(T value) {
+    Func f("cached_param_f");
+    Param<T> q("q");
+    f() = cast<int>(q) * 2;
+    q.set(value);
+    Buffer<int> im = f.realize();
+    return im();
+}
+
+void remove_cache_dir(const std::string &dir) {
+    DIR *d = opendir(dir.c_str());
+    if (!d) return;
+    while (dirent *e = readdir(d)) {
+        std::string name = e->d_name;
+        if (name != "." && name != "..") {
+            unlink((dir + "/" + name).c_str());
+        }
+    }
+    closedir(d);
+    rmdir(dir.c_str());
+}
+
+bool check(const Buffer<int> &im, int offset) {
+    for (int y = 0; y < im.height(); y++) {
+        for (int x = 0; x < im.width(); x++) {
+            int correct = (x * y + offset) + ((x + 1) * y + offset);
+            if (im(x, y) != correct) {
+                printf("im(%d, %d) = %d instead of %d\n", x, y, im(x, y), correct);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+#endif
+
+#ifndef _WIN32
+int run_tests(const char *dir) {
+    // The first compilation populates the cache. Names generated
+    // during lowering depend on what the process has compiled before,
+    // so compile in a forked child, which starts from exactly the
+    // same state as this process does below, as a fresh process
+    // would.
+    pid_t child = fork();
+    if (child == 0) {
+        exit(check(run_pipeline(3), 3) ? 0 : 1);
+    }
+    int status = 0;
+    waitpid(child, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        printf("First compilation failed\n");
+        return -1;
+    }
+    int entries = count_cache_entries(dir);
+    if (entries != 1) {
+        printf("Expected one cache entry after the first compilation, found %d\n", entries);
+        return -1;
+    }
+
+    // The second compilation of the same pipeline should reuse the
+    // object, and parameters must still be honored.
+    if (!check(run_pipeline(5), 5)) return -1;
+    entries = count_cache_entries(dir);
+    if (entries != 1) {
+        printf("Expected the cache entry to be reused, found %d entries\n", entries);
+        return -1;
+    }
+
+    // A different pipeline gets its own entry.
+    Func h("cached_h");
+    Var x("x");
+    h(x) = x * 2;
+    Buffer<int> im = h.realize(16);
+    for (int i = 0; i < 16; i++) {
+        if (im(i) != i * 2) {
+            printf("im(%d) = %d instead of %d\n", i, im(i), i * 2);
+            return -1;
+        }
+    }
+    entries = count_cache_entries(dir);
+    if (entries != 2) {
+        printf("Expected a second cache entry, found %d\n", entries);
+        return -1;
+    }
+
+    // Pipelines that differ only in the type of a parameter need
+    // different code (sign vs. zero extension), and so different
+    // entries.
+    int signed_result = run_param_pipeline<int16_t>(-1);
+    int unsigned_result = run_param_pipeline<uint16_t>(65535);
+    if (signed_result != -2 || unsigned_result != 131070) {
+        printf("Got %d and %d instead of -2 and 131070. An object was reused for a\n"
+               "pipeline with a parameter of a different type.\n",
+               signed_result, unsigned_result);
+        return -1;
+    }
+    entries = count_cache_entries(dir);
+    if (entries != 4) {
+        printf("Expected four cache entries, found %d\n", entries);
+        return -1;
+    }
+
+    return 0;
+}
+#endif
+
+int main(int argc, char **argv) {
+#ifdef _WIN32
+    printf("Skipping test because it uses setenv\n");
+    return 0;
+#else
+    char dir_template[] = "/tmp/halide_jit_cache_XXXXXX";
+    const char *dir = mkdtemp(dir_template);
+    if (!dir) {
+        printf("Could not make a temporary directory\n");
+        return -1;
+    }
+    setenv("HL_JIT_CACHE_DIR", dir, 1);
+
+    int result = run_tests(dir);
+    remove_cache_dir(dir);
+    if (result != 0) {
+        return result;
+    }
+
+    printf("Success!\n");
+    return 0;
+#endif
+}
@@ -0,0 +1,69 @@
+#include "Halide.h"
+#include <stdio.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    Buffer<int> input(1024, 64);
+    for (int y = 0; y < input.height(); y++) {
+        for (int x = 0; x < input.width(); x++) {
+            input(x, y) = rand() & 0xfff;
+        }
+    }
+
+    Var x, y;
+
+    {
+        // A stencil wider than the vector along the vectorized
+        // dimension. The misaligned loads should become slices of
+        // aligned vectors carried from one iteration to the next.
+        Func f;
+        f(x, y) = (input(x, y) + input(x + 1, y) + input(x + 2, y) +
+                   input(x + 3, y) + input(x + 4, y) + input(x + 5, y));
+        f.vectorize(x, 4).loop_carry();
+
+        Buffer<int> out = f.realize(input.width() - 8, input.height());
+        for (int y = 0; y < out.height(); y++) {
+            for (int x = 0; x < out.width(); x++) {
+                int correct = 0;
+                for (int i = 0; i <= 5; i++) {
+                    correct += input(x + i, y);
+                }
+                if (out(x, y) != correct) {
+                    printf("out(%d, %d) = %d instead of %d\n", x, y, out(x, y), correct);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    {
+        // A scalar 3x3 stencil, carried along the rows.
+        Func f;
+        f(x, y) = (input(x - 1, y - 1) + input(x, y - 1) + input(x + 1, y - 1) +
+                   input(x - 1, y)     + input(x, y)     + input(x + 1, y) +
+                   input(x - 1, y + 1) + input(x, y + 1) + input(x + 1, y + 1));
+        f.loop_carry();
+
+        Buffer<int> out(input.width() - 2, input.height() - 2);
+        out.set_min(1, 1);
+        f.realize(out);
+        for (int y = out.top(); y <= out.bottom(); y++) {
+            for (int x = out.left(); x <= out.right(); x++) {
+                int correct = 0;
+                for (int dy = -1; dy <= 1; dy++) {
+                    for (int dx = -1; dx <= 1; dx++) {
+                        correct += input(x + dx, y + dy);
+                    }
+                }
+                if (out(x, y) != correct) {
+                    printf("out(%d, %d) = %d instead of %d\n", x, y, out(x, y), correct);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -4,6 +4,11 @@
 #include "Halide.h"
 #include "HalideRuntime.h"
 
+#ifdef __linux__
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
 using namespace Halide;
 
 #ifdef _WIN32
@@ -63,6 +68,31 @@ extern "C" DLLEXPORT int count_calls_staged(int32_t stage, uint8_t val, buffer_t
     return 0;
 }
 
+// Define, compile and run a pipeline with a memoized stage from
+// scratch, as a fresh process would. Returns the number of times the
+// memoized stage was computed.
+int run_fresh_memoized_pipeline() {
+    Param<float> val("fresh_val");
+    val.set(42.0f);
+
+    call_count_with_arg = 0;
+    Func count_calls("fresh_count_calls");
+    count_calls.define_extern("count_calls_with_arg", {cast<uint8_t>(val)}, UInt(8), 2);
+
+    Func f("fresh_f");
+    Var x("x"), y("y");
+    f(x, y) = count_calls(x, y) + cast<uint8_t>(x);
+    count_calls.compute_root().memoize();
+
+    Buffer<uint8_t> out = f.realize(64, 64);
+    for (int32_t i = 0; i < 64; i++) {
+        for (int32_t j = 0; j < 64; j++) {
+            assert(out(i, j) == (uint8_t)(42 + i));
+        }
+    }
+    return call_count_with_arg;
+}
+
 void simple_free(void *user_context, void *ptr) {
     free(ptr);
 }
@@ -550,6 +580,150 @@ int main(int argc, char **argv) {
 
     }
 
+    {
+        // Test the cache counters, and that the cost-aware eviction
+        // policy keeps the cache within its size limit.
+        Param<float> val;
+
+        call_count_with_arg = 0;
+        Func count_calls;
+        count_calls.define_extern("count_calls_with_arg", {cast<uint8_t>(val)}, UInt(8), 2);
+
+        Func f;
+        Var x, y;
+        f(x, y) = count_calls(x, y) + cast<uint8_t>(x);
+        count_calls.compute_root().memoize();
+
+        Internal::JITSharedRuntime::memoization_cache_set_eviction_policy(halide_memoization_evict_cost_aware);
+        Internal::JITSharedRuntime::memoization_cache_set_size(100000);
+
+        halide_memoization_cache_stats_t before;
+        Internal::JITSharedRuntime::memoization_cache_get_stats(&before);
+
+        for (int v = 0; v < 200; v++) {
+            val.set((float)(v % 50));
+            Buffer<uint8_t> out = f.realize(64, 64);
+            assert(out(3, 3) == (uint8_t)((v % 50) + 3));
+        }
+
+        halide_memoization_cache_stats_t after;
+        Internal::JITSharedRuntime::memoization_cache_get_stats(&after);
+
+        uint64_t lookups = (after.hits - before.hits) + (after.misses - before.misses);
+        assert(lookups == 200);
+        assert(after.misses - before.misses == (uint64_t)call_count_with_arg);
+        assert(after.current_size <= after.max_size);
+        assert(after.evictions > before.evictions);
+        fprintf(stderr, "Cache hits %d, misses %d, evictions %d.\n",
+                (int)(after.hits - before.hits), (int)(after.misses - before.misses),
+                (int)(after.evictions - before.evictions));
+
+        // Return cache size and policy to the defaults.
+        Internal::JITSharedRuntime::memoization_cache_set_size(0);
+        Internal::JITSharedRuntime::memoization_cache_set_eviction_policy(halide_memoization_evict_lru);
+    }
+
+    if (get_jit_target_from_environment().os == Target::Linux) {
+        // Test the persistent store: a result evicted from the
+        // in-process cache is found again in the store.
+        const char *store_path = "/tmp/halide_test_memoize_store";
+        remove(store_path);
+
+        Param<float> val;
+
+        call_count_with_arg = 0;
+        Func count_calls;
+        count_calls.define_extern("count_calls_with_arg", {cast<uint8_t>(val)}, UInt(8), 2);
+
+        Func f;
+        Var x, y;
+        f(x, y) = count_calls(x, y) + cast<uint8_t>(x);
+        count_calls.compute_root().memoize();
+
+        int result = Internal::JITSharedRuntime::memoization_cache_set_persistent_store(store_path, 1 << 20);
+        assert(result == 0);
+        // Only one entry fits in memory at a time.
+        Internal::JITSharedRuntime::memoization_cache_set_size(1);
+
+        halide_memoization_cache_stats_t before;
+        Internal::JITSharedRuntime::memoization_cache_get_stats(&before);
+
+        const float vals[] = {23.0f, 24.0f, 23.0f};
+        for (float v : vals) {
+            val.set(v);
+            Buffer<uint8_t> out = f.realize(64, 64);
+            for (int32_t i = 0; i < 64; i++) {
+                for (int32_t j = 0; j < 64; j++) {
+                    assert(out(i, j) == (uint8_t)(v + i));
+                }
+            }
+        }
+
+        halide_memoization_cache_stats_t after;
+        Internal::JITSharedRuntime::memoization_cache_get_stats(&after);
+        assert(call_count_with_arg == 2);
+        assert(after.persistent_hits - before.persistent_hits == 1);
+        // The result read back from the store is a hit, not a store.
+        assert(after.stores - before.stores == 2);
+        assert(after.hits - before.hits == 1);
+
+        Internal::JITSharedRuntime::memoization_cache_set_persistent_store("");
+        Internal::JITSharedRuntime::memoization_cache_set_size(0);
+        remove(store_path);
+    }
+
+#ifdef __linux__
+    if (get_jit_target_from_environment().os == Target::Linux) {
+        // Test that a result stored by one process is found by
+        // another one that compiles the same pipeline. The child
+        // compiles an unrelated memoized pipeline first, so the two
+        // compilations are numbered differently, and the generated
+        // code of each lives at a different address.
+        const char *store_path = "/tmp/halide_test_memoize_store_shared";
+        remove(store_path);
+
+        fflush(stdout);
+        pid_t pid = fork();
+        assert(pid >= 0);
+        if (pid == 0) {
+            Func other;
+            Var x;
+            Func g;
+            g(x) = x;
+            g.compute_root().memoize();
+            other(x) = g(x) + 1;
+            other.realize(8);
+
+            int result = Internal::JITSharedRuntime::memoization_cache_set_persistent_store(store_path, 1 << 20);
+            int calls = run_fresh_memoized_pipeline();
+            Internal::JITSharedRuntime::memoization_cache_set_persistent_store("");
+            _exit(result == 0 && calls == 1 ? 0 : 1);
+        }
+        int status = 0;
+        waitpid(pid, &status, 0);
+        assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+        int result = Internal::JITSharedRuntime::memoization_cache_set_persistent_store(store_path, 1 << 20);
+        assert(result == 0);
+        halide_memoization_cache_stats_t before;
+        Internal::JITSharedRuntime::memoization_cache_get_stats(&before);
+
+        int calls = run_fresh_memoized_pipeline();
+
+        halide_memoization_cache_stats_t after;
+        Internal::JITSharedRuntime::memoization_cache_get_stats(&after);
+        if (calls != 0 || after.persistent_hits - before.persistent_hits != 1) {
+            printf("The result stored by the child process wasn't found by its parent.\n"
+                   "The memoized stage ran %d times, with %d hits in the persistent store.\n",
+                   calls, (int)(after.persistent_hits - before.persistent_hits));
+            return -1;
+        }
+
+        Internal::JITSharedRuntime::memoization_cache_set_persistent_store("");
+        remove(store_path);
+    }
+#endif
+
     {
         // Test out of memory handling.
         Param<float> val;
@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <string>
+#include "Halide.h"
+
+using namespace Halide;
+
+// Override Halide's malloc and free to track how many buffers are
+// live at once.
+
+int mallocs = 0, frees = 0;
+int live = 0, peak_live = 0;
+size_t largest_malloc = 0;
+
+void *my_malloc(void *user_context, size_t x) {
+    mallocs++;
+    if (x > largest_malloc) {
+        largest_malloc = x;
+    }
+    live++;
+    if (live > peak_live) {
+        peak_live = live;
+    }
+    void *orig = malloc(x+32);
+    void *ptr = (void *)((((size_t)orig + 32) >> 5) << 5);
+    ((void **)ptr)[-1] = orig;
+    return ptr;
+}
+
+void my_free(void *user_context, void *ptr) {
+    frees++;
+    live--;
+    free(((void**)ptr)[-1]);
+}
+
+std::string report;
+void my_print(void *, const char *msg) {
+    report += msg;
+}
+
+// Run a chain of four stages computed at root with the profiler on,
+// and return the number of heap allocations and the peak heap usage
+// it reports.
+bool profile_chain(const std::string &name, MemoryType memory_type, int size,
+                   int *allocs, long long *peak) {
+    Var x;
+    Func f, g, h, k, out(name);
+    f(x) = x;
+    g(x) = f(x) * 2;
+    h(x) = g(x) + 3;
+    k(x) = h(x) * h(x);
+    out(x) = k(x) - 1;
+    f.compute_root().store_in(memory_type);
+    g.compute_root().store_in(memory_type);
+    h.compute_root().store_in(memory_type);
+    k.compute_root().store_in(memory_type);
+
+    report.clear();
+    out.set_custom_print(my_print);
+    Target t = get_jit_target_from_environment().with_feature(Target::Profile);
+    out.realize(size, t);
+
+    size_t pos = report.find("heap allocations: ");
+    return (pos != std::string::npos &&
+            sscanf(report.c_str() + pos, "heap allocations: %d  peak heap usage: %lld bytes",
+                   allocs, peak) == 2);
+}
+
+int main(int argc, char **argv) {
+    Var x;
+    const int size = 100000;
+
+    {
+        Func f, g, h, k, out;
+
+        // A chain of stages computed at root. Each stage only needs the
+        // one before it, so once g has been computed, f is dead and h can
+        // use its storage. Then k can use g's.
+        f(x) = x;
+        g(x) = f(x) * 2;
+        h(x) = g(x) + 3;
+        k(x) = h(x) * h(x);
+        out(x) = k(x) - 1;
+        f.compute_root();
+        g.compute_root();
+        h.compute_root();
+        k.compute_root();
+
+        out.set_custom_allocator(my_malloc, my_free);
+
+        Buffer<int> im = out.realize(size);
+
+        for (int x = 0; x < size; x++) {
+            int correct = (x * 2 + 3) * (x * 2 + 3) - 1;
+            if (im(x) != correct) {
+                printf("im(%d) = %d instead of %d\n", x, im(x), correct);
+                return -1;
+            }
+        }
+
+        if (mallocs != 2 || frees != 2 || peak_live != 2) {
+            printf("There were supposed to be 2 heap allocations live at once.\n"
+                   "Instead there were %d mallocs, %d frees, and %d live at once.\n",
+                   mallocs, frees, peak_live);
+            return -1;
+        }
+    }
+
+    {
+        // A wide allocation placed in the storage of a narrow one. The
+        // storage must hold all of h, plus the one element of padding
+        // past the end that a vector load of h may touch.
+        mallocs = frees = live = peak_live = 0;
+        largest_malloc = 0;
+
+        Func f, g, h, out;
+        f(x) = cast<uint8_t>(x);
+        g(x) = f(x) + 1;
+        h(x) = cast<int>(g(x)) * 3;
+        out(x) = h(x) + h(x + 1);
+        f.compute_root().vectorize(x, 16);
+        g.compute_root().vectorize(x, 16);
+        h.compute_root().vectorize(x, 4);
+        out.vectorize(x, 4);
+
+        out.set_custom_allocator(my_malloc, my_free);
+
+        Buffer<int> im = out.realize(size);
+
+        for (int x = 0; x < size; x++) {
+            int correct = (uint8_t)(x + 1) * 3 + (uint8_t)(x + 2) * 3;
+            if (im(x) != correct) {
+                printf("im(%d) = %d instead of %d\n", x, im(x), correct);
+                return -1;
+            }
+        }
+
+        size_t h_bytes = (size + 1) * sizeof(int);
+        if (mallocs != 2 || largest_malloc < h_bytes + sizeof(int)) {
+            printf("h was supposed to be placed in the storage of f, with room for\n"
+                   "one int of padding. There were %d mallocs, the largest of %d bytes.\n",
+                   mallocs, (int)largest_malloc);
+            return -1;
+        }
+    }
+
+    {
+        // The profiler should count shared storage once, at its full
+        // size. Compare against the same chain taken from the scratch
+        // arena, which plan_memory leaves alone, so each stage gets a
+        // buffer of its own.
+        int shared_allocs = 0, unshared_allocs = 0;
+        long long shared_peak = 0, unshared_peak = 0;
+        if (!profile_chain("planned_chain", MemoryType::Auto, size, &shared_allocs, &shared_peak) ||
+            !profile_chain("unplanned_chain", MemoryType::Arena, size, &unshared_allocs, &unshared_peak)) {
+            printf("Couldn't find the heap usage in the profiler's report:\n%s", report.c_str());
+            return -1;
+        }
+
+        // Either way, two stages' worth of buffers are live at
+        // once. Sharing may add a little padding to the storage.
+        long long two_buffers = 2LL * size * sizeof(int);
+        if (unshared_allocs != 4 || unshared_peak != two_buffers) {
+            printf("Without sharing, expected 4 allocations and a peak of %lld bytes.\n"
+                   "Instead there were %d allocations and a peak of %lld bytes.\n",
+                   two_buffers, unshared_allocs, unshared_peak);
+            return -1;
+        }
+        if (shared_allocs != 2 ||
+            shared_peak < two_buffers ||
+            shared_peak > unshared_peak + 2 * 64) {
+            printf("With sharing, expected 2 allocations and a peak of about %lld bytes.\n"
+                   "Instead there were %d allocations and a peak of %lld bytes.\n",
+                   unshared_peak, shared_allocs, shared_peak);
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -29,6 +29,32 @@ int main(int argc, char **argv) {
         }
     }
 
+    // Parallelize over a batch of images, and within each image over
+    // tiles of rows, with a producer that is itself parallel computed
+    // per image. Inner jobs are pushed while outer tasks are running.
+    {
+        Func producer, consumer;
+        Var b;
+        producer(x, y, b) = x + y * 3 + b * 7;
+        consumer(x, y, b) = producer(x, y, b) + producer(x + 1, y, b);
+        consumer.parallel(b).parallel(y, 8);
+        producer.compute_at(consumer, b).parallel(y, 4);
+
+        Buffer<int> out = consumer.realize(32, 64, 6);
+        for (int b = 0; b < 6; b++) {
+            for (int y = 0; y < 64; y++) {
+                for (int x = 0; x < 32; x++) {
+                    int correct = 2 * (x + y * 3 + b * 7) + 1;
+                    if (out(x, y, b) != correct) {
+                        printf("out(%d, %d, %d) = %d instead of %d\n",
+                               x, y, b, out(x, y, b), correct);
+                        return -1;
+                    }
+                }
+            }
+        }
+    }
+
     printf("Success!\n");
     return 0;
 }
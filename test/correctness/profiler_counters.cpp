@@ -0,0 +1,41 @@
+#include "Halide.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+using namespace Halide;
+
+std::string report;
+void my_print(void *, const char *msg) {
+    report += msg;
+}
+
+int main(int argc, char **argv) {
+#ifdef _WIN32
+    printf("Skipping test because it uses setenv\n");
+    return 0;
+#else
+    setenv("HL_PROFILER_COUNTERS", "1", 1);
+
+    Func producer("counters_producer"), consumer("counters_consumer");
+    Var x, y;
+    producer(x, y) = sqrt(cast<float>(x * y));
+    consumer(x, y) = producer(x, y) + producer(x + 1, y);
+    producer.compute_at(consumer, y);
+    consumer.parallel(y);
+
+    consumer.set_custom_print(&my_print);
+    Target t = get_jit_target_from_environment().with_feature(Target::Profile);
+    consumer.realize(1024, 256, t);
+
+    if (report.find("Hardware counters are unavailable") != std::string::npos) {
+        printf("Hardware counters are not available here:\n%s", report.c_str());
+    } else if (report.find("ipc: ") == std::string::npos) {
+        printf("Report does not contain hardware counters:\n%s", report.c_str());
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+#endif
+}
@@ -0,0 +1,60 @@
+#include "Halide.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+#ifdef _WIN32
+    printf("Skipping test because it uses setenv\n");
+    return 0;
+#else
+    const char *path = "/tmp/halide_test_profiler_timeline.json";
+    remove(path);
+    setenv("HL_PROFILER_TIMELINE", path, 1);
+
+    Func producer("timeline_producer"), consumer("timeline_consumer");
+    Var x, y;
+    producer(x, y) = sqrt(cast<float>(x * y));
+    consumer(x, y) = producer(x, y) + producer(x + 1, y);
+    producer.compute_at(consumer, y);
+    consumer.parallel(y);
+
+    Target t = get_jit_target_from_environment().with_feature(Target::Profile);
+    consumer.realize(1024, 256, t);
+
+    // Each realization reports (and resets) the profiler. The second
+    // one must add to the timeline rather than replace it.
+    Func second("timeline_second");
+    second(x, y) = sqrt(cast<float>(x + y));
+    second.parallel(y);
+    second.realize(1024, 256, t);
+
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        printf("Profiler did not write a timeline to %s\n", path);
+        return -1;
+    }
+    std::string contents;
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        contents.append(buf, n);
+    }
+    fclose(f);
+
+    const char *expected[] = {"\"traceEvents\"", "\"busy\"",
+                              "\"timeline_producer\"", "\"timeline_consumer\"",
+                              "\"timeline_second\""};
+    for (const char *e : expected) {
+        if (contents.find(e) == std::string::npos) {
+            printf("Timeline does not contain %s:\n%s\n", e, contents.c_str());
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+#endif
+}
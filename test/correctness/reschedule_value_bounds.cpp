@@ -0,0 +1,49 @@
+#include "Halide.h"
+#include <stdio.h>
+
+using namespace Halide;
+
+// Recompiling after a schedule change reuses the bounds computed on
+// the values of each Func. Check that the results stay correct as the
+// schedule changes, including changes that add specializations.
+int check(Buffer<int> result, Buffer<uint8_t> input) {
+    for (int x = 0; x < result.width(); x++) {
+        int correct = input(x) * 3 + 1;
+        if (result(x) != correct) {
+            printf("result(%d) = %d instead of %d\n", x, result(x), correct);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    Buffer<uint8_t> input(1024);
+    input.for_each_element([&](int x) { input(x) = (x * 37) & 0xff; });
+
+    Func lut("lut"), idx("idx"), g("g");
+    Var x("x");
+    Param<bool> p;
+
+    // The region of lut required is given by the bounds on the value of idx.
+    lut(x) = x * 3 + 1;
+    idx(x) = input(x);
+    g(x) = lut(idx(x));
+
+    lut.compute_root();
+    p.set(true);
+    if (check(g.realize(1024), input) != 0) return -1;
+
+    lut.vectorize(x, 8);
+    idx.compute_root();
+    if (check(g.realize(1024), input) != 0) return -1;
+
+    idx.specialize(p).vectorize(x, 16);
+    if (check(g.realize(1024), input) != 0) return -1;
+
+    p.set(false);
+    if (check(g.realize(1024), input) != 0) return -1;
+
+    printf("Success!\n");
+    return 0;
+}
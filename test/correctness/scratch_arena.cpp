@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include "Halide.h"
+
+using namespace Halide;
+
+int mallocs = 0;
+
+void *my_malloc(void *user_context, size_t x) {
+    mallocs++;
+    void *orig = malloc(x+32);
+    void *ptr = (void *)((((size_t)orig + 32) >> 5) << 5);
+    ((void **)ptr)[-1] = orig;
+    return ptr;
+}
+
+void my_free(void *user_context, void *ptr) {
+    free(((void**)ptr)[-1]);
+}
+
+int main(int argc, char **argv) {
+    Var x, y;
+
+    {
+        Func f, g, out("scratch_arena_out");
+
+        f(x, y) = x + y;
+        g(x, y) = f(x, y) * 2 + f(x + 1, y);
+        out(x, y) = g(x, y) + g(x, y + 1);
+        f.compute_root();
+        g.compute_root().parallel(y);
+
+        out.set_custom_allocator(my_malloc, my_free);
+
+        Target t = get_jit_target_from_environment().with_feature(Target::ScratchArena);
+        out.compile_jit(t);
+
+        for (int i = 0; i < 3; i++) {
+            mallocs = 0;
+            Buffer<int> im = out.realize(1024, 512, t);
+
+            for (int y = 0; y < im.height(); y++) {
+                for (int x = 0; x < im.width(); x++) {
+                    int correct = (x + y) * 2 + (x + y + 1) + (x + y + 1) * 2 + (x + y + 2);
+                    if (im(x, y) != correct) {
+                        printf("im(%d, %d) = %d instead of %d\n", x, y, im(x, y), correct);
+                        return -1;
+                    }
+                }
+            }
+
+            // The first call allocates each buffer with the custom
+            // allocator, before the arena grows to hold them. Later
+            // calls reuse the arena.
+            if (i == 0 && mallocs == 0) {
+                printf("The first call should have allocated memory\n");
+                return -1;
+            } else if (i > 0 && mallocs != 0) {
+                printf("Call %d allocated memory %d times instead of reusing the arena\n", i, mallocs);
+                return -1;
+            }
+        }
+    }
+
+    {
+        // A heap buffer allocated and freed once per row, inside the
+        // lifetime of a buffer computed at root. The arena only needs
+        // room for the root buffer and one row, not for every row.
+        Func f, g, out("scratch_arena_rows");
+        f(x, y) = x * y;
+        g(x, y) = f(x, y) + f(x + 1, y);
+        out(x, y) = g(x, y) * 2;
+        f.compute_root();
+        g.compute_at(out, y).store_in(MemoryType::Heap);
+
+        Target t = get_jit_target_from_environment().with_feature(Target::ScratchArena);
+        const int width = 1024, height = 256;
+        Buffer<int> im = out.realize(width, height, t);
+
+        for (int y = 0; y < im.height(); y++) {
+            for (int x = 0; x < im.width(); x++) {
+                int correct = (x * y + (x + 1) * y) * 2;
+                if (im(x, y) != correct) {
+                    printf("im(%d, %d) = %d instead of %d\n", x, y, im(x, y), correct);
+                    return -1;
+                }
+            }
+        }
+
+        uint64_t f_bytes = (width + 1) * height * sizeof(int);
+        uint64_t row_bytes = width * sizeof(int);
+        uint64_t required = Internal::JITSharedRuntime::scratch_arena_required_size("scratch_arena_rows");
+        if (required < f_bytes + row_bytes || required > f_bytes + 4 * row_bytes) {
+            printf("The arena was supposed to need room for f and one row of g (%d bytes).\n"
+                   "Instead it needs %d bytes.\n",
+                   (int)(f_bytes + row_bytes), (int)required);
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -324,6 +324,41 @@ int main(int argc, char **argv) {
         }
     }
 
+    {
+        custom_malloc_size = 0;
+        Func f, g;
+        Var yo, yi;
+
+        f(x, y) = x * y;
+        g(x, y) = f(x, y - 1) + f(x, y + 1);
+
+        // Parallelize over strips of rows, and slide f within each
+        // strip. The strips don't share any values of f, so each
+        // thread should get its own folded copy of it.
+        g.split(y, yo, yi, 16).parallel(yo);
+        f.store_root().compute_at(g, yi);
+
+        g.set_custom_allocator(my_malloc, my_free);
+
+        Buffer<int> im = g.realize(100, 1000);
+
+        size_t expected_size = 100*4*sizeof(int) + sizeof(int);
+        if (custom_malloc_size == 0 || custom_malloc_size != expected_size) {
+            printf("Scratch space allocated was %d instead of %d\n", (int)custom_malloc_size, (int)expected_size);
+            return -1;
+        }
+
+        for (int y = 0; y < im.height(); y++) {
+            for (int x = 0; x < im.width(); x++) {
+                int correct = x * (y - 1) + x * (y + 1);
+                if (im(x, y) != correct) {
+                    printf("im(%d, %d) = %d instead of %d\n", x, y, im(x, y), correct);
+                    return -1;
+                }
+            }
+        }
+    }
+
     printf("Success!\n");
     return 0;
 }
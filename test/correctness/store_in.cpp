@@ -0,0 +1,110 @@
+#include <stdio.h>
+#include "Halide.h"
+
+using namespace Halide;
+
+int mallocs = 0;
+
+void *my_malloc(void *user_context, size_t x) {
+    mallocs++;
+    void *orig = malloc(x+32);
+    void *ptr = (void *)((((size_t)orig + 32) >> 5) << 5);
+    ((void **)ptr)[-1] = orig;
+    return ptr;
+}
+
+void my_free(void *user_context, void *ptr) {
+    free(((void**)ptr)[-1]);
+}
+
+int check(const Buffer<int> &im, int offset) {
+    for (int x = 0; x < im.width(); x++) {
+        int correct = x * 2 + 1 + offset;
+        if (im(x) != correct) {
+            printf("im(%d) = %d instead of %d\n", x, im(x), correct);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    Var x;
+
+    {
+        // A small buffer that would otherwise go on the stack.
+        Func f, g;
+        f(x) = x;
+        g(x) = f(x) + f(x + 1);
+        f.compute_root().store_in(MemoryType::Heap);
+
+        g.set_custom_allocator(my_malloc, my_free);
+        mallocs = 0;
+        Buffer<int> im = g.realize(16);
+        if (check(im, 0)) return -1;
+        if (mallocs != 1) {
+            printf("f was supposed to be allocated on the heap. There were %d mallocs.\n", mallocs);
+            return -1;
+        }
+    }
+
+    {
+        // A buffer of constant size that would otherwise go on the heap.
+        Func f, g;
+        f(x) = x;
+        g(x) = f(x) + f(x + 1);
+        f.compute_root().bound_extent(x, 20000).store_in(MemoryType::Stack);
+        g.bound(x, 0, 16000);
+
+        g.set_custom_allocator(my_malloc, my_free);
+        mallocs = 0;
+        Buffer<int> im = g.realize(16000);
+        if (check(im, 0)) return -1;
+        if (mallocs != 0) {
+            printf("f was supposed to be allocated on the stack. There were %d mallocs.\n", mallocs);
+            return -1;
+        }
+    }
+
+    {
+        // A buffer held in registers. Every access to it must be at a
+        // constant index, so the loop over it is unrolled.
+        Func f, g;
+        Var c;
+        f(x, c) = x + c;
+        g(x) = f(x, 0) + f(x, 1) + 7;
+        f.compute_at(g, x).bound(c, 0, 2).unroll(c).store_in(MemoryType::Register);
+
+        Buffer<int> im = g.realize(64);
+        if (check(im, 7)) return -1;
+    }
+
+    {
+        // A large buffer taken from the pipeline's scratch arena,
+        // without Target::ScratchArena. Only the first call should
+        // allocate memory.
+        Func f, g("store_in_arena");
+        f(x) = x;
+        g(x) = f(x) + f(x + 1);
+        f.compute_root().store_in(MemoryType::Arena);
+
+        g.set_custom_allocator(my_malloc, my_free);
+        g.compile_jit();
+        for (int i = 0; i < 3; i++) {
+            mallocs = 0;
+            Buffer<int> im = g.realize(100000);
+            if (check(im, 0)) return -1;
+            if (i == 0 && mallocs == 0) {
+                printf("The first call should have allocated f.\n");
+                return -1;
+            } else if (i > 0 && mallocs != 0) {
+                printf("f was supposed to be taken from the arena on call %d. There were %d mallocs.\n",
+                       i, mallocs);
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
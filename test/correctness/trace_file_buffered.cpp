@@ -0,0 +1,75 @@
+#include "Halide.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+#ifdef _WIN32
+    printf("Skipping test because it uses setenv\n");
+    return 0;
+#else
+    const char *path = "/tmp/halide_test_trace_file_buffered.bin";
+    remove(path);
+    setenv("HL_TRACE_FILE", path, 1);
+
+    // Enough packets from enough threads to fill several trace buffers.
+    const int W = 256, H = 512;
+    Func f("f");
+    Var x, y;
+    f(x, y) = x + y;
+    f.trace_stores();
+    f.parallel(y);
+    f.realize(W, H);
+
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        printf("No trace file was written to %s\n", path);
+        return -1;
+    }
+    std::vector<uint8_t> data;
+    uint8_t buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), file)) > 0) {
+        data.insert(data.end(), buf, buf + n);
+    }
+    fclose(file);
+
+    std::vector<int> seen(W * H, 0);
+    size_t pos = 0;
+    int stores = 0;
+    while (pos < data.size()) {
+        const halide_trace_packet_t *p = (const halide_trace_packet_t *)(&data[pos]);
+        if (p->size % 4 != 0 || pos + p->size > data.size()) {
+            printf("Malformed trace packet at offset %d\n", (int)pos);
+            return -1;
+        }
+        if (p->event == halide_trace_store) {
+            const int *c = p->coordinates();
+            int value = *(const int *)p->value();
+            if (c[0] + c[1] != value) {
+                printf("Bad value in trace: f(%d, %d) = %d\n", c[0], c[1], value);
+                return -1;
+            }
+            seen[c[1] * W + c[0]]++;
+            stores++;
+        }
+        pos += p->size;
+    }
+
+    if (stores != W * H) {
+        printf("Expected %d stores in the trace, but found %d\n", W * H, stores);
+        return -1;
+    }
+    for (int i = 0; i < W * H; i++) {
+        if (seen[i] != 1) {
+            printf("Store %d appears %d times in the trace\n", i, seen[i]);
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+#endif
+}
@@ -0,0 +1,111 @@
+#include "Halide.h"
+#include <stdio.h>
+
+using namespace Halide;
+
+int sampled_stores = 0;
+int region_stores = 0, region_stores_outside = 0;
+int summary_events = 0, summary_min = 1000, summary_max = -1000, summary_stores = 0;
+
+int my_trace(void *user_context, const halide_trace_event_t *e) {
+    std::string name = e->func;
+    if (name == "sampled") {
+        if (e->event == halide_trace_store) {
+            sampled_stores++;
+        }
+    } else if (name == "region") {
+        if (e->event == halide_trace_store) {
+            // Vector stores are traced if their first lane is inside.
+            int x = e->coordinates[0];
+            int y = e->coordinates[e->type.lanes];
+            if (x < 10 || x >= 15 || y < 20 || y >= 23) {
+                region_stores_outside++;
+            }
+            region_stores++;
+        }
+    } else if (name == "summary") {
+        if (e->event == halide_trace_summary) {
+            if (e->type.lanes != 2 || e->dimensions != 4) {
+                printf("Bad summary event: %d lanes, %d dimensions\n", e->type.lanes, e->dimensions);
+                exit(-1);
+            }
+            const int *v = (const int *)e->value;
+            summary_min = std::min(summary_min, v[0]);
+            summary_max = std::max(summary_max, v[1]);
+            summary_events++;
+        } else if (e->event == halide_trace_store || e->event == halide_trace_load) {
+            summary_stores++;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    Var x, y;
+
+    {
+        Func sampled("sampled");
+        sampled(x, y) = x + y;
+        sampled.trace_stores().trace_sampled(4);
+        sampled.set_custom_trace(&my_trace);
+        sampled.realize(100, 100);
+
+        // Roughly a quarter of the stores should be traced.
+        if (sampled_stores < 1500 || sampled_stores > 3500) {
+            printf("Traced %d of 10000 stores when sampling one in four\n", sampled_stores);
+            return -1;
+        }
+    }
+
+    {
+        Func region("region");
+        region(x, y) = x * y;
+        region.trace_stores().trace_region({{10, 5}, {20, 3}});
+        region.set_custom_trace(&my_trace);
+        region.realize(100, 100);
+
+        if (region_stores != 15 || region_stores_outside != 0) {
+            printf("Traced %d stores (%d outside the region) instead of 15\n",
+                   region_stores, region_stores_outside);
+            return -1;
+        }
+
+        region_stores = 0;
+        Func vec_region("region");
+        vec_region(x, y) = x * y;
+        vec_region.vectorize(x, 4);
+        vec_region.trace_stores().trace_region({{10, 5}, {20, 3}});
+        vec_region.set_custom_trace(&my_trace);
+        vec_region.realize(100, 100);
+
+        if (region_stores == 0 || region_stores_outside != 0) {
+            printf("Traced %d vector stores (%d outside the region)\n",
+                   region_stores, region_stores_outside);
+            return -1;
+        }
+    }
+
+    {
+        Func summary("summary");
+        summary(x, y) = x + 2 * y;
+        summary.vectorize(x, 8).parallel(y);
+        summary.trace_summaries();
+        summary.set_custom_trace(&my_trace);
+        summary.realize(64, 32);
+
+        // One summary for the production, combining the parallel
+        // tasks.
+        if (summary_events != 1 || summary_stores != 0) {
+            printf("Got %d summary events and %d stores\n", summary_events, summary_stores);
+            return -1;
+        }
+        if (summary_min != 0 || summary_max != 63 + 2 * 31) {
+            printf("Summary range was [%d, %d] instead of [0, %d]\n",
+                   summary_min, summary_max, 63 + 2 * 31);
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include "Halide.h"
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    const int size = 1000;
+
+    Buffer<int16_t> a(size, 4), b(size, 4);
+    Buffer<uint8_t> c(size);
+    Buffer<float> d(size);
+    for (int y = 0; y < 4; y++) {
+        for (int x = 0; x < size; x++) {
+            a(x, y) = (int16_t)((x * 17 + y * 3) % 201 - 100);
+            b(x, y) = (int16_t)((x * 5 + y * 11) % 131 - 65);
+        }
+    }
+    for (int x = 0; x < size; x++) {
+        c(x) = (uint8_t)(x * 7 + 3);
+        // Quarters, so that the sum is exact whatever order the lanes
+        // are added in.
+        d(x) = (x % 17) * 0.25f - 2.0f;
+    }
+
+    Var y;
+
+    {
+        // A dot product of each row of a and b, vectorized over the
+        // reduction domain without rfactor. The extent of the RDom
+        // isn't a multiple of the vector width.
+        RDom r(0, size - 3);
+        Func dot;
+        dot(y) = 0;
+        dot(y) += cast<int>(a(r, y)) * b(r, y);
+        dot.update().vectorize(r, 8);
+
+        Buffer<int> result = dot.realize(4);
+        for (int y = 0; y < 4; y++) {
+            int correct = 0;
+            for (int x = 0; x < size - 3; x++) {
+                correct += a(x, y) * b(x, y);
+            }
+            if (result(y) != correct) {
+                printf("dot(%d) = %d instead of %d\n", y, result(y), correct);
+                return -1;
+            }
+        }
+    }
+
+    {
+        // A sum of bytes, vectorized over the inner part of the RDom
+        // and accumulated over the outer part.
+        RDom r(0, size);
+        Func sum;
+        sum() = cast<uint32_t>(0);
+        sum() += cast<uint32_t>(c(r));
+        RVar ro, ri;
+        sum.update().split(r, ro, ri, 16).vectorize(ri);
+
+        Buffer<uint32_t> result = sum.realize();
+        uint32_t correct = 0;
+        for (int x = 0; x < size; x++) {
+            correct += c(x);
+        }
+        if (result() != correct) {
+            printf("sum = %u instead of %u\n", result(), correct);
+            return -1;
+        }
+    }
+
+    {
+        // A maximum, starting from a value the reduction may not
+        // exceed.
+        RDom r(0, size);
+        Func biggest;
+        biggest(y) = cast<int16_t>(y * 10);
+        biggest(y) = max(biggest(y), a(r, y));
+        biggest.update().vectorize(r, 8);
+
+        Buffer<int16_t> result = biggest.realize(4);
+        for (int y = 0; y < 4; y++) {
+            int16_t correct = (int16_t)(y * 10);
+            for (int x = 0; x < size; x++) {
+                correct = std::max(correct, a(x, y));
+            }
+            if (result(y) != correct) {
+                printf("biggest(%d) = %d instead of %d\n", y, result(y), correct);
+                return -1;
+            }
+        }
+    }
+
+    {
+        // A float sum, which prove_associativity treats as
+        // associative.
+        RDom r(0, size);
+        Func total;
+        total() = 0.0f;
+        total() += d(r);
+        total.update().vectorize(r, 8);
+
+        Buffer<float> result = total.realize();
+        float correct = 0.0f;
+        for (int x = 0; x < size; x++) {
+            correct += d(x);
+        }
+        if (result() != correct) {
+            printf("total = %f instead of %f\n", result(), correct);
+            return -1;
+        }
+    }
+
+    {
+        // An update that isn't associative, so each lane must be
+        // applied to the element in turn. The read-modify-write is
+        // scalarized rather than rewritten with partial results.
+        RDom r(0, size);
+        Func horner;
+        horner() = cast<uint32_t>(1);
+        horner() = horner() * 3 + cast<uint32_t>(c(r));
+        horner.update().allow_race_conditions().vectorize(r, 8);
+
+        Buffer<uint32_t> result = horner.realize();
+        uint32_t correct = 1;
+        for (int x = 0; x < size; x++) {
+            correct = correct * 3 + c(x);
+        }
+        if (result() != correct) {
+            printf("horner = %u instead of %u\n", result(), correct);
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,20 @@
+#include "Halide.h"
+#include <stdio.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    Func f("f");
+    Var x("x");
+
+    f(x) = x;
+
+    // The storage of an output is provided by the caller, so this
+    // makes no sense.
+    f.store_in(MemoryType::Heap);
+
+    f.realize(10);
+
+    printf("I should not have reached here\n");
+    return 0;
+}
@@ -0,0 +1,90 @@
+#include "Halide.h"
+#include <stdio.h>
+
+#include "benchmark.h"
+#include "tools/halide_autotune.h"
+
+using namespace Halide;
+using namespace Halide::Tools;
+
+int main(int argc, char **argv) {
+    const int W = 1536, H = 1024;
+    Buffer<uint16_t> input(W + 2, H + 2);
+    input.for_each_element([&](int x, int y) { input(x, y) = (x * 7 + y * 13) & 0xfff; });
+    Buffer<uint16_t> output(W, H);
+
+    ScheduleSpace space;
+    space.add_int("tile_x", {16, 64, 256})
+         .add_int("tile_y", {8, 32})
+         .add_choice("blur_x", {"inline", "tile", "root"});
+
+    auto make = [&](const ScheduleConfig &c) {
+        Func blur_x("blur_x"), blur_y("blur_y");
+        Var x("x"), y("y"), xi("xi"), yi("yi");
+        blur_x(x, y) = (input(x, y + 1) + input(x + 1, y + 1) + input(x + 2, y + 1)) / 3;
+        blur_y(x, y) = (blur_x(x, y - 1) + blur_x(x, y) + blur_x(x, y + 1)) / 3;
+
+        blur_y.tile(x, y, xi, yi, c.get_int("tile_x"), c.get_int("tile_y"))
+            .vectorize(xi, 8).parallel(y);
+        if (c.get_choice("blur_x") == "tile") {
+            blur_x.compute_at(blur_y, x).vectorize(x, 8);
+        } else if (c.get_choice("blur_x") == "root") {
+            blur_x.compute_root().vectorize(x, 8).parallel(y);
+        }
+        return Pipeline(blur_y);
+    };
+    auto run = [&](Pipeline p) { p.realize(output); };
+
+    AutotuneOptions options;
+    options.timer = [](const std::function<void()> &op) { return benchmark(3, 3, op); };
+
+    options.strategy = AutotuneOptions::Strategy::Exhaustive;
+    AutotuneResult exhaustive = autotune(space, make, run, options);
+    if (exhaustive.trials.size() != 18) {
+        printf("Exhaustive search tried %d candidates instead of 18\n", (int)exhaustive.trials.size());
+        return -1;
+    }
+
+    options.strategy = AutotuneOptions::Strategy::HillClimb;
+    AutotuneResult climb = autotune(space, make, run, options);
+
+    options.strategy = AutotuneOptions::Strategy::Random;
+    options.max_trials = 5;
+    AutotuneResult random = autotune(space, make, run, options);
+    if (random.trials.size() != 5) {
+        printf("Random search tried %d candidates instead of 5\n", (int)random.trials.size());
+        return -1;
+    }
+
+    printf("Best of %d: %f ms\n%s", (int)exhaustive.trials.size(),
+           exhaustive.best_seconds * 1000, exhaustive.best.serialize().c_str());
+    printf("Hill climbing found %f ms in %d trials\n",
+           climb.best_seconds * 1000, (int)climb.trials.size());
+
+    // The best schedule round-trips through its serialized form.
+    ScheduleConfig parsed;
+    if (!ScheduleConfig::parse("# tuned\n" + exhaustive.best.serialize(), &parsed) ||
+        parsed.serialize() != exhaustive.best.serialize()) {
+        printf("Schedule config did not round-trip\n");
+        return -1;
+    }
+
+    // Check the tuned schedule computes the right thing.
+    make(parsed).realize(output);
+    for (int y = 0; y < H; y++) {
+        for (int x = 0; x < W; x++) {
+            int bx[3];
+            for (int dy = -1; dy <= 1; dy++) {
+                bx[dy + 1] = (input(x, y + dy + 1) + input(x + 1, y + dy + 1) + input(x + 2, y + dy + 1)) / 3;
+            }
+            uint16_t correct = (bx[0] + bx[1] + bx[2]) / 3;
+            if (output(x, y) != correct) {
+                printf("output(%d, %d) = %d instead of %d\n", x, y, output(x, y), correct);
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,444 @@
+#ifndef HALIDE_AUTOTUNE_H
+#define HALIDE_AUTOTUNE_H
+
+//---------------------------------------------------------------------------
+// An empirical autotuner for Halide schedules. Describe the schedule
+// choices worth exploring as a ScheduleSpace of named knobs, and
+// write a function that builds the pipeline with the schedule a
+// ScheduleConfig selects:
+//
+//   ScheduleSpace space;
+//   space.add_int("blur_y.tile_x", {32, 64, 128, 256})
+//        .add_int("blur_y.vector", {4, 8, 16})
+//        .add_choice("blur_x.compute_at", {"root", "tile", "inline"});
+//
+//   auto make = [&](const ScheduleConfig &c) {
+//       Func blur_x, blur_y;
+//       ... define the algorithm ...
+//       blur_y.tile(x, y, xo, yo, xi, yi, c.get_int("blur_y.tile_x"), 32)
+//             .vectorize(xi, c.get_int("blur_y.vector"));
+//       if (c.get_choice("blur_x.compute_at") == "tile") ...
+//       return Pipeline(blur_y);
+//   };
+//   auto run = [&](Pipeline p) { p.realize(output); };
+//
+//   AutotuneResult result = autotune(space, make, run);
+//   result.best.save("blur.schedule");
+//
+// Each candidate is jit-compiled and timed, keeping the fastest. The
+// saved config can be loaded with ScheduleConfig::load in a Generator,
+// so that the AOT-compiled pipeline gets the same schedule by calling
+// the same scheduling code.
+//---------------------------------------------------------------------------
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <map>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Halide.h"
+
+namespace Halide {
+namespace Tools {
+
+// A schedule choice, and the values it may take.
+struct Knob {
+    std::string name;
+    std::vector<std::string> options;
+};
+
+// The set of schedules to search.
+class ScheduleSpace {
+    std::vector<Knob> knobs_;
+
+public:
+    // A numeric knob, such as a split factor, vector width, unroll
+    // factor or parallel grain size.
+    ScheduleSpace &add_int(const std::string &name, const std::vector<int> &values) {
+        Knob k;
+        k.name = name;
+        for (int v : values) {
+            k.options.push_back(std::to_string(v));
+        }
+        return add(k);
+    }
+
+    // A choice between named alternatives, such as where to compute
+    // a Func.
+    ScheduleSpace &add_choice(const std::string &name, const std::vector<std::string> &options) {
+        Knob k;
+        k.name = name;
+        k.options = options;
+        return add(k);
+    }
+
+    const std::vector<Knob> &knobs() const {
+        return knobs_;
+    }
+
+    // The number of points in the space, saturating at the largest
+    // double.
+    double size() const {
+        double s = 1;
+        for (const Knob &k : knobs_) {
+            s *= k.options.size();
+        }
+        return s;
+    }
+
+private:
+    ScheduleSpace &add(const Knob &k) {
+        if (k.options.empty()) {
+            fprintf(stderr, "Knob %s has no options\n", k.name.c_str());
+            abort();
+        }
+        for (const Knob &other : knobs_) {
+            if (other.name == k.name) {
+                fprintf(stderr, "Knob %s added twice\n", k.name.c_str());
+                abort();
+            }
+        }
+        knobs_.push_back(k);
+        return *this;
+    }
+};
+
+// A point in a ScheduleSpace: the value of each knob.
+class ScheduleConfig {
+    std::map<std::string, std::string> values_;
+
+    const std::string &lookup(const std::string &name) const {
+        auto it = values_.find(name);
+        if (it == values_.end()) {
+            fprintf(stderr, "Schedule config has no knob named %s\n", name.c_str());
+            abort();
+        }
+        return it->second;
+    }
+
+public:
+    void set(const std::string &name, const std::string &value) {
+        values_[name] = value;
+    }
+
+    bool has(const std::string &name) const {
+        return values_.count(name) != 0;
+    }
+
+    int get_int(const std::string &name) const {
+        return std::atoi(lookup(name).c_str());
+    }
+
+    const std::string &get_choice(const std::string &name) const {
+        return lookup(name);
+    }
+
+    const std::map<std::string, std::string> &values() const {
+        return values_;
+    }
+
+    // One "name = value" line per knob.
+    std::string serialize() const {
+        std::ostringstream o;
+        for (const auto &v : values_) {
+            o << v.first << " = " << v.second << "\n";
+        }
+        return o.str();
+    }
+
+    // Parse the output of serialize. Blank lines and lines starting
+    // with '#' are ignored.
+    static bool parse(const std::string &text, ScheduleConfig *result) {
+        ScheduleConfig config;
+        std::istringstream in(text);
+        std::string line;
+        while (std::getline(in, line)) {
+            size_t start = line.find_first_not_of(" \t\r");
+            if (start == std::string::npos || line[start] == '#') {
+                continue;
+            }
+            size_t eq = line.find('=');
+            if (eq == std::string::npos) {
+                return false;
+            }
+            auto trim = [](const std::string &s) {
+                size_t b = s.find_first_not_of(" \t\r");
+                size_t e = s.find_last_not_of(" \t\r");
+                return b == std::string::npos ? std::string() : s.substr(b, e - b + 1);
+            };
+            config.set(trim(line.substr(0, eq)), trim(line.substr(eq + 1)));
+        }
+        *result = config;
+        return true;
+    }
+
+    bool save(const std::string &path) const {
+        std::ofstream f(path.c_str());
+        f << serialize();
+        return (bool)f;
+    }
+
+    static bool load(const std::string &path, ScheduleConfig *result) {
+        std::ifstream f(path.c_str());
+        if (!f) {
+            return false;
+        }
+        std::ostringstream text;
+        text << f.rdbuf();
+        return parse(text.str(), result);
+    }
+};
+
+struct AutotuneOptions {
+    enum class Strategy {
+        // Try every point in the space, up to max_trials.
+        Exhaustive,
+        // Try random points.
+        Random,
+        // Starting from the first option of every knob, repeatedly
+        // move to the fastest neighbouring point: one that differs in
+        // a single knob by one option.
+        HillClimb
+    };
+    Strategy strategy;
+
+    // The most candidates to compile and time.
+    int max_trials;
+
+    // The seed for the Random strategy.
+    uint32_t seed;
+
+    // The target candidates are compiled for.
+    Target target;
+
+    // Time one candidate, given a function that runs it once, in
+    // seconds. By default takes the best of 'samples' timings of
+    // 'iterations' runs, as the benchmark() helper in
+    // test/performance/benchmark.h does, which may be passed here
+    // instead.
+    std::function<double(const std::function<void()> &)> timer;
+    int samples, iterations;
+
+    // Print each candidate and its time to stderr.
+    bool verbose;
+
+    AutotuneOptions() :
+        strategy(Strategy::HillClimb), max_trials(64), seed(0),
+        target(get_jit_target_from_environment()),
+        samples(5), iterations(3), verbose(false) {}
+};
+
+struct AutotuneTrial {
+    ScheduleConfig config;
+    // Infinite if the candidate failed to compile or run.
+    double seconds;
+};
+
+struct AutotuneResult {
+    ScheduleConfig best;
+    double best_seconds;
+    // Every candidate tried, in order.
+    std::vector<AutotuneTrial> trials;
+};
+
+namespace Internal {
+
+class Autotuner {
+    const ScheduleSpace &space;
+    const std::function<Pipeline(const ScheduleConfig &)> &make;
+    const std::function<void(Pipeline)> &run;
+    const AutotuneOptions &options;
+
+    std::map<std::string, double> seen;
+
+public:
+    AutotuneResult result;
+
+    Autotuner(const ScheduleSpace &space,
+              const std::function<Pipeline(const ScheduleConfig &)> &make,
+              const std::function<void(Pipeline)> &run,
+              const AutotuneOptions &options) :
+        space(space), make(make), run(run), options(options) {
+        result.best_seconds = std::numeric_limits<double>::infinity();
+    }
+
+    typedef std::vector<size_t> Point;
+
+    ScheduleConfig config_of(const Point &p) const {
+        ScheduleConfig c;
+        for (size_t i = 0; i < p.size(); i++) {
+            const Knob &k = space.knobs()[i];
+            c.set(k.name, k.options[p[i]]);
+        }
+        return c;
+    }
+
+    bool budget_left() const {
+        return (int)result.trials.size() < options.max_trials;
+    }
+
+    double time_candidate(const ScheduleConfig &config) {
+        Pipeline p = make(config);
+        p.compile_jit(options.target);
+        std::function<void()> op = [&]() { run(p); };
+        if (options.timer) {
+            return options.timer(op);
+        }
+        // Run once first, so that one-time costs aren't timed.
+        op();
+        double best = std::numeric_limits<double>::infinity();
+        for (int i = 0; i < options.samples; i++) {
+            auto t1 = std::chrono::high_resolution_clock::now();
+            for (int j = 0; j < options.iterations; j++) {
+                op();
+            }
+            auto t2 = std::chrono::high_resolution_clock::now();
+            double dt = std::chrono::duration<double>(t2 - t1).count();
+            best = std::min(best, dt);
+        }
+        return best / options.iterations;
+    }
+
+    // The time of the candidate at p, compiling and timing it if it
+    // hasn't been already.
+    double evaluate(const Point &p) {
+        ScheduleConfig config = config_of(p);
+        std::string key = config.serialize();
+        auto it = seen.find(key);
+        if (it != seen.end()) {
+            return it->second;
+        }
+
+        double seconds = std::numeric_limits<double>::infinity();
+#if defined(__cpp_exceptions) || defined(__EXCEPTIONS) || defined(_CPPUNWIND)
+        if (exceptions_enabled()) {
+            // An invalid schedule is just a bad candidate.
+            try {
+                seconds = time_candidate(config);
+            } catch (const Halide::Error &e) {
+                if (options.verbose) {
+                    fprintf(stderr, "Candidate failed: %s\n", e.what());
+                }
+            }
+        } else {
+            seconds = time_candidate(config);
+        }
+#else
+        seconds = time_candidate(config);
+#endif
+
+        if (options.verbose) {
+            fprintf(stderr, "%.6f ms: %s\n", seconds * 1000, key.c_str());
+        }
+        seen[key] = seconds;
+        result.trials.push_back({config, seconds});
+        if (seconds < result.best_seconds) {
+            result.best_seconds = seconds;
+            result.best = config;
+        }
+        return seconds;
+    }
+
+    void exhaustive() {
+        const std::vector<Knob> &knobs = space.knobs();
+        Point p(knobs.size(), 0);
+        while (budget_left()) {
+            evaluate(p);
+            // Advance p like a mixed-radix counter.
+            size_t i = 0;
+            while (i < p.size() && ++p[i] == knobs[i].options.size()) {
+                p[i++] = 0;
+            }
+            if (i == p.size()) {
+                break;
+            }
+        }
+    }
+
+    void random() {
+        const std::vector<Knob> &knobs = space.knobs();
+        std::mt19937 rng(options.seed);
+        // Give up after a while once most of the space has been seen.
+        int misses = 0;
+        while (budget_left() && (double)seen.size() < space.size() && misses < 1000) {
+            Point p(knobs.size());
+            for (size_t i = 0; i < p.size(); i++) {
+                p[i] = std::uniform_int_distribution<size_t>(0, knobs[i].options.size() - 1)(rng);
+            }
+            if (seen.count(config_of(p).serialize())) {
+                misses++;
+                continue;
+            }
+            evaluate(p);
+        }
+    }
+
+    void hill_climb() {
+        const std::vector<Knob> &knobs = space.knobs();
+        Point current(knobs.size(), 0);
+        double current_seconds = evaluate(current);
+        bool improved = true;
+        while (improved && budget_left()) {
+            improved = false;
+            Point best = current;
+            for (size_t i = 0; i < knobs.size() && budget_left(); i++) {
+                for (int step : {-1, 1}) {
+                    if ((step < 0 && current[i] == 0) ||
+                        (step > 0 && current[i] + 1 == knobs[i].options.size()) ||
+                        !budget_left()) {
+                        continue;
+                    }
+                    Point next = current;
+                    next[i] += step;
+                    double seconds = evaluate(next);
+                    if (seconds < current_seconds) {
+                        current_seconds = seconds;
+                        best = next;
+                        improved = true;
+                    }
+                }
+            }
+            current = best;
+        }
+    }
+};
+
+}  // namespace Internal
+
+// Search the space for the fastest schedule. make builds the pipeline
+// scheduled as the given config says, and run runs it once, for
+// example by realizing it into preallocated buffers. Candidates are
+// compiled and timed one at a time, as Halide's lowering isn't
+// thread-safe and concurrent timings would disturb each other.
+inline AutotuneResult autotune(const ScheduleSpace &space,
+                               const std::function<Pipeline(const ScheduleConfig &)> &make,
+                               const std::function<void(Pipeline)> &run,
+                               const AutotuneOptions &options = AutotuneOptions()) {
+    Internal::Autotuner tuner(space, make, run, options);
+    switch (options.strategy) {
+    case AutotuneOptions::Strategy::Exhaustive:
+        tuner.exhaustive();
+        break;
+    case AutotuneOptions::Strategy::Random:
+        tuner.random();
+        break;
+    case AutotuneOptions::Strategy::HillClimb:
+        tuner.hill_climb();
+        break;
+    }
+    return tuner.result;
+}
+
+}  // namespace Tools
+}  // namespace Halide
+
+#endif  // HALIDE_AUTOTUNE_H
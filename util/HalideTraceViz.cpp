@@ -708,6 +708,7 @@ int run(int argc, char **argv) {
             break;
         case halide_trace_begin_pipeline:
         case halide_trace_end_pipeline:
+        case halide_trace_summary:
             break;
         default:
             fprintf(stderr, "Unknown tracing event code: %d\n", p.event);